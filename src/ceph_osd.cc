@@ -246,6 +246,11 @@ int main(int argc, const char **argv)
   SimpleMessenger *cluster_messenger = new SimpleMessenger(g_ceph_context);
   SimpleMessenger *messenger_hbin = new SimpleMessenger(g_ceph_context);
   SimpleMessenger *messenger_hbout = new SimpleMessenger(g_ceph_context);
+  SimpleMessenger *messenger_objecter = new SimpleMessenger(g_ceph_context);
+
+  // heartbeats are tiny; don't let deep socket buffers hide a stalled peer
+  messenger_hbin->set_socket_buffer_size(g_conf->osd_heartbeat_sockbuf);
+  messenger_hbout->set_socket_buffer_size(g_conf->osd_heartbeat_sockbuf);
 
   client_messenger->bind(g_conf->public_addr, getpid());
   cluster_messenger->bind(g_conf->cluster_addr, getpid());
@@ -256,6 +261,12 @@ int main(int argc, const char **argv)
     hb_addr.set_port(0);
   messenger_hbout->bind(hb_addr, getpid());
 
+  // the cache tier agent talks to other osds as a client, from the public ip
+  entity_addr_t objecter_addr = g_conf->public_addr;
+  if (!objecter_addr.is_blank_ip())
+    objecter_addr.set_port(0);
+  messenger_objecter->bind(objecter_addr, getpid());
+
   cout << "starting osd." << whoami
        << " at " << client_messenger->get_ms_addr() 
        << " osd_data " << g_conf->osd_data
@@ -267,6 +278,7 @@ int main(int argc, const char **argv)
   cluster_messenger->register_entity(entity_name_t::OSD(whoami));
   messenger_hbin->register_entity(entity_name_t::OSD(whoami));
   messenger_hbout->register_entity(entity_name_t::OSD(whoami));
+  messenger_objecter->register_entity(entity_name_t::OSD(whoami));
 
   Throttle client_throttler(g_conf->osd_client_message_size_cap);
 
@@ -296,6 +308,8 @@ int main(int argc, const char **argv)
   cluster_messenger->set_policy(entity_name_t::TYPE_CLIENT,
 				SimpleMessenger::Policy::stateless_server(0, 0));
 
+  messenger_objecter->set_default_policy(SimpleMessenger::Policy::client(supported, 0));
+
   // Set up crypto, daemonize, etc.
   // Leave stderr open in case we need to report errors.
   global_init_daemonize(g_ceph_context, CINIT_FLAG_NO_CLOSE_STDERR);
@@ -314,7 +328,7 @@ int main(int argc, const char **argv)
   global_init_chdir(g_ceph_context);
 
   OSD *osd = new OSD(whoami, cluster_messenger, client_messenger,
-		     messenger_hbin, messenger_hbout,
+		     messenger_hbin, messenger_hbout, messenger_objecter,
 		     &mc,
 		     g_conf->osd_data, g_conf->osd_journal);
   err = osd->pre_init();
@@ -330,6 +344,7 @@ int main(int argc, const char **argv)
   client_messenger->start();
   messenger_hbin->start_with_nonce(getpid());
   messenger_hbout->start();
+  messenger_objecter->start();
   cluster_messenger->start();
 
   // start osd
@@ -343,6 +358,7 @@ int main(int argc, const char **argv)
   client_messenger->wait();
   messenger_hbin->wait();
   messenger_hbout->wait();
+  messenger_objecter->wait();
   cluster_messenger->wait();
 
   // done
@@ -350,6 +366,7 @@ int main(int argc, const char **argv)
   client_messenger->destroy();
   messenger_hbin->destroy();
   messenger_hbout->destroy();
+  messenger_objecter->destroy();
   cluster_messenger->destroy();
 
   // cd on exit, so that gmon.out (if any) goes into a separate directory for each node.
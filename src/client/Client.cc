@@ -41,6 +41,7 @@ using namespace std;
 #include "messages/MClientReply.h"
 #include "messages/MClientCaps.h"
 #include "messages/MClientCapRelease.h"
+#include "messages/MClientCapsBatch.h"
 #include "messages/MClientLease.h"
 #include "messages/MClientSnap.h"
 
@@ -1243,6 +1244,8 @@ void Client::handle_client_session(MClientSession *m)
     if (mds_session)
       remove_session_caps(mds_session);
     kick_requests(from, true);
+    if (mds_session)
+      discard_caps_batch(mds_session);
     delete mds_session;
     mds_sessions.erase(from);
     break;
@@ -1302,6 +1305,7 @@ void Client::send_request(MetaRequest *request, int mds)
   mds_sessions[mds]->requests.push_back(&request->item);
 
   ldout(cct, 10) << "send_request " << *r << " to mds." << mds << dendl;
+  flush_caps_batch(mds);
   messenger->send_message(r, mdsmap->get_inst(mds));
 }
 
@@ -1501,6 +1505,15 @@ bool Client::ms_dispatch(Message *m)
   case CEPH_MSG_CLIENT_CAPS:
     handle_caps((MClientCaps*)m);
     break;
+  case CEPH_MSG_CLIENT_CAPS_BATCH:
+    {
+      MClientCapsBatch *b = (MClientCapsBatch*)m;
+      ldout(cct, 10) << "handle " << *b << " from " << b->get_source() << dendl;
+      while (!b->caps.empty())
+	handle_caps(b->pop_front());
+      b->put();
+    }
+    break;
   case CEPH_MSG_CLIENT_LEASE:
     handle_lease((MClientLease*)m);
     break;
@@ -1591,6 +1604,9 @@ void Client::send_reconnect(int mds)
 
   assert(mds_sessions.count(mds));
 
+  // the mds lost them; the reconnect carries our cap state instead
+  discard_caps_batch(mds_sessions[mds]);
+
   // i have an open session.
   hash_set<inodeno_t> did_snaprealm;
   for (hash_map<vinodeno_t, Inode*>::iterator p = inode_map.begin();
@@ -1687,9 +1703,11 @@ void Client::got_mds_push(int mds)
 
   s->seq++;
   ldout(cct, 10) << " mds." << mds << " seq now " << s->seq << dendl;
-  if (s->closing)
+  if (s->closing) {
+    flush_caps_batch(mds);
     messenger->send_message(new MClientSession(CEPH_SESSION_REQUEST_CLOSE, s->seq),
 			    s->inst);
+  }
 }
 
 void Client::handle_lease(MClientLease *m)
@@ -1722,6 +1740,7 @@ void Client::handle_lease(MClientLease *m)
   } 
   
  revoke:
+  flush_caps_batch(m->get_source().num());
   messenger->send_message(new MClientLease(CEPH_MDS_LEASE_RELEASE, seq,
 					   m->get_mask(), m->get_ino(), m->get_first(), m->get_last(), m->dname),
 			  m->get_source_inst());
@@ -1739,6 +1758,7 @@ void Client::release_lease(Inode *in, Dentry *dn, int mask)
   if (dn->lease_mds >= 0 && now < dn->lease_ttl && mdsmap->is_up(dn->lease_mds)) {
     ldout(cct, 10) << "release_lease mds." << dn->lease_mds << " mask " << mask
 	     << " on " << in->ino << " " << dn->name << dendl;
+    flush_caps_batch(dn->lease_mds);
     messenger->send_message(new MClientLease(CEPH_MDS_LEASE_RELEASE, dn->lease_seq, 
 					     CEPH_LOCK_DN,
 					     in->ino, in->snapid, in->snapid, dn->name),
@@ -2032,7 +2052,83 @@ void Client::send_cap(Inode *in, int mds, Cap *cap, int used, int want, int reta
     in->requested_max_size = in->wanted_max_size;
     ldout(cct, 15) << "auth cap, setting max_size = " << in->requested_max_size << dendl;
   }
-  messenger->send_message(m, mdsmap->get_inst(mds));
+  send_caps_message(m, mds);
+}
+
+class C_C_FlushCapsBatch : public Context {
+  Client *client;
+  int mds;
+public:
+  C_C_FlushCapsBatch(Client *c, int m) : client(c), mds(m) {}
+  void finish(int r) {
+    client->flush_caps_batch(mds);
+  }
+};
+
+/*
+ * cap updates, flushes and acks may be held back for up to
+ * client_caps_batch_window and sent to the mds together.  requests and
+ * session messages flush the batch first, so the mds sees everything
+ * in the order we sent it.
+ */
+void Client::send_caps_message(MClientCaps *m, int mds)
+{
+  MetaSession *s = mds_sessions[mds];
+  bool batch = false;
+  if (cct->_conf->client_caps_batch_window > 0) {
+    Connection *con = messenger->get_connection(mdsmap->get_inst(mds));
+    batch = con->has_feature(CEPH_FEATURE_CAPS_BATCH);
+    con->put();
+  }
+  if (!batch) {
+    flush_caps_batch(mds);
+    messenger->send_message(m, mdsmap->get_inst(mds));
+    return;
+  }
+
+  s->caps_pending.push_back(m);
+  if ((int)s->caps_pending.size() >= cct->_conf->client_caps_batch_max) {
+    flush_caps_batch(mds);
+    return;
+  }
+  if (!s->caps_flush_event) {
+    s->caps_flush_event = new C_C_FlushCapsBatch(this, mds);
+    timer.add_event_after(cct->_conf->client_caps_batch_window, s->caps_flush_event);
+  }
+}
+
+void Client::flush_caps_batch(int mds)
+{
+  if (!mds_sessions.count(mds))
+    return;
+  MetaSession *s = mds_sessions[mds];
+  if (s->caps_flush_event) {
+    timer.cancel_event(s->caps_flush_event);
+    s->caps_flush_event = NULL;
+  }
+  if (s->caps_pending.empty())
+    return;
+  if (s->caps_pending.size() == 1) {
+    messenger->send_message(s->caps_pending.front(), mdsmap->get_inst(mds));
+  } else {
+    MClientCapsBatch *b = new MClientCapsBatch;
+    b->caps.swap(s->caps_pending);
+    ldout(cct, 15) << "flush_caps_batch " << *b << " to mds." << mds << dendl;
+    messenger->send_message(b, mdsmap->get_inst(mds));
+  }
+  s->caps_pending.clear();
+}
+
+void Client::discard_caps_batch(MetaSession *s)
+{
+  if (s->caps_flush_event) {
+    timer.cancel_event(s->caps_flush_event);
+    s->caps_flush_event = NULL;
+  }
+  while (!s->caps_pending.empty()) {
+    s->caps_pending.front()->put();
+    s->caps_pending.pop_front();
+  }
 }
 
 
@@ -2263,7 +2359,7 @@ void Client::flush_snaps(Inode *in, bool all_again, CapSnap *again)
     capsnap->atime.encode_timeval(&m->head.atime);
     m->head.time_warp_seq = capsnap->time_warp_seq;
 
-    messenger->send_message(m, mdsmap->get_inst(mds));
+    send_caps_message(m, mds);
   }
 }
 
@@ -3376,6 +3472,7 @@ void Client::unmount()
 	    << " seq " << p->second->seq << dendl;
     if (!p->second->closing) {
       p->second->closing = true;
+      flush_caps_batch(p->first);
       messenger->send_message(new MClientSession(CEPH_SESSION_REQUEST_CLOSE, p->second->seq),
                               mdsmap->get_inst(p->first));
     }
@@ -3411,6 +3508,7 @@ void Client::flush_cap_releases()
   for (map<int,MetaSession*>::iterator p = mds_sessions.begin();
        p != mds_sessions.end();
        p++) {
+    flush_caps_batch(p->first);
     if (p->second->release) {
       messenger->send_message(p->second->release, mdsmap->get_inst(p->first));
       p->second->release = 0;
@@ -4193,6 +4291,7 @@ void Client::_closedir(dir_result_t *dirp)
 
 void Client::rewinddir(dir_result_t *dirp)
 {
+  Mutex::Locker lock(client_lock);
   ldout(cct, 3) << "rewinddir(" << dirp << ")" << dendl;
   dir_result_t *d = (dir_result_t*)dirp;
   _readdir_drop_dirp_buffer(d);
@@ -4208,6 +4307,8 @@ loff_t Client::telldir(dir_result_t *dirp)
 
 void Client::seekdir(dir_result_t *dirp, loff_t offset)
 {
+  // dropping the buffer puts inodes; don't race other (fuse) threads
+  Mutex::Locker lock(client_lock);
   ldout(cct, 3) << "seekdir(" << dirp << ", " << offset << ")" << dendl;
   dir_result_t *d = (dir_result_t*)dirp;
 
@@ -4422,6 +4523,14 @@ int Client::_readdir_cache_cb(dir_result_t *dirp, add_dirent_cb_t cb, void *p)
 }
 
 int Client::readdir_r_cb(dir_result_t *d, add_dirent_cb_t cb, void *p)
+{
+  // the cache walk touches dentries and inodes, so it must not race with
+  // other (fuse) threads; the callbacks only copy into caller buffers.
+  Mutex::Locker lock(client_lock);
+  return _readdir_r_cb(d, cb, p);
+}
+
+int Client::_readdir_r_cb(dir_result_t *d, add_dirent_cb_t cb, void *p)
 {
   dir_result_t *dirp = (dir_result_t*)d;
 
@@ -4498,7 +4607,6 @@ int Client::readdir_r_cb(dir_result_t *d, add_dirent_cb_t cb, void *p)
       return 0;
 
     if (dirp->buffer_frag != dirp->frag() || dirp->buffer == NULL) {
-      Mutex::Locker lock(client_lock);
       int r = _readdir_get_frag(dirp);
       if (r)
 	return r;
@@ -5005,7 +5113,7 @@ void Client::unlock_fh_pos(Fh *f)
 
 int Client::read(int fd, char *buf, loff_t size, loff_t offset) 
 {
-  Mutex::Locker lock(client_lock);
+  client_lock.Lock();
   tout(cct) << "read" << std::endl;
   tout(cct) << fd << std::endl;
   tout(cct) << size << std::endl;
@@ -5016,6 +5124,9 @@ int Client::read(int fd, char *buf, loff_t size, loff_t offset)
   bufferlist bl;
   int r = _read(f, offset, size, &bl);
   ldout(cct, 3) << "read(" << fd << ", " << (void*)buf << ", " << size << ", " << offset << ") = " << r << dendl;
+  client_lock.Unlock();
+
+  // bl holds its own refs; copy out to the caller without client_lock
   if (r >= 0) {
     bl.copy(0, bl.length(), buf);
     r = bl.length();
@@ -5137,8 +5248,22 @@ int Client::_read_async(Fh *f, uint64_t off, uint64_t len, bufferlist *bl)
     }
   }
   
+  // try the cache without client_lock first, so that hits (on different
+  // objects) from several threads don't serialize on it.  the cacher
+  // still takes its own shared and per-object locks.  f holds a ref on in.
+  int r;
+  {
+    ceph_file_layout layout = in->layout;
+    snapid_t snapid = in->snapid;
+    client_lock.Unlock();
+    r = objectcacher->file_read_shared(&in->oset, &layout, snapid, off, len, bl);
+    client_lock.Lock();
+    if (r >= 0)
+      return r;
+  }
+
   // read (and possibly block)
-  int r, rvalue = 0;
+  int rvalue = 0;
   Mutex flock("Client::_read_async flock");
   Cond cond;
   bool done = false;
@@ -5254,6 +5379,12 @@ void Client::sync_write_commit(Inode *in)
 
 int Client::write(int fd, const char *buf, loff_t size, loff_t offset) 
 {
+  // copy into fresh buffer (since our write may be resub, async) before
+  // taking client_lock, so that concurrent writers don't serialize on it
+  bufferlist bl;
+  if (size > 0)
+    bl.append(buffer::copy(buf, size));
+
   Mutex::Locker lock(client_lock);
   tout(cct) << "write" << std::endl;
   tout(cct) << fd << std::endl;
@@ -5262,13 +5393,13 @@ int Client::write(int fd, const char *buf, loff_t size, loff_t offset)
 
   assert(fd_map.count(fd));
   Fh *fh = fd_map[fd];
-  int r = _write(fh, offset, size, buf);
+  int r = _write(fh, offset, size, bl);
   ldout(cct, 3) << "write(" << fd << ", \"...\", " << size << ", " << offset << ") = " << r << dendl;
   return r;
 }
 
 
-int Client::_write(Fh *f, int64_t offset, uint64_t size, const char *buf)
+int Client::_write(Fh *f, int64_t offset, uint64_t size, bufferlist& bl)
 {
   if ((uint64_t)(offset+size) > mdsmap->get_max_filesize()) //too large!
     return -EFBIG;
@@ -5301,12 +5432,6 @@ int Client::_write(Fh *f, int64_t offset, uint64_t size, const char *buf)
 
   // time it.
   utime_t start = ceph_clock_now(cct);
-    
-  // copy into fresh buffer (since our write may be resub, async)
-  bufferptr bp;
-  if (size > 0) bp = buffer::copy(buf, size);
-  bufferlist bl;
-  bl.push_back( bp );
 
   uint64_t endoff = offset + size;
   int got;
@@ -6714,6 +6839,10 @@ int Client::ll_read(Fh *fh, loff_t off, loff_t len, bufferlist *bl)
 
 int Client::ll_write(Fh *fh, loff_t off, loff_t len, const char *data)
 {
+  bufferlist bl;
+  if (len > 0)
+    bl.append(buffer::copy(data, len));
+
   Mutex::Locker lock(client_lock);
   ldout(cct, 3) << "ll_write " << fh << " " << fh->inode->ino << " " << off << "~" << len << dendl;
   tout(cct) << "ll_write" << std::endl;
@@ -6721,7 +6850,7 @@ int Client::ll_write(Fh *fh, loff_t off, loff_t len, const char *data)
   tout(cct) << off << std::endl;
   tout(cct) << len << std::endl;
 
-  int r = _write(fh, off, len, data);
+  int r = _write(fh, off, len, bl);
   ldout(cct, 3) << "ll_write " << fh << " " << off << "~" << len << " = " << r << dendl;
   return r;
 }
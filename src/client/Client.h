@@ -201,6 +201,7 @@ class Client : public Dispatcher {
   void flush_cap_releases();
 public:
   void tick();
+  void flush_caps_batch(int mds);
 
  protected:
   MonClient *monclient;
@@ -215,6 +216,8 @@ public:
   void got_mds_push(int mds);
   void handle_client_session(MClientSession *m);
   void send_reconnect(int mds);
+  void send_caps_message(MClientCaps *m, int mds);
+  void discard_caps_batch(MetaSession *s);
   void resend_unsafe_requests(int mds);
 
   // mds requests
@@ -460,6 +463,7 @@ private:
   void _readdir_rechoose_frag(dir_result_t *dirp);
   int _readdir_get_frag(dir_result_t *dirp);
   int _readdir_cache_cb(dir_result_t *dirp, add_dirent_cb_t cb, void *p);
+  int _readdir_r_cb(dir_result_t *dirp, add_dirent_cb_t cb, void *p);
   void _closedir(dir_result_t *dirp);
 
   // other helpers
@@ -495,7 +499,7 @@ private:
   int _create(Inode *in, const char *name, int flags, mode_t mode, Inode **inp, Fh **fhp, int uid=-1, int gid=-1);
   loff_t _lseek(Fh *fh, loff_t offset, int whence);
   int _read(Fh *fh, int64_t offset, uint64_t size, bufferlist *bl);
-  int _write(Fh *fh, int64_t offset, uint64_t size, const char *buf);
+  int _write(Fh *fh, int64_t offset, uint64_t size, bufferlist& bl);
   int _flush(Fh *fh);
   int _fsync(Fh *fh, bool syncdataonly);
   int _sync_fs();
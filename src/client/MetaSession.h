@@ -11,6 +11,8 @@ class Inode;
 class CapSnap;
 class MetaRequest;
 class MClientCapRelease;
+class MClientCaps;
+class Context;
 
 struct MetaSession {
   int mds_num;
@@ -30,9 +32,13 @@ struct MetaSession {
   xlist<MetaRequest*> unsafe_requests;
 
   MClientCapRelease *release;
+
+  list<MClientCaps*> caps_pending;  // held back for an MClientCapsBatch
+  Context *caps_flush_event;
   
   MetaSession() : mds_num(-1), seq(0), cap_gen(0), cap_renew_seq(0), num_caps(0),
-		 closing(false), was_stale(false), release(NULL) {}
+		 closing(false), was_stale(false), release(NULL),
+		 caps_flush_event(NULL) {}
 };
 
 #endif
@@ -25,6 +25,9 @@ using namespace std;
 
 #include "include/filepath.h"
 #include "common/perf_counters.h"
+#include "common/Thread.h"
+#include "common/errno.h"
+#include "include/atomic.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -115,6 +118,11 @@ void parse_syn_options(vector<const char*>& args)
         syn_modes.push_back( SYNCLIENT_MODE_READFILE );
         syn_iargs.push_back( a );
         syn_iargs.push_back( b );
+      } else if (strcmp(args[i],"mtrw") == 0) {
+        syn_modes.push_back( SYNCLIENT_MODE_MTRW );
+        syn_iargs.push_back( atoi(args[++i]) );
+        syn_iargs.push_back( atoi(args[++i]) );
+        syn_iargs.push_back( atoi(args[++i]) );
       } else if (strcmp(args[i],"dumpplacement") == 0) {
 	syn_modes.push_back( SYNCLIENT_MODE_DUMP );
 	syn_sargs.push_back( args[++i] );   
@@ -746,6 +754,22 @@ int SyntheticClient::run()
       }
       break;
 
+    case SYNCLIENT_MODE_MTRW:
+      {
+        string sarg1 = get_sarg(0);
+        int iarg1 = iargs.front();  iargs.pop_front();
+        int iarg2 = iargs.front();  iargs.pop_front();
+        int iarg3 = iargs.front();  iargs.pop_front();
+
+        if (run_me()) {
+          dout(2) << "mtrw " << sarg1 << " threads " << iarg1
+		  << " mb " << iarg2 << " chunk " << iarg3 << dendl;
+          mt_read_write(sarg1, iarg1, iarg2, iarg3);
+	}
+	did_run_me();
+      }
+      break;
+
     case SYNCLIENT_MODE_RDWRRANDOM:
       {
         string sarg1 = get_sarg(0);
@@ -2088,6 +2112,7 @@ int SyntheticClient::read_file(const std::string& fn, int size,
   utime_t from = ceph_clock_now(g_ceph_context);
   utime_t start = from;
   uint64_t bytes = 0, total = 0;
+  int badblocks = 0;
 
   for (unsigned i=0; i<chunks; i++) {
     if (time_to_stop()) break;
@@ -2131,6 +2156,8 @@ int SyntheticClient::read_file(const std::string& fn, int size,
     }
     if (bad && !ignoreprint) 
       dout(0) << " + " << (bad-1) << " other bad 16-byte bits in this block" << dendl;
+    if (bad)
+      badblocks++;
   }
 
   utime_t stop = ceph_clock_now(g_ceph_context);
@@ -2141,12 +2168,133 @@ int SyntheticClient::read_file(const std::string& fn, int size,
   client->close(fd);
   delete[] buf;
 
+  if (badblocks && !ignoreprint)
+    return -EIO;
   return 0;
 }
 
 
 
 
+/*
+ * several threads share this client, each writing and then reading
+ * back its own file, to measure how well the client scales when it
+ * is driven concurrently (as ceph-fuse does with its mt loop).
+ *
+ * a final pass has every thread read every file while one more
+ * thread rewrites them (writeback commits) and drops the cache
+ * (releases), so cache hits on the same objects race with the
+ * ObjectCacher changing their buffers underneath.
+ */
+class SynRWThread : public Thread {
+public:
+  enum {
+    OP_WRITE,   // write our file
+    OP_READ,    // read back our file
+    OP_SHARED,  // read every file, starting with ours
+    OP_CHURN,   // rewrite and drop every file until told to stop
+  };
+private:
+  SyntheticClient *syn;
+  string fn;
+  int nfiles, mb, chunk, op;
+  int idx;
+  atomic_t *stop;
+public:
+  int r;
+  SynRWThread(SyntheticClient *s, const string& f, int n, int i,
+	      int m, int c, int o, atomic_t *st)
+    : syn(s), fn(f), nfiles(n), mb(m), chunk(c), op(o), idx(i), stop(st),
+      r(0) {}
+  string file_name(int i) {
+    char s[20];
+    snprintf(s, sizeof(s), ".t%d", i);
+    return fn + s;
+  }
+  void *entry() {
+    string f;
+    switch (op) {
+    case OP_WRITE:
+      f = file_name(idx);
+      r = syn->write_file(f, mb, chunk);
+      break;
+    case OP_READ:
+      r = syn->read_file(file_name(idx), mb, chunk);
+      break;
+    case OP_SHARED:
+      for (int i = 0; i < nfiles && r == 0; i++)
+	r = syn->read_file(file_name((idx + i) % nfiles), mb, chunk);
+      break;
+    case OP_CHURN:
+      for (int i = 0; !stop->read() && r == 0; i = (i + 1) % nfiles) {
+	f = file_name(i);
+	r = syn->rewrite_and_drop(f, mb, chunk);
+      }
+      break;
+    }
+    return 0;
+  }
+};
+
+int SyntheticClient::rewrite_and_drop(string& fn, int mb, int chunk)
+{
+  int r = write_file(fn, mb, chunk);
+  client->drop_caches();
+  return r;
+}
+
+int SyntheticClient::mt_read_write(string& fn, int threads, int mb, int chunk)
+{
+  if (threads < 1)
+    threads = 1;
+  uint64_t total = (uint64_t)threads * (uint64_t)mb * 1048576ull;
+  int ret = 0;
+
+  for (int pass = 0; pass < 3; pass++) {
+    int op = pass == 0 ? SynRWThread::OP_WRITE :
+      (pass == 1 ? SynRWThread::OP_READ : SynRWThread::OP_SHARED);
+    atomic_t stop(0);
+    vector<SynRWThread*> ts;
+    utime_t start = ceph_clock_now(g_ceph_context);
+    for (int i = 0; i < threads; i++) {
+      SynRWThread *t = new SynRWThread(this, fn, threads, i, mb, chunk, op, &stop);
+      t->create();
+      ts.push_back(t);
+    }
+    SynRWThread *churn = 0;
+    if (op == SynRWThread::OP_SHARED) {
+      churn = new SynRWThread(this, fn, threads, 0, mb, chunk,
+			      SynRWThread::OP_CHURN, &stop);
+      churn->create();
+    }
+    for (vector<SynRWThread*>::iterator p = ts.begin(); p != ts.end(); ++p) {
+      (*p)->join();
+      if ((*p)->r < 0 && ret == 0)
+	ret = (*p)->r;
+      delete *p;
+    }
+    utime_t stop_time = ceph_clock_now(g_ceph_context);
+    if (churn) {
+      stop.set(1);
+      churn->join();
+      if (churn->r < 0 && ret == 0)
+	ret = churn->r;
+      delete churn;
+    }
+    double el = stop_time - start;
+    uint64_t bytes = op == SynRWThread::OP_SHARED ? total * threads : total;
+    const char *what = op == SynRWThread::OP_WRITE ? "write" :
+      (op == SynRWThread::OP_READ ? "read" : "shared read");
+    dout(0) << "mtrw " << threads << " threads " << what
+	    << " aggregate " << (bytes / el / 1048576.0) << " MB/sec ("
+	    << bytes << " bytes in " << el << " seconds)" << dendl;
+  }
+  if (ret < 0)
+    dout(0) << "mtrw failed: " << cpp_strerror(ret) << dendl;
+  return ret;
+}
+
+
 class C_Ref : public Context {
   Mutex& lock;
   Cond& cond;
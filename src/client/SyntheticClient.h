@@ -56,6 +56,7 @@
 
 #define SYNCLIENT_MODE_CREATEOBJECTS 35
 #define SYNCLIENT_MODE_OBJECTRW 36
+#define SYNCLIENT_MODE_MTRW     37     // threads mb chunk
 
 #define SYNCLIENT_MODE_OPENTEST     40
 #define SYNCLIENT_MODE_OPTEST       41
@@ -241,6 +242,8 @@ class SyntheticClient {
 
   int write_batch(int nfile, int mb, int chunk);
   int read_file(const std::string& fn, int mb, int chunk, bool ignoreprint=false);
+  int mt_read_write(string& fn, int threads, int mb, int chunk);
+  int rewrite_and_drop(string& fn, int mb, int chunk);
 
   int create_objects(int nobj, int osize, int inflight);
   int object_rw(int nobj, int osize, int wrpc, int overlap, 
@@ -155,7 +155,10 @@ static int create_symlink(string oldpath, const string &newpath)
 ///////////////////////////// DoutStreambuf /////////////////////////////
 template <typename charT, typename traits>
 DoutStreambuf<charT, traits>::DoutStreambuf()
-  : flags(0), ofd(-1)
+  : flags(0), ofd(-1), line_to_file(true),
+    flushing(false), ofile_error(false),
+    flusher_stop(false), flusher_running(false),
+    recent(NULL), recent_size(0), recent_pos(0), recent_wrapped(false)
 {
   // Initialize get pointer to zero so that underflow is called on the first read.
   this->setg(0, 0, 0);
@@ -173,6 +176,11 @@ DoutStreambuf<charT, traits>::DoutStreambuf()
   ret = pthread_mutexattr_destroy(&attr);
   assert(ret == 0);
 
+  ret = pthread_mutex_init(&flush_lock, NULL);
+  assert(ret == 0);
+  ret = pthread_cond_init(&flush_cond, NULL);
+  assert(ret == 0);
+
   simple_spin_lock(&dout_emergency_lock);
   for (size_t i = 0; i < NUM_DOUT_EMERG_STREAMS; ++i) {
     if (dout_emerg_streams[i] == 0) {
@@ -194,10 +202,14 @@ DoutStreambuf<charT, traits>::~DoutStreambuf()
     }
   }
   simple_spin_unlock(&dout_emergency_lock);
+  _stop_flusher();
   if (ofd != -1) {
     TEMP_FAILURE_RETRY(::close(ofd));
     ofd = -1;
   }
+  delete[] recent;
+  pthread_cond_destroy(&flush_cond);
+  pthread_mutex_destroy(&flush_lock);
   pthread_mutex_destroy(&lock);
 }
 
@@ -237,11 +249,11 @@ DoutStreambuf<charT, traits>::overflow(DoutStreambuf<charT, traits>::int_type c)
   // Now 'obuf' points to a NULL-terminated string, which we want to
   // output with priority 'prio'
   int len = strlen(obuf);
-  if (flags & DOUTSB_FLAG_SYSLOG) {
+  if (line_to_file && (flags & DOUTSB_FLAG_SYSLOG)) {
     syslog(LOG_USER | dout_prio_to_syslog_prio(prio), "%s",
 	   obuf + TIME_FMT_SZ + 1);
   }
-  if (flags & DOUTSB_FLAG_STDERR) {
+  if (line_to_file && (flags & DOUTSB_FLAG_STDERR)) {
     if ((flags & DOUTSB_FLAG_STDERR_ALL) || (prio == -1)) {
       // Just write directly out to the stderr fileno. There's no point in
       // using something like fputs to write to a temporary buffer,
@@ -251,10 +263,19 @@ DoutStreambuf<charT, traits>::overflow(DoutStreambuf<charT, traits>::int_type c)
 	flags &= ~DOUTSB_FLAG_STDERR;
     }
   }
-  if (flags & DOUTSB_FLAG_OFILE) {
-    if (safe_write(ofd, obuf, len))
-      flags &= ~DOUTSB_FLAG_OFILE;
+  if (line_to_file && (flags & DOUTSB_FLAG_OFILE)) {
+    if (flusher_running) {
+      // the flusher thread does the write(2)
+      if (ofile_error)
+	flags &= ~DOUTSB_FLAG_OFILE;
+      else
+	_queue_line(obuf, len);
+    } else {
+      if (safe_write(ofd, obuf, len))
+	flags &= ~DOUTSB_FLAG_OFILE;
+    }
   }
+  _remember_line(obuf, len);
 
   _clear_output_buffer();
 
@@ -278,7 +299,9 @@ get_tracked_conf_keys() const
   static const char *KEYS[] =
 	{ "log_file", "log_sym_dir",
 	 "log_sym_history", "log_to_stderr",
-	 "log_to_syslog", "log_per_instance", NULL };
+	 "log_to_syslog", "log_per_instance",
+	 "log_async", "log_max_recent",
+	 "internal_safe_to_start_threads", NULL };
   return KEYS;
 }
 
@@ -287,6 +310,30 @@ void DoutStreambuf<charT, traits>::
 handle_conf_change(const md_config_t *conf, const std::set <std::string> &changed)
 {
   DoutLocker _dout_locker(&lock);
+
+  _resize_recent(conf->log_max_recent > 0 ?
+		 conf->log_max_recent * RECENT_LINE_BYTES : 0);
+
+  if (changed.count("log_file") || changed.count("log_sym_dir") ||
+      changed.count("log_sym_history") || changed.count("log_to_stderr") ||
+      changed.count("log_to_syslog") || changed.count("log_per_instance")) {
+    _stop_flusher();
+    _reconfigure_sinks(conf, changed);
+  }
+
+  // the flusher needs a log file, and must not start before we are
+  // done forking (see global_init_daemonize)
+  if ((flags & DOUTSB_FLAG_OFILE) && conf->log_async &&
+      conf->internal_safe_to_start_threads)
+    _start_flusher();
+  else
+    _stop_flusher();
+}
+
+template <typename charT, typename traits>
+void DoutStreambuf<charT, traits>::
+_reconfigure_sinks(const md_config_t *conf, const std::set <std::string> &changed)
+{
   type_name = conf->name.get_type_name();
 
   flags = 0;
@@ -408,6 +455,207 @@ emergency_log_to_file_and_syslog(const char * const str) const
   }
 }
 
+/* Like emergency_log_to_file_and_syslog, this may be called from a
+ * signal handler, so we only trylock: if the flusher (or a logger)
+ * holds the lock we skip rather than deadlock.  Nothing here allocates
+ * or frees.
+ */
+template <typename charT, typename traits>
+void DoutStreambuf<charT, traits>::emergency_flush()
+{
+  if (pthread_mutex_trylock(&flush_lock))
+    return;
+  if (!flushing && pending.length()) {
+    if (ofd >= 0 && safe_write(ofd, pending.data(), pending.length())) {
+      ; // ignore
+    }
+    pending.clear();
+  }
+  pthread_mutex_unlock(&flush_lock);
+}
+
+/* May be called from a signal handler.  lock is recursive, so this
+ * works if the crashing thread was logging; if another thread holds
+ * it we dump anyway and may catch a line being overwritten.
+ */
+template <typename charT, typename traits>
+void DoutStreambuf<charT, traits>::emergency_dump_recent()
+{
+  bool locked = (pthread_mutex_trylock(&lock) == 0);
+  if (recent_pos || recent_wrapped) {
+    int fd = ofd >= 0 ? ofd : STDERR_FILENO;
+    static const char *begin = "--- begin dump of recent events ---\n";
+    static const char *end = "--- end dump of recent events ---\n";
+    if (safe_write(fd, begin, strlen(begin)) == 0) {
+      int r = 0;
+      if (recent_wrapped) {
+	// the oldest line was partly overwritten; start at the next one
+	size_t start = recent_pos;
+	while (start < recent_size && recent[start] != '\n')
+	  start++;
+	start++;
+	if (start < recent_size)
+	  r = safe_write(fd, recent + start, recent_size - start);
+      }
+      if (r == 0 && recent_pos)
+	r = safe_write(fd, recent, recent_pos);
+      if (safe_write(fd, end, strlen(end))) {
+	; // ignore
+      }
+    }
+  }
+  if (locked)
+    pthread_mutex_unlock(&lock);
+}
+
+// Called with lock held.
+template <typename charT, typename traits>
+void DoutStreambuf<charT, traits>::_remember_line(const charT *buf, size_t len)
+{
+  if (!recent_size)
+    return;
+  if (len > recent_size) {
+    buf += len - recent_size;
+    len = recent_size;
+  }
+  size_t first = recent_size - recent_pos;
+  if (len < first)
+    first = len;
+  memcpy(recent + recent_pos, buf, first);
+  memcpy(recent, buf + first, len - first);
+  recent_pos += len;
+  if (recent_pos >= recent_size) {
+    recent_pos -= recent_size;
+    recent_wrapped = true;
+  }
+}
+
+// Called with lock held.  Resizing forgets what we had.
+template <typename charT, typename traits>
+void DoutStreambuf<charT, traits>::_resize_recent(size_t size)
+{
+  if (size == recent_size)
+    return;
+  delete[] recent;
+  recent = size ? new charT[size] : NULL;
+  recent_size = size;
+  recent_pos = 0;
+  recent_wrapped = false;
+}
+
+// Called with lock held.
+template <typename charT, typename traits>
+void DoutStreambuf<charT, traits>::_queue_line(const charT *buf, int len)
+{
+  pthread_mutex_lock(&flush_lock);
+  while (pending.length() > ASYNC_MAX_BYTES && !ofile_error) {
+    // the flusher can't keep up; push back on the loggers.
+    pthread_cond_broadcast(&flush_cond);
+    pthread_cond_wait(&flush_cond, &flush_lock);
+  }
+  pending.append(buf, len);
+  if (pending.length() >= ASYNC_BATCH_BYTES)
+    pthread_cond_broadcast(&flush_cond);
+  pthread_mutex_unlock(&flush_lock);
+}
+
+// Called with flush_lock held; drops it while writing.
+template <typename charT, typename traits>
+void DoutStreambuf<charT, traits>::_write_pending()
+{
+  flushing_buf.swap(pending);
+  int fd = ofd;
+  flushing = true;
+  pthread_mutex_unlock(&flush_lock);
+
+  int r = safe_write(fd, flushing_buf.data(), flushing_buf.length());
+  flushing_buf.clear();
+
+  pthread_mutex_lock(&flush_lock);
+  if (r)
+    ofile_error = true;
+  flushing = false;
+  pthread_cond_broadcast(&flush_cond);
+}
+
+// Write out everything queued so far.  Called with lock held, so
+// nothing new is queued meanwhile.
+template <typename charT, typename traits>
+void DoutStreambuf<charT, traits>::_drain_pending()
+{
+  pthread_mutex_lock(&flush_lock);
+  while (flushing)
+    pthread_cond_wait(&flush_cond, &flush_lock);
+  if (!pending.empty())
+    _write_pending();
+  pthread_mutex_unlock(&flush_lock);
+}
+
+template <typename charT, typename traits>
+void *DoutStreambuf<charT, traits>::_flusher_entry(void *arg)
+{
+  ((DoutStreambuf<charT, traits>*)arg)->_flusher();
+  return NULL;
+}
+
+template <typename charT, typename traits>
+void DoutStreambuf<charT, traits>::_flusher()
+{
+  pthread_mutex_lock(&flush_lock);
+  while (!flusher_stop) {
+    if (pending.length() < ASYNC_BATCH_BYTES) {
+      // wait for a full batch, but not too long
+      struct timeval tv;
+      gettimeofday(&tv, NULL);
+      struct timespec ts;
+      ts.tv_sec = tv.tv_sec;
+      ts.tv_nsec = (tv.tv_usec + 100000) * 1000;
+      if (ts.tv_nsec >= 1000000000) {
+	ts.tv_sec++;
+	ts.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&flush_cond, &flush_lock, &ts);
+    }
+    if (!pending.empty())
+      _write_pending();
+  }
+  pthread_mutex_unlock(&flush_lock);
+}
+
+// Called with lock held.
+template <typename charT, typename traits>
+void DoutStreambuf<charT, traits>::_start_flusher()
+{
+  if (flusher_running)
+    return;
+  flusher_stop = false;
+  ofile_error = false;
+  int r = pthread_create(&flusher_thread, NULL, _flusher_entry, (void*)this);
+  if (r) {
+    ostringstream oss;
+    oss << "DoutStreambuf: failed to start log flusher thread: "
+	<< cpp_strerror(r) << "; logging synchronously\n";
+    dout_emergency(oss.str());
+    return;
+  }
+  flusher_running = true;
+}
+
+// Called with lock held (or from the destructor).
+template <typename charT, typename traits>
+void DoutStreambuf<charT, traits>::_stop_flusher()
+{
+  if (!flusher_running)
+    return;
+  pthread_mutex_lock(&flush_lock);
+  flusher_stop = true;
+  pthread_cond_broadcast(&flush_cond);
+  pthread_mutex_unlock(&flush_lock);
+  pthread_join(flusher_thread, NULL);
+  flusher_running = false;
+  _drain_pending();
+}
+
 // This is called to flush the buffer.
 // This is called when we're done with the file stream (or when .flush() is called).
 template <typename charT, typename traits>
@@ -631,6 +879,8 @@ void dout_emergency(const char * const str)
   simple_spin_lock(&dout_emergency_lock);
   for (size_t i = 0; i < NUM_DOUT_EMERG_STREAMS; ++i) {
     if (dout_emerg_streams[i]) {
+      // get queued lines out first so the file stays in order
+      dout_emerg_streams[i]->emergency_flush();
       dout_emerg_streams[i]->emergency_log_to_file_and_syslog(str);
     }
   }
@@ -642,5 +892,18 @@ void dout_emergency(const std::string &str)
   dout_emergency(str.c_str());
 }
 
+/* This function may be called from a signal handler. */
+void dout_emergency_dump_recent()
+{
+  simple_spin_lock(&dout_emergency_lock);
+  for (size_t i = 0; i < NUM_DOUT_EMERG_STREAMS; ++i) {
+    if (dout_emerg_streams[i]) {
+      dout_emerg_streams[i]->emergency_flush();
+      dout_emerg_streams[i]->emergency_dump_recent();
+    }
+  }
+  simple_spin_unlock(&dout_emergency_lock);
+}
+
 // Explicit template instantiation
 template class DoutStreambuf <char>;
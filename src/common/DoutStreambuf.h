@@ -33,6 +33,8 @@ class EmergencyLogger {
 public:
   virtual ~EmergencyLogger();
   virtual void emergency_log_to_file_and_syslog(const char *const str) const = 0;
+  virtual void emergency_flush() {}
+  virtual void emergency_dump_recent() {}
 };
 
 template <typename charT, typename traits = std::char_traits<charT> >
@@ -57,6 +59,14 @@ public:
   // The size of the output buffer.
   static const size_t OBUF_SZ = 32000;
 
+  // Wake the flusher once this much is queued; block loggers past the max.
+  static const size_t ASYNC_BATCH_BYTES = 64 << 10;
+  static const size_t ASYNC_MAX_BYTES = 8 << 20;
+
+  // The recent-lines ring has room for log_max_recent lines of about
+  // this length.
+  static const size_t RECENT_LINE_BYTES = 256;
+
   DoutStreambuf();
   ~DoutStreambuf();
 
@@ -84,6 +94,18 @@ public:
   // (if those sinks are active)
   void emergency_log_to_file_and_syslog(const char * const str) const;
 
+  // Write out anything queued for the flusher thread, without blocking
+  void emergency_flush();
+
+  // Write the recent-lines ring to the log file (or stderr)
+  void emergency_dump_recent();
+
+  // Whether the line being formatted goes to the log sinks, or only to
+  // the in-memory recent-lines ring.  Called with the lock held.
+  void set_line_to_file(bool b) {
+    line_to_file = b;
+  }
+
   // Reopen the logs
   void reopen_logs(const md_config_t *conf);
 
@@ -107,6 +129,18 @@ private:
   int _read_ofile_config(const md_config_t *conf);
   int _rotate_files(const md_config_t *conf, const std::string &base);
 
+  void _reconfigure_sinks(const md_config_t *conf,
+			  const std::set <std::string> &changed);
+  void _queue_line(const charT *buf, int len);
+  void _remember_line(const charT *buf, size_t len);
+  void _resize_recent(size_t size);
+  void _write_pending();
+  void _drain_pending();
+  void _start_flusher();
+  void _stop_flusher();
+  void _flusher();
+  static void *_flusher_entry(void *arg);
+
   std::string type_name;
 
   // Output buffer
@@ -124,6 +158,31 @@ private:
   // Mutex that protects this output stream
   pthread_mutex_t lock;
 
+  bool line_to_file;
+
+  // Lines waiting for the flusher thread to write them to ofd.
+  // Protected by flush_lock.  ofd is stable while flushing is set;
+  // the batch being written sits in flushing_buf meanwhile.  Both
+  // buffers keep their capacity, so queueing a line is a memcpy.
+  pthread_mutex_t flush_lock;
+  pthread_cond_t flush_cond;
+  std::string pending;
+  std::string flushing_buf;
+  bool flushing;
+  bool ofile_error;
+  bool flusher_stop;
+  bool flusher_running;   // protected by lock
+  pthread_t flusher_thread;
+
+  // The most recent lines (including memory-only ones), for crash
+  // dumps: a byte ring, allocated when configured and overwritten
+  // oldest first, so neither logging nor dumping it allocates.
+  // Protected by lock, which loggers already hold.
+  charT *recent;
+  size_t recent_size;
+  size_t recent_pos;
+  bool recent_wrapped;
+
   friend class CephContext;
 };
 
@@ -132,4 +191,7 @@ private:
 extern void dout_emergency(const char * const str);
 extern void dout_emergency(const std::string &str);
 
+// Dump the recent in-memory log lines; for crash handlers.
+extern void dout_emergency_dump_recent();
+
 #endif
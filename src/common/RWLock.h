@@ -78,6 +78,18 @@ public:
   void put_write() {
     unlock();
   }
+
+  class RLocker {
+    RWLock &m_lock;
+
+  public:
+    RLocker(RWLock& lock) : m_lock(lock) {
+      m_lock.get_read();
+    }
+    ~RLocker() {
+      m_lock.put_read();
+    }
+  };
 };
 
 #endif // !_Mutex_Posix_
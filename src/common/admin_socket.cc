@@ -259,22 +259,17 @@ private:
     }
     request = ntohl(request_raw);
     switch (request) {
-      case 0:
-	/* version request */
+      case CEPH_ADMIN_SOCK_REQ_VERSION:
 	ret = handle_version_request(connection_fd);
 	break;
-      case 1:
-	/* data request */
+      case CEPH_ADMIN_SOCK_REQ_PERFCOUNTERS:
 	ret = handle_json_request(connection_fd, false);
 	break;
-      case 2:
-	/* schema request */
+      case CEPH_ADMIN_SOCK_REQ_SCHEMA:
 	ret = handle_json_request(connection_fd, true);
 	break;
       default:
-	lderr(m_parent->m_cct) << "AdminSocket: unknown request "
-	    << "code " << request << dendl;
-	ret = false;
+	ret = handle_hook_request(connection_fd, request);
 	break;
     }
     TEMP_FAILURE_RETRY(close(connection_fd));
@@ -302,7 +297,31 @@ private:
     if (coll) {
       coll->write_json_to_buf(buffer, schema);
     }
+    return send_reply(connection_fd, buffer);
+  }
+
+  bool handle_hook_request(int connection_fd, uint32_t request)
+  {
+    std::string out;
+    {
+      Mutex::Locker l(m_parent->m_hook_lock);
+      std::map<uint32_t, AdminSocketHook*>::iterator p =
+	m_parent->m_hooks.find(request);
+      if (p == m_parent->m_hooks.end()) {
+	lderr(m_parent->m_cct) << "AdminSocket: unknown request "
+	    << "code " << request << dendl;
+	return false;
+      }
+      if (!p->second->call(request, out))
+	return false;
+    }
+    std::vector<char> buffer(out.begin(), out.end());
+    buffer.push_back('\0');
+    return send_reply(connection_fd, buffer);
+  }
 
+  bool send_reply(int connection_fd, std::vector<char> &buffer)
+  {
     uint32_t len = htonl(buffer.size());
     int ret = safe_write(connection_fd, &len, sizeof(len));
     if (ret < 0) {
@@ -316,7 +335,7 @@ private:
 	  << cpp_strerror(ret) << dendl;
       return false;
     }
-    ldout(m_parent->m_cct, 30) << "AdminSocket: handle_json_request succeeded."
+    ldout(m_parent->m_cct, 30) << "AdminSocket: send_reply succeeded."
 	 << dendl;
     return true;
   }
@@ -338,7 +357,8 @@ AdminSocketConfigObs::
 AdminSocketConfigObs(CephContext *cct)
   : m_cct(cct),
     m_thread(NULL),
-    m_shutdown_fd(-1)
+    m_shutdown_fd(-1),
+    m_hook_lock("AdminSocketConfigObs::m_hook_lock")
 {
 }
 
@@ -413,6 +433,24 @@ init(const std::string &path)
   return true;
 }
 
+int AdminSocketConfigObs::
+register_hook(uint32_t request, AdminSocketHook *hook)
+{
+  assert(request > CEPH_ADMIN_SOCK_REQ_SCHEMA);
+  Mutex::Locker l(m_hook_lock);
+  if (m_hooks.count(request))
+    return -EEXIST;
+  m_hooks[request] = hook;
+  return 0;
+}
+
+void AdminSocketConfigObs::
+unregister_hook(uint32_t request)
+{
+  Mutex::Locker l(m_hook_lock);
+  m_hooks.erase(request);
+}
+
 void AdminSocketConfigObs::
 shutdown()
 {
@@ -13,7 +13,10 @@
  */
 
 #include "common/config_obs.h"
+#include "common/Mutex.h"
 
+#include <map>
+#include <stdint.h>
 #include <string>
 
 class AdminSocket;
@@ -21,6 +24,28 @@ class CephContext;
 
 #define CEPH_ADMIN_SOCK_VERSION 1U
 
+/* Request codes.  0-2 are served by the admin socket itself; anything
+ * else is handed to whichever AdminSocketHook registered for it. */
+#define CEPH_ADMIN_SOCK_REQ_VERSION         0U
+#define CEPH_ADMIN_SOCK_REQ_PERFCOUNTERS    1U
+#define CEPH_ADMIN_SOCK_REQ_SCHEMA          2U
+#define CEPH_ADMIN_SOCK_REQ_OPS_IN_FLIGHT   3U
+#define CEPH_ADMIN_SOCK_REQ_HISTORIC_OPS    4U
+
+/*
+ * A daemon component that wants to answer an admin socket request
+ * implements this and registers itself with the CephContext's admin
+ * socket.  call() runs in the admin socket thread and fills in the reply;
+ * returning false makes the admin socket close the connection without
+ * replying.
+ */
+class AdminSocketHook
+{
+public:
+  virtual bool call(uint32_t request, std::string &out) = 0;
+  virtual ~AdminSocketHook() {}
+};
+
 class AdminSocketConfigObs : public md_config_obs_t
 {
 public:
@@ -29,6 +54,10 @@ public:
   virtual const char** get_tracked_conf_keys() const;
   virtual void handle_conf_change(const md_config_t *conf,
 			  const std::set <std::string> &changed);
+
+  /* Returns -EEXIST if something already handles this request. */
+  int register_hook(uint32_t request, AdminSocketHook *hook);
+  void unregister_hook(uint32_t request);
 private:
   AdminSocketConfigObs(const AdminSocketConfigObs& rhs);
   AdminSocketConfigObs& operator=(const AdminSocketConfigObs &rhs);
@@ -40,6 +69,11 @@ private:
   std::string m_path;
   int m_shutdown_fd;
 
+  /** Protects m_hooks; held while a hook runs so unregister_hook() can't
+   * pull it out from under the admin socket thread */
+  Mutex m_hook_lock;
+  std::map<uint32_t, AdminSocketHook*> m_hooks;
+
   friend class AdminSocket;
   friend class AdminSocketTest;
 };
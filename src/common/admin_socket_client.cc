@@ -172,8 +172,7 @@ std::string AdminSocketClient::
 get_json(std::string *message, uint32_t request_code)
 {
   int socket_fd, res;
-  std::vector<uint8_t> vec(65536, 0);
-  uint8_t *buffer = &vec[0];
+  std::vector<uint8_t> vec;
   uint32_t message_size_raw, message_size;
 
   std::string err = asok_connect(m_path, &socket_fd);
@@ -195,7 +194,8 @@ get_json(std::string *message, uint32_t request_code)
     goto done;
   }
   message_size = ntohl(message_size_raw);
-  res = safe_read_exact(socket_fd, buffer, message_size);
+  vec.resize(message_size + 1, 0);  // hook replies can be large
+  res = safe_read_exact(socket_fd, &vec[0], message_size);
   if (res < 0) {
     int e = res;
     ostringstream oss;
@@ -204,7 +204,7 @@ get_json(std::string *message, uint32_t request_code)
     goto done;
   }
   //printf("MESSAGE FROM SERVER: %s\n", buffer);
-  message->assign((const char*)buffer);
+  message->assign((const char*)&vec[0]);
 done:
   close(socket_fd);
   return err;
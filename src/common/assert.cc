@@ -67,6 +67,8 @@ namespace ceph {
 	     "is needed to interpret this.\n");
     dout_emergency(oss.str());
 
+    dout_emergency_dump_recent();
+
     throw FailedAssertion(bt);
   }
 
@@ -70,6 +70,11 @@ public:
     return _heartbeat_map;
   }
 
+  /* Get the admin socket observer, to register request hooks with */
+  AdminSocketConfigObs *get_admin_socket() {
+    return _admin_socket_config_obs;
+  }
+
 private:
   CephContext(const CephContext &rhs);
   CephContext &operator=(const CephContext &rhs);
@@ -27,6 +27,9 @@ OPTION(log_sym_history, OPT_INT, 10)
 OPTION(log_to_stderr, OPT_INT, LOG_TO_STDERR_ALL)
 OPTION(log_to_syslog, OPT_BOOL, false)
 OPTION(log_per_instance, OPT_BOOL, false)
+OPTION(log_async, OPT_BOOL, true)     // write the log file from a background thread
+OPTION(log_max_recent, OPT_INT, 500)  // recent lines (~256 bytes each) kept in memory and dumped on a crash
+OPTION(log_recent_level, OPT_INT, -1) // also keep lines up to this level in memory, even if not logged
 OPTION(clog_to_monitors, OPT_BOOL, true)
 OPTION(clog_to_syslog, OPT_BOOL, false)
 OPTION(pid_file, OPT_STR, "")
@@ -73,6 +76,7 @@ OPTION(ms_max_backoff, OPT_DOUBLE, 15.0)
 OPTION(ms_nocrc, OPT_BOOL, false)
 OPTION(ms_die_on_bad_msg, OPT_BOOL, false)
 OPTION(ms_dispatch_throttle_bytes, OPT_U64, 100 << 20)
+OPTION(ms_dispatch_threads, OPT_INT, 1)   // dispatchers must be thread-safe if > 1
 OPTION(ms_bind_ipv6, OPT_BOOL, false)
 OPTION(ms_rwthread_stack_bytes, OPT_U64, 1024 << 10)
 OPTION(ms_tcp_read_timeout, OPT_U64, 900)
@@ -119,17 +123,25 @@ OPTION(client_readahead_max_periods, OPT_LONGLONG, 4)  // as multiple of file la
 OPTION(client_snapdir, OPT_STR, ".snap")
 OPTION(client_mountpoint, OPT_STR, "/")
 OPTION(client_notify_timeout, OPT_INT, 10) // in seconds
+OPTION(client_caps_batch_window, OPT_DOUBLE, 0)  // hold cap messages to an mds this long (seconds) and send them together; 0 = off
+OPTION(client_caps_batch_max, OPT_INT, 64)       // send a session's batch once it has this many cap messages
 OPTION(client_oc, OPT_BOOL, true)
 OPTION(client_oc_size, OPT_INT, 1024*1024* 200)    // MB * n
 OPTION(client_oc_max_dirty, OPT_INT, 1024*1024* 100)    // MB * n  (dirty OR tx.. bigish)
 OPTION(client_oc_target_dirty, OPT_INT, 1024*1024* 8) // target dirty (keep this smallish)
 // note: the max amount of "in flight" dirty data is roughly (max - target)
 OPTION(client_oc_max_sync_write, OPT_U64, 128*1024)   // sync writes >= this use wrlock
+OPTION(client_oc_bh_pool, OPT_INT, 4096)   // freed BufferHeads kept around for reuse
 OPTION(fuse_use_invalidate_cb, OPT_BOOL, false) // use fuse 2.8+ invalidate callback to keep page cache consistent
+OPTION(fuse_multithreaded, OPT_BOOL, true) // serve fuse requests from several threads
 OPTION(objecter_tick_interval, OPT_DOUBLE, 5.0)
 OPTION(objecter_mon_retry_interval, OPT_DOUBLE, 5.0)
 OPTION(objecter_timeout, OPT_DOUBLE, 10.0)    // before we ask for a map
 OPTION(objecter_inflight_op_bytes, OPT_U64, 1024*1024*100) //max in-flight data (both directions)
+OPTION(objecter_batch_window, OPT_DOUBLE, 0)  // coalesce small ops to the same pg for this long (seconds); 0 = off
+OPTION(objecter_batch_max_ops, OPT_INT, 16)   // flush a pg's batch once it has this many ops
+OPTION(objecter_batch_max_op_bytes, OPT_INT, 4096)  // only batch ops carrying at most this much data
+OPTION(objecter_read_latency_alpha, OPT_DOUBLE, .2)  // weight of the newest sample in per-osd read latency averages
 OPTION(journaler_allow_split_entries, OPT_BOOL, true)
 OPTION(journaler_write_head_interval, OPT_INT, 15)
 OPTION(journaler_prefetch_periods, OPT_INT, 10)   // * journal object size
@@ -155,10 +167,17 @@ OPTION(mds_dirstat_min_interval, OPT_FLOAT, 1)    // try to avoid propagating mo
 OPTION(mds_scatter_nudge_interval, OPT_FLOAT, 5)  // how quickly dirstat changes propagate up the hierarchy
 OPTION(mds_client_prealloc_inos, OPT_INT, 1000)
 OPTION(mds_early_reply, OPT_BOOL, true)
+OPTION(mds_caps_batch_window, OPT_DOUBLE, 0)  // hold cap messages to a client this long (seconds) and send them together; 0 = off
+OPTION(mds_caps_batch_max, OPT_INT, 64)       // send a session's batch once it has this many cap messages
 OPTION(mds_use_tmap, OPT_BOOL, true)        // use trivialmap for dir updates
+OPTION(mds_dir_fetch_dentry, OPT_BOOL, true)  // on a lookup miss, fetch just the wanted dentry
+OPTION(mds_dir_fetch_dentry_min_size, OPT_INT, 1024)  // ...if the dir has at least this many entries
 OPTION(mds_default_dir_hash, OPT_INT, CEPH_STR_HASH_RJENKINS)
 OPTION(mds_log, OPT_BOOL, true)
 OPTION(mds_log_skip_corrupt_events, OPT_BOOL, false)
+OPTION(mds_log_replay_prefetch_periods, OPT_INT, 32)  // journal objects to read ahead during replay
+OPTION(mds_log_replay_decode_threads, OPT_INT, 2)     // decode events on this many threads during replay; 0 = inline
+OPTION(mds_log_replay_decode_window, OPT_INT, 256)    // max events read ahead of the one being replayed
 OPTION(mds_log_max_events, OPT_INT, -1)
 OPTION(mds_log_max_segments, OPT_INT, 30)  // segment size defined by FileLayout, above
 OPTION(mds_log_max_expiring, OPT_INT, 20)
@@ -234,13 +253,27 @@ OPTION(osd_pool_default_crush_rule, OPT_INT, 0)
 OPTION(osd_pool_default_size, OPT_INT, 2)
 OPTION(osd_pool_default_pg_num, OPT_INT, 8)
 OPTION(osd_pool_default_pgp_num, OPT_INT, 8)
+OPTION(osd_tier_default_hit_set_period, OPT_INT, 1200)      // seconds per hit set, for new cache tiers
+OPTION(osd_tier_default_hit_set_count, OPT_INT, 4)          // past hit sets a new cache tier remembers
+OPTION(osd_tier_default_cache_min_flush_age, OPT_INT, 600)  // seconds
+OPTION(osd_tier_default_cache_min_evict_age, OPT_INT, 1800) // seconds
+OPTION(osd_agent_max_ops, OPT_INT, 4)        // cache tier flushes/evictions in flight per pg
+OPTION(osd_agent_scan_chunk, OPT_INT, 64)    // cached objects the agent looks at per pg per tick
+OPTION(osd_agent_thread_timeout, OPT_INT, 60)
 OPTION(osd_map_cache_max, OPT_INT, 250)
 OPTION(osd_map_message_max, OPT_INT, 100)  // max maps per MOSDMap message
 OPTION(osd_op_threads, OPT_INT, 2)    // 0 == no threading
+OPTION(osd_fast_dispatch, OPT_BOOL, false)  // deliver ops from the messenger reader threads (still takes osd_lock)
 OPTION(osd_max_opq, OPT_INT, 10)
 OPTION(osd_disk_threads, OPT_INT, 1)
 OPTION(osd_recovery_threads, OPT_INT, 1)
+OPTION(osd_map_threads, OPT_INT, 0)   // read pg state at boot, remap pgs on new maps; 0 == inline
+OPTION(osd_map_thread_timeout, OPT_INT, 300)
 OPTION(osd_op_thread_timeout, OPT_INT, 30)
+OPTION(osd_op_tracking, OPT_BOOL, true)        // stamp client ops and subops as they move through the osd
+OPTION(osd_op_complaint_time, OPT_FLOAT, 30)    // warn about ops in flight longer than this (seconds)
+OPTION(osd_op_history_size, OPT_INT, 20)        // how many of the slowest completed ops to keep
+OPTION(osd_op_history_duration, OPT_INT, 600)   // forget completed ops older than this (seconds)
 OPTION(osd_backlog_thread_timeout, OPT_INT, 60*60*1)
 OPTION(osd_recovery_thread_timeout, OPT_INT, 30)
 OPTION(osd_snap_trim_thread_timeout, OPT_INT, 60*60*1)
@@ -252,8 +285,10 @@ OPTION(osd_age_time, OPT_INT, 0)
 OPTION(osd_heartbeat_interval, OPT_INT, 1)
 OPTION(osd_mon_heartbeat_interval, OPT_INT, 30)  // if no peers, ping monitor
 OPTION(osd_heartbeat_grace, OPT_INT, 20)
+OPTION(osd_heartbeat_sockbuf, OPT_INT, 16384)  // socket buffer bytes for heartbeat messengers; 0 = kernel default
 OPTION(osd_mon_report_interval_max, OPT_INT, 120)
 OPTION(osd_mon_report_interval_min, OPT_INT, 5)  // pg stats, failures, up_thru, boot.
+OPTION(osd_mon_report_full_interval, OPT_INT, 600)  // resend stats for every pg, changed or not
 OPTION(osd_min_down_reporters, OPT_INT, 1)   // number of OSDs who need to report a down OSD for it to count
 OPTION(osd_min_down_reports, OPT_INT, 3)     // number of times a down OSD must be reported for it to count
 OPTION(osd_replay_window, OPT_INT, 45)
@@ -271,10 +306,13 @@ OPTION(osd_auto_weight, OPT_BOOL, false)
 OPTION(osd_class_error_timeout, OPT_DOUBLE, 60.0)  // seconds
 OPTION(osd_class_timeout, OPT_DOUBLE, 60*60.0) // seconds
 OPTION(osd_class_dir, OPT_STR, "/usr/lib64/rados-classes")
+OPTION(osd_erasure_code_dir, OPT_STR, "/usr/lib64/erasure-code")  // where libec_<plugin>.so live
 OPTION(osd_check_for_log_corruption, OPT_BOOL, false)
 OPTION(osd_use_stale_snap, OPT_BOOL, false)
 OPTION(osd_rollback_to_cluster_snap, OPT_STR, "")
 OPTION(osd_max_notify_timeout, OPT_U32, 30) // max notify timeout in seconds
+OPTION(osd_objectstore, OPT_STR, "filestore")  // filestore, or memstore (everything in ram)
+OPTION(memstore_device_bytes, OPT_U64, 1<<30)  // capacity memstore reports to statfs
 OPTION(filestore, OPT_BOOL, false)
 OPTION(filestore_max_sync_interval, OPT_DOUBLE, 5)    // seconds
 OPTION(filestore_min_sync_interval, OPT_DOUBLE, .01)  // seconds
@@ -299,6 +337,17 @@ OPTION(filestore_queue_committing_max_bytes, OPT_INT, 100 << 20) //  "
 OPTION(filestore_op_threads, OPT_INT, 2)
 OPTION(filestore_op_thread_timeout, OPT_INT, 60)
 OPTION(filestore_op_thread_suicide_timeout, OPT_INT, 180)
+OPTION(filestore_apply_batch_ops, OPT_INT, 32)     // max queued ops per sequencer applied in one pass
+OPTION(filestore_apply_coalesce, OPT_BOOL, true)   // merge adjacent writes and repeated xattr updates to an object
+OPTION(filestore_apply_coalesce_max_bytes, OPT_INT, 4 << 20)  // largest merged write
+OPTION(filestore_fd_cache_size, OPT_INT, 128)     // open fds and resolved paths kept for hot objects; 0 to disable
+OPTION(filestore_syncfs, OPT_BOOL, true)   // commit with syncfs(2) when not on btrfs
+OPTION(filestore_sync_threads, OPT_INT, 4)    // threads fdatasync'ing dirty objects when syncfs(2) is unavailable
+OPTION(filestore_sync_max_dirty, OPT_INT, 4096)  // dirty objects tracked per commit before falling back to sync(2)
+OPTION(filestore_wbthrottle, OPT_BOOL, true)   // pace queue_transactions by measured sync throughput
+OPTION(filestore_wbthrottle_target_sync, OPT_FLOAT, 2.0)  // seconds of writeback to allow to build up
+OPTION(filestore_wbthrottle_low, OPT_FLOAT, .5)          // start delaying at this fraction of the target
+OPTION(filestore_wbthrottle_max_delay, OPT_FLOAT, .5)    // longest delay imposed on one transaction
 OPTION(filestore_commit_timeout, OPT_FLOAT, 600)
 OPTION(filestore_fiemap_threshold, OPT_INT, 4096)
 OPTION(filestore_merge_threshold, OPT_INT, 10)
@@ -342,6 +391,7 @@ OPTION(rgw_log_object_name_utc, OPT_BOOL, false)
 OPTION(rgw_intent_log_object_name, OPT_STR, "%Y-%m-%d-%i-%n")  // man date to see codes (a subset are supported)
 OPTION(rgw_intent_log_object_name_utc, OPT_BOOL, false)
 OPTION(rbd_writeback_window, OPT_INT, 0 /*8 << 20*/) // rbd writeback window size, bytes
+OPTION(rbd_read_policy, OPT_INT, 0)  // which replica serves image data reads (LIBRADOS_READ_*)
 
 // This will be set to true when it is safe to start threads.
 // Once it is true, it will never change.
@@ -49,7 +49,10 @@ public:
   pthread_mutex_t *lock;
 };
 
-static inline void _dout_begin_line(CephContext *cct, signed int prio) {
+static inline void _dout_begin_line(CephContext *cct, signed int prio,
+				    bool to_file) {
+  cct->_doss->set_line_to_file(to_file);
+
   // Put priority information into dout
   cct->_doss->sputc(prio + 12);
 
@@ -72,25 +75,36 @@ inline std::ostream& operator<<(std::ostream& out, _bad_endl_use_dendl_t) {
 #define XDOUT_CONDVAR(cct, x) DOUT_CONDVAR(cct, x)
 #define DOUT_COND(cct, l) l <= XDOUT_CONDVAR(cct, DOUT_SUBSYS)
 
+// Levels above this are compiled out entirely.
+#ifndef DOUT_MAX_LEVEL
+# define DOUT_MAX_LEVEL 200
+#endif
+
+// Lines that don't pass DOUT_COND are still formatted into the
+// in-memory recent log (for crash dumps) up to log_recent_level.
+#define DOUT_RECENT_COND(cct, l) ((l) <= cct->_conf->log_recent_level)
+
 // The array declaration will trigger a compiler error if 'l' is
 // out of range
-#define dout_impl(cct, v) \
+#define dout_impl(cct, v, to_file) \
   if (0) {\
     char __array[((v >= -1) && (v <= 200)) ? 0 : -1] __attribute__((unused)); \
   }\
   DoutLocker __dout_locker; \
   cct->dout_lock(&__dout_locker); \
-  _dout_begin_line(cct, v); \
+  _dout_begin_line(cct, v, to_file); \
 
 #define ldout(cct, v) \
-  do { if (DOUT_COND(cct, v)) {\
-    dout_impl(cct, v) \
+  do { bool __dout_to_file = (v) <= DOUT_MAX_LEVEL && (DOUT_COND(cct, v)); \
+  if (__dout_to_file || \
+      ((v) <= DOUT_MAX_LEVEL && DOUT_RECENT_COND(cct, v))) {	\
+    dout_impl(cct, v, __dout_to_file) \
     std::ostream* _dout = &(cct->_dout); \
     dout_prefix
 
 #define lpdout(cct, v, p) \
   do { if ((v) <= (p)) {\
-    dout_impl(cct, v) \
+    dout_impl(cct, v, true) \
     std::ostream* _dout = &(cct->_dout); \
     *_dout
 
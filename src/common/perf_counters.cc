@@ -59,7 +59,6 @@ logger_remove(class PerfCounters *l)
   Mutex::Locker lck(m_lock);
   perf_counters_set_t::iterator i = m_loggers.find(l);
   assert(i != m_loggers.end());
-  delete *i;
   m_loggers.erase(i);
 }
 
@@ -97,46 +96,85 @@ write_json_to_buf(std::vector <char> &buffer, bool schema)
 PerfCounters::
 ~PerfCounters()
 {
+  for (perf_counter_data_vec_t::iterator d = m_data.begin();
+       d != m_data.end(); ++d) {
+    delete[] d->histogram;
+    d->histogram = NULL;
+  }
 }
 
 void PerfCounters::
 inc(int idx, uint64_t amt)
 {
-  Mutex::Locker lck(m_lock);
   assert(idx > m_lower_bound);
   assert(idx < m_upper_bound);
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_U64))
     return;
-  data.u.u64 += amt;
+  __sync_fetch_and_add(&data.u.u64, amt);
   if (data.type & PERFCOUNTER_LONGRUNAVG)
-    data.avgcount++;
+    __sync_fetch_and_add(&data.avgcount, 1);
 }
 
 void PerfCounters::
 set(int idx, uint64_t amt)
 {
-  Mutex::Locker lck(m_lock);
   assert(idx > m_lower_bound);
   assert(idx < m_upper_bound);
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_U64))
     return;
-  data.u.u64 = amt;
+  __sync_lock_test_and_set(&data.u.u64, amt);
   if (data.type & PERFCOUNTER_LONGRUNAVG)
-    data.avgcount++;
+    __sync_fetch_and_add(&data.avgcount, 1);
 }
 
 uint64_t PerfCounters::
 get(int idx) const
 {
-  Mutex::Locker lck(m_lock);
   assert(idx > m_lower_bound);
   assert(idx < m_upper_bound);
   const perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_U64))
     return 0;
-  return data.u.u64;
+  return __sync_add_and_fetch(const_cast<uint64_t*>(&data.u.u64), 0);
+}
+
+static inline int time_bucket(utime_t amt)
+{
+  uint64_t us = (uint64_t)amt.sec() * 1000000ull + amt.usec();
+  int b = 0;
+  while (us && b < PERFCOUNTER_TIME_BUCKETS - 1) {
+    us >>= 1;
+    b++;
+  }
+  return b;
+}
+
+void PerfCounters::
+tinc(int idx, utime_t amt)
+{
+  assert(idx > m_lower_bound);
+  assert(idx < m_upper_bound);
+  perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
+  if (!(data.type & PERFCOUNTER_TIME))
+    return;
+  uint64_t ns = (uint64_t)amt.sec() * 1000000000ull + amt.nsec();
+  __sync_fetch_and_add(&data.u.u64, ns);
+  __sync_fetch_and_add(&data.histogram[time_bucket(amt)], 1);
+  __sync_fetch_and_add(&data.avgcount, 1);
+}
+
+utime_t PerfCounters::
+tget(int idx) const
+{
+  assert(idx > m_lower_bound);
+  assert(idx < m_upper_bound);
+  const perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
+  if (!(data.type & PERFCOUNTER_TIME))
+    return utime_t();
+  uint64_t ns = __sync_add_and_fetch(const_cast<uint64_t*>(&data.u.u64), 0);
+  return utime_t(ns / 1000000000ull, ns % 1000000000ull);
 }
 
 void PerfCounters::
@@ -191,6 +229,8 @@ void PerfCounters::
 write_json_to_buf(std::vector <char> &buffer, bool schema)
 {
   char buf[512];
+  // keeps the floating point values consistent; integer and time counters
+  // may keep moving underneath us, which is fine for a snapshot.
   Mutex::Locker lck(m_lock);
 
   snprintf(buf, sizeof(buf), "\"%s\":{", m_name.c_str());
@@ -241,7 +281,8 @@ PerfCounters::perf_counter_data_any_d::
 perf_counter_data_any_d()
   : name(NULL),
     type(PERFCOUNTER_NONE),
-    avgcount(0)
+    avgcount(0),
+    histogram(NULL)
 {
   memset(&u, 0, sizeof(u));
 }
@@ -252,9 +293,52 @@ write_schema_json(char *buf, size_t buf_sz) const
   snprintf(buf, buf_sz, "\"%s\":{\"type\":%d}", name, type);
 }
 
+/*
+ * Estimate the p'th percentile (0 < p < 1) of the recorded intervals, in
+ * seconds, by interpolating linearly inside the histogram bucket that
+ * contains it.
+ */
+double PerfCounters::perf_counter_data_any_d::
+percentile(uint64_t count, double p) const
+{
+  if (!count)
+    return 0.0;
+  double target = p * (double)count;
+  uint64_t seen = 0;
+  for (int b = 0; b < PERFCOUNTER_TIME_BUCKETS; b++) {
+    uint64_t n = histogram[b];
+    if (!n)
+      continue;
+    if ((double)(seen + n) >= target) {
+      double lo = b ? (double)(1ull << (b - 1)) : 0.0;
+      double hi = (double)(1ull << b);
+      double frac = (target - (double)seen) / (double)n;
+      return (lo + frac * (hi - lo)) / 1000000.0;
+    }
+    seen += n;
+  }
+  return (double)(1ull << (PERFCOUNTER_TIME_BUCKETS - 1)) / 1000000.0;
+}
+
 void  PerfCounters::perf_counter_data_any_d::
 write_json(char *buf, size_t buf_sz) const
 {
+  if (type & PERFCOUNTER_TIME) {
+    // sum the buckets rather than trusting avgcount, so the percentiles
+    // agree with the histogram even if we race with tinc().
+    uint64_t count = 0;
+    for (int b = 0; b < PERFCOUNTER_TIME_BUCKETS; b++)
+      count += histogram[b];
+    uint64_t ns = u.u64;
+    snprintf(buf, buf_sz, "\"%s\":{\"avgcount\":%" PRId64 ","
+	     "\"sum\":%" PRIu64 ".%09" PRIu64 ","
+	     "\"p50\":%g,\"p99\":%g,\"p999\":%g}",
+	     name, avgcount, (uint64_t)(ns / 1000000000ull),
+	     (uint64_t)(ns % 1000000000ull),
+	     percentile(count, 0.5), percentile(count, 0.99),
+	     percentile(count, 0.999));
+    return;
+  }
   if (type & PERFCOUNTER_LONGRUNAVG) {
     if (type & PERFCOUNTER_U64) {
       snprintf(buf, buf_sz, "\"%s\":{\"avgcount\":%" PRId64 ","
@@ -323,6 +407,12 @@ add_fl_avg(int idx, const char *name)
   add_impl(idx, name, PERFCOUNTER_FLOAT | PERFCOUNTER_LONGRUNAVG);
 }
 
+void PerfCountersBuilder::
+add_time_avg(int idx, const char *name)
+{
+  add_impl(idx, name, PERFCOUNTER_TIME | PERFCOUNTER_LONGRUNAVG);
+}
+
 void PerfCountersBuilder::
 add_impl(int idx, const char *name, int ty)
 {
@@ -334,6 +424,10 @@ add_impl(int idx, const char *name, int ty)
   data.name = name;
   data.type = (enum perfcounter_type_d)ty;
   data.avgcount = 0;
+  if (ty & PERFCOUNTER_TIME) {
+    data.histogram = new uint64_t[PERFCOUNTER_TIME_BUCKETS];
+    memset(data.histogram, 0, sizeof(uint64_t) * PERFCOUNTER_TIME_BUCKETS);
+  }
 }
 
 PerfCounters *PerfCountersBuilder::
@@ -18,6 +18,7 @@
 
 #include "common/config_obs.h"
 #include "common/Mutex.h"
+#include "include/utime.h"
 
 #include <stdint.h>
 #include <string>
@@ -34,15 +35,24 @@ enum perfcounter_type_d
   PERFCOUNTER_U64 = 0x2,
   PERFCOUNTER_LONGRUNAVG = 0x4,
   PERFCOUNTER_COUNTER = 0x8,
+  PERFCOUNTER_TIME = 0x10,
 };
 
+/* Time counters keep a log2 histogram of the recorded intervals, in
+ * microseconds: bucket 0 holds intervals under 1us, bucket i holds
+ * [2^(i-1), 2^i) us, and the last bucket absorbs everything longer. */
+#define PERFCOUNTER_TIME_BUCKETS 32
+
 /*
  * A PerfCounters object is usually associated with a single subsystem.
  * It contains counters which we modify to track performance and throughput
  * over time. 
  *
- * This object is thread-safe. However, it is better to avoid sharing
- * a PerfCounters object between multiple threads to avoid cacheline ping-pong.
+ * This object is thread-safe. Integer and time counters are updated with
+ * atomic operations and never take m_lock, so they are cheap enough to use
+ * on hot paths; floating point counters are still serialized by m_lock.
+ * Sharing a PerfCounters object between many threads still costs some
+ * cacheline ping-pong.
  */
 class PerfCounters
 {
@@ -57,6 +67,9 @@ public:
   void finc(int idx, double v);
   double fget(int idx) const;
 
+  void tinc(int idx, utime_t amt);
+  utime_t tget(int idx) const;
+
   void write_json_to_buf(std::vector <char> &buffer, bool schema);
 
   const std::string& get_name() const;
@@ -72,14 +85,16 @@ private:
     perf_counter_data_any_d();
     void write_schema_json(char *buf, size_t buf_sz) const;
     void  write_json(char *buf, size_t buf_sz) const;
+    double percentile(uint64_t count, double p) const;
 
     const char *name;
     enum perfcounter_type_d type;
     union {
-      uint64_t u64;
+      uint64_t u64;   // for PERFCOUNTER_TIME, total nanoseconds
       double dbl;
     } u;
     uint64_t avgcount;
+    uint64_t *histogram;  // PERFCOUNTER_TIME only; owned by PerfCounters
   };
   typedef std::vector<perf_counter_data_any_d> perf_counter_data_vec_t;
 
@@ -89,7 +104,7 @@ private:
   const std::string m_name;
   const std::string m_lock_name;
 
-  /** Protects m_data */
+  /** Protects the floating point values in m_data */
   mutable Mutex m_lock;
 
   perf_counter_data_vec_t m_data;
@@ -115,6 +130,7 @@ public:
   PerfCountersCollection(CephContext *cct);
   ~PerfCountersCollection();
   void logger_add(class PerfCounters *l);
+  /** Unregister l; the caller is responsible for deleting it. */
   void logger_remove(class PerfCounters *l);
   void logger_clear();
   void write_json_to_buf(std::vector <char> &buffer, bool schema);
@@ -151,6 +167,7 @@ public:
   void add_u64_counter(int key, const char *name);
   void add_fl(int key, const char *name);
   void add_fl_avg(int key, const char *name);
+  void add_time_avg(int key, const char *name);
   PerfCounters* create_perf_counters();
 private:
   PerfCountersBuilder(const PerfCountersBuilder &rhs);
@@ -15,20 +15,41 @@
 #ifndef CEPH_SYNC_FILESYSTEM_H
 #define CEPH_SYNC_FILESYSTEM_H
 
+#include <errno.h>
 #include <unistd.h>
+#include <sys/syscall.h>
 
-inline int sync_filesystem(int fd)
+/*
+ * Sync only the filesystem fd lives on.  glibc grew a syncfs() wrapper in
+ * 2.14, but the system call is in Linux 2.6.39, so if our headers know
+ * the syscall number we call it directly.
+ *
+ * @return 0 on success, or -errno (-ENOSYS if syncfs is not available)
+ */
+inline int try_syncfs(int fd)
 {
-  /* On Linux, newer versions of glibc have a function called syncfs that
-   * performs a sync on only one filesystem. If we don't have this call, we
-   * have to fall back on sync(), which synchronizes every filesystem on the
-   * computer. */
-#ifdef HAVE_SYS_SYNCFS
-  return syncfs(fd);
+#if defined(HAVE_SYS_SYNCFS)
+  if (syncfs(fd) < 0)
+    return -errno;
+  return 0;
+#elif defined(SYS_syncfs)
+  if (syscall(SYS_syncfs, fd) < 0)
+    return -errno;
+  return 0;
 #else
+  return -ENOSYS;
+#endif
+}
+
+inline int sync_filesystem(int fd)
+{
+  /* If we can't sync just the one filesystem, we have to fall back on
+   * sync(), which synchronizes every filesystem on the computer. */
+  int r = try_syncfs(fd);
+  if (r != -ENOSYS)
+    return r;
   sync();
   return 0;
-#endif
 }
 
 #endif
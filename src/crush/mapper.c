@@ -65,6 +65,7 @@ int crush_find_rule(struct crush_map *map, int ruleset, int type, int size)
  * Since this is expensive, we optimize for the r=0 case, which
  * captures the vast majority of calls.
  */
+#ifdef __KERNEL__
 static int bucket_perm_choose(struct crush_bucket *bucket,
 			      int x, int r)
 {
@@ -123,6 +124,47 @@ out:
 		bucket->size, x, r, pr, s);
 	return bucket->items[s];
 }
+#else
+/*
+ * Userspace maps pgs against one shared crush_map from several threads
+ * (see OSD::map_pgs), so don't cache the permutation in the bucket;
+ * build it on the stack instead.  The permutation is the same.
+ */
+static int bucket_perm_choose(struct crush_bucket *bucket,
+			      int x, int r)
+{
+	unsigned pr = r % bucket->size;
+	unsigned i, p, s;
+	__u32 perm[bucket->size];
+
+	/* optimize common r=0 case */
+	if (pr == 0) {
+		s = crush_hash32_3(bucket->hash, x, bucket->id, 0) %
+			bucket->size;
+		goto out;
+	}
+
+	for (i = 0; i < bucket->size; i++)
+		perm[i] = i;
+	for (p = 0; p <= pr; p++) {
+		/* no point in swapping the final entry */
+		if (p < bucket->size - 1) {
+			i = crush_hash32_3(bucket->hash, x, bucket->id, p) %
+				(bucket->size - p);
+			if (i) {
+				unsigned t = perm[p + i];
+				perm[p + i] = perm[p];
+				perm[p] = t;
+			}
+		}
+	}
+	s = perm[pr];
+out:
+	dprintk(" perm_choose %d sz=%d x=%d r=%d (%d) s=%d\n", bucket->id,
+		bucket->size, x, r, pr, s);
+	return bucket->items[s];
+}
+#endif
 
 /* uniform */
 static int bucket_uniform_choose(struct crush_bucket_uniform *bucket,
@@ -103,6 +103,8 @@ static void handle_fatal_signal(int signum)
   bt.print(oss);
   dout_emergency(oss.str());
 
+  dout_emergency_dump_recent();
+
   reraise_fatal(signum);
 }
 
@@ -50,6 +50,9 @@
 #define CEPH_FEATURE_OBJECTLOCATOR  (1<<8)
 #define CEPH_FEATURE_PGID64         (1<<9)
 #define CEPH_FEATURE_INCSUBOSDMAP   (1<<10)
+#define CEPH_FEATURE_OSD_OPBATCH    (1<<11)
+#define CEPH_FEATURE_CAPS_BATCH     (1<<12)
+#define CEPH_FEATURE_OSD_CACHEPOOL  (1<<13)
 
 /*
  * ceph_file_layout - describe data layout for a file/inode
@@ -133,6 +136,7 @@ struct ceph_dir_layout {
 #define CEPH_MSG_CLIENT_LEASE           0x311
 #define CEPH_MSG_CLIENT_SNAP            0x312
 #define CEPH_MSG_CLIENT_CAPRELEASE      0x313
+#define CEPH_MSG_CLIENT_CAPS_BATCH      0x314
 
 /* pool ops */
 #define CEPH_MSG_POOLOP_REPLY           48
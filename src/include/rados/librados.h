@@ -18,7 +18,7 @@ extern "C" {
 #endif
 
 #define LIBRADOS_VER_MAJOR 0
-#define LIBRADOS_VER_MINOR 30
+#define LIBRADOS_VER_MINOR 31
 #define LIBRADOS_VER_EXTRA 0
 
 #define LIBRADOS_VERSION(maj, min, extra) ((maj << 16) + (min << 8) + extra)
@@ -38,6 +38,15 @@ enum {
 	LIBRADOS_CMPXATTR_OP_LTE = 6
 };
 
+/* read balancing policies, for rados_ioctx_set_read_policy() */
+enum {
+	LIBRADOS_READ_PRIMARY = 0,            /* always the primary (default) */
+	LIBRADOS_READ_RANDOM = 1,             /* any replica, uniformly */
+	LIBRADOS_READ_LOCAL = 2,              /* a replica on this host, if any */
+	LIBRADOS_READ_LEAST_OUTSTANDING = 3,  /* the replica with fewest of our ops in flight */
+	LIBRADOS_READ_LATENCY = 4             /* the replica with lowest recent read latency */
+};
+
 struct CephContext;
 
 typedef void *rados_t;
@@ -138,6 +147,21 @@ int rados_ioctx_pool_set_auid(rados_ioctx_t io, uint64_t auid);
 int rados_ioctx_pool_get_auid(rados_ioctx_t io, uint64_t *auid);
 
 void rados_ioctx_locator_set_key(rados_ioctx_t io, const char *key);
+
+/**
+ * choose which osd serves reads from this io context
+ *
+ * Reads go to the primary by default.  Any other LIBRADOS_READ_*
+ * policy spreads them over the pg's replicas; a read that reaches a
+ * replica still recovering the object is retried at the primary.
+ * Reads from a replica may not see writes still in flight from other
+ * clients.
+ *
+ * @param io the io context
+ * @param policy a LIBRADOS_READ_* value
+ * @returns 0 on success, -EINVAL for an unknown policy
+ */
+int rados_ioctx_set_read_policy(rados_ioctx_t io, int policy);
 int rados_ioctx_get_id(rados_ioctx_t io);
 
 /* objects */
@@ -314,6 +314,9 @@ namespace librados
     int notify(const std::string& o, uint64_t ver, bufferlist& bl);
     void set_notify_timeout(uint32_t timeout);
 
+    // which replica serves reads from this IoCtx; LIBRADOS_READ_*
+    int set_read_policy(int policy);
+
     // assert version for next sync operations
     void set_assert_version(uint64_t ver);
     void set_assert_src_version(const std::string& o, uint64_t ver);
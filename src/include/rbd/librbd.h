@@ -25,7 +25,7 @@ extern "C" {
 #include "../rados/librados.h"
 
 #define LIBRBD_VER_MAJOR 0
-#define LIBRBD_VER_MINOR 1
+#define LIBRBD_VER_MINOR 2
 #define LIBRBD_VER_EXTRA 1
 
 #define LIBRBD_VERSION(maj, min, extra) ((maj << 16) + (min << 8) + extra)
@@ -77,6 +77,8 @@ int rbd_stat(rbd_image_t image, rbd_image_info_t *info, size_t infosize);
 int rbd_copy(rbd_image_t image, rados_ioctx_t dest_io_ctx, const char *destname);
 int rbd_copy_with_progress(rbd_image_t image, rados_ioctx_t dest_p, const char *destname,
 			   librbd_progress_fn_t cb, void *cbdata);
+/* which replica serves data reads; a LIBRADOS_READ_* value */
+int rbd_set_read_policy(rbd_image_t image, int policy);
 
 /* snapshots */
 int rbd_snap_list(rbd_image_t image, rbd_snap_info_t *snaps, int *max_snaps);
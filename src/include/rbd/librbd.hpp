@@ -90,6 +90,7 @@ public:
   int copy(IoCtx& dest_io_ctx, const char *destname);
   int copy_with_progress(IoCtx& dest_io_ctx, const char *destname,
 			 ProgressContext &prog_ctx);
+  int set_read_policy(int policy);  // LIBRADOS_READ_*
 
   /* snapshots */
   int snap_list(std::vector<snap_info_t>& snaps);
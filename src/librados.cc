@@ -89,6 +89,7 @@ struct librados::IoCtxImpl {
   eversion_t last_objver;
   uint32_t notify_timeout;
   object_locator_t oloc;
+  int read_flags;   // Objecter flags choosing which replica serves our reads
 
   Mutex aio_write_list_lock;
   tid_t aio_write_seq;
@@ -110,6 +111,7 @@ struct librados::IoCtxImpl {
     last_objver = rhs.last_objver;
     notify_timeout = rhs.notify_timeout;
     oloc = rhs.oloc;
+    read_flags = rhs.read_flags;
   }
 
   void set_snap_read(snapid_t s);
@@ -870,6 +872,15 @@ public:
   void set_notify_timeout(IoCtxImpl& io, uint32_t timeout) {
     io.notify_timeout = timeout;
   }
+
+  int set_read_policy(IoCtxImpl& io, int policy) {
+    int flags = Objecter::get_read_policy_flags(policy);
+    if (flags < 0)
+      return flags;
+    ldout(cct, 10) << "set read policy " << policy << " on pool " << io.poolid << dendl;
+    io.read_flags = flags;
+    return 0;
+  }
 };
 
 librados::IoCtxImpl::IoCtxImpl()
@@ -880,7 +891,7 @@ librados::IoCtxImpl::IoCtxImpl()
 librados::IoCtxImpl::IoCtxImpl(RadosClient *c, int pid, const char *pool_name_, snapid_t s)
   : ref_cnt(0), client(c), poolid(pid),
   pool_name(pool_name_), snap_seq(s), assert_ver(0),
-  notify_timeout(c->cct->_conf->client_notify_timeout), oloc(pid),
+  notify_timeout(c->cct->_conf->client_notify_timeout), oloc(pid), read_flags(0),
   aio_write_list_lock("librados::IoCtxImpl::aio_write_list_lock"), aio_write_seq(0)
 {
 }
@@ -1752,7 +1763,7 @@ int librados::RadosClient::operate_read(IoCtxImpl& io, const object_t& oid,
 
   lock.Lock();
   objecter->read(oid, io.oloc,
-	           *o, io.snap_seq, pbl, 0,
+	           *o, io.snap_seq, pbl, io.read_flags,
 	           onack, &ver);
   lock.Unlock();
 
@@ -1794,7 +1805,7 @@ int librados::RadosClient::aio_read(IoCtxImpl& io, const object_t oid, AioComple
 
   Mutex::Locker l(lock);
   objecter->read(oid, io.oloc,
-		 off, len, io.snap_seq, &c->bl, 0,
+		 off, len, io.snap_seq, &c->bl, io.read_flags,
 		 onack, &c->objver);
   return 0;
 }
@@ -1809,7 +1820,7 @@ int librados::RadosClient::aio_read(IoCtxImpl& io, const object_t oid, AioComple
 
   Mutex::Locker l(lock);
   objecter->read(oid, io.oloc,
-		 off, len, io.snap_seq, &c->bl, 0,
+		 off, len, io.snap_seq, &c->bl, io.read_flags,
 		 onack, &c->objver);
 
   return 0;
@@ -1829,7 +1840,7 @@ int librados::RadosClient::aio_sparse_read(IoCtxImpl& io, const object_t oid,
 
   Mutex::Locker l(lock);
   objecter->sparse_read(oid, io.oloc,
-		 off, len, io.snap_seq, &c->bl, 0,
+		 off, len, io.snap_seq, &c->bl, io.read_flags,
 		 onack);
   return 0;
 }
@@ -2060,7 +2071,7 @@ int librados::RadosClient::tmap_get(IoCtxImpl& io, const object_t& oid, bufferli
   ::ObjectOperation rd;
   prepare_assert_ops(&io, &rd);
   rd.tmap_get();
-  objecter->read(oid, io.oloc, rd, io.snap_seq, &bl, 0, onack, &ver);
+  objecter->read(oid, io.oloc, rd, io.snap_seq, &bl, io.read_flags, onack, &ver);
   lock.Unlock();
 
   mylock.Lock();
@@ -2134,7 +2145,7 @@ int librados::RadosClient::read(IoCtxImpl& io, const object_t& oid,
 
   lock.Lock();
   objecter->read(oid, io.oloc,
-	      off, len, io.snap_seq, &bl, 0,
+	      off, len, io.snap_seq, &bl, io.read_flags,
               onack, &ver, pop);
   lock.Unlock();
 
@@ -2171,7 +2182,7 @@ int librados::RadosClient::mapext(IoCtxImpl& io, const object_t& oid,
 
   lock.Lock();
   objecter->mapext(oid, io.oloc,
-	      off, len, io.snap_seq, &bl, 0,
+	      off, len, io.snap_seq, &bl, io.read_flags,
               onack);
   lock.Unlock();
 
@@ -2205,7 +2216,7 @@ int librados::RadosClient::sparse_read(IoCtxImpl& io, const object_t& oid,
 
   lock.Lock();
   objecter->sparse_read(oid, io.oloc,
-	      off, len, io.snap_seq, &bl, 0,
+	      off, len, io.snap_seq, &bl, io.read_flags,
               onack);
   lock.Unlock();
 
@@ -2245,7 +2256,7 @@ int librados::RadosClient::stat(IoCtxImpl& io, const object_t& oid, uint64_t *ps
 
   lock.Lock();
   objecter->stat(oid, io.oloc,
-	      io.snap_seq, psize, &mtime, 0,
+	      io.snap_seq, psize, &mtime, io.read_flags,
               onack, &ver, pop);
   lock.Unlock();
 
@@ -2280,7 +2291,7 @@ int librados::RadosClient::getxattr(IoCtxImpl& io, const object_t& oid,
 
   lock.Lock();
   objecter->getxattr(oid, io.oloc,
-	      name, io.snap_seq, &bl, 0,
+	      name, io.snap_seq, &bl, io.read_flags,
               onack, &ver, pop);
   lock.Unlock();
 
@@ -2394,7 +2405,7 @@ int librados::RadosClient::getxattrs(IoCtxImpl& io, const object_t& oid,
   map<string, bufferlist> aset;
   objecter->getxattrs(oid, io.oloc, io.snap_seq,
 		      aset,
-		      0, onack, &ver, pop);
+		      io.read_flags, onack, &ver, pop);
   lock.Unlock();
 
   attrset.clear();
@@ -3081,6 +3092,11 @@ void librados::IoCtx::set_notify_timeout(uint32_t timeout)
   io_ctx_impl->client->set_notify_timeout(*io_ctx_impl, timeout);
 }
 
+int librados::IoCtx::set_read_policy(int policy)
+{
+  return io_ctx_impl->client->set_read_policy(*io_ctx_impl, policy);
+}
+
 void librados::IoCtx::set_assert_version(uint64_t ver)
 {
   io_ctx_impl->client->set_assert_version(*io_ctx_impl, ver);
@@ -3713,6 +3729,12 @@ extern "C" int rados_ioctx_pool_get_auid(rados_ioctx_t io, uint64_t *auid)
   return ctx->client->pool_get_auid(ctx, (unsigned long long *)auid);
 }
 
+extern "C" int rados_ioctx_set_read_policy(rados_ioctx_t io, int policy)
+{
+  librados::IoCtxImpl *ctx = (librados::IoCtxImpl *)io;
+  return ctx->client->set_read_policy(*ctx, policy);
+}
+
 extern "C" void rados_ioctx_locator_set_key(rados_ioctx_t io, const char *key)
 {
   librados::IoCtxImpl *ctx = (librados::IoCtxImpl *)io;
@@ -105,6 +105,7 @@ namespace librbd {
     {
       md_ctx.dup(p);
       data_ctx.dup(p);
+      data_ctx.set_read_policy(cct->_conf->rbd_read_policy);
     }
 
     ~ImageCtx() {
@@ -325,6 +326,7 @@ namespace librbd {
   };
 
   int snap_set(ImageCtx *ictx, const char *snap_name);
+  int set_read_policy(ImageCtx *ictx, int policy);
   int list(IoCtx& io_ctx, std::vector<string>& names);
   int create(IoCtx& io_ctx, const char *imgname, uint64_t size, int *order);
   int rename(IoCtx& io_ctx, const char *srcname, const char *dstname);
@@ -1200,6 +1202,15 @@ int snap_set(ImageCtx *ictx, const char *snap_name)
   return 0;
 }
 
+int set_read_policy(ImageCtx *ictx, int policy)
+{
+  ldout(ictx->cct, 20) << "set_read_policy " << ictx << " policy = " << policy << dendl;
+
+  // only data reads are spread over replicas; the header stays on the primary
+  Mutex::Locker l(ictx->lock);
+  return ictx->data_ctx.set_read_policy(policy);
+}
+
 int open_image(IoCtx& io_ctx, ImageCtx *ictx, const char *name, const char *snap_name)
 {
   CephContext *cct = io_ctx.cct();
@@ -1805,6 +1816,12 @@ int Image::snap_set(const char *snap_name)
   return librbd::snap_set(ictx, snap_name);
 }
 
+int Image::set_read_policy(int policy)
+{
+  ImageCtx *ictx = (ImageCtx *)ctx;
+  return librbd::set_read_policy(ictx, policy);
+}
+
 ssize_t Image::read(uint64_t ofs, size_t len, bufferlist& bl)
 {
   ImageCtx *ictx = (ImageCtx *)ctx;
@@ -2061,6 +2078,12 @@ extern "C" int rbd_snap_set(rbd_image_t image, const char *snapname)
   return librbd::snap_set(ictx, snapname);
 }
 
+extern "C" int rbd_set_read_policy(rbd_image_t image, int policy)
+{
+  librbd::ImageCtx *ictx = (librbd::ImageCtx *)image;
+  return librbd::set_read_policy(ictx, policy);
+}
+
 /* I/O */
 extern "C" ssize_t rbd_read(rbd_image_t image, uint64_t ofs, size_t len, char *buf)
 {
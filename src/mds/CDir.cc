@@ -1337,7 +1337,12 @@ void CDir::fetch(Context *c, const string& want_dn, bool ignore_authpinnability)
   
   // already fetching?
   if (state_test(CDir::STATE_FETCHING)) {
-    dout(7) << "already fetching; waiting" << dendl;
+    if (state_test(CDir::STATE_FETCHINGDN)) {
+      dout(7) << "already fetching a single dentry; will fetch the rest after" << dendl;
+      state_set(CDir::STATE_FETCHAGAIN);
+    } else {
+      dout(7) << "already fetching; waiting" << dendl;
+    }
     return;
   }
 
@@ -1402,20 +1407,7 @@ void CDir::_fetched(bufferlist &bl, const string& want_dn)
 	   << dendl;
   
 
-  // take the loaded fnode?
-  // only if we are a fresh CDir* with no prior state.
-  if (get_version() == 0) {
-    assert(!is_projected());
-    assert(!state_test(STATE_COMMITTING));
-    fnode = got_fnode;
-    projected_version = committing_version = committed_version = got_fnode.version;
-
-    if (state_test(STATE_REJOINUNDEF)) {
-      assert(cache->mds->is_rejoin());
-      state_clear(STATE_REJOINUNDEF);
-      cache->opened_undef_dirfrag(this);
-    }
-  }
+  _take_fetched_fnode(got_fnode, false);
 
   // purge stale snaps?
   //  * only if we have past_parents open!
@@ -1433,7 +1425,73 @@ void CDir::_fetched(bufferlist &bl, const string& want_dn)
   bool purged_any = false;
 
 
-  //int num_new_inodes_loaded = 0;
+  _load_dentries(p, n, got_fnode.version, snaps, want_dn, &purged_any);
+
+  if (!p.end()) {
+    clog.warn() << "dir " << dirfrag() << " has "
+	<< bl.length() - p.get_off() << " extra bytes\n";
+  }
+
+  //cache->mds->logger->inc("newin", num_new_inodes_loaded);
+  //hack_num_accessed = 0;
+
+  if (purged_any)
+    log_mark_dirty();
+
+  // mark complete, !fetching
+  state_set(STATE_COMPLETE);
+  state_clear(STATE_FETCHING);
+  auth_unpin(this);
+
+  // kick waiters
+  finish_waiting(WAIT_COMPLETE, 0);
+}
+
+
+
+/*
+ * take the loaded fnode, but only if we are a fresh CDir* with no
+ * prior state.
+ *
+ * a partial (single dentry) fetch doesn't load the rest of the
+ * dirfrag, so it leaves committed_version at 0: the underwater dentry
+ * cleanup in _load_dentries and the new_dirfrags tracking in
+ * _mark_dirty both key off that, and the eventual full fetch will
+ * advance it.
+ */
+void CDir::_take_fetched_fnode(const fnode_t& got_fnode, bool partial)
+{
+  if (get_version() == 0) {
+    assert(!is_projected());
+    assert(!state_test(STATE_COMMITTING));
+    fnode = got_fnode;
+    projected_version = got_fnode.version;
+
+    if (state_test(STATE_REJOINUNDEF)) {
+      assert(cache->mds->is_rejoin());
+      state_clear(STATE_REJOINUNDEF);
+      cache->opened_undef_dirfrag(this);
+    }
+  }
+
+  if (!partial &&
+      committed_version == 0 &&
+      !is_dirty() &&
+      get_version() == got_fnode.version) {
+    assert(!state_test(STATE_COMMITTING));
+    committing_version = committed_version = got_fnode.version;
+  }
+}
+
+/*
+ * decode n tmap entries (dentry key, dentry blob) and link them into
+ * the cache, skipping any we already have.
+ */
+void CDir::_load_dentries(bufferlist::iterator& p, unsigned n, version_t got_version,
+			  const set<snapid_t> *snaps, const string& want_dn,
+			  bool *purged_any)
+{
+  LogClient &clog = cache->mds->clog;
   loff_t baseoff = p.get_off();
   for (unsigned i=0; i<n; i++) {
     loff_t dn_offset = p.get_off() - baseoff;
@@ -1462,7 +1520,7 @@ void CDir::_fetched(bufferlist &bl, const string& want_dn)
       if (p == snaps->end() || *p > last) {
 	dout(10) << " skipping stale dentry on [" << first << "," << last << "]" << dendl;
 	stale = true;
-	purged_any = true;
+	*purged_any = true;
       }
     }
     
@@ -1606,39 +1664,140 @@ void CDir::_fetched(bufferlist &bl, const string& want_dn)
      */
     if (committed_version == 0 &&     
 	dn &&
-	dn->get_version() <= got_fnode.version &&
+	dn->get_version() <= got_version &&
 	dn->is_dirty()) {
       dout(10) << "_fetched  had underwater dentry " << *dn << ", marking clean" << dendl;
       dn->mark_clean();
 
       if (dn->get_linkage()->get_inode()) {
-	assert(dn->get_linkage()->get_inode()->get_version() <= got_fnode.version);
+	assert(dn->get_linkage()->get_inode()->get_version() <= got_version);
 	dout(10) << "_fetched  had underwater inode " << *dn->get_linkage()->get_inode() << ", marking clean" << dendl;
 	dn->get_linkage()->get_inode()->mark_clean();
       }
     }
   }
-  if (!p.end()) {
-    clog.warn() << "dir " << dirfrag() << " has "
-	<< bl.length() - p.get_off() << " extra bytes\n";
+}
+
+
+// -----------------------
+// FETCH DENTRY
+
+class C_Dir_FetchDentry : public Context {
+ protected:
+  CDir *dir;
+  string dname;
+ public:
+  bufferlist bl;
+
+  C_Dir_FetchDentry(CDir *d, const string& n) : dir(d), dname(n) { }
+  void finish(int r) {
+    dir->_fetched_dentry(r, bl, dname);
   }
+};
 
-  //cache->mds->logger->inc("newin", num_new_inodes_loaded);
-  //hack_num_accessed = 0;
+/*
+ * Fetch only the head dentry for dname, instead of the whole dirfrag.
+ * This is what a lookup miss in a large, incomplete directory wants;
+ * the dir stays incomplete.  If the dentry does not exist on disk we
+ * add a null dentry so that the lookup can conclude ENOENT.
+ *
+ * Returns false (and does nothing) if a partial fetch isn't appropriate,
+ * in which case the caller should do a normal fetch().
+ */
+bool CDir::fetch_dentry(Context *c, const string& dname)
+{
+  if (!g_conf->mds_dir_fetch_dentry ||
+      !g_conf->mds_use_tmap ||
+      state_test(STATE_FETCHING) ||
+      state_test(STATE_REJOINUNDEF) ||
+      is_frozen() ||
+      !can_auth_pin() ||
+      inode->get_projected_inode()->dirstat.size() <
+        g_conf->mds_dir_fetch_dentry_min_size)
+    return false;
 
-  if (purged_any)
-    log_mark_dirty();
+  dout(10) << "fetch_dentry '" << dname << "' on " << *this << dendl;
+  assert(is_auth());
+  assert(!is_complete());
 
-  // mark complete, !fetching
-  state_set(STATE_COMPLETE);
-  state_clear(STATE_FETCHING);
-  auth_unpin(this);
+  if (c) add_waiter(WAIT_COMPLETE, c);
 
-  // kick waiters
-  finish_waiting(WAIT_COMPLETE, 0);
+  auth_pin(this);
+  state_set(STATE_FETCHING);
+  state_set(STATE_FETCHINGDN);
+
+  if (cache->mds->logger) cache->mds->logger->inc(l_mds_dir_fdn);
+
+  // the on-disk key for the head dentry
+  bufferlist kbl;
+  dentry_key_t(CEPH_NOSNAP, dname.c_str()).encode(kbl);
+  bufferlist::iterator kp = kbl.begin();
+  string key;
+  ::decode(key, kp);
+  set<string> keys;
+  keys.insert(key);
+
+  C_Dir_FetchDentry *fin = new C_Dir_FetchDentry(this, dname);
+  object_t oid = get_ondisk_object();
+  object_locator_t oloc(cache->mds->mdsmap->get_metadata_pg_pool());
+  ObjectOperation rd;
+  rd.tmap_get_vals(keys);
+  cache->mds->objecter->read(oid, oloc, rd, CEPH_NOSNAP, &fin->bl, 0, fin);
+  return true;
 }
 
+void CDir::_fetched_dentry(int r, bufferlist &bl, const string& dname)
+{
+  dout(10) << "_fetched_dentry '" << dname << "' r=" << r << ", " << bl.length()
+	   << " bytes for " << *this << dendl;
+
+  assert(is_auth());
+  state_clear(STATE_FETCHING);
+  state_clear(STATE_FETCHINGDN);
+
+  // an old osd, a missing object, or someone wants the whole thing
+  // anyway: fall back to a full fetch.  our waiter rides along.
+  if (r < 0 || bl.length() == 0 || state_test(STATE_FETCHAGAIN)) {
+    dout(10) << "_fetched_dentry doing full fetch" << dendl;
+    state_clear(STATE_FETCHAGAIN);
+    fetch(NULL, dname, true);
+    auth_unpin(this);
+    return;
+  }
+
+  bufferlist::iterator p = bl.begin();
+  bufferlist header;
+  ::decode(header, p);
+  bufferlist::iterator hp = header.begin();
+  fnode_t got_fnode;
+  ::decode(got_fnode, hp);
+  __u32 n;
+  ::decode(n, p);
+  dout(10) << "_fetched_dentry version " << got_fnode.version << ", " << n << " keys" << dendl;
+
+  _take_fetched_fnode(got_fnode, true);
+
+  // skip stale dentries, but leave the snap purge (and fnode update)
+  // to a full fetch.
+  const set<snapid_t> *snaps = 0;
+  SnapRealm *realm = inode->find_snaprealm();
+  if (realm->have_past_parents_open() &&
+      fnode.snap_purged_thru < realm->get_last_destroyed())
+    snaps = &realm->get_snaps();
+  bool purged_any = false;
+
+  _load_dentries(p, n, got_fnode.version, snaps, dname, &purged_any);
+
+  if (!lookup(dname)) {
+    // not on disk; make the miss stick.  the null dentry only covers
+    // snaps newer than any existing snapshot.
+    CDentry *dn = add_null_dentry(dname, realm->get_newest_seq() + 1);
+    dout(12) << "_fetched_dentry added null " << *dn << dendl;
+  }
 
+  auth_unpin(this);
+  finish_waiting(WAIT_COMPLETE, 0);
+}
 
 // -----------------------
 // COMMIT
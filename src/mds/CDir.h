@@ -99,6 +99,8 @@ public:
   static const unsigned STATE_FREEZINGDIR =   (1<< 5);
   static const unsigned STATE_COMMITTING =    (1<< 6);   // mid-commit
   static const unsigned STATE_FETCHING =      (1<< 7);   // currenting fetching
+  static const unsigned STATE_FETCHINGDN =    (1<< 8);   // fetching a single dentry
+  static const unsigned STATE_FETCHAGAIN =    (1<< 9);   // full fetch wanted after dentry fetch
   static const unsigned STATE_IMPORTBOUND =   (1<<10);
   static const unsigned STATE_EXPORTBOUND =   (1<<11);
   static const unsigned STATE_EXPORTING =     (1<<12);
@@ -474,6 +476,14 @@ private:
   void fetch(Context *c, bool ignore_authpinnability=false);
   void fetch(Context *c, const string& want_dn, bool ignore_authpinnability=false);
   void _fetched(bufferlist &bl, const string& want_dn);
+  bool fetch_dentry(Context *c, const string& dname);
+  void _fetched_dentry(int r, bufferlist &bl, const string& dname);
+private:
+  void _take_fetched_fnode(const fnode_t& got_fnode, bool partial);
+  void _load_dentries(bufferlist::iterator& p, unsigned n, version_t got_version,
+		      const set<snapid_t> *snaps, const string& want_dn,
+		      bool *purged_any);
+public:
 
   // -- commit --
   map<version_t, list<Context*> > waiting_for_commit;
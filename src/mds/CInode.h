@@ -419,8 +419,50 @@ public:
 
 protected:
 
-  ceph_lock_state_t fcntl_locks;
-  ceph_lock_state_t flock_locks;
+  // advisory file locks; most inodes never see one, so allocate on demand
+  ceph_lock_state_t *fcntl_locks;
+  ceph_lock_state_t *flock_locks;
+
+  ceph_lock_state_t *get_fcntl_lock_state() {
+    if (!fcntl_locks)
+      fcntl_locks = new ceph_lock_state_t;
+    return fcntl_locks;
+  }
+  ceph_lock_state_t *get_flock_lock_state() {
+    if (!flock_locks)
+      flock_locks = new ceph_lock_state_t;
+    return flock_locks;
+  }
+  // non-allocating accessors for queries; NULL means no locks
+  ceph_lock_state_t *get_fcntl_lock_state_if_exists() { return fcntl_locks; }
+  ceph_lock_state_t *get_flock_lock_state_if_exists() { return flock_locks; }
+  void try_clear_file_locks() {
+    if (fcntl_locks && fcntl_locks->held_locks.empty() &&
+	fcntl_locks->waiting_locks.empty()) {
+      delete fcntl_locks;
+      fcntl_locks = NULL;
+    }
+    if (flock_locks && flock_locks->held_locks.empty() &&
+	flock_locks->waiting_locks.empty()) {
+      delete flock_locks;
+      flock_locks = NULL;
+    }
+  }
+  void _encode_file_locks(bufferlist& bl) const {
+    if (fcntl_locks)
+      ::encode(*fcntl_locks, bl);
+    else
+      ::encode(ceph_lock_state_t(), bl);
+    if (flock_locks)
+      ::encode(*flock_locks, bl);
+    else
+      ::encode(ceph_lock_state_t(), bl);
+  }
+  void _decode_file_locks(bufferlist::iterator& p) {
+    ::decode(*get_fcntl_lock_state(), p);
+    ::decode(*get_flock_lock_state(), p);
+    try_clear_file_locks();
+  }
 
   // LogSegment dlists i (may) belong to
 public:
@@ -469,6 +511,7 @@ private:
     parent(0),
     inode_auth(CDIR_AUTH_DEFAULT),
     replica_caps_wanted(0),
+    fcntl_locks(NULL), flock_locks(NULL),
     item_dirty(this), item_caps(this), item_open_file(this), item_renamed_file(this), 
     item_dirty_dirfrag_dir(this), 
     item_dirty_dirfrag_nest(this), 
@@ -498,6 +541,8 @@ private:
     g_num_inos++;
     close_dirfrags();
     close_snaprealm();
+    delete fcntl_locks;
+    delete flock_locks;
   }
   
 
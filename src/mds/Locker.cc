@@ -48,6 +48,7 @@
 #include "messages/MClientReply.h"
 #include "messages/MClientCaps.h"
 #include "messages/MClientCapRelease.h"
+#include "messages/MClientCapsBatch.h"
 
 #include "messages/MMDSSlaveRequest.h"
 
@@ -87,6 +88,9 @@ void Locker::dispatch(Message *m)
   case CEPH_MSG_CLIENT_CAPRELEASE:
     handle_client_cap_release((MClientCapRelease*)m);
     break;
+  case CEPH_MSG_CLIENT_CAPS_BATCH:
+    handle_client_caps_batch((MClientCapsBatch*)m);
+    break;
   case CEPH_MSG_CLIENT_LEASE:
     handle_client_lease((MClientLease*)m);
     break;
@@ -2319,7 +2323,7 @@ void Locker::handle_client_caps(MClientCaps *m)
 	if (!in->filelock.is_stable() ||
 	    !in->authlock.is_stable() ||
 	    !in->xattrlock.is_stable())
-	  mds->mdlog->flush();
+	  flush_log_for_caps();
       }
 
       adjust_cap_wanted(cap, new_wanted, m->get_issue_seq());
@@ -2331,7 +2335,7 @@ void Locker::handle_client_caps(MClientCaps *m)
       eval(in, CEPH_CAP_LOCKS);
       
       if (cap->wanted() & ~cap->pending())
-	mds->mdlog->flush();
+	flush_log_for_caps();
     } else {
       // no update, ack now.
       if (ack)
@@ -2687,17 +2691,17 @@ bool Locker::_do_cap_update(CInode *in, Capability *cap,
     for ( int i=0; i < num_locks; ++i) {
       ceph_filelock decoded_lock;
       ::decode(decoded_lock, bli);
-      in->fcntl_locks.held_locks.
+      in->get_fcntl_lock_state()->held_locks.
 	insert(pair<uint64_t, ceph_filelock>(decoded_lock.start, decoded_lock));
-      ++in->fcntl_locks.client_held_lock_counts[(client_t)(decoded_lock.client)];
+      ++in->get_fcntl_lock_state()->client_held_lock_counts[(client_t)(decoded_lock.client)];
     }
     ::decode(num_locks, bli);
     for ( int i=0; i < num_locks; ++i) {
       ceph_filelock decoded_lock;
       ::decode(decoded_lock, bli);
-      in->flock_locks.held_locks.
+      in->get_flock_lock_state()->held_locks.
 	insert(pair<uint64_t, ceph_filelock>(decoded_lock.start, decoded_lock));
-      ++in->flock_locks.client_held_lock_counts[(client_t)(decoded_lock.client)];
+      ++in->get_flock_lock_state()->client_held_lock_counts[(client_t)(decoded_lock.client)];
     }
   }
 
@@ -2767,11 +2771,40 @@ bool Locker::_do_cap_update(CInode *in, Capability *cap,
       (!dirty && (!in->filelock.is_stable() || !in->authlock.is_stable() || !in->xattrlock.is_stable())) ||  // nothing dirty + unstable lock -> probably a revoke?
       (change_max && new_max) ||         // max INCREASE
       (cap && (cap->wanted() & ~cap->pending())))
-    mds->mdlog->flush();
+    flush_log_for_caps();
 
   return true;
 }
 
+/*
+ * handle each cap message in the batch in turn.  log flushes they ask
+ * for are deferred and done once at the end, so the updates journaled
+ * for the whole batch go out in a single flush.
+ */
+void Locker::handle_client_caps_batch(MClientCapsBatch *m)
+{
+  dout(7) << "handle_client_caps_batch " << *m << " from " << m->get_source() << dendl;
+
+  in_caps_batch = true;
+  while (!m->caps.empty())
+    handle_client_caps(m->pop_front());
+  in_caps_batch = false;
+
+  if (caps_batch_flush_log) {
+    caps_batch_flush_log = false;
+    mds->mdlog->flush();
+  }
+  m->put();
+}
+
+void Locker::flush_log_for_caps()
+{
+  if (in_caps_batch)
+    caps_batch_flush_log = true;
+  else
+    mds->mdlog->flush();
+}
+
 /* This function DOES put the passed message before returning */
 void Locker::handle_client_cap_release(MClientCapRelease *m)
 {
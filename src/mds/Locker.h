@@ -62,7 +62,8 @@ private:
   MDCache *mdcache;
  
  public:
-  Locker(MDS *m, MDCache *c) : mds(m), mdcache(c) {}  
+  Locker(MDS *m, MDCache *c) : mds(m), mdcache(c),
+				in_caps_batch(false), caps_batch_flush_log(false) {}  
 
   SimpleLock *get_lock(int lock_type, MDSCacheObjectInfo &info);
   
@@ -224,6 +225,11 @@ public:
   bool _do_cap_update(CInode *in, Capability *cap, int dirty, snapid_t follows, MClientCaps *m,
 		      MClientCaps *ack=0);
   void handle_client_cap_release(class MClientCapRelease *m);
+  void handle_client_caps_batch(class MClientCapsBatch *m);
+
+  bool in_caps_batch;        // log flushes are deferred to the end of the batch
+  bool caps_batch_flush_log;
+  void flush_log_for_caps();
 
 
   // local
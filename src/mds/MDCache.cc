@@ -6780,7 +6780,9 @@ int MDCache::path_traverse(MDRequest *mdr, Message *req, Context *fin,     // wh
 	// directory isn't complete; reload
         dout(7) << "traverse: incomplete dir contents for " << *cur << ", fetching" << dendl;
         touch_inode(cur);
-        curdir->fetch(_get_waiter(mdr, req, fin), path[depth]);
+	Context *c = _get_waiter(mdr, req, fin);
+	if (snapid != CEPH_NOSNAP || !curdir->fetch_dentry(c, path[depth]))
+	  curdir->fetch(c, path[depth]);
 	if (mds->logger) mds->logger->inc(l_mds_tdirf);
         return 1;
       }
@@ -70,6 +70,10 @@ void MDLog::create_logger()
   plb.add_u64(l_mdl_rdpos, "rdpos");
   plb.add_u64(l_mdl_jlat, "jlat");
 
+  plb.add_u64_counter(l_mdl_replayev, "replayev");
+  plb.add_u64_counter(l_mdl_replaybytes, "replaybytes");
+  plb.add_fl_avg(l_mdl_replaywait, "replaywait");
+
   // logger
   logger = plb.create_perf_counters();
   g_ceph_context->GetPerfCountersCollection()->logger_add(logger);
@@ -462,77 +466,124 @@ public:
 
 
 
+void MDLog::ReplayDecodeWQ::_process(ReplayEntry *e)
+{
+  e->le = LogEvent::decode(e->bl);
+}
+
 // i am a separate thread
 void MDLog::_replay_thread()
 {
   mds->mds_lock.Lock();
   dout(10) << "_replay_thread start" << dendl;
 
+  // read well ahead, and decode on a few threads while we apply
+  journaler->set_prefetch_periods(g_conf->mds_log_replay_prefetch_periods);
+  ThreadPool decode_tp(g_ceph_context, "MDLog::replay_decode_tp",
+		       g_conf->mds_log_replay_decode_threads);
+  ReplayDecodeWQ decode_wq(&decode_tp);
+  bool use_tp = g_conf->mds_log_replay_decode_threads > 0;
+  if (use_tp)
+    decode_tp.start();
+  deque<ReplayEntry*> pending;
+  unsigned window = MAX(g_conf->mds_log_replay_decode_window, 1);
+
   // loop
   int r = 0;
   while (1) {
-    // wait for read?
-    while (!journaler->is_readable() &&
-	   journaler->get_read_pos() < journaler->get_write_pos() &&
-	   !journaler->get_error()) {
-      journaler->wait_for_readable(new C_MDL_Replay(this));
-      replay_cond.Wait(mds->mds_lock);
-    }
-    if (journaler->get_error()) {
-      r = journaler->get_error();
-      dout(0) << "_replay journaler got error " << r << ", aborting" << dendl;
-      if (r == -EINVAL) {
-        if (journaler->get_read_pos() < journaler->get_expire_pos()) {
-          // this should only happen if you're following somebody else
-          assert(journaler->is_readonly());
-          dout(0) << "expire_pos is higher than read_pos, returning EAGAIN" << dendl;
-          r = -EAGAIN;
-        } else {
-          /* re-read head and check it
-           * Given that replay happens in a separate thread and
-           * the MDS is going to either shut down or restart when
-           * we return this error, doing it synchronously is fine
-           * -- as long as we drop the main mds lock--. */
-          Mutex mylock("MDLog::_replay_thread lock");
-          Cond cond;
-          bool done = false;
-          int err = 0;
-          journaler->reread_head(new C_SafeCond(&mylock, &cond, &done, &err));
-          mds->mds_lock.Unlock();
-          while (!done)
-            cond.Wait(mylock);
-          if (err) { // well, crap
-            dout(0) << "got error while reading head: " << cpp_strerror(err)
-                    << dendl;
-            mds->suicide();
-          }
-          mds->mds_lock.Lock();
-	  standby_trim_segments();
-          if (journaler->get_read_pos() < journaler->get_expire_pos()) {
-            dout(0) << "expire_pos is higher than read_pos, returning EAGAIN" << dendl;
-            r = -EAGAIN;
-          }
-        }
+    // keep the decode pipeline full
+    while (pending.size() < window && journaler->is_readable()) {
+      ReplayEntry *e = new ReplayEntry(journaler->get_read_pos());
+      if (!journaler->try_read_entry(e->bl)) {
+	delete e;
+	break;
+      }
+      e->end = journaler->get_read_pos();
+      pending.push_back(e);
+      if (use_tp) {
+	decode_wq.queue(e);
+      } else {
+	e->le = LogEvent::decode(e->bl);
+	e->decoded = true;
       }
-      break;
     }
-    
-    if (!journaler->is_readable() &&
-	journaler->get_read_pos() == journaler->get_write_pos())
-      break;
-    
-    assert(journaler->is_readable());
-    
-    // read it
-    uint64_t pos = journaler->get_read_pos();
-    bufferlist bl;
-    bool r = journaler->try_read_entry(bl);
-    if (!r && journaler->get_error())
+
+    if (pending.empty()) {
+      // wait for read?
+      while (!journaler->is_readable() &&
+	     journaler->get_read_pos() < journaler->get_write_pos() &&
+	     !journaler->get_error()) {
+	journaler->wait_for_readable(new C_MDL_Replay(this));
+	replay_cond.Wait(mds->mds_lock);
+      }
+      if (journaler->get_error()) {
+	r = journaler->get_error();
+	dout(0) << "_replay journaler got error " << r << ", aborting" << dendl;
+	if (r == -EINVAL) {
+	  if (journaler->get_read_pos() < journaler->get_expire_pos()) {
+	    // this should only happen if you're following somebody else
+	    assert(journaler->is_readonly());
+	    dout(0) << "expire_pos is higher than read_pos, returning EAGAIN" << dendl;
+	    r = -EAGAIN;
+	  } else {
+	    /* re-read head and check it
+	     * Given that replay happens in a separate thread and
+	     * the MDS is going to either shut down or restart when
+	     * we return this error, doing it synchronously is fine
+	     * -- as long as we drop the main mds lock--. */
+	    Mutex mylock("MDLog::_replay_thread lock");
+	    Cond cond;
+	    bool done = false;
+	    int err = 0;
+	    journaler->reread_head(new C_SafeCond(&mylock, &cond, &done, &err));
+	    mds->mds_lock.Unlock();
+	    while (!done)
+	      cond.Wait(mylock);
+	    if (err) { // well, crap
+	      dout(0) << "got error while reading head: " << cpp_strerror(err)
+		      << dendl;
+	      mds->suicide();
+	    }
+	    mds->mds_lock.Lock();
+	    standby_trim_segments();
+	    if (journaler->get_read_pos() < journaler->get_expire_pos()) {
+	      dout(0) << "expire_pos is higher than read_pos, returning EAGAIN" << dendl;
+	      r = -EAGAIN;
+	    }
+	  }
+	}
+	break;
+      }
+
+      if (!journaler->is_readable() &&
+	  journaler->get_read_pos() == journaler->get_write_pos())
+	break;
       continue;
-    assert(r);
-    
+    }
+
+    ReplayEntry *e = pending.front();
+    pending.pop_front();
+
+    // wait for it to be decoded, without holding up everyone else
+    if (!e->decoded) {
+      utime_t start = ceph_clock_now(g_ceph_context);
+      mds->mds_lock.Unlock();
+      decode_tp.lock();
+      while (!e->decoded)
+	decode_tp.wait(decode_wq.cond);
+      decode_tp.unlock();
+      mds->mds_lock.Lock();
+      logger->finc(l_mdl_replaywait, ceph_clock_now(g_ceph_context) - start);
+    }
+
+    uint64_t pos = e->pos;
+    bufferlist& bl = e->bl;
+    LogEvent *le = e->le;
+    uint64_t end = e->end;
+    logger->inc(l_mdl_replayev);
+    logger->inc(l_mdl_replaybytes, bl.length());
+
     // unpack event
-    LogEvent *le = LogEvent::decode(bl);
     if (!le) {
       dout(0) << "_replay " << pos << "~" << bl.length() << " / " << journaler->get_write_pos() 
 	      << " -- unable to decode event" << dendl;
@@ -541,6 +592,7 @@ void MDLog::_replay_thread()
       *_dout << dendl;
 
       assert(!!"corrupt log event" == g_conf->mds_log_skip_corrupt_events);
+      delete e;
       continue;
     }
     le->set_start_off(pos);
@@ -561,12 +613,13 @@ void MDLog::_replay_thread()
 	       << " " << le->get_stamp() << ": " << *le << dendl;
       le->_segment = get_current_segment();    // replay may need this
       le->_segment->num_events++;
-      le->_segment->end = journaler->get_read_pos();
+      le->_segment->end = end;
       num_events++;
 
       le->replay(mds);
     }
     delete le;
+    delete e;
 
     logger->set(l_mdl_rdpos, pos);
 
@@ -584,6 +637,14 @@ void MDLog::_replay_thread()
     logger->set(l_mdl_expos, journaler->get_expire_pos());
   }
 
+  assert(pending.empty());
+  if (use_tp) {
+    mds->mds_lock.Unlock();
+    decode_tp.stop();
+    mds->mds_lock.Lock();
+  }
+  journaler->set_prefetch_periods(0);
+
   dout(10) << "_replay_thread kicking waiters" << dendl;
   finish_contexts(g_ceph_context, waitfor_replay, 0);  
 
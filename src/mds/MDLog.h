@@ -34,6 +34,9 @@ enum {
   l_mdl_wrpos,
   l_mdl_rdpos,
   l_mdl_jlat,
+  l_mdl_replayev,
+  l_mdl_replaybytes,
+  l_mdl_replaywait,
   l_mdl_last,
 };
 
@@ -42,6 +45,7 @@ enum {
 
 #include "common/Thread.h"
 #include "common/Cond.h"
+#include "common/WorkQueue.h"
 
 #include "LogSegment.h"
 
@@ -97,6 +101,52 @@ protected:
   void _replay();         // old way
   void _replay_thread();  // new way
 
+  /*
+   * replay pipeline: entries are read off the journal in order, decoded
+   * on the ReplayDecodeWQ threads, and applied one at a time, in order,
+   * under mds_lock.
+   */
+  struct ReplayEntry {
+    uint64_t pos, end;  // extent of the entry in the journal
+    bufferlist bl;
+    LogEvent *le;
+    bool decoded;
+    ReplayEntry(uint64_t p) : pos(p), end(0), le(NULL), decoded(false) {}
+  };
+
+  struct ReplayDecodeWQ : public ThreadPool::WorkQueue<ReplayEntry> {
+    deque<ReplayEntry*> q;
+    Cond cond;  // signalled, under the pool lock, as entries are decoded
+    ReplayDecodeWQ(ThreadPool *tp)
+      : ThreadPool::WorkQueue<ReplayEntry>("MDLog::ReplayDecodeWQ", 600, 0, tp) {}
+
+    bool _enqueue(ReplayEntry *e) {
+      q.push_back(e);
+      return true;
+    }
+    void _dequeue(ReplayEntry *e) {
+      assert(0);
+    }
+    bool _empty() {
+      return q.empty();
+    }
+    ReplayEntry *_dequeue() {
+      if (q.empty())
+	return NULL;
+      ReplayEntry *e = q.front();
+      q.pop_front();
+      return e;
+    }
+    void _process(ReplayEntry *e);
+    void _process_finish(ReplayEntry *e) {
+      e->decoded = true;
+      cond.Signal();
+    }
+    void _clear() {
+      assert(q.empty());
+    }
+  };
+
 
   // -- segments --
   map<uint64_t,LogSegment*> segments;
@@ -60,6 +60,7 @@
 
 #include "messages/MClientRequest.h"
 #include "messages/MClientRequestForward.h"
+#include "messages/MClientCapsBatch.h"
 
 #include "messages/MMDSTableRequest.h"
 
@@ -181,7 +182,7 @@ MDS::~MDS() {
     logger = 0;
   }
   if (mlogger) {
-    g_ceph_context->GetPerfCountersCollection()->logger_remove(logger);
+    g_ceph_context->GetPerfCountersCollection()->logger_remove(mlogger);
     delete mlogger;
     mlogger = 0;
   }
@@ -207,6 +208,7 @@ void MDS::create_logger()
     mds_plb.add_u64_counter(l_mds_fw, "fw");
     
     mds_plb.add_u64_counter(l_mds_dir_f, "dir_f");
+    mds_plb.add_u64_counter(l_mds_dir_fdn, "dir_fdn");
     mds_plb.add_u64_counter(l_mds_dir_c, "dir_c");
     mds_plb.add_u64_counter(l_mds_dir_sp, "dir_sp");
     mds_plb.add_u64_counter(l_mds_dir_ffc, "dir_ffc");
@@ -363,7 +365,8 @@ void MDS::forward_message_mds(Message *m, int mds)
     // NEW: always make the client resend!  
     bool client_must_resend = true;  //!creq->can_forward();
 
-    // tell the client where it should go
+    // tell the client where it should go (after any caps we owe it)
+    flush_client_caps(client_t(creq->get_source().num()));
     messenger->send_message(new MClientRequestForward(creq->get_tid(), mds, creq->get_num_fwd(),
 						      client_must_resend),
 			    creq->get_source_inst());
@@ -418,6 +421,14 @@ void MDS::send_message_client_counted(Message *m, Session *session)
   version_t seq = session->inc_push_seq();
   dout(10) << "send_message_client_counted " << session->inst.name << " seq "
 	   << seq << " " << *m << dendl;
+  if (m->get_type() == CEPH_MSG_CLIENT_CAPS &&
+      g_conf->mds_caps_batch_window > 0 &&
+      session->connection &&
+      session->connection->has_feature(CEPH_FEATURE_CAPS_BATCH)) {
+    queue_client_caps(m, session);
+    return;
+  }
+  flush_client_caps(session);
   if (session->connection) {
     messenger->send_message(m, session->connection);
   } else {
@@ -425,9 +436,68 @@ void MDS::send_message_client_counted(Message *m, Session *session)
   }
 }
 
+class C_MDS_FlushClientCaps : public Context {
+  MDS *mds;
+  client_t client;
+public:
+  C_MDS_FlushClientCaps(MDS *m, client_t c) : mds(m), client(c) {}
+  void finish(int r) {
+    mds->flush_client_caps(client);
+  }
+};
+
+/*
+ * hold a cap message back for up to mds_caps_batch_window, so that a
+ * storm of them (recursive ops, cache trimming) goes out in a few
+ * MClientCapsBatch messages.  anything else sent to the session flushes
+ * the batch first, so the client still sees everything in order (and
+ * push_seq, taken at queue time, still matches).
+ */
+void MDS::queue_client_caps(Message *m, Session *session)
+{
+  if (session->pending_caps.empty())
+    timer.add_event_after(g_conf->mds_caps_batch_window,
+			  new C_MDS_FlushClientCaps(this, session->get_client()));
+  session->pending_caps.push_back(m);
+  if ((int)session->pending_caps.size() >= g_conf->mds_caps_batch_max)
+    flush_client_caps(session);
+}
+
+void MDS::flush_client_caps(Session *session)
+{
+  if (!session || session->pending_caps.empty())
+    return;
+  Message *b;
+  if (session->pending_caps.size() == 1) {
+    b = session->pending_caps.front();
+    session->pending_caps.pop_front();
+  } else {
+    MClientCapsBatch *batch = new MClientCapsBatch;
+    while (!session->pending_caps.empty()) {
+      batch->caps.push_back((MClientCaps*)session->pending_caps.front());
+      session->pending_caps.pop_front();
+    }
+    b = batch;
+  }
+  dout(10) << "flush_client_caps " << session->inst.name << " " << *b << dendl;
+  if (session->connection) {
+    messenger->send_message(b, session->connection);
+  } else {
+    messenger->send_message(b, session->inst);
+  }
+}
+
+void MDS::flush_client_caps(client_t client)
+{
+  entity_name_t n = entity_name_t::CLIENT(client.v);
+  if (sessionmap.have_session(n))
+    flush_client_caps(sessionmap.get_session(n));
+}
+
 void MDS::send_message_client(Message *m, Session *session)
 {
   dout(10) << "send_message_client " << session->inst << " " << *m << dendl;
+  flush_client_caps(session);
  if (session->connection) {
     messenger->send_message(m, session->connection);
   } else {
@@ -1767,6 +1837,7 @@ bool MDS::handle_deferrable_message(Message *m)
     case CEPH_MSG_CLIENT_CAPS:
     case CEPH_MSG_CLIENT_CAPRELEASE:
     case CEPH_MSG_CLIENT_LEASE:
+    case CEPH_MSG_CLIENT_CAPS_BATCH:
       ALLOW_MESSAGES_FROM(CEPH_ENTITY_TYPE_CLIENT);
       locker->dispatch(m);
       break;
@@ -42,6 +42,7 @@ enum {
   l_mds_replyl,
   l_mds_fw,
   l_mds_dir_f,
+  l_mds_dir_fdn,
   l_mds_dir_c,
   l_mds_dir_sp,
   l_mds_dir_ffc,
@@ -347,6 +348,11 @@ class MDS : public Dispatcher {
   void send_message_client(Message *m, Session *session);
   void send_message(Message *m, Connection *c);
 
+  // cap message batching
+  void queue_client_caps(Message *m, Session *session);
+  void flush_client_caps(Session *session);
+  void flush_client_caps(client_t client);
+
   // start up, shutdown
   int init(int wanted_state=MDSMap::STATE_BOOT);
 
@@ -206,6 +206,7 @@ void Server::handle_client_session(MClientSession *m)
 	mds->sessionmap.set_state(session, Session::STATE_OPEN);
 	mds->locker->resume_stale_caps(session);
       }
+      mds->flush_client_caps(session);
       mds->messenger->send_message(new MClientSession(CEPH_SESSION_RENEWCAPS, m->get_seq()), 
 				   m->get_connection());
     } else {
@@ -265,6 +266,7 @@ void Server::_session_logged(Session *session, uint64_t state_seq, bool open, ve
   } else if (open) {
     assert(session->is_opening());
     mds->sessionmap.set_state(session, Session::STATE_OPEN);
+    mds->flush_client_caps(session);
     mds->messenger->send_message(new MClientSession(CEPH_SESSION_OPEN), session->inst);
   } else if (session->is_closing() ||
 	     session->is_killing()) {
@@ -349,6 +351,7 @@ void Server::finish_force_open_sessions(map<client_t,entity_inst_t>& cm,
       } else {
 	dout(10) << "force_open_sessions opened " << session->inst << dendl;
 	mds->sessionmap.set_state(session, Session::STATE_OPEN);
+	mds->flush_client_caps(session);
 	mds->messenger->send_message(new MClientSession(CEPH_SESSION_OPEN), session->inst);
       }
     } else {
@@ -543,6 +546,7 @@ void Server::handle_client_reconnect(MClientReconnect *m)
   }
 
   // notify client of success with an OPEN
+  mds->flush_client_caps(session);
   mds->messenger->send_message(new MClientSession(CEPH_SESSION_OPEN), m->get_connection());
     
   if (session->is_closed()) {
@@ -675,17 +679,17 @@ void Server::recover_filelocks(CInode *in, bufferlist locks, int64_t client)
   for (int i = 0; i < numlocks; ++i) {
     ::decode(lock, p);
     lock.client = client;
-    in->fcntl_locks.held_locks.insert(pair<uint64_t, ceph_filelock>
-				      (lock.start, lock));
-    ++in->fcntl_locks.client_held_lock_counts[client];
+    in->get_fcntl_lock_state()->held_locks.insert(pair<uint64_t, ceph_filelock>
+						  (lock.start, lock));
+    ++in->get_fcntl_lock_state()->client_held_lock_counts[client];
   }
   ::decode(numlocks, p);
   for (int i = 0; i < numlocks; ++i) {
     ::decode(lock, p);
     lock.client = client;
-    in->flock_locks.held_locks.insert(pair<uint64_t, ceph_filelock>
-				      (lock.start, lock));
-    ++in->flock_locks.client_held_lock_counts[client];
+    in->get_flock_lock_state()->held_locks.insert(pair<uint64_t, ceph_filelock>
+						  (lock.start, lock));
+    ++in->get_flock_lock_state()->client_held_lock_counts[client];
   }
 }
 
@@ -818,6 +822,7 @@ void Server::early_reply(MDRequest *mdr, CInode *tracei, CDentry *tracedn)
 		   mdr->client_request->get_dentry_wanted());
   }
 
+  mds->flush_client_caps(mdr->session);  // keep cap msgs ordered before the reply
   messenger->send_message(reply, req->get_connection());
 
   mdr->did_early_reply = true;
@@ -900,6 +905,7 @@ void Server::reply_request(MDRequest *mdr, MClientReply *reply, CInode *tracei,
     }
 
     reply->set_mdsmap_epoch(mds->mdsmap->get_epoch());
+    mds->flush_client_caps(session);  // keep cap msgs ordered before the reply
     messenger->send_message(reply, client_con);
   }
   client_con->put();
@@ -2921,11 +2927,11 @@ void Server::handle_client_file_setlock(MDRequest *mdr)
   // get the appropriate lock state
   switch (req->head.args.filelock_change.rule) {
   case CEPH_LOCK_FLOCK:
-    lock_state = &cur->flock_locks;
+    lock_state = cur->get_flock_lock_state();
     break;
 
   case CEPH_LOCK_FCNTL:
-    lock_state = &cur->fcntl_locks;
+    lock_state = cur->get_fcntl_lock_state();
     break;
 
   default:
@@ -2974,6 +2980,9 @@ void Server::handle_client_file_setlock(MDRequest *mdr)
       reply_request(mdr, 0);
   }
   dout(10) << " state after lock change: " << *lock_state << dendl;
+
+  // free the lock state again if that was the last lock (or a failed try)
+  cur->try_clear_file_locks();
 }
 
 void Server::handle_client_file_readlock(MDRequest *mdr)
@@ -3003,15 +3012,15 @@ void Server::handle_client_file_readlock(MDRequest *mdr)
   checking_lock.pid = req->head.args.filelock_change.pid;
   checking_lock.type = req->head.args.filelock_change.type;
 
-  // get the appropriate lock state
+  // get the appropriate lock state; don't allocate one just to answer
   ceph_lock_state_t *lock_state = NULL;
   switch (req->head.args.filelock_change.rule) {
   case CEPH_LOCK_FLOCK:
-    lock_state = &cur->flock_locks;
+    lock_state = cur->get_flock_lock_state_if_exists();
     break;
 
   case CEPH_LOCK_FCNTL:
-    lock_state = &cur->fcntl_locks;
+    lock_state = cur->get_fcntl_lock_state_if_exists();
     break;
 
   default:
@@ -3019,7 +3028,10 @@ void Server::handle_client_file_readlock(MDRequest *mdr)
 	    << ", dropping request!" << dendl;
     return;
   }
-  lock_state->look_for_lock(checking_lock);
+  if (lock_state)
+    lock_state->look_for_lock(checking_lock);
+  else
+    checking_lock.type = CEPH_LOCK_UNLOCK;  // nothing held, nothing blocks
 
   bufferlist lock_bl;
   ::encode(checking_lock, lock_bl);
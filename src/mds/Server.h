@@ -57,8 +57,10 @@ public:
     terminating_sessions(false) {
   }
   ~Server() {
-    g_ceph_context->GetPerfCountersCollection()->logger_remove(logger);
-    delete logger;
+    if (logger) {
+      g_ceph_context->GetPerfCountersCollection()->logger_remove(logger);
+      delete logger;
+    }
   }
 
   void create_logger();
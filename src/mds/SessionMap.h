@@ -145,6 +145,7 @@ public:
   xlist<Capability*> caps;     // inodes with caps; front=most recently used
   xlist<ClientLease*> leases;  // metadata leases to clients
   utime_t last_cap_renew;
+  list<Message*> pending_caps; // MClientCaps held back for batching (see MDS::queue_client_caps)
 
 public:
   version_t inc_push_seq() { return ++cap_push_seq; }
@@ -289,6 +290,10 @@ public:
     s->get();
   }
   void remove_session(Session *s) {
+    while (!s->pending_caps.empty()) {
+      s->pending_caps.front()->put();
+      s->pending_caps.pop_front();
+    }
     s->trim_completed_requests(0);
     s->item_session_list.remove_myself();
     session_map.erase(s->inst.name);
@@ -0,0 +1,88 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*- 
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2004-2006 Sage Weil <sage@newdream.net>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software 
+ * Foundation.  See file COPYING.
+ * 
+ */
+
+
+#ifndef CEPH_MCLIENTCAPSBATCH_H
+#define CEPH_MCLIENTCAPSBATCH_H
+
+#include "msg/Message.h"
+#include "MClientCaps.h"
+
+/*
+ * cap messages (grants, revokes, flushes, updates, acks) for one
+ * session, held back for a short window and sent together.  the
+ * receiver unpacks them and handles each one, in order, as if it had
+ * arrived on its own.
+ */
+
+struct MClientCapsBatch : public Message {
+  list<MClientCaps*> caps;
+
+  MClientCapsBatch() : Message(CEPH_MSG_CLIENT_CAPS_BATCH) {}
+private:
+  ~MClientCapsBatch() {
+    while (!caps.empty()) {
+      caps.front()->put();
+      caps.pop_front();
+    }
+  }
+
+public:
+  void encode_payload(CephContext *cct) {
+    __u32 n = caps.size();
+    ::encode(n, payload);
+    for (list<MClientCaps*>::iterator p = caps.begin(); p != caps.end(); ++p) {
+      // MClientCaps encoding depends on the peer's features
+      (*p)->set_connection(connection->get());
+      encode_message(cct, *p, payload);
+    }
+  }
+
+  void decode_payload(CephContext *cct) {
+    bufferlist::iterator p = payload.begin();
+    __u32 n;
+    ::decode(n, p);
+    while (n--) {
+      // dropping one would desync the cap seqs; reject the whole batch
+      Message *m = decode_message(cct, p);
+      if (!m)
+	throw buffer::malformed_input("undecodable cap message in batch");
+      if (m->get_type() != CEPH_MSG_CLIENT_CAPS) {
+	m->put();
+	throw buffer::malformed_input("non-cap message in caps batch");
+      }
+      caps.push_back((MClientCaps*)m);
+    }
+  }
+
+  /*
+   * hand each cap message the connection, source and stamp of the
+   * batch, so that it can be handled as if it had arrived alone.
+   */
+  MClientCaps *pop_front() {
+    MClientCaps *m = caps.front();
+    caps.pop_front();
+    m->set_connection(get_connection()->get());
+    m->get_header().src = get_header().src;
+    m->set_recv_stamp(get_recv_stamp());
+    return m;
+  }
+
+  const char *get_type_name() { return "client_caps_batch"; }
+  void print(ostream& out) {
+    out << "client_caps_batch(" << caps.size() << " caps)";
+  }
+};
+
+#endif
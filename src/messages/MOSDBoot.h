@@ -25,12 +25,14 @@ class MOSDBoot : public PaxosServiceMessage {
   OSDSuperblock sb;
   entity_addr_t hb_addr;
   entity_addr_t cluster_addr;
+  uint64_t osd_features;   ///< CEPH_FEATURE_* this osd supports
 
-  MOSDBoot() : PaxosServiceMessage(MSG_OSD_BOOT, 0) { }
+  MOSDBoot() : PaxosServiceMessage(MSG_OSD_BOOT, 0), osd_features(0) { }
   MOSDBoot(OSDSuperblock& s, const entity_addr_t& hb_addr_ref,
-           const entity_addr_t& cluster_addr_ref) :
+           const entity_addr_t& cluster_addr_ref, uint64_t features) :
     PaxosServiceMessage(MSG_OSD_BOOT, s.current_epoch),
-    sb(s), hb_addr(hb_addr_ref), cluster_addr(cluster_addr_ref) { }
+    sb(s), hb_addr(hb_addr_ref), cluster_addr(cluster_addr_ref),
+    osd_features(features) { }
   
 private:
   ~MOSDBoot() { }
@@ -42,11 +44,12 @@ public:
   }
   
   void encode_payload(CephContext *cct) {
-    header.version = 2;
+    header.version = 3;
     paxos_encode();
     ::encode(sb, payload);
     ::encode(hb_addr, payload);
     ::encode(cluster_addr, payload);
+    ::encode(osd_features, payload);
   }
   void decode_payload(CephContext *cct) {
     bufferlist::iterator p = payload.begin();
@@ -55,6 +58,10 @@ public:
     ::decode(hb_addr, p);
     if (header.version >= 2)
       ::decode(cluster_addr, p);
+    if (header.version >= 3)
+      ::decode(osd_features, p);
+    else
+      osd_features = 0;
   }
 };
 
@@ -152,6 +152,7 @@ public:
 
   // flags
   int get_flags() const { return flags; }
+  void add_flags(int f) { flags |= f; }
 
   bool wants_ack() const { return flags & CEPH_OSD_FLAG_ACK; }
   bool wants_ondisk() const { return flags & CEPH_OSD_FLAG_ONDISK; }
@@ -0,0 +1,78 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*- 
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2004-2006 Sage Weil <sage@newdream.net>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software 
+ * Foundation.  See file COPYING.
+ * 
+ */
+
+
+#ifndef CEPH_MOSDOPBATCH_H
+#define CEPH_MOSDOPBATCH_H
+
+#include "msg/Message.h"
+#include "MOSDOp.h"
+
+/*
+ * a batch of small, independent client ops for the same pg (and
+ * primary), coalesced by the Objecter into a single message.  the osd
+ * unpacks them and handles each one as if it had arrived on its own.
+ */
+
+struct MOSDOpBatch : public Message {
+  pg_t pgid;
+  list<MOSDOp*> ops;
+
+  MOSDOpBatch() : Message(MSG_OSD_OP_BATCH) {}
+  MOSDOpBatch(pg_t p) : Message(MSG_OSD_OP_BATCH), pgid(p) {}
+private:
+  ~MOSDOpBatch() {
+    while (!ops.empty()) {
+      ops.front()->put();
+      ops.pop_front();
+    }
+  }
+
+public:
+  void encode_payload(CephContext *cct) {
+    ::encode(pgid, payload);
+    __u32 n = ops.size();
+    ::encode(n, payload);
+    for (list<MOSDOp*>::iterator p = ops.begin(); p != ops.end(); ++p) {
+      // MOSDOp encoding depends on the peer's features
+      (*p)->set_connection(connection->get());
+      encode_message(cct, *p, payload);
+    }
+  }
+
+  void decode_payload(CephContext *cct) {
+    bufferlist::iterator p = payload.begin();
+    ::decode(pgid, p);
+    __u32 n;
+    ::decode(n, p);
+    while (n--) {
+      // the client waits for a reply to every op; reject the whole batch
+      Message *m = decode_message(cct, p);
+      if (!m)
+	throw buffer::malformed_input("undecodable op in batch");
+      if (m->get_type() != CEPH_MSG_OSD_OP) {
+	m->put();
+	throw buffer::malformed_input("non-op message in op batch");
+      }
+      ops.push_back((MOSDOp*)m);
+    }
+  }
+
+  const char *get_type_name() { return "osd_op_batch"; }
+  void print(ostream& out) {
+    out << "osd_op_batch(" << pgid << " " << ops.size() << " ops)";
+  }
+};
+
+#endif
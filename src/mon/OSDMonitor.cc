@@ -554,6 +554,14 @@ bool OSDMonitor::preprocess_boot(MOSDBoot *m)
   }
 
   assert(m->get_orig_source_inst().name.is_osd());
+
+  // an osd that can't serve a cache tier must not join while one is in use
+  if ((m->osd_features & CEPH_FEATURE_OSD_CACHEPOOL) == 0 &&
+      osdmap.have_cache_overlay()) {
+    dout(0) << "preprocess_boot " << m->get_orig_source_inst()
+	    << " lacks the cache pool feature and a pool has an overlay" << dendl;
+    goto ignore;
+  }
   
   // already booted?
   if (osdmap.is_up(from) &&
@@ -610,6 +618,7 @@ bool OSDMonitor::prepare_boot(MOSDBoot *m)
       down_pending_out.erase(from);  // if any
 
     pending_inc.new_up_client[from] = m->get_orig_source_addr();
+    pending_inc.new_up_features[from] = m->osd_features;
     if (!m->cluster_addr.is_blank_ip())
       pending_inc.new_up_internal[from] = m->cluster_addr;
     pending_inc.new_hb_up[from] = m->hb_addr;
@@ -1833,6 +1842,158 @@ bool OSDMonitor::prepare_command(MMonCommand *m)
 	goto out;
       }
     }
+    else if (m->cmd[1] == "tier" && m->cmd.size() >= 4) {
+      int64_t pool = osdmap.lookup_pg_pool_name(m->cmd[3].c_str());
+      if (pool < 0) {
+	ss << "unrecognized pool '" << m->cmd[3] << "'";
+	err = -ENOENT;
+	goto out;
+      }
+      const pg_pool_t *p = get_pending_pool(pool);
+      if (m->cmd[2] == "add" || m->cmd[2] == "remove" ||
+	  m->cmd[2] == "set-overlay") {
+	if (m->cmd.size() != 5) {
+	  ss << "usage: osd tier " << m->cmd[2] << " <pool> <tierpool>";
+	  err = -EINVAL;
+	  goto out;
+	}
+	int64_t tierpool = osdmap.lookup_pg_pool_name(m->cmd[4].c_str());
+	if (tierpool < 0) {
+	  ss << "unrecognized pool '" << m->cmd[4] << "'";
+	  err = -ENOENT;
+	  goto out;
+	}
+	const pg_pool_t *tp = get_pending_pool(tierpool);
+	if (m->cmd[2] == "add") {
+	  if (tierpool == pool || p->is_tier() || tp->is_tier() || tp->has_tiers()) {
+	    ss << "pool '" << m->cmd[4] << "' can not be a tier of '" << m->cmd[3]
+	       << "': tiers do not nest";
+	    err = -EINVAL;
+	    goto out;
+	  }
+	  if (tp->has_snaps()) {
+	    ss << "pool '" << m->cmd[4] << "' has snapshots; a cache tier can not";
+	    err = -ENOTEMPTY;
+	    goto out;
+	  }
+	  // the tiering agent writes back with an empty SnapContext
+	  if (p->has_snaps()) {
+	    ss << "pool '" << m->cmd[3] << "' has snapshots; it can not have a cache tier";
+	    err = -EINVAL;
+	    goto out;
+	  }
+	  if (mon->pgmon()->pg_map.pg_pool_sum[tierpool].stats.sum.num_objects) {
+	    ss << "pool '" << m->cmd[4] << "' is not empty";
+	    err = -ENOTEMPTY;
+	    goto out;
+	  }
+	  pg_pool_t *np = prepare_pending_pool(pool);
+	  pg_pool_t *ntp = prepare_pending_pool(tierpool);
+	  np->tiers.insert(tierpool);
+	  ntp->tier_of = pool;
+	  ntp->cache_mode = pg_pool_t::CACHEMODE_NONE;
+	  ntp->hit_set_period = g_conf->osd_tier_default_hit_set_period;
+	  ntp->hit_set_count = g_conf->osd_tier_default_hit_set_count;
+	  ntp->cache_min_flush_age = g_conf->osd_tier_default_cache_min_flush_age;
+	  ntp->cache_min_evict_age = g_conf->osd_tier_default_cache_min_evict_age;
+	  ss << "pool '" << m->cmd[4] << "' is now a tier of '" << m->cmd[3] << "'";
+	} else if (m->cmd[2] == "remove") {
+	  if (tp->tier_of != pool) {
+	    ss << "pool '" << m->cmd[4] << "' is not a tier of '" << m->cmd[3] << "'";
+	    err = -ENOENT;
+	    goto out;
+	  }
+	  if (p->read_tier == tierpool || p->write_tier == tierpool) {
+	    ss << "pool '" << m->cmd[4] << "' is the overlay of '" << m->cmd[3]
+	       << "'; remove the overlay first";
+	    err = -EBUSY;
+	    goto out;
+	  }
+	  // dirty objects would be lost with the tier
+	  if (mon->pgmon()->pg_map.pg_pool_sum[tierpool].stats.sum.num_objects) {
+	    ss << "pool '" << m->cmd[4] << "' is not empty; set cache-mode "
+	       << "forward and wait for it to drain";
+	    err = -ENOTEMPTY;
+	    goto out;
+	  }
+	  pg_pool_t *np = prepare_pending_pool(pool);
+	  pg_pool_t *ntp = prepare_pending_pool(tierpool);
+	  np->tiers.erase(tierpool);
+	  ntp->clear_tier();
+	  ss << "pool '" << m->cmd[4] << "' is no longer a tier of '" << m->cmd[3] << "'";
+	} else {
+	  if (tp->tier_of != pool) {
+	    ss << "pool '" << m->cmd[4] << "' is not a tier of '" << m->cmd[3] << "'";
+	    err = -ENOENT;
+	    goto out;
+	  }
+	  if (tp->cache_mode == pg_pool_t::CACHEMODE_NONE) {
+	    ss << "pool '" << m->cmd[4] << "' has cache mode none; set one first";
+	    err = -EINVAL;
+	    goto out;
+	  }
+	  if ((osdmap.get_common_osd_features() & CEPH_FEATURE_OSD_CACHEPOOL) == 0) {
+	    ss << "not all osds support cache pools; upgrade (and restart) them first";
+	    err = -EOPNOTSUPP;
+	    goto out;
+	  }
+	  pg_pool_t *np = prepare_pending_pool(pool);
+	  np->read_tier = np->write_tier = tierpool;
+	  ss << "overlay for '" << m->cmd[3] << "' is now '" << m->cmd[4] << "'";
+	}
+      } else if (m->cmd[2] == "remove-overlay" && m->cmd.size() == 4) {
+	if (!p->has_read_tier() && !p->has_write_tier()) {
+	  ss << "pool '" << m->cmd[3] << "' has no overlay";
+	  err = -ENOENT;
+	  goto out;
+	}
+	// clients would then go straight to the base and miss whatever
+	// the tier has not flushed yet
+	int64_t overlay = p->has_write_tier() ? p->write_tier : p->read_tier;
+	if (mon->pgmon()->pg_map.pg_pool_sum[overlay].stats.sum.num_objects) {
+	  ss << "pool '" << osdmap.get_pool_name(overlay) << "' is not empty; "
+	     << "set cache-mode forward and wait for it to drain";
+	  err = -ENOTEMPTY;
+	  goto out;
+	}
+	pg_pool_t *np = prepare_pending_pool(pool);
+	np->read_tier = np->write_tier = -1;
+	ss << "there is now no overlay for '" << m->cmd[3] << "'";
+      } else if (m->cmd[2] == "cache-mode" && m->cmd.size() == 5) {
+	int mode = pg_pool_t::get_cache_mode_from_str(m->cmd[4]);
+	if (mode < 0) {
+	  ss << "unrecognized cache mode '" << m->cmd[4] << "'";
+	  err = -EINVAL;
+	  goto out;
+	}
+	if (!p->is_tier()) {
+	  ss << "pool '" << m->cmd[3] << "' is not a tier";
+	  err = -EINVAL;
+	  goto out;
+	}
+	// with no caching, the overlay would send io to a pool that may
+	// not have the objects
+	const pg_pool_t *bp = get_pending_pool(p->tier_of);
+	if (mode == pg_pool_t::CACHEMODE_NONE &&
+	    (bp->read_tier == pool || bp->write_tier == pool)) {
+	  ss << "pool '" << m->cmd[3] << "' is an overlay; remove the overlay first";
+	  err = -EBUSY;
+	  goto out;
+	}
+	prepare_pending_pool(pool)->cache_mode = mode;
+	ss << "set cache mode of '" << m->cmd[3] << "' to "
+	   << pg_pool_t::get_cache_mode_name(mode);
+      } else {
+	ss << "usage: osd tier add|remove|set-overlay <pool> <tierpool>, "
+	   << "osd tier remove-overlay <pool>, "
+	   << "osd tier cache-mode <tierpool> none|writeback|forward";
+	err = -EINVAL;
+	goto out;
+      }
+      getline(ss, rs);
+      paxos->wait_for_commit(new Monitor::C_Command(mon, m, 0, rs, paxos->get_version()));
+      return true;
+    }
     else if (m->cmd[1] == "pool" && m->cmd.size() >= 3) {
       if (m->cmd.size() >= 5 && m->cmd[2] == "mksnap") {
 	int64_t pool = osdmap.lookup_pg_pool_name(m->cmd[3].c_str());
@@ -1845,7 +2006,11 @@ bool OSDMonitor::prepare_command(MMonCommand *m)
 	  if (pending_inc.new_pools.count(pool))
 	    pp = &pending_inc.new_pools[pool];
 	  const string& snapname = m->cmd[4];
-	  if (p->snap_exists(snapname.c_str()) ||
+	  const pg_pool_t *tp = get_pending_pool(pool);
+	  if (tp->is_tier() || tp->has_tiers()) {
+	    ss << "pool " << m->cmd[3] << " is in a cache tier; it can not have snaps";
+	    err = -EINVAL;
+	  } else if (p->snap_exists(snapname.c_str()) ||
 	      (pp && pp->snap_exists(snapname.c_str()))) {
 	    ss << "pool " << m->cmd[3] << " snap " << snapname << " already exists";
 	    err = -EEXIST;
@@ -1916,6 +2081,8 @@ bool OSDMonitor::prepare_command(MMonCommand *m)
 	  int ret = _prepare_remove_pool(pool);
 	  if (ret == 0)
 	    ss << "pool '" << m->cmd[3] << "' deleted";
+	  else if (ret == -EBUSY)
+	    ss << "pool '" << m->cmd[3] << "' is in a cache tier; osd tier remove it first";
 	  getline(ss, rs);
 	  paxos->wait_for_commit(new Monitor::C_Command(mon, m, ret, rs, paxos->get_version()));
 	  return true;
@@ -1933,6 +2100,33 @@ bool OSDMonitor::prepare_command(MMonCommand *m)
 	} else {
 	  const pg_pool_t *p = osdmap.get_pg_pool(pool);
 	  unsigned n = atoi(m->cmd[5].c_str());
+	  if (m->cmd[4] == "hit_set_period" ||
+	      m->cmd[4] == "hit_set_count" ||
+	      m->cmd[4] == "target_max_objects" ||
+	      m->cmd[4] == "cache_min_flush_age" ||
+	      m->cmd[4] == "cache_min_evict_age") {
+	    // zero is meaningful for all of these
+	    if (!get_pending_pool(pool)->is_tier()) {
+	      ss << "pool '" << m->cmd[3] << "' is not a tier";
+	      err = -EINVAL;
+	      goto out;
+	    }
+	    pg_pool_t *np = prepare_pending_pool(pool);
+	    if (m->cmd[4] == "hit_set_period")
+	      np->hit_set_period = n;
+	    else if (m->cmd[4] == "hit_set_count")
+	      np->hit_set_count = n;
+	    else if (m->cmd[4] == "target_max_objects")
+	      np->target_max_objects = strtoull(m->cmd[5].c_str(), NULL, 10);
+	    else if (m->cmd[4] == "cache_min_flush_age")
+	      np->cache_min_flush_age = n;
+	    else
+	      np->cache_min_evict_age = n;
+	    ss << "set pool " << pool << " " << m->cmd[4] << " to " << m->cmd[5];
+	    getline(ss, rs);
+	    paxos->wait_for_commit(new Monitor::C_Command(mon, m, 0, rs, paxos->get_version()));
+	    return true;
+	  }
 	  if (n) {
 	    if (m->cmd[4] == "size") {
 	      pending_inc.new_pools[pool] = *p;
@@ -2152,6 +2346,13 @@ bool OSDMonitor::prepare_pool_op(MPoolOp *m)
   else
     pp = *osdmap.get_pg_pool(m->pool);
 
+  // cache tiers copy objects between pools without a SnapContext
+  if ((m->op == POOL_OP_CREATE_SNAP || m->op == POOL_OP_CREATE_UNMANAGED_SNAP) &&
+      (pp.is_tier() || pp.has_tiers())) {
+    ret = -EINVAL;
+    goto out;
+  }
+
   // pool snaps vs unmanaged snaps are mutually exclusive
   switch (m->op) {
   case POOL_OP_CREATE_SNAP:
@@ -2229,6 +2430,20 @@ bool OSDMonitor::prepare_pool_op_create(MPoolOp *m)
   return true;
 }
 
+const pg_pool_t *OSDMonitor::get_pending_pool(int64_t pool)
+{
+  if (pending_inc.new_pools.count(pool))
+    return &pending_inc.new_pools[pool];
+  return osdmap.get_pg_pool(pool);
+}
+
+pg_pool_t *OSDMonitor::prepare_pending_pool(int64_t pool)
+{
+  if (!pending_inc.new_pools.count(pool))
+    pending_inc.new_pools[pool] = *osdmap.get_pg_pool(pool);
+  return &pending_inc.new_pools[pool];
+}
+
 int OSDMonitor::_prepare_remove_pool(uint64_t pool)
 {
     dout(10) << "_prepare_remove_pool " << pool << dendl;
@@ -2236,6 +2451,11 @@ int OSDMonitor::_prepare_remove_pool(uint64_t pool)
     dout(10) << "_prepare_remove_pool " << pool << " pending removal" << dendl;    
     return -ENOENT;  // already removed
   }
+  const pg_pool_t *p = osdmap.get_pg_pool(pool);
+  if (p && (p->is_tier() || p->has_tiers())) {
+    dout(10) << "_prepare_remove_pool " << pool << " is in a cache tier" << dendl;
+    return -EBUSY;  // osd tier remove first
+  }
   pending_inc.old_pools.insert(pool);
 
   // remove any pg_temp mappings for this pool too
@@ -91,6 +91,10 @@ private:
   bool prepare_pgtemp(class MOSDPGTemp *m);
 
   int _prepare_remove_pool(uint64_t pool);
+  /// the pool as the pending map will have it
+  const pg_pool_t *get_pending_pool(int64_t pool);
+  /// the same, copied into the pending map so it can be changed
+  pg_pool_t *prepare_pending_pool(int64_t pool);
 
   bool preprocess_pool_op ( class MPoolOp *m);
   bool preprocess_pool_op_create ( class MPoolOp *m);
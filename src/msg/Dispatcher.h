@@ -33,6 +33,18 @@ public:
   // how i receive messages
   virtual bool ms_dispatch(Message *m) = 0;
 
+  /*
+   * fast dispatch.  messages we claim here are handed to ms_fast_dispatch
+   * straight from the connection's reader thread instead of going through
+   * the messenger's dispatch queue, as long as nothing else from that
+   * connection is still queued or being dispatched (so per-connection
+   * ordering holds).  ms_can_fast_dispatch is called with the pipe locked
+   * and must only look at the message type; ms_fast_dispatch stalls reads
+   * on the connection until it returns, so it should not block for long.
+   */
+  virtual bool ms_can_fast_dispatch(Message *m) { return false; }
+  virtual void ms_fast_dispatch(Message *m) { assert(0); }
+
   // after a connection connects
   virtual void ms_handle_connect(Connection *con) { };
 
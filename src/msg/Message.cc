@@ -44,6 +44,7 @@ using namespace std;
 #include "messages/MOSDFailure.h"
 #include "messages/MOSDPing.h"
 #include "messages/MOSDOp.h"
+#include "messages/MOSDOpBatch.h"
 #include "messages/MOSDOpReply.h"
 #include "messages/MOSDSubOp.h"
 #include "messages/MOSDSubOpReply.h"
@@ -79,6 +80,7 @@ using namespace std;
 #include "messages/MClientReply.h"
 #include "messages/MClientCaps.h"
 #include "messages/MClientCapRelease.h"
+#include "messages/MClientCapsBatch.h"
 #include "messages/MClientLease.h"
 #include "messages/MClientSnap.h"
 
@@ -285,6 +287,9 @@ Message *decode_message(CephContext *cct, ceph_msg_header& header, ceph_msg_foot
   case CEPH_MSG_OSD_OPREPLY:
     m = new MOSDOpReply();
     break;
+  case MSG_OSD_OP_BATCH:
+    m = new MOSDOpBatch();
+    break;
   case MSG_OSD_SUBOP:
     m = new MOSDSubOp();
     break;
@@ -374,6 +379,9 @@ Message *decode_message(CephContext *cct, ceph_msg_header& header, ceph_msg_foot
   case CEPH_MSG_CLIENT_CAPRELEASE:
     m = new MClientCapRelease;
     break;
+  case CEPH_MSG_CLIENT_CAPS_BATCH:
+    m = new MClientCapsBatch;
+    break;
   case CEPH_MSG_CLIENT_LEASE:
     m = new MClientLease;
     break;
@@ -75,6 +75,7 @@
 #define MSG_OSD_SCRUB          91
 #define MSG_OSD_PG_MISSING     92
 #define MSG_OSD_REP_SCRUB      93
+#define MSG_OSD_OP_BATCH       94
 
 
 
@@ -280,15 +281,19 @@ protected:
   // currently throttled.
   uint64_t dispatch_throttle_size;
 
+  // per-op state of whoever is tracking this message through the
+  // daemon (see OpTracker); we hold a ref.
+  RefCountedObject *tracked;
+
   friend class Messenger;
 
 public:
-  Message() : connection(NULL), dispatch_throttle_size(0) {
+  Message() : connection(NULL), dispatch_throttle_size(0), tracked(NULL) {
     memset(&header, 0, sizeof(header));
     memset(&footer, 0, sizeof(footer));
     throttler = NULL;
   };
-  Message(int t) : connection(NULL), dispatch_throttle_size(0) {
+  Message(int t) : connection(NULL), dispatch_throttle_size(0), tracked(NULL) {
     memset(&header, 0, sizeof(header));
     header.type = t;
     header.version = 1;
@@ -309,6 +314,8 @@ protected:
       connection->put();
     if (throttler)
       throttler->put(payload.length() + middle.length() + data.length());
+    if (tracked)
+      tracked->put();
   }
 public:
   Connection *get_connection() { return connection; }
@@ -318,6 +325,14 @@ public:
     connection = c;
   }
   void set_throttler(Throttle *t) { throttler = t; }
+
+  /// the tracked state is set once, before the message is shared, and
+  /// lives as long as the message; no ref is taken for the caller.
+  RefCountedObject *get_tracked() { return tracked; }
+  void set_tracked(RefCountedObject *t) {
+    assert(!tracked);
+    tracked = t;
+  }
   Throttle *get_throttler() { return throttler; }
  
   void set_dispatch_throttle_size(uint64_t s) { dispatch_throttle_size = s; }
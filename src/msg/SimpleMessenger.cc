@@ -187,7 +187,6 @@ int SimpleMessenger::Accepter::start()
 
 void *SimpleMessenger::Accepter::entry()
 {
-  const md_config_t *conf = msgr->cct->_conf;
   ldout(msgr->cct,10) << "accepter starting" << dendl;
   
   int errors = 0;
@@ -218,14 +217,8 @@ void *SimpleMessenger::Accepter::entry()
       errors = 0;
       ldout(msgr->cct,10) << "accepted incoming on sd " << sd << dendl;
       
-      // disable Nagle algorithm?
-      if (conf->ms_tcp_nodelay) {
-	int flag = 1;
-	int r = ::setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(flag));
-	if (r < 0)
-	  ldout(msgr->cct,0) << "accepter could't set TCP_NODELAY: " << strerror_r(errno, buf, sizeof(buf)) << dendl;
-      }
-      
+      msgr->set_socket_options(sd);
+
       msgr->lock.Lock();
 
       if (!msgr->destination_stopped) {
@@ -278,39 +271,55 @@ void SimpleMessenger::Accepter::stop()
 /*
  * This function delivers incoming messages to the Messenger.
  * Pipes with messages are kept in queues; when beginning a message
- * delivery the highest-priority queue is selected, the pipe from the
- * front of the queue is removed, and its message read. If the pipe
- * has remaining messages at that priority level, it is re-placed on to the
- * end of the queue. If the queue is empty; it's removed.
- * The message is then delivered and the process starts again.
+ * delivery the highest-priority queue is selected, the first pipe in it
+ * that no other dispatch thread is delivering from is removed, and its
+ * message read. If the pipe has remaining messages at that priority level,
+ * it is re-placed on to the end of the queue. If the queue is empty; it's
+ * removed.
+ * The message is then delivered and the process starts again.  With one
+ * dispatch thread the chosen pipe is always the first one.
  */
 void SimpleMessenger::dispatch_entry()
 {
   dispatch_queue.lock.Lock();
   while (!dispatch_queue.stop) {
     while (!dispatch_queue.queued_pipes.empty() && !dispatch_queue.stop) {
-      //get highest-priority pipe
-      map<int, xlist<Pipe *>* >::reverse_iterator high_iter =
-	dispatch_queue.queued_pipes.rbegin();
-      int priority = high_iter->first;
-      xlist<Pipe *> *pipe_list = high_iter->second;
+      //get highest-priority pipe that isn't busy
+      Pipe *pipe = NULL;
+      int priority = 0;
+      xlist<Pipe *> *pipe_list = NULL;
+      for (map<int, xlist<Pipe *>* >::reverse_iterator p =
+	     dispatch_queue.queued_pipes.rbegin();
+	   p != dispatch_queue.queued_pipes.rend() && !pipe;
+	   ++p) {
+	for (xlist<Pipe *>::iterator q = p->second->begin(); !q.end(); ++q) {
+	  if (!(*q)->delivering) {
+	    pipe = *q;
+	    priority = p->first;
+	    pipe_list = p->second;
+	    break;
+	  }
+	}
+      }
+      if (!pipe)
+	break;  // everything queued is already being delivered
 
-      Pipe *pipe = pipe_list->front();
       //move pipe to back of line -- or just take off if no more messages
       pipe->pipe_lock.Lock();
       list<Message *>& m_queue = pipe->in_q[priority];
       Message *m = m_queue.front();
       m_queue.pop_front();
 
-      if (m_queue.empty()) {
-	pipe_list->pop_front();  // pipe is done
-	if (pipe_list->empty()) {
-	  delete pipe_list;
-	  dispatch_queue.queued_pipes.erase(priority);
-	}
-      } else {
-	pipe_list->push_back(pipe->queue_items[priority]);  // move to end of list
+      xlist<Pipe *>::item *item = pipe->queue_items[priority];
+      item->remove_myself();
+      if (!m_queue.empty())
+	pipe_list->push_back(item);  // move to end of list
+      if (pipe_list->empty()) {
+	delete pipe_list;
+	dispatch_queue.queued_pipes.erase(priority);
       }
+      pipe->delivering = true;
+      pipe->get();
       ldout(cct,20) << "dispatch_entry pipe " << pipe << " dequeued " << m << dendl;
       dispatch_queue.lock.Unlock(); //done with the pipe queue for a while
 
@@ -361,24 +370,76 @@ void SimpleMessenger::dispatch_entry()
 	}
       }
       dispatch_queue.lock.Lock();
+      pipe->pipe_lock.Lock();
+      pipe->delivering = false;
+      bool more = pipe->in_qlen > 0;
+      pipe->pipe_lock.Unlock();
+      pipe->put();
+      if (more && num_dispatch_threads > 1)
+	dispatch_queue.cond.Signal();  // others may have skipped it while we had it
     }
     if (!dispatch_queue.stop)
       dispatch_queue.cond.Wait(dispatch_queue.lock); //wait for something to be put on queue
   }
+  bool last = --dispatch_queue.running == 0;
   dispatch_queue.lock.Unlock();
 
   //tell everything else it's time to stop
-  lock.Lock();
-  destination_stopped = true;
-  wait_cond.Signal();
-  lock.Unlock();
+  if (last) {
+    lock.Lock();
+    destination_stopped = true;
+    wait_cond.Signal();
+    lock.Unlock();
+  }
+}
+
+/*
+ * Deliver a message the dispatchers asked for early, from the pipe's
+ * reader thread, bypassing the dispatch queue.
+ */
+void SimpleMessenger::fast_dispatch(Message *m)
+{
+  m->set_recv_stamp(ceph_clock_now(cct));
+  uint64_t msize = m->get_dispatch_throttle_size();
+  m->set_dispatch_throttle_size(0);
+
+  ldout(cct,1) << "<== " << m->get_source_inst()
+	       << " " << m->get_seq()
+	       << " ==== " << *m
+	       << " ==== " << m->get_payload().length() << "+" << m->get_middle().length()
+	       << "+" << m->get_data().length()
+	       << " (" << m->get_footer().front_crc << " " << m->get_footer().middle_crc
+	       << " " << m->get_footer().data_crc << ")"
+	       << " " << m << " con " << m->get_connection()
+	       << " (fast)" << dendl;
+  ms_deliver_fast_dispatch(m);
+
+  dispatch_throttle_release(msize);
+}
+
+bool SimpleMessenger::is_dispatch_thread()
+{
+  for (vector<DispatchThread*>::iterator p = dispatch_threads.begin();
+       p != dispatch_threads.end();
+       ++p)
+    if ((*p)->am_self())
+      return true;
+  return false;
 }
 
 void SimpleMessenger::ready()
 {
-  ldout(cct,10) << "ready " << get_myaddr() << dendl;
-  assert(!dispatch_thread.is_started());
-  dispatch_thread.create();
+  ldout(cct,10) << "ready " << get_myaddr() << " with " << num_dispatch_threads
+		<< " dispatch threads" << dendl;
+  assert(dispatch_threads.empty());
+  dispatch_queue.lock.Lock();
+  dispatch_queue.running = num_dispatch_threads;
+  dispatch_queue.lock.Unlock();
+  for (int i = 0; i < num_dispatch_threads; i++) {
+    DispatchThread *t = new DispatchThread(this);
+    dispatch_threads.push_back(t);
+    t->create();
+  }
 }
 
 
@@ -386,17 +447,16 @@ int SimpleMessenger::shutdown()
 {
   ldout(cct,10) << "shutdown " << get_myaddr() << dendl;
 
-  // stop my dispatch thread
-  if (dispatch_thread.am_self()) {
+  // stop my dispatch threads.  a dispatch thread never holds the queue
+  // lock while it delivers, so it is safe to take it here either way.
+  if (is_dispatch_thread())
     ldout(cct,10) << "shutdown i am dispatch, setting stop flag" << dendl;
-    dispatch_queue.stop = true;
-  } else {
+  else
     ldout(cct,10) << "shutdown i am not dispatch, setting stop flag and joining thread." << dendl;
-    dispatch_queue.lock.Lock();
-    dispatch_queue.stop = true;
-    dispatch_queue.cond.Signal();
-    dispatch_queue.lock.Unlock();
-  }
+  dispatch_queue.lock.Lock();
+  dispatch_queue.stop = true;
+  dispatch_queue.cond.Signal();
+  dispatch_queue.lock.Unlock();
   return 0;
 }
 
@@ -566,7 +626,8 @@ void SimpleMessenger::Pipe::queue_received(Message *m, int priority)
       ldout(msgr->cct,20) << "queue_received queuing pipe" << dendl;
       if (!queue_items.count(priority)) 
 	queue_items[priority] = new xlist<Pipe *>::item(this);
-      if (msgr->dispatch_queue.queued_pipes.empty())
+      if (msgr->dispatch_queue.queued_pipes.empty() ||
+	  msgr->num_dispatch_threads > 1)
 	msgr->dispatch_queue.cond.Signal();
 
       map<int, xlist<Pipe*>*>::iterator p = msgr->dispatch_queue.queued_pipes.find(priority);
@@ -1018,7 +1079,6 @@ int SimpleMessenger::Pipe::connect()
   entity_addr_t peer_addr_for_me, socket_addr;
   AuthAuthorizer *authorizer = NULL;
   bufferlist addrbl, myaddrbl;
-  const md_config_t *conf = msgr->cct->_conf;
 
   // close old socket.  this is safe because we stopped the reader thread above.
   if (sd >= 0)
@@ -1044,13 +1104,7 @@ int SimpleMessenger::Pipe::connect()
     goto fail;
   }
 
-  // disable Nagle algorithm?
-  if (conf->ms_tcp_nodelay) {
-    int flag = 1;
-    int r = ::setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(flag));
-    if (r < 0) 
-      ldout(msgr->cct,0) << "connect couldn't set TCP_NODELAY: " << strerror_r(errno, buf, sizeof(buf)) << dendl;
-  }
+  msgr->set_socket_options(sd);
 
   // verify banner
   // FIXME: this should be non-blocking, or in some other way verify the banner as we get it.
@@ -1637,6 +1691,16 @@ void SimpleMessenger::Pipe::reader()
       ldout(msgr->cct,10) << "reader got message "
 	       << m->get_seq() << " " << m << " " << *m
 	       << dendl;
+
+      // nothing of ours ahead of it in the dispatch queue?  then it can
+      // skip the queue without being reordered.
+      if (in_qlen == 0 && !delivering && !halt_delivery &&
+	  !msgr->dispatch_queue.stop && msgr->ms_can_fast_dispatch(m)) {
+	pipe_lock.Unlock();
+	msgr->fast_dispatch(m);
+	pipe_lock.Lock();
+	continue;
+      }
       queue_received(m);
     } 
     
@@ -2329,6 +2393,29 @@ void SimpleMessenger::queue_reap(Pipe *pipe)
   lock.Unlock();
 }
 
+void SimpleMessenger::set_socket_options(int sd)
+{
+  char buf[80];
+
+  // disable Nagle algorithm?
+  if (cct->_conf->ms_tcp_nodelay) {
+    int flag = 1;
+    int r = ::setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(flag));
+    if (r < 0)
+      ldout(cct,0) << "couldn't set TCP_NODELAY: " << strerror_r(errno, buf, sizeof(buf)) << dendl;
+  }
+  if (sockbuf > 0) {
+    int r = ::setsockopt(sd, SOL_SOCKET, SO_SNDBUF, (char*)&sockbuf, sizeof(sockbuf));
+    if (r < 0)
+      ldout(cct,0) << "couldn't set SO_SNDBUF to " << sockbuf << ": "
+		   << strerror_r(errno, buf, sizeof(buf)) << dendl;
+    r = ::setsockopt(sd, SOL_SOCKET, SO_RCVBUF, (char*)&sockbuf, sizeof(sockbuf));
+    if (r < 0)
+      ldout(cct,0) << "couldn't set SO_RCVBUF to " << sockbuf << ": "
+		   << strerror_r(errno, buf, sizeof(buf)) << dendl;
+  }
+}
+
 
 
 int SimpleMessenger::bind(entity_addr_t bind_addr, int64_t nonce)
@@ -61,7 +61,10 @@ using namespace __gnu_cxx;
   CEPH_FEATURE_DIRLAYOUTHASH |   \
   CEPH_FEATURE_OBJECTLOCATOR |	 \
   CEPH_FEATURE_PGID64 |		 \
-  CEPH_FEATURE_INCSUBOSDMAP
+  CEPH_FEATURE_INCSUBOSDMAP |	 \
+  CEPH_FEATURE_OSD_OPBATCH |	 \
+  CEPH_FEATURE_CAPS_BATCH |	 \
+  CEPH_FEATURE_OSD_CACHEPOOL
 
 class SimpleMessenger : public Messenger {
 public:
@@ -150,6 +153,7 @@ private:
     map<int, list<Message*> > in_q; // and inbound ones
     int in_qlen;
     map<int, xlist<Pipe *>::item* > queue_items; // protected by pipe_lock AND q.lock
+    bool delivering;  // a dispatch thread has one of our messages; ditto
     list<Message*> sent;
     Cond cond;
     bool keepalive;
@@ -228,7 +232,7 @@ private:
       state(st), 
       connection_state(new Connection),
       reader_running(false), reader_joining(false), writer_running(false),
-      in_qlen(0), keepalive(false), halt_delivery(false), 
+      in_qlen(0), delivering(false), keepalive(false), halt_delivery(false), 
       close_on_empty(false), disposable(false),
       connect_seq(0), peer_global_seq(0),
       out_seq(0), in_seq(0), in_seq_acked(0),
@@ -380,6 +384,8 @@ private:
     list<Connection*> remote_reset_q;
     list<Connection*> reset_q;
 
+    int running;   // dispatch threads that have not exited yet
+
     Pipe *local_pipe;
     void local_delivery(Message *m, int priority) {
       local_pipe->pipe_lock.Lock();
@@ -416,6 +422,7 @@ private:
       lock("SimpleMessenger::DispatchQeueu::lock"), 
       stop(false),
       qlen(0),
+      running(0),
       local_pipe(NULL)
     {}
     ~DispatchQueue() {
@@ -449,6 +456,7 @@ private:
   hash_map<entity_addr_t, Pipe*> rank_pipe;
  
   int my_type;
+  int sockbuf;    // SO_SNDBUF/SO_RCVBUF, or 0 for the kernel's default
 
 
   // --- policy ---
@@ -471,6 +479,17 @@ private:
     get_policy(type).throttler = t;
   }
 
+  /**
+   * Give our sockets fixed buffers of this many bytes instead of letting
+   * the kernel autotune them.  Call before start().  Useful for
+   * messengers that only carry small, latency-sensitive messages (like
+   * heartbeats), where deep buffers only hide a stalled peer.
+   */
+  void set_socket_buffer_size(int bytes) {
+    sockbuf = bytes;
+  }
+  void set_socket_options(int sd);
+
   // --- pipes ---
   set<Pipe*>      pipes;
   list<Pipe*>     pipe_reap_queue;
@@ -512,8 +531,14 @@ private:
 
   /***** Messenger-required functions  **********/
   void destroy() {
-    if (dispatch_thread.is_started())
-      dispatch_thread.join();
+    for (vector<DispatchThread*>::iterator p = dispatch_threads.begin();
+	 p != dispatch_threads.end();
+	 ++p) {
+      if ((*p)->is_started())
+	(*p)->join();
+      delete *p;
+    }
+    dispatch_threads.clear();
     Messenger::destroy();
   }
 
@@ -524,6 +549,18 @@ private:
     return dispatch_queue.get_queue_len();
   }
 
+  /**
+   * Deliver queued messages from this many threads (before the first
+   * dispatcher is added).  Each connection's messages are still handed
+   * over one at a time and in order, but different connections are
+   * dispatched concurrently, so the dispatchers must be thread-safe.
+   */
+  void set_dispatch_threads(int n) {
+    assert(dispatch_threads.empty());
+    num_dispatch_threads = max(n, 1);
+  }
+  bool is_dispatch_thread();
+
   void ready();
   int shutdown();
   void suicide();
@@ -549,9 +586,12 @@ private:
       msgr->put();
       return 0;
     }
-  } dispatch_thread;
+  };
+  vector<DispatchThread*> dispatch_threads;
+  int num_dispatch_threads;
 
   void dispatch_entry();
+  void fast_dispatch(Message *m);
 
   SimpleMessenger *msgr; //hack to make dout macro work, will fix
   int timeout;
@@ -562,10 +602,10 @@ public:
     accepter(this),
     lock("SimpleMessenger::lock"), started(false), did_bind(false),
     dispatch_throttler(cct->_conf->ms_dispatch_throttle_bytes), need_addr(true),
-    destination_stopped(true), my_type(-1),
+    destination_stopped(true), my_type(-1), sockbuf(0),
     global_seq_lock("SimpleMessenger::global_seq_lock"), global_seq(0),
     reaper_thread(this), reaper_started(false), reaper_stop(false), 
-    dispatch_thread(this), msgr(this) {
+    num_dispatch_threads(max((int)cct->_conf->ms_dispatch_threads, 1)), msgr(this) {
     // for local dmsg delivery
     dispatch_queue.local_pipe = new Pipe(this, Pipe::STATE_OPEN);
   }
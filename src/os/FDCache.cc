@@ -0,0 +1,165 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2012 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "FDCache.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+FDCache::FDCache(int max_)
+  : lock("FDCache::lock"),
+    max(max_),
+    last_gen(0),
+    hits(0), misses(0)
+{
+  lru.lru_set_max(max);
+}
+
+FDCache::~FDCache()
+{
+  clear();
+}
+
+uint64_t FDCache::_get_gen(const coll_t& cid)
+{
+  std::map<coll_t, uint64_t>::iterator p = coll_gen.find(cid);
+  if (p == coll_gen.end())
+    return 0;
+  return p->second;
+}
+
+void FDCache::_bump(const coll_t& cid)
+{
+  coll_gen[cid] = ++last_gen;
+}
+
+uint64_t FDCache::get_gen(const coll_t& cid)
+{
+  Mutex::Locker l(lock);
+  return _get_gen(cid);
+}
+
+int FDCache::get_fd(const coll_t& cid, const hobject_t& oid)
+{
+  Mutex::Locker l(lock);
+  std::map<Key, Entry*>::iterator p = entries.find(Key(cid, oid));
+  if (p == entries.end() || p->second->fd < 0) {
+    misses++;
+    return -ENOENT;
+  }
+  int fd = ::dup(p->second->fd);
+  if (fd < 0)
+    return -errno;
+  hits++;
+  lru.lru_touch(p->second);
+  return fd;
+}
+
+bool FDCache::get_path(const coll_t& cid, const hobject_t& oid, std::string *path)
+{
+  Mutex::Locker l(lock);
+  std::map<Key, Entry*>::iterator p = entries.find(Key(cid, oid));
+  if (p == entries.end() || p->second->gen != _get_gen(cid)) {
+    misses++;
+    return false;
+  }
+  hits++;
+  *path = p->second->path;
+  lru.lru_touch(p->second);
+  return true;
+}
+
+void FDCache::add(const coll_t& cid, const hobject_t& oid, int fd,
+		  const std::string& path, uint64_t gen)
+{
+  Mutex::Locker l(lock);
+  if (max <= 0 || gen != _get_gen(cid)) {
+    // the index changed under the caller; what it found may be stale
+    if (fd >= 0)
+      ::close(fd);
+    return;
+  }
+  std::pair<std::map<Key, Entry*>::iterator, bool> r =
+    entries.insert(std::make_pair(Key(cid, oid), (Entry*)NULL));
+  Entry *e = r.first->second;
+  if (r.second) {
+    e = r.first->second = new Entry;
+    e->pos = r.first;
+    lru.lru_insert_mid(e);
+  } else {
+    lru.lru_touch(e);
+  }
+  if (fd >= 0) {
+    if (e->fd >= 0)
+      ::close(e->fd);
+    e->fd = fd;
+  }
+  e->path = path;
+  e->gen = gen;
+  _trim();
+}
+
+void FDCache::changed(const coll_t& cid)
+{
+  Mutex::Locker l(lock);
+  _bump(cid);
+}
+
+void FDCache::invalidate(const coll_t& cid, const hobject_t& oid)
+{
+  Mutex::Locker l(lock);
+  _bump(cid);
+  std::map<Key, Entry*>::iterator p = entries.find(Key(cid, oid));
+  if (p != entries.end())
+    _remove(p->second);
+}
+
+void FDCache::invalidate_collection(const coll_t& cid)
+{
+  Mutex::Locker l(lock);
+  _bump(cid);
+  std::map<Key, Entry*>::iterator p = entries.lower_bound(Key(cid, hobject_t()));
+  while (p != entries.end() && p->first.cid == cid) {
+    Entry *e = p->second;
+    ++p;
+    _remove(e);
+  }
+}
+
+void FDCache::clear()
+{
+  Mutex::Locker l(lock);
+  while (!entries.empty())
+    _remove(entries.begin()->second);
+}
+
+void FDCache::_remove(Entry *e)
+{
+  assert(lock.is_locked());
+  lru.lru_remove(e);
+  if (e->fd >= 0)
+    ::close(e->fd);
+  entries.erase(e->pos);
+  delete e;
+}
+
+void FDCache::_trim()
+{
+  while (lru.lru_get_size() > (unsigned)max) {
+    Entry *e = static_cast<Entry*>(lru.lru_expire());
+    if (!e)
+      break;
+    _remove(e);
+  }
+}
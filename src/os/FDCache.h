@@ -0,0 +1,118 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2012 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OS_FDCACHE_H
+#define CEPH_OS_FDCACHE_H
+
+#include <map>
+#include <string>
+
+#include "common/Mutex.h"
+#include "include/lru.h"
+#include "include/object.h"
+#include "osd/osd_types.h"
+
+/**
+ * FDCache remembers, for recently used objects, the path the collection
+ * index resolved them to and an O_RDWR descriptor on the file, so that
+ * hot objects skip the index lookup and the open() on every op.
+ *
+ * Callers never see the cached descriptor itself; get_fd() hands out a
+ * dup() of it, which the caller closes (or gives to the flusher) as it
+ * would any freshly opened fd.  That keeps entries evictable at any time.
+ *
+ * A descriptor stays valid for as long as its object is linked at
+ * (cid, oid), so entries only have to go when the object is unlinked or
+ * its collection is renamed or destroyed.  Paths are more fragile: any
+ * create or unlink may split or merge index directories or renumber long
+ * file names.  Each collection therefore carries a generation which such
+ * changes bump; a cached path is only used while its generation is
+ * current, and an entry is only inserted if nothing changed between the
+ * caller's get_gen() and its add().
+ */
+class FDCache {
+public:
+  FDCache(int max);
+  ~FDCache();
+
+  /// current generation of cid; call before resolving a path to add()
+  uint64_t get_gen(const coll_t& cid);
+
+  /// @return a dup of the cached fd, or -ENOENT on a miss
+  int get_fd(const coll_t& cid, const hobject_t& oid);
+
+  /// @return true and the path if we have one that is still current
+  bool get_path(const coll_t& cid, const hobject_t& oid, std::string *path);
+
+  /**
+   * Remember what a lookup started at generation gen found.  fd may be -1
+   * if only the path is known; otherwise the cache takes ownership of it
+   * and closes it if it cannot be kept.
+   */
+  void add(const coll_t& cid, const hobject_t& oid, int fd,
+	   const std::string& path, uint64_t gen);
+
+  /// cid's index changed shape (an object was created or linked)
+  void changed(const coll_t& cid);
+  /// oid was unlinked from cid
+  void invalidate(const coll_t& cid, const hobject_t& oid);
+  /// cid was renamed or destroyed
+  void invalidate_collection(const coll_t& cid);
+  void clear();
+
+  uint64_t get_hits() { return hits; }
+  uint64_t get_misses() { return misses; }
+
+  /// identifies an object file; also used by FileStore's dirty tracking
+  struct Key {
+    coll_t cid;
+    hobject_t oid;
+    Key(const coll_t& c, const hobject_t& o) : cid(c), oid(o) {}
+    bool operator<(const Key& r) const {
+      if (cid != r.cid)
+	return cid < r.cid;
+      if (oid.oid.name != r.oid.oid.name)
+	return oid.oid.name < r.oid.oid.name;
+      if (oid.snap != r.oid.snap)
+	return oid.snap < r.oid.snap;
+      if (oid.hash != r.oid.hash)
+	return oid.hash < r.oid.hash;
+      return oid.get_key() < r.oid.get_key();
+    }
+  };
+
+private:
+  struct Entry : public LRUObject {
+    std::map<Key, Entry*>::iterator pos;
+    int fd;
+    std::string path;
+    uint64_t gen;      // generation path was resolved at
+    Entry() : fd(-1), gen(0) {}
+  };
+
+  Mutex lock;
+  int max;
+  LRU lru;
+  std::map<Key, Entry*> entries;
+  std::map<coll_t, uint64_t> coll_gen;
+  uint64_t last_gen;
+  uint64_t hits, misses;
+
+  uint64_t _get_gen(const coll_t& cid);
+  void _bump(const coll_t& cid);
+  void _remove(Entry *e);
+  void _trim();
+};
+
+#endif
@@ -185,65 +185,86 @@ int FileStore::init_index(coll_t cid)
   return index_manager.init_index(cid, path, on_disk_version);
 }
 
-int FileStore::lfn_find(coll_t cid, const hobject_t& oid, IndexedPath *path)
+/*
+ * Resolve oid's path, from the fd cache if we have a current one.  The
+ * lookup result is cached only if the collection's index did not change
+ * while we were looking.
+ */
+int FileStore::lfn_find(coll_t cid, const hobject_t& oid, string *path)
 {
+  if (fdcache.get_path(cid, oid, path))
+    return 0;
+
   Index index; 
+  IndexedPath ipath;
   int r, exist;
+  uint64_t gen = fdcache.get_gen(cid);
   r = get_index(cid, &index);
   if (r < 0)
     return r;
 
-  r = index->lookup(oid, path, &exist);
+  r = index->lookup(oid, &ipath, &exist);
   if (r < 0)
     return r;
   if (!exist)
     return -ENOENT;
+  *path = ipath->path();
+  fdcache.add(cid, oid, -1, *path, gen);
   return 0;
 }
 
 int FileStore::lfn_getxattr(coll_t cid, const hobject_t& oid, const char *name, void *val, size_t size)
 {
-  IndexedPath path;
+  string path;
   int r = lfn_find(cid, oid, &path);
   if (r < 0)
     return r;
-  return do_getxattr(path->path(), name, val, size);
+  return do_getxattr(path.c_str(), name, val, size);
 }
 
 int FileStore::lfn_setxattr(coll_t cid, const hobject_t& oid, const char *name, const void *val, size_t size)
 {
-  IndexedPath path;
+  string path;
   int r = lfn_find(cid, oid, &path);
   if (r < 0)
     return r;
-  return do_setxattr(path->path(), name, val, size);
+  return do_setxattr(path.c_str(), name, val, size);
 }
 
 int FileStore::lfn_removexattr(coll_t cid, const hobject_t& oid, const char *name)
 {
-  IndexedPath path;
+  string path;
   int r = lfn_find(cid, oid, &path);
   if (r < 0)
     return r;
-  return do_removexattr(path->path(), name);
+  return do_removexattr(path.c_str(), name);
 }
 
 int FileStore::lfn_listxattr(coll_t cid, const hobject_t& oid, char *names, size_t len)
 {
-  IndexedPath path;
+  string path;
   int r = lfn_find(cid, oid, &path);
   if (r < 0)
     return r;
-  return do_listxattr(path->path(), names, len);
+  return do_listxattr(path.c_str(), names, len);
 }
 
 int FileStore::lfn_truncate(coll_t cid, const hobject_t& oid, off_t length)
 {
-  IndexedPath path;
+  int fd = fdcache.get_fd(cid, oid);
+  if (fd >= 0) {
+    int r = ::ftruncate(fd, length);
+    if (r < 0)
+      r = -errno;
+    TEMP_FAILURE_RETRY(::close(fd));
+    return r;
+  }
+
+  string path;
   int r = lfn_find(cid, oid, &path);
   if (r < 0)
     return r;
-  r = ::truncate(path->path(), length);
+  r = ::truncate(path.c_str(), length);
   if (r < 0)
     return -errno;
   return r;
@@ -251,21 +272,47 @@ int FileStore::lfn_truncate(coll_t cid, const hobject_t& oid, off_t length)
 
 int FileStore::lfn_stat(coll_t cid, const hobject_t& oid, struct stat *buf)
 {
-  IndexedPath path;
+  int fd = fdcache.get_fd(cid, oid);
+  if (fd >= 0) {
+    int r = ::fstat(fd, buf);
+    if (r < 0)
+      r = -errno;
+    TEMP_FAILURE_RETRY(::close(fd));
+    return r;
+  }
+
+  string path;
   int r = lfn_find(cid, oid, &path);
   if (r < 0)
     return r;
-  r = ::stat(path->path(), buf);
+  r = ::stat(path.c_str(), buf);
   if (r < 0)
     return -errno;
   return 0;
 }
 
+/*
+ * Like open(2): returns an fd the caller must close, or -1 with errno
+ * set (or a negative error from the index).  Existing objects are opened
+ * O_RDWR once and then served from the fd cache.
+ */
 int FileStore::lfn_open(coll_t cid, const hobject_t& oid, int flags, mode_t mode)
 {
+  int fd = fdcache.get_fd(cid, oid);
+  if (fd >= 0) {
+    if ((flags & O_TRUNC) && ::ftruncate(fd, 0) < 0) {
+      int err = errno;
+      TEMP_FAILURE_RETRY(::close(fd));
+      errno = err;
+      return -1;
+    }
+    return fd;
+  }
+
   Index index;
   IndexedPath path;
-  int r, fd, exist;
+  int r, exist;
+  uint64_t gen = fdcache.get_gen(cid);
   r = get_index(cid, &index);
   if (r < 0)
     return r;
@@ -274,6 +321,19 @@ int FileStore::lfn_open(coll_t cid, const hobject_t& oid, int flags, mode_t mode
     return r;
   }
 
+  if (exist && m_filestore_fd_cache_size > 0) {
+    r = ::open(path->path(), (flags & O_TRUNC) | O_RDWR);
+    if (r >= 0) {
+      fd = ::dup(r);
+      if (fd >= 0) {
+	fdcache.add(cid, oid, r, path->path(), gen);
+	return fd;
+      }
+      TEMP_FAILURE_RETRY(::close(r));
+    }
+    // fall back to what the caller asked for
+  }
+
   r = ::open(path->path(), flags, mode);
   if (r < 0)
     return r;
@@ -281,6 +341,7 @@ int FileStore::lfn_open(coll_t cid, const hobject_t& oid, int flags, mode_t mode
 
   if ((flags & O_CREAT) && (!exist)) {
     r = index->created(oid, path->path());
+    fdcache.changed(cid);
     if (r < 0) {
       close(fd);
       return r;
@@ -335,6 +396,7 @@ int FileStore::lfn_link(coll_t c, coll_t cid, const hobject_t& o)
     return -errno;
 
   r = index_new->created(o, path_new->path());
+  fdcache.changed(cid);
   if (r < 0)
     return r;
   return 0;
@@ -346,7 +408,9 @@ int FileStore::lfn_unlink(coll_t cid, const hobject_t& o)
   int r = get_index(cid, &index);
   if (r < 0)
     return r;
-  return index->unlink(o);
+  r = index->unlink(o);
+  fdcache.invalidate(cid, o);
+  return r;
 }
 
 static void get_raw_xattr_name(const char *name, int i, char *raw_name, int raw_len)
@@ -630,6 +694,15 @@ FileStore::FileStore(const std::string &base, const std::string &jdev) :
   op_wq(this, g_conf->filestore_op_thread_timeout,
 	g_conf->filestore_op_thread_suicide_timeout, &op_tp),
   flusher_queue_len(0), flusher_thread(this),
+  have_syncfs(false), track_dirty(false),
+  dirty_lock("FileStore::dirty_lock"), dirty_overflow(false),
+  sync_tp(g_ceph_context, "FileStore::sync_tp", g_conf->filestore_sync_threads),
+  sync_wq(this, g_conf->filestore_op_thread_timeout,
+	  g_conf->filestore_op_thread_suicide_timeout, &sync_tp),
+  wb_lock("FileStore::wb_lock"),
+  wb_dirty_bytes(0), wb_committing_bytes(0),
+  wb_sync_bw(0), wb_apply_bw(0),
+  wb_sync_requested(false),
   logger(NULL),
   m_filestore_btrfs_clone_range(g_conf->filestore_btrfs_clone_range),
   m_filestore_btrfs_snap (g_conf->filestore_btrfs_snap ),
@@ -656,7 +729,18 @@ FileStore::FileStore(const std::string &base, const std::string &jdev) :
   m_filestore_queue_max_ops(g_conf->filestore_queue_max_ops),
   m_filestore_queue_max_bytes(g_conf->filestore_queue_max_bytes),
   m_filestore_queue_committing_max_ops(g_conf->filestore_queue_committing_max_ops),
-  m_filestore_queue_committing_max_bytes(g_conf->filestore_queue_committing_max_bytes)
+  m_filestore_queue_committing_max_bytes(g_conf->filestore_queue_committing_max_bytes),
+  m_filestore_apply_batch_ops(g_conf->filestore_apply_batch_ops),
+  m_filestore_apply_coalesce(g_conf->filestore_apply_coalesce),
+  m_filestore_apply_coalesce_max_bytes(g_conf->filestore_apply_coalesce_max_bytes),
+  m_filestore_fd_cache_size(g_conf->filestore_fd_cache_size),
+  m_filestore_syncfs(g_conf->filestore_syncfs),
+  m_filestore_sync_max_dirty(g_conf->filestore_sync_max_dirty),
+  m_filestore_wbthrottle(g_conf->filestore_wbthrottle),
+  m_filestore_wbthrottle_target_sync(g_conf->filestore_wbthrottle_target_sync),
+  m_filestore_wbthrottle_low(g_conf->filestore_wbthrottle_low),
+  m_filestore_wbthrottle_max_delay(g_conf->filestore_wbthrottle_max_delay),
+  fdcache(g_conf->filestore_fd_cache_size)
 {
   ostringstream oss;
   oss << basedir << "/current";
@@ -1216,6 +1300,17 @@ int FileStore::_detect_fs()
   } else {
     dout(0) << "mount did NOT detect btrfs" << dendl;
     btrfs = false;
+
+    have_syncfs = false;
+    if (m_filestore_syncfs) {
+      int r = try_syncfs(fd);
+      if (r == 0) {
+	dout(0) << "mount syncfs(2) syscall fully supported (by glibc and kernel)" << dendl;
+	have_syncfs = true;
+      } else {
+	dout(0) << "mount syncfs(2) syscall not supported: " << cpp_strerror(r) << dendl;
+      }
+    }
   }
   ::close(fd);
   return 0;
@@ -1378,6 +1473,11 @@ int FileStore::mount()
   if (ret)
     goto done;
 
+  // with neither btrfs nor syncfs(2), commit by fdatasync'ing the objects
+  // written since the last commit rather than sync()ing every fs on the host
+  track_dirty = !btrfs && !have_syncfs && !m_filestore_fsync_flushes_journal_data &&
+    g_conf->filestore_sync_threads > 0;
+
   uint32_t version_stamp;
   ret = version_stamp_is_valid(&version_stamp);
   if (ret < 0) {
@@ -1669,6 +1769,8 @@ int FileStore::mount()
 
   sync_thread.create();
   op_tp.start();
+  if (track_dirty)
+    sync_tp.start();
   flusher_thread.create();
   op_finisher.start();
   ondisk_finisher.start();
@@ -1705,6 +1807,8 @@ int FileStore::umount()
   lock.Unlock();
   sync_thread.join();
   op_tp.stop();
+  if (track_dirty)
+    sync_tp.stop();
   flusher_thread.join();
 
   journal_stop();
@@ -1713,6 +1817,15 @@ int FileStore::umount()
   op_finisher.stop();
   ondisk_finisher.stop();
 
+  fdcache.clear();
+  {
+    Mutex::Locker l(dirty_lock);
+    for (map<DirtyKey, DirtyObject>::iterator p = dirty.begin(); p != dirty.end(); ++p)
+      TEMP_FAILURE_RETRY(::close(p->second.fd));
+    dirty.clear();
+    dirty_overflow = false;
+  }
+
   if (fsid_fd >= 0) {
     TEMP_FAILURE_RETRY(::close(fsid_fd));
     fsid_fd = -1;
@@ -1770,11 +1883,11 @@ void FileStore::start_logger(int whoami, utime_t tare)
   PerfCountersBuilder plb(g_ceph_context, name, l_os_first, l_os_last);
 
   plb.add_u64_counter(l_os_in_ops, "in_o");
-  //plb.add_u64_counter(l_os_in_bytes, "in_b");
+  plb.add_u64_counter(l_os_in_bytes, "in_b");
   plb.add_u64_counter(l_os_readable_ops, "or_o");
   plb.add_u64_counter(l_os_readable_bytes, "or_b");
-  //plb.add_u64_counter(l_os_commit_bytes, "com_o");
-  //plb.add_u64_counter(l_os_commit_bytes, "com_b");
+  plb.add_u64_counter(l_os_commit_ops, "com_o");
+  plb.add_u64_counter(l_os_commit_bytes, "com_b");
 
   plb.add_u64(l_os_jq_max_ops, "jq_mo");
   plb.add_u64(l_os_jq_ops, "jq_o");
@@ -1790,6 +1903,15 @@ void FileStore::start_logger(int whoami, utime_t tare)
   plb.add_u64_counter(l_os_bytes, "b");
   plb.add_u64(l_os_committing, "comitng");
 
+  plb.add_time_avg(l_os_j_lat, "j_lat");          // submit -> journaled
+  plb.add_time_avg(l_os_apply_lat, "apply_lat");  // time to apply a transaction
+  plb.add_time_avg(l_os_commit_lat, "commit_lat");  // time to commit (sync) to disk
+  plb.add_u64(l_os_wb_dirty, "wb_dirty");          // bytes applied but not yet synced
+  plb.add_u64(l_os_wb_sync_bw, "wb_sync_bw");      // measured sync throughput, bytes/sec
+  plb.add_u64(l_os_wb_apply_bw, "wb_apply_bw");    // measured apply throughput, bytes/sec
+  plb.add_time_avg(l_os_wb_delay, "wb_delay");     // admission delays imposed
+  plb.add_u64_counter(l_os_commit_dirty, "commit_dirty");  // objects fdatasync'ed by commits
+
   logger = plb.create_perf_counters();
   if (journal)
     journal->logger = logger;
@@ -1825,6 +1947,7 @@ FileStore::Op *FileStore::build_op(list<Transaction*>& tls,
   }
 
   Op *o = new Op;
+  o->start = ceph_clock_now(g_ceph_context);
   o->tls.swap(tls);
   o->onreadable = onreadable;
   o->onreadable_sync = onreadable_sync;
@@ -1909,30 +2032,67 @@ void FileStore::_op_queue_release_throttle(Op *o)
   op_throttle_cond.Signal();
 }
 
+/*
+ * Apply everything queued on this sequencer (up to
+ * filestore_apply_batch_ops) in one pass, so that writes and xattr
+ * updates from consecutive ops can be coalesced.  Independent sequencers
+ * are applied by other op_tp threads in parallel.
+ */
 void FileStore::_do_op(OpSequencer *osr)
 {
   osr->apply_lock.Lock();
-  Op *o = osr->peek_queue();
 
-  dout(5) << "_do_op " << o << " " << o->op << " osr " << osr << "/" << osr->parent << " start" << dendl;
-  int r = do_transactions(o->tls, o->op);
-  op_apply_finish(o->op);
-  dout(10) << "_do_op " << o << " " << o->op << " r = " << r
-	   << ", finisher " << o->onreadable << " " << o->onreadable_sync << dendl;
-  
-  /*dout(10) << "op_entry finished " << o->bytes << " bytes, queue now "
-	   << op_queue_len << " ops, " << op_queue_bytes << " bytes" << dendl;
-  */
+  list<Op*> batch;
+  osr->peek_batch(batch, MAX(m_filestore_apply_batch_ops, 1));
+  osr->batch = batch.size();
+
+  list<Transaction*> tls;
+  for (list<Op*>::iterator p = batch.begin(); p != batch.end(); ++p)
+    tls.insert(tls.end(), (*p)->tls.begin(), (*p)->tls.end());
+
+  dout(5) << "_do_op " << batch.front()->op << ".." << batch.back()->op
+	  << " (" << osr->batch << " ops) osr " << osr << "/" << osr->parent << " start" << dendl;
+  utime_t start = ceph_clock_now(g_ceph_context);
+  int r = do_transactions(tls, batch.back()->op);
+  utime_t lat = ceph_clock_now(g_ceph_context) - start;
+  if (logger)
+    logger->tinc(l_os_apply_lat, lat);
+  uint64_t bytes = 0;
+  for (list<Op*>::iterator p = batch.begin(); p != batch.end(); ++p)
+    bytes += (*p)->bytes;
+  wb_applied(bytes, lat);
+  for (list<Op*>::iterator p = batch.begin(); p != batch.end(); ++p)
+    op_apply_finish((*p)->op);
+  dout(10) << "_do_op " << batch.front()->op << ".." << batch.back()->op
+	   << " r = " << r << dendl;
 }
 
 void FileStore::_finish_op(OpSequencer *osr)
 {
-  Op *o = osr->dequeue();
+  // called with tp lock held
+  list<Op*> done;
+  for (int i = 0; i < osr->batch; i++)
+    done.push_back(osr->dequeue());
+  osr->batch = 0;
   
-  dout(10) << "_finish_op on osr " << osr << "/" << osr->parent << dendl;
+  dout(10) << "_finish_op on osr " << osr << "/" << osr->parent
+	   << " " << done.size() << " ops" << dendl;
   osr->apply_lock.Unlock();  // locked in _do_op
 
-  // called with tp lock held
+  for (list<Op*>::iterator p = done.begin(); p != done.end(); ++p)
+    _finish_one_op(*p);
+
+  // anything queued while we were applying is ours to pick up; put the
+  // sequencer back on the queue (_enqueue skipped it while in_wq).
+  osr->in_wq = false;
+  if (osr->have_queued()) {
+    osr->in_wq = true;
+    op_queue.push_back(osr);
+  }
+}
+
+void FileStore::_finish_one_op(Op *o)
+{
   _op_queue_release_throttle(o);
 
   if (logger) {
@@ -2016,6 +2176,13 @@ int FileStore::queue_transactions(Sequencer *posr, list<Transaction*> &tls,
     //logger->inc(l_os_in_bytes, 1); 
   }
 
+  if (m_filestore_wbthrottle) {
+    uint64_t bytes = 0;
+    for (list<Transaction*>::iterator p = tls.begin(); p != tls.end(); ++p)
+      bytes += (*p)->get_num_bytes();
+    wb_throttle(bytes);
+  }
+
   if (journal && journal->is_writeable() && !m_filestore_journal_trailing) {
     Op *o = build_op(tls, onreadable, onreadable_sync);
     op_queue_reserve_throttle(o);
@@ -2045,7 +2212,12 @@ int FileStore::queue_transactions(Sequencer *posr, list<Transaction*> &tls,
   dout(5) << "queue_transactions (trailing journal) " << op << " " << tls << dendl;
 
   _op_apply_start(op);
+  uint64_t bytes = 0;
+  for (list<Transaction*>::iterator p = tls.begin(); p != tls.end(); ++p)
+    bytes += (*p)->get_num_bytes();
+  utime_t start = ceph_clock_now(g_ceph_context);
   int r = do_transactions(tls, op);
+  wb_applied(bytes, ceph_clock_now(g_ceph_context) - start);
     
   if (r >= 0) {
     _op_journal_transactions(tls, op, ondisk);
@@ -2076,6 +2248,9 @@ void FileStore::_journaled_ahead(OpSequencer *osr, Op *o, Context *ondisk)
 {
   dout(5) << "_journaled_ahead " << o->op << " " << o->tls << dendl;
 
+  if (logger)
+    logger->tinc(l_os_j_lat, ceph_clock_now(g_ceph_context) - o->start);
+
   // this should queue in order because the journal does it's completions in order.
   journal_lock.Lock();
   queue_op(osr, o);
@@ -2108,13 +2283,16 @@ int FileStore::do_transactions(list<Transaction*> &tls, uint64_t op_seq)
     return id;
   }
     
+  PendingApply pending;
   for (list<Transaction*>::iterator p = tls.begin();
        p != tls.end();
        p++) {
-    r = _do_transaction(**p);
+    r = _do_transaction(**p, pending);
     if (r < 0)
       break;
   }
+  // errors from coalesced writes/setattrs are checked like the direct ops
+  _check_op_result(Transaction::OP_WRITE, _flush_pending(pending));
   
   _transaction_finish(id);
   return r;
@@ -2205,13 +2383,21 @@ void FileStore::_transaction_finish(int fd)
 #endif /* DARWIN */
 }
 
-unsigned FileStore::_do_transaction(Transaction& t)
+unsigned FileStore::_do_transaction(Transaction& t, PendingApply& pending)
 {
   dout(10) << "_do_transaction on " << &t << dendl;
 
   while (t.have_op()) {
     int op = t.get_op();
     int r = 0;
+
+    if (pending.active &&
+	op != Transaction::OP_NOP &&
+	op != Transaction::OP_WRITE &&
+	op != Transaction::OP_SETATTR &&
+	op != Transaction::OP_SETATTRS)
+      _check_op_result(Transaction::OP_WRITE, _flush_pending(pending));
+
     switch (op) {
     case Transaction::OP_NOP:
       break;
@@ -2231,7 +2417,13 @@ unsigned FileStore::_do_transaction(Transaction& t)
 	uint64_t len = t.get_length();
 	bufferlist bl;
 	t.get_bl(bl);
-	r = _write(cid, oid, off, len, bl);
+	if (m_filestore_apply_coalesce && len == bl.length()) {
+	  r = _pending_write(pending, cid, oid, off, bl);
+	} else {
+	  // keep it ordered after anything we're holding back
+	  _check_op_result(op, _flush_pending(pending));
+	  r = _write(cid, oid, off, len, bl);
+	}
       }
       break;
       
@@ -2279,6 +2471,12 @@ unsigned FileStore::_do_transaction(Transaction& t)
 	string name = t.get_attrname();
 	bufferlist bl;
 	t.get_bl(bl);
+	if (m_filestore_apply_coalesce) {
+	  // only a flush of earlier pending data can fail here
+	  _check_op_result(Transaction::OP_WRITE,
+			   _pending_setattr(pending, cid, oid, name, bl));
+	  break;
+	}
 	r = _setattr(cid, oid, name.c_str(), bl.c_str(), bl.length());
 	if (r == -ENOSPC)
 	  dout(0) << " ENOSPC on setxattr on " << cid << "/" << oid
@@ -2292,6 +2490,13 @@ unsigned FileStore::_do_transaction(Transaction& t)
 	hobject_t oid = t.get_oid();
 	map<string, bufferptr> aset;
 	t.get_attrset(aset);
+	if (m_filestore_apply_coalesce) {
+	  _check_op_result(Transaction::OP_WRITE,
+			   _pending_switch(pending, cid, oid));
+	  for (map<string, bufferptr>::iterator p = aset.begin(); p != aset.end(); ++p)
+	    pending.attrs[p->first] = p->second;
+	  break;
+	}
 	r = _setattrs(cid, oid, aset);
   	if (r == -ENOSPC)
 	  dout(0) << " ENOSPC on setxattrs on " << cid << "/" << oid << dendl;
@@ -2413,39 +2618,199 @@ unsigned FileStore::_do_transaction(Transaction& t)
       assert(0);
     }
 
-    if (r == -ENOENT && 
-	(op == Transaction::OP_CLONERANGE ||
-	 op == Transaction::OP_CLONE ||
-	 op == Transaction::OP_CLONERANGE2)) {
-      // Halt before we incorrectly mark the pg clean
-      assert(0 == "ENOENT on clone suggests osd bug");
-    }
+    _check_op_result(op, r);
+  }
+  return 0;  // FIXME count errors
+}
+
+void FileStore::_check_op_result(int op, int r)
+{
+  if (r >= 0)
+    return;
+  dout(10) << "_check_op_result op " << op << " = " << r << dendl;
+
+  if (r == -ENOENT && 
+      (op == Transaction::OP_CLONERANGE ||
+       op == Transaction::OP_CLONE ||
+       op == Transaction::OP_CLONERANGE2)) {
+    // Halt before we incorrectly mark the pg clean
+    assert(0 == "ENOENT on clone suggests osd bug");
+  }
       
-    if (r == -ENOTEMPTY) {
-      assert(0 == "ENOTEMPTY suggests garbage data in osd data dir");
-    }
-    if (r == -ENOSPC) {
-      // For now, if we hit _any_ ENOSPC, crash, before we do any damage
-      // by partially applying transactions.
+  if (r == -ENOTEMPTY) {
+    assert(0 == "ENOTEMPTY suggests garbage data in osd data dir");
+  }
+  if (r == -ENOSPC) {
+    // For now, if we hit _any_ ENOSPC, crash, before we do any damage
+    // by partially applying transactions.
 
-      // XXX HACK: if it was an setxattr op, silently fail, until we have a better workaround XXX
-      if (op == Transaction::OP_SETATTR || op == Transaction::OP_SETATTRS)
-	dout(0) << "WARNING: ignoring setattr ENOSPC failure, until we implement a workaround for extN"
-		<< " xattr limitations" << dendl;
-      else
-	assert(0 == "ENOSPC handling not implemented");
-    }
-    if (r == -EIO) {
-      assert(0 == "EIO handling not implemented");
-    }
+    // XXX HACK: if it was an setxattr op, silently fail, until we have a better workaround XXX
+    if (op == Transaction::OP_SETATTR || op == Transaction::OP_SETATTRS)
+      dout(0) << "WARNING: ignoring setattr ENOSPC failure, until we implement a workaround for extN"
+	      << " xattr limitations" << dendl;
+    else
+      assert(0 == "ENOSPC handling not implemented");
+  }
+  if (r == -EIO) {
+    assert(0 == "EIO handling not implemented");
   }
-  return 0;  // FIXME count errors
 }
 
   /*********************************************/
 
 
 
+// --------------------
+// apply coalescing
+
+int FileStore::_pending_switch(PendingApply& pending, coll_t cid, const hobject_t& oid)
+{
+  int r = 0;
+  if (pending.active) {
+    if (pending.cid == cid && pending.oid == oid)
+      return 0;
+    r = _flush_pending(pending);
+  }
+  pending.active = true;
+  pending.cid = cid;
+  pending.oid = oid;
+  return r;
+}
+
+int FileStore::_pending_write(PendingApply& pending, coll_t cid, const hobject_t& oid,
+			      uint64_t off, bufferlist& bl)
+{
+  int r = _pending_switch(pending, cid, oid);
+  pending.touched = true;
+
+  uint64_t end = off + bl.length();
+  if (pending.data.length()) {
+    uint64_t pend = pending.off + pending.data.length();
+    if (off > pend || end < pending.off ||
+	MAX(end, pend) - MIN(off, pending.off) > (uint64_t)m_filestore_apply_coalesce_max_bytes) {
+      // disjoint (or too big): write out what we have and start over
+      int wr = _flush_pending_data(pending);
+      if (wr < 0 && r == 0)
+	r = wr;
+    } else {
+      // adjacent or overlapping: the new data wins where they overlap
+      dout(20) << "_pending_write merging " << off << "~" << bl.length()
+	       << " into " << pending.off << "~" << pending.data.length() << dendl;
+      bufferlist merged;
+      if (off > pending.off)
+	merged.substr_of(pending.data, 0, off - pending.off);
+      merged.claim_append(bl);
+      if (pend > end) {
+	bufferlist tail;
+	tail.substr_of(pending.data, end - pending.off, pend - end);
+	merged.claim_append(tail);
+      }
+      pending.off = MIN(off, pending.off);
+      pending.data.swap(merged);
+      return r;
+    }
+  }
+  pending.off = off;
+  pending.data.claim(bl);
+  return r;
+}
+
+int FileStore::_pending_setattr(PendingApply& pending, coll_t cid, const hobject_t& oid,
+				const string& name, bufferlist& bl)
+{
+  int r = _pending_switch(pending, cid, oid);
+  // the last update of a given attr is the only one that matters
+  if (bl.length())
+    pending.attrs[name] = bufferptr(bl.c_str(), bl.length());
+  else
+    pending.attrs[name] = bufferptr();
+  return r;
+}
+
+/*
+ * Write out the pending data.  Also used for a queued empty write, so
+ * that the object is still created.
+ */
+int FileStore::_flush_pending_data(PendingApply& pending)
+{
+  uint64_t len = pending.data.length();
+  int r = _write(pending.cid, pending.oid, pending.off, len, pending.data);
+  pending.data.clear();
+  return r < 0 ? r : 0;
+}
+
+/*
+ * Write out whatever we're holding for the pending object.  With both
+ * data and attrs pending we open the object once and set the attrs on
+ * that fd, instead of looking the path up again for every attr.
+ */
+int FileStore::_flush_pending(PendingApply& pending)
+{
+  if (!pending.active)
+    return 0;
+  dout(15) << "_flush_pending " << pending.cid << "/" << pending.oid
+	   << " " << pending.off << "~" << pending.data.length()
+	   << (pending.touched ? " (write)" : "")
+	   << " + " << pending.attrs.size() << " attrs" << dendl;
+
+  int ret = 0;
+  if (!pending.attrs.empty()) {
+    int r = 0;
+    if (fake_attrs) {
+      r = _setattrs(pending.cid, pending.oid, pending.attrs);
+    } else {
+      // a queued write creates the object, even an empty one
+      int fd = lfn_open(pending.cid, pending.oid,
+			pending.touched ? (O_WRONLY|O_CREAT) : O_RDONLY, 0644);
+      if (fd < 0) {
+	r = -errno;
+      } else {
+	for (map<string, bufferptr>::iterator p = pending.attrs.begin();
+	     p != pending.attrs.end();
+	     ++p) {
+	  char n[ATTR_MAX_NAME_LEN];
+	  get_attrname(p->first.c_str(), n, ATTR_MAX_NAME_LEN);
+	  r = do_fsetxattr(fd, n, p->second.length() ? p->second.c_str() : "",
+			   p->second.length());
+	  if (r < 0) {
+	    derr << "FileStore::_flush_pending: do_fsetxattr returned " << r << dendl;
+	    break;
+	  }
+	}
+	if (pending.touched) {
+	  uint64_t len = pending.data.length();
+	  int wr = _write_fd(pending.cid, pending.oid, fd, pending.off, len, pending.data);
+	  pending.data.clear();
+	  pending.touched = false;
+	  if (wr < 0)
+	    ret = wr;
+	} else {
+	  TEMP_FAILURE_RETRY(::close(fd));
+	}
+      }
+    }
+    dout(10) << "_flush_pending setattrs " << pending.cid << "/" << pending.oid
+	     << " = " << r << dendl;
+    if (r == -ENOSPC)
+      dout(0) << "WARNING: ignoring setattr ENOSPC failure, until we implement a workaround for extN"
+	      << " xattr limitations" << dendl;
+    else if (r < 0 && ret == 0)
+      ret = r;
+    pending.attrs.clear();
+  }
+
+  if (pending.touched) {
+    int r = _flush_pending_data(pending);
+    if (r < 0 && ret == 0)
+      ret = r;
+  }
+
+  pending.touched = false;
+  pending.active = false;
+  return ret;
+}
+
+
 // --------------------
 // objects
 
@@ -2621,29 +2986,43 @@ int FileStore::_write(coll_t cid, const hobject_t& oid,
                      const bufferlist& bl)
 {
   dout(15) << "write " << cid << "/" << oid << " " << offset << "~" << len << dendl;
-  int r;
-
-  int64_t actual;
 
   char buf[80];
   int flags = O_WRONLY|O_CREAT;
   int fd = lfn_open(cid, oid, flags, 0644);
   if (fd < 0) {
+    int r = -errno;
     dout(0) << "write couldn't open " << cid << "/" << oid << " flags " << flags << " errno " << errno << " " << strerror_r(errno, buf, sizeof(buf)) << dendl;
-    r = -errno;
-    goto out;
+    dout(10) << "write " << cid << "/" << oid << " " << offset << "~" << len << " = " << r << dendl;
+    return r;
   }
+  return _write_fd(cid, oid, fd, offset, len, bl);
+}
+
+/*
+ * write to an already open object.  consumes fd: it is either closed or
+ * handed to the flusher.
+ */
+int FileStore::_write_fd(coll_t cid, const hobject_t& oid, int fd,
+			 uint64_t offset, size_t len,
+			 const bufferlist& bl)
+{
+  int r;
+  int64_t actual;
+  char buf[80];
     
   // seek
   actual = ::lseek64(fd, offset, SEEK_SET);
   if (actual < 0) {
     dout(0) << "write lseek64 to " << offset << " failed: " << strerror_r(errno, buf, sizeof(buf)) << dendl;
     r = -errno;
+    TEMP_FAILURE_RETRY(::close(fd));
     goto out;
   }
   if (actual != (int64_t)offset) {
     dout(0) << "write lseek64 to " << offset << " gave bad offset " << actual << dendl;
     r = -EIO;
+    TEMP_FAILURE_RETRY(::close(fd));
     goto out;
   }
 
@@ -2651,6 +3030,8 @@ int FileStore::_write(coll_t cid, const hobject_t& oid,
   r = bl.write_fd(fd);
   if (r == 0)
     r = bl.length();
+  if (track_dirty)
+    _mark_dirty(cid, oid, fd);
 
   // flush?
 #ifdef HAVE_SYNC_FILE_RANGE
@@ -2707,6 +3088,8 @@ int FileStore::_clone(coll_t cid, const hobject_t& oldoid, const hobject_t& newo
   }
   if (r < 0)
     r = -errno;
+  if (track_dirty)
+    _mark_dirty(cid, newoid, n);
 
   ::close(n);
  out:
@@ -2802,16 +3185,15 @@ int FileStore::_do_copy_range(int from, int to, uint64_t srcoff, uint64_t len, u
 {
   dout(20) << "_do_copy_range " << srcoff << "~" << len << " to " << dstoff << dendl;
   int r = 0;
-  ::lseek64(from, srcoff, SEEK_SET);
-  ::lseek64(to, dstoff, SEEK_SET);
-  
+  // pread/pwrite: from and to may be dups of cached fds, so leave the
+  // shared file offsets alone
   loff_t pos = srcoff;
   loff_t end = srcoff + len;
   int buflen = 4096*32;
   char buf[buflen];
   while (pos < end) {
     int l = MIN(end-pos, buflen);
-    r = ::read(from, buf, l);
+    r = ::pread64(from, buf, l, pos);
     dout(25) << "  read from " << from << "~" << l << " got " << r << dendl;
     if (r < 0) {
       r = -errno;
@@ -2828,7 +3210,7 @@ int FileStore::_do_copy_range(int from, int to, uint64_t srcoff, uint64_t len, u
     }
     int op = 0;
     while (op < r) {
-      int r2 = safe_write(to, buf+op, r-op);
+      int r2 = safe_pwrite(to, buf+op, r-op, dstoff + (pos - srcoff) + op);
       dout(25) << " write to " << to << "~" << (r-op) << " got " << r2 << dendl;      
       if (r2 < 0) {
 	r = r2;
@@ -2864,6 +3246,8 @@ int FileStore::_clone_range(coll_t cid, const hobject_t& oldoid, const hobject_t
     goto out;
   }
   r = _do_clone_range(o, n, srcoff, len, dstoff);
+  if (track_dirty)
+    _mark_dirty(cid, newoid, n);
   ::close(n);
  out:
   ::close(o);
@@ -2965,6 +3349,67 @@ private:
   int m_commit_timeo;
 };
 
+/*
+ * Remember that oid's data must be on disk by the next commit.  We keep
+ * our own dup of the fd until then, so neither a later rename, unlink or
+ * eviction from the fd cache can lose track of the file.
+ */
+void FileStore::_mark_dirty(coll_t cid, const hobject_t& oid, int fd)
+{
+  Mutex::Locker l(dirty_lock);
+  if (dirty_overflow)
+    return;
+  struct stat st;
+  if (::fstat(fd, &st) < 0) {
+    int err = errno;
+    dout(0) << "_mark_dirty fstat " << cid << "/" << oid << " got " << cpp_strerror(err)
+	    << ", next commit will sync everything" << dendl;
+    dirty_overflow = true;
+    return;
+  }
+  pair<map<DirtyKey, DirtyObject>::iterator, bool> r =
+    dirty.insert(make_pair(DirtyKey(st.st_dev, st.st_ino), DirtyObject()));
+  if (!r.second)
+    return;
+  if ((int)dirty.size() <= m_filestore_sync_max_dirty)
+    r.first->second.fd = ::dup(fd);
+  if (r.first->second.fd < 0) {
+    dout(10) << "_mark_dirty " << dirty.size() << " dirty objects, next commit will sync everything" << dendl;
+    dirty.erase(r.first);
+    dirty_overflow = true;
+  }
+}
+
+/*
+ * fdatasync each object written since the last commit, in parallel on
+ * sync_tp, then fsync op_seq.  Namespace and xattr changes are metadata:
+ * the fsync forces the filesystem's own journal (ext3/4, xfs) to commit
+ * through op_seq's update, which was made after all of them.
+ */
+void FileStore::sync_dirty(map<DirtyKey, DirtyObject>& objs)
+{
+  dout(15) << "sync_entry fdatasync on " << objs.size() << " dirty objects" << dendl;
+  for (map<DirtyKey, DirtyObject>::iterator p = objs.begin(); p != objs.end(); ++p)
+    sync_wq.queue(&p->second);
+  sync_wq.drain();
+  if (logger)
+    logger->inc(l_os_commit_dirty, objs.size());
+
+  for (map<DirtyKey, DirtyObject>::iterator p = objs.begin(); p != objs.end(); ++p) {
+    if (p->second.r < 0) {
+      derr << "sync_entry fdatasync on inode " << p->first.second
+	   << " got " << cpp_strerror(p->second.r) << dendl;
+      assert(0 == "fdatasync failed");
+    }
+  }
+
+  if (::fsync(op_fd) < 0) {
+    int err = errno;
+    derr << "sync_entry fsync of op_seq got " << cpp_strerror(err) << dendl;
+    assert(0 == "fsync failed");
+  }
+}
+
 void FileStore::sync_entry()
 {
   lock.Lock();
@@ -2986,16 +3431,25 @@ void FileStore::sync_entry()
       dout(20) << "sync_entry force_sync set" << dendl;
       force_sync = false;
     } else {
-      // wait for at least the min interval
-      utime_t woke = ceph_clock_now(g_ceph_context);
-      woke -= startwait;
-      dout(20) << "sync_entry woke after " << woke << dendl;
-      if (woke < min_interval) {
+      // wait for at least the min interval.  we may be woken early
+      // again (writeback throttle, journal), so recheck; only an
+      // explicit start_sync() cuts this short.
+      while (!stop) {
+	utime_t woke = ceph_clock_now(g_ceph_context);
+	woke -= startwait;
+	dout(20) << "sync_entry woke after " << woke << dendl;
+	if (woke >= min_interval)
+	  break;
 	utime_t t = min_interval;
 	t -= woke;
 	dout(20) << "sync_entry waiting for another " << t 
 		 << " to reach min interval " << min_interval << dendl;
 	sync_cond.WaitInterval(g_ceph_context, lock, t);
+	if (force_sync) {
+	  dout(20) << "sync_entry force_sync set" << dendl;
+	  force_sync = false;
+	  break;
+	}
       }
     }
 
@@ -3007,6 +3461,7 @@ void FileStore::sync_entry()
     if (commit_start()) {
       utime_t start = ceph_clock_now(g_ceph_context);
       uint64_t cp = committing_seq;
+      wb_commit_start();
 
       sync_entry_timeo_lock.Lock();
       SyncEntryTimeout *sync_entry_timeo =
@@ -3076,12 +3531,32 @@ void FileStore::sync_entry()
 	  commit_started();
 	}
       } else {
+	// everything applied up to cp is in the dirty set now; later ops
+	// start a new one.
+	map<DirtyKey, DirtyObject> objs;
+	bool overflow = false;
+	if (track_dirty) {
+	  Mutex::Locker l(dirty_lock);
+	  objs.swap(dirty);
+	  overflow = dirty_overflow;
+	  dirty_overflow = false;
+	}
+
 	commit_started();
 
 	if (btrfs) {
 	  dout(15) << "sync_entry doing btrfs SYNC" << dendl;
 	  // do a full btrfs commit
 	  ::ioctl(op_fd, BTRFS_IOC_SYNC);
+	} else if (have_syncfs) {
+	  dout(15) << "sync_entry doing syncfs" << dendl;
+	  int r = try_syncfs(basedir_fd);
+	  if (r < 0) {
+	    derr << "sync_entry syncfs got " << cpp_strerror(r) << dendl;
+	    assert(0 == "syncfs failed");
+	  }
+	} else if (track_dirty && !overflow) {
+	  sync_dirty(objs);
 	} else if (m_filestore_fsync_flushes_journal_data) {
 	  dout(15) << "sync_entry doing fsync on " << current_op_seq_fn << dendl;
 	  // make the file system's journal commit.
@@ -3090,6 +3565,8 @@ void FileStore::sync_entry()
 	} else {
 	  dout(15) << "sync_entry doing a full sync (!)" << dendl;
 	  sync_filesystem(basedir_fd);
+	  for (map<DirtyKey, DirtyObject>::iterator p = objs.begin(); p != objs.end(); ++p)
+	    TEMP_FAILURE_RETRY(::close(p->second.fd));
 	}
       }
       
@@ -3098,8 +3575,11 @@ void FileStore::sync_entry()
       dout(10) << "sync_entry commit took " << done << dendl;
       commit_finish();
 
-      if (logger)
+      if (logger) {
 	logger->set(l_os_committing, 0);
+	logger->tinc(l_os_commit_lat, done);
+      }
+      wb_commit_finish(done);
 
       // remove old snaps?
       if (do_snap) {
@@ -3142,6 +3622,120 @@ void FileStore::sync_entry()
   lock.Unlock();
 }
 
+// -- writeback throttle --
+
+/*
+ * How long to hold back a transaction of this many bytes.  Nothing until
+ * the dirty data would take filestore_wbthrottle_low of the target time
+ * to sync; from there the delay ramps up linearly, reaching the time the
+ * disk needs to write the transaction itself at the target.  Past that,
+ * admission is slower than the disk drains and the backlog shrinks.
+ */
+double FileStore::_wb_delay(uint64_t bytes)
+{
+  assert(wb_lock.is_locked());
+  // whichever is slower is what the disk is actually absorbing
+  double bw = wb_sync_bw;
+  if (wb_apply_bw > 0 && wb_apply_bw < bw)
+    bw = wb_apply_bw;
+  if (bw <= 0)
+    return 0;   // nothing measured yet
+
+  double target = bw * m_filestore_wbthrottle_target_sync;
+  double low = target * m_filestore_wbthrottle_low;
+  double pending = wb_dirty_bytes + wb_committing_bytes;
+  if (pending <= low || target <= low)
+    return 0;
+  double delay = (pending - low) / (target - low) * (double)bytes / bw;
+  return MIN(delay, m_filestore_wbthrottle_max_delay);
+}
+
+void FileStore::wb_throttle(uint64_t bytes)
+{
+  Mutex::Locker l(wb_lock);
+  double delay = _wb_delay(bytes);
+  if (delay <= 0)
+    return;
+
+  // a commit finishing mid-wait may let us go early
+  utime_t start = ceph_clock_now(g_ceph_context);
+  utime_t waited;
+  while (!stop) {
+    dout(15) << "wb_throttle " << bytes << " bytes, dirty " << wb_dirty_bytes
+	     << " committing " << wb_committing_bytes << ", delaying " << delay
+	     << " (waited " << waited << ")" << dendl;
+    utime_t t;
+    t.set_from_double(delay - (double)waited);
+    wb_cond.WaitInterval(g_ceph_context, wb_lock, t);
+    waited = ceph_clock_now(g_ceph_context) - start;
+    delay = _wb_delay(bytes);
+    if ((double)waited >= delay)
+      break;
+  }
+  if (logger)
+    logger->tinc(l_os_wb_delay, waited);
+}
+
+/*
+ * Account for bytes just applied.  If the dirty data already exceeds the
+ * target, wake the sync thread rather than waiting for max_sync_interval.
+ */
+void FileStore::wb_applied(uint64_t bytes, utime_t lat)
+{
+  bool kick = false;
+  uint64_t dirty;
+  {
+    Mutex::Locker l(wb_lock);
+    wb_dirty_bytes += bytes;
+    dirty = wb_dirty_bytes;
+    if (bytes && lat > utime_t()) {
+      double bw = (double)bytes / (double)lat;
+      wb_apply_bw = wb_apply_bw > 0 ? wb_apply_bw * .9 + bw * .1 : bw;
+    }
+    if (m_filestore_wbthrottle && !wb_sync_requested && wb_sync_bw > 0 &&
+	wb_dirty_bytes > wb_sync_bw * m_filestore_wbthrottle_target_sync) {
+      wb_sync_requested = true;
+      kick = true;
+    }
+    if (logger) {
+      logger->set(l_os_wb_dirty, wb_dirty_bytes + wb_committing_bytes);
+      logger->set(l_os_wb_apply_bw, (uint64_t)wb_apply_bw);
+    }
+  }
+  if (kick) {
+    dout(10) << "wb_applied " << dirty << " dirty bytes, starting a commit early" << dendl;
+    Mutex::Locker l(lock);
+    sync_cond.Signal();
+  }
+}
+
+void FileStore::wb_commit_start()
+{
+  Mutex::Locker l(wb_lock);
+  wb_committing_bytes = wb_dirty_bytes;
+  wb_dirty_bytes = 0;
+  wb_sync_requested = false;
+}
+
+void FileStore::wb_commit_finish(utime_t lat)
+{
+  Mutex::Locker l(wb_lock);
+  // small commits are dominated by fixed costs and would understate
+  // what the disk can do
+  if (wb_committing_bytes >= (1 << 20) && lat > utime_t()) {
+    double bw = (double)wb_committing_bytes / (double)lat;
+    wb_sync_bw = wb_sync_bw > 0 ? wb_sync_bw * .7 + bw * .3 : bw;
+    dout(10) << "wb_commit_finish synced " << wb_committing_bytes << " bytes in " << lat
+	     << ", sync bw now " << (uint64_t)wb_sync_bw << " bytes/sec" << dendl;
+  }
+  wb_committing_bytes = 0;
+  if (logger) {
+    logger->set(l_os_wb_dirty, wb_dirty_bytes);
+    logger->set(l_os_wb_sync_bw, (uint64_t)wb_sync_bw);
+  }
+  wb_cond.Signal();
+}
+
 void FileStore::_start_sync()
 {
   if (!journal) {  // don't do a big sync if the journal is on
@@ -3615,6 +4209,8 @@ int FileStore::_collection_rename(const coll_t &cid, const coll_t &ncid)
   if (::rename(old_coll, new_coll)) {
     ret = errno;
   }
+  fdcache.invalidate_collection(cid);
+  fdcache.invalidate_collection(ncid);
   dout(10) << "collection_rename '" << cid << "' to '" << ncid << "'"
 	   << ": ret = " << ret << dendl;
   return ret;
@@ -3778,6 +4374,7 @@ int FileStore::_destroy_collection(coll_t c)
   dout(15) << "_destroy_collection " << fn << dendl;
   int r = ::rmdir(fn);
   if (r < 0) r = -errno;
+  fdcache.invalidate_collection(c);
   dout(10) << "_destroy_collection " << fn << " = " << r << dendl;
   return r;
 }
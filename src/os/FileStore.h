@@ -25,6 +25,7 @@
 #include "common/Mutex.h"
 #include "HashIndex.h"
 #include "IndexManager.h"
+#include "FDCache.h"
 
 #include "Fake.h"
 
@@ -106,6 +107,7 @@ class FileStore : public JournalingObjectStore,
 
   // -- op workqueue --
   struct Op {
+    utime_t start;
     uint64_t op;
     list<Transaction*> tls;
     Context *onreadable, *onreadable_sync;
@@ -119,6 +121,8 @@ class FileStore : public JournalingObjectStore,
   public:
     Sequencer *parent;
     Mutex apply_lock;  // for apply mutual exclusion
+    bool in_wq;        // on op_queue or being applied (op_tp lock)
+    int batch;         // ops taken by the current _do_op (apply_lock)
     
     void queue_journal(uint64_t s) {
       Mutex::Locker l(qlock);
@@ -137,6 +141,18 @@ class FileStore : public JournalingObjectStore,
       assert(apply_lock.is_locked());
       return q.front();
     }
+    /// the first (up to) max queued ops, in order
+    void peek_batch(list<Op*>& ls, int max) {
+      assert(apply_lock.is_locked());
+      Mutex::Locker l(qlock);
+      int n = 0;
+      for (list<Op*>::iterator p = q.begin(); p != q.end() && n < max; ++p, ++n)
+	ls.push_back(*p);
+    }
+    bool have_queued() {
+      Mutex::Locker l(qlock);
+      return !q.empty();
+    }
     Op *dequeue() {
       assert(apply_lock.is_locked());
       Mutex::Locker l(qlock);
@@ -164,7 +180,8 @@ class FileStore : public JournalingObjectStore,
     }
 
     OpSequencer() : qlock("FileStore::OpSequencer::qlock", false, false),
-		    apply_lock("FileStore::OpSequencer::apply_lock", false, false) {}
+		    apply_lock("FileStore::OpSequencer::apply_lock", false, false),
+		    in_wq(false), batch(0) {}
     ~OpSequencer() {
       assert(q.empty());
     }
@@ -184,6 +201,12 @@ class FileStore : public JournalingObjectStore,
       : ThreadPool::WorkQueue<OpSequencer>("FileStore::OpWQ", timeout, suicide_timeout, tp), store(fs) {}
 
     bool _enqueue(OpSequencer *osr) {
+      // a sequencer is queued at most once.  whoever is applying it
+      // picks up anything queued behind it (see _finish_op), so a
+      // second worker never sits blocked on its apply_lock.
+      if (osr->in_wq)
+	return false;
+      osr->in_wq = true;
       store->op_queue.push_back(osr);
       return true;
     }
@@ -213,6 +236,7 @@ class FileStore : public JournalingObjectStore,
 
   void _do_op(OpSequencer *o);
   void _finish_op(OpSequencer *o);
+  void _finish_one_op(Op *o);
   Op *build_op(list<Transaction*>& tls,
 	       Context *onreadable, Context *onreadable_sync);
   void queue_op(OpSequencer *osr, Op *o);
@@ -237,6 +261,78 @@ class FileStore : public JournalingObjectStore,
   } flusher_thread;
   bool queue_flusher(int fd, uint64_t off, uint64_t len);
 
+  // commit without syncfs(2): fdatasync what we wrote since the last commit.
+  // keyed by inode, not name: the file may be linked into another
+  // collection and unlinked from this one (or a new file take its name)
+  // before the commit, and its data still has to be synced.
+  typedef pair<uint64_t, uint64_t> DirtyKey;   // st_dev, st_ino
+  struct DirtyObject {
+    int fd;    // our own dup; holds the inode until the commit
+    int r;
+    DirtyObject() : fd(-1), r(0) {}
+  };
+  bool have_syncfs;
+  bool track_dirty;
+  Mutex dirty_lock;
+  map<DirtyKey, DirtyObject> dirty;
+  bool dirty_overflow;    // too many to track; do a full sync this time
+  void _mark_dirty(coll_t cid, const hobject_t& oid, int fd);
+  void sync_dirty(map<DirtyKey, DirtyObject>& objs);
+
+  ThreadPool sync_tp;
+  deque<DirtyObject*> sync_queue;
+  struct SyncWQ : public ThreadPool::WorkQueue<DirtyObject> {
+    FileStore *store;
+    SyncWQ(FileStore *fs, time_t timeout, time_t suicide_timeout, ThreadPool *tp)
+      : ThreadPool::WorkQueue<DirtyObject>("FileStore::SyncWQ", timeout, suicide_timeout, tp),
+	store(fs) {}
+
+    bool _enqueue(DirtyObject *o) {
+      store->sync_queue.push_back(o);
+      return true;
+    }
+    void _dequeue(DirtyObject *o) {
+      assert(0);
+    }
+    bool _empty() {
+      return store->sync_queue.empty();
+    }
+    DirtyObject *_dequeue() {
+      if (store->sync_queue.empty())
+	return NULL;
+      DirtyObject *o = store->sync_queue.front();
+      store->sync_queue.pop_front();
+      return o;
+    }
+    void _process(DirtyObject *o) {
+      o->r = ::fdatasync(o->fd);
+      if (o->r < 0)
+	o->r = -errno;
+      TEMP_FAILURE_RETRY(::close(o->fd));
+      o->fd = -1;
+    }
+    void _clear() {
+      assert(store->sync_queue.empty());
+    }
+  } sync_wq;
+
+  /*
+   * writeback throttle: admit new transactions no faster than we have
+   * measured we can sync them, so dirty data stays within roughly
+   * filestore_wbthrottle_target_sync seconds of writeback.
+   */
+  Mutex wb_lock;
+  Cond wb_cond;
+  uint64_t wb_dirty_bytes;        // applied since the last commit started
+  uint64_t wb_committing_bytes;   // being synced by the current commit
+  double wb_sync_bw, wb_apply_bw; // bytes/sec, smoothed; 0 until measured
+  bool wb_sync_requested;
+  double _wb_delay(uint64_t bytes);
+  void wb_throttle(uint64_t bytes);
+  void wb_applied(uint64_t bytes, utime_t lat);
+  void wb_commit_start();
+  void wb_commit_finish(utime_t lat);
+
   int open_journal();
 
 
@@ -246,7 +342,7 @@ public:
   void start_logger(int whoami, utime_t tare);
   void stop_logger();
 
-  int lfn_find(coll_t cid, const hobject_t& oid, IndexedPath *path);
+  int lfn_find(coll_t cid, const hobject_t& oid, string *path);
   int lfn_getxattr(coll_t cid, const hobject_t& oid, const char *name, void *val, size_t size);
   int lfn_setxattr(coll_t cid, const hobject_t& oid, const char *name, const void *val, size_t size);
   int lfn_removexattr(coll_t cid, const hobject_t& oid, const char *name);
@@ -284,7 +380,33 @@ public:
   unsigned apply_transactions(list<Transaction*>& tls, Context *ondisk=0);
   int _transaction_start(uint64_t bytes, uint64_t ops);
   void _transaction_finish(int id);
-  unsigned _do_transaction(Transaction& t);
+  /*
+   * Writes and xattr updates to a single object, held back while we
+   * apply a batch so that adjacent/overlapping writes go down as one
+   * write and repeated setattrs of the same name collapse into one.
+   * Anything else flushes it first, so the visible order of operations
+   * is unchanged.
+   */
+  struct PendingApply {
+    bool active;
+    coll_t cid;
+    hobject_t oid;
+    bool touched;   // a write was queued, so the object must exist
+    uint64_t off;
+    bufferlist data;
+    map<string, bufferptr> attrs;
+    PendingApply() : active(false), touched(false), off(0) {}
+  };
+  int _pending_switch(PendingApply& pending, coll_t cid, const hobject_t& oid);
+  int _pending_write(PendingApply& pending, coll_t cid, const hobject_t& oid,
+		     uint64_t off, bufferlist& bl);
+  int _pending_setattr(PendingApply& pending, coll_t cid, const hobject_t& oid,
+		       const string& name, bufferlist& bl);
+  int _flush_pending_data(PendingApply& pending);
+  int _flush_pending(PendingApply& pending);
+
+  unsigned _do_transaction(Transaction& t, PendingApply& pending);
+  void _check_op_result(int op, int r);
 
   int queue_transaction(Sequencer *osr, Transaction* t);
   int queue_transactions(Sequencer *osr, list<Transaction*>& tls, Context *onreadable, Context *ondisk=0,
@@ -302,6 +424,7 @@ public:
 
   int _touch(coll_t cid, const hobject_t& oid);
   int _write(coll_t cid, const hobject_t& oid, uint64_t offset, size_t len, const bufferlist& bl);
+  int _write_fd(coll_t cid, const hobject_t& oid, int fd, uint64_t offset, size_t len, const bufferlist& bl);
   int _zero(coll_t cid, const hobject_t& oid, uint64_t offset, size_t len);
   int _truncate(coll_t cid, const hobject_t& oid, uint64_t size);
   int _clone(coll_t cid, const hobject_t& oldoid, const hobject_t& newoid);
@@ -392,6 +515,18 @@ private:
   int m_filestore_queue_max_bytes;
   int m_filestore_queue_committing_max_ops;
   int m_filestore_queue_committing_max_bytes;
+  int m_filestore_apply_batch_ops;
+  bool m_filestore_apply_coalesce;
+  int m_filestore_apply_coalesce_max_bytes;
+  int m_filestore_fd_cache_size;
+  bool m_filestore_syncfs;
+  int m_filestore_sync_max_dirty;
+  bool m_filestore_wbthrottle;
+  double m_filestore_wbthrottle_target_sync;
+  double m_filestore_wbthrottle_low;
+  double m_filestore_wbthrottle_max_delay;
+
+  FDCache fdcache;
 };
 
 #endif
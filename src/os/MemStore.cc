@@ -0,0 +1,1004 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2012 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+
+#include "MemStore.h"
+#include "include/Context.h"
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/debug.h"
+#include "common/errno.h"
+#include "common/config.h"
+
+#define DOUT_SUBSYS filestore
+#undef dout_prefix
+#define dout_prefix *_dout << "memstore(" << path << ") "
+
+// fragmented objects get flattened once they reach this many buffers
+#define MAX_OBJECT_BUFFERS 64
+
+void MemStore::Collection::encode(bufferlist& bl) const
+{
+  __u8 struct_v = 1;
+  ::encode(struct_v, bl);
+  ::encode(xattr, bl);
+  __u32 n = objects.size();
+  ::encode(n, bl);
+  for (map<hobject_t, ObjectRef, HashOrder>::const_iterator p = objects.begin();
+       p != objects.end();
+       ++p) {
+    ::encode(p->first, bl);
+    ::encode(*p->second, bl);
+  }
+}
+
+void MemStore::Collection::decode(bufferlist::iterator& p)
+{
+  __u8 struct_v;
+  ::decode(struct_v, p);
+  ::decode(xattr, p);
+  __u32 n;
+  ::decode(n, p);
+  objects.clear();
+  while (n--) {
+    hobject_t oid;
+    ::decode(oid, p);
+    ObjectRef o(new Object);
+    ::decode(*o, p);
+    objects[oid] = o;
+  }
+}
+
+MemStore::MemStore(const string& path_)
+  : path(path_),
+    lock("MemStore::lock"),
+    used_bytes(0),
+    finisher(g_ceph_context)
+{
+}
+
+MemStore::~MemStore()
+{
+}
+
+MemStore::CollectionRef MemStore::get_collection(coll_t cid)
+{
+  map<coll_t, CollectionRef>::iterator p = coll_map.find(cid);
+  if (p == coll_map.end())
+    return CollectionRef();
+  return p->second;
+}
+
+MemStore::ObjectRef MemStore::get_object(coll_t cid, const hobject_t& oid)
+{
+  CollectionRef c = get_collection(cid);
+  if (!c)
+    return ObjectRef();
+  return c->get_object(oid);
+}
+
+
+// -------------------------
+// mgmt
+
+int MemStore::mkfs()
+{
+  dout(1) << "mkfs" << dendl;
+  lock.get_write();
+  coll_map.clear();
+  used_bytes = 0;
+  int r = _save();
+  lock.put_write();
+  return r;
+}
+
+int MemStore::mount()
+{
+  dout(1) << "mount" << dendl;
+  lock.get_write();
+  int r = _load();
+  lock.put_write();
+  if (r < 0)
+    return r;
+  finisher.start();
+  return 0;
+}
+
+int MemStore::umount()
+{
+  dout(1) << "umount" << dendl;
+  finisher.wait_for_empty();
+  finisher.stop();
+  lock.get_write();
+  int r = _save();
+  coll_map.clear();
+  used_bytes = 0;
+  lock.put_write();
+  return r;
+}
+
+int MemStore::_save()
+{
+  string fn = path + "/memstore";
+  string tmp = fn + ".tmp";
+  bufferlist bl;
+  __u8 struct_v = 1;
+  ::encode(struct_v, bl);
+  __u32 n = coll_map.size();
+  ::encode(n, bl);
+  for (map<coll_t, CollectionRef>::iterator p = coll_map.begin();
+       p != coll_map.end();
+       ++p) {
+    ::encode(p->first, bl);
+    ::encode(*p->second, bl);
+  }
+  dout(10) << "_save " << coll_map.size() << " collections, " << bl.length()
+	   << " bytes to " << fn << dendl;
+  int r = bl.write_file(tmp.c_str());
+  if (r < 0) {
+    derr << "_save failed to write " << tmp << ": " << cpp_strerror(r) << dendl;
+    return r;
+  }
+  if (::rename(tmp.c_str(), fn.c_str()) < 0) {
+    r = -errno;
+    derr << "_save failed to rename " << tmp << ": " << cpp_strerror(r) << dendl;
+    return r;
+  }
+  return 0;
+}
+
+int MemStore::_load()
+{
+  string fn = path + "/memstore";
+  bufferlist bl;
+  string err;
+  int r = bl.read_file(fn.c_str(), &err);
+  if (r < 0) {
+    derr << "_load " << err << dendl;
+    return r;
+  }
+
+  coll_map.clear();
+  used_bytes = 0;
+  try {
+    bufferlist::iterator p = bl.begin();
+    __u8 struct_v;
+    ::decode(struct_v, p);
+    __u32 n;
+    ::decode(n, p);
+    while (n--) {
+      coll_t cid;
+      ::decode(cid, p);
+      CollectionRef c(new Collection);
+      ::decode(*c, p);
+      for (map<hobject_t, ObjectRef, HashOrder>::iterator q = c->objects.begin();
+	   q != c->objects.end();
+	   ++q)
+	used_bytes += q->second->data.length();
+      coll_map[cid] = c;
+    }
+  } catch (buffer::error& e) {
+    derr << "_load " << fn << " is corrupt" << dendl;
+    coll_map.clear();
+    used_bytes = 0;
+    return -EIO;
+  }
+  dout(10) << "_load " << coll_map.size() << " collections, " << used_bytes
+	   << " bytes of data" << dendl;
+  return 0;
+}
+
+int MemStore::statfs(struct statfs *st)
+{
+  uint64_t total = g_conf->memstore_device_bytes;
+  lock.get_read();
+  uint64_t used = used_bytes;
+  lock.put_read();
+
+  memset(st, 0, sizeof(*st));
+  st->f_bsize = 4096;
+  st->f_blocks = total / st->f_bsize;
+  uint64_t used_blocks = (used + st->f_bsize - 1) / st->f_bsize;
+  st->f_bfree = st->f_blocks > used_blocks ? st->f_blocks - used_blocks : 0;
+  st->f_bavail = st->f_bfree;
+  return 0;
+}
+
+
+// -------------------------
+// objects
+
+bool MemStore::exists(coll_t cid, const hobject_t& oid)
+{
+  RWLock::RLocker l(lock);
+  return get_object(cid, oid) != NULL;
+}
+
+int MemStore::stat(coll_t cid, const hobject_t& oid, struct stat *st)
+{
+  RWLock::RLocker l(lock);
+  ObjectRef o = get_object(cid, oid);
+  if (!o)
+    return -ENOENT;
+  memset(st, 0, sizeof(*st));
+  st->st_size = o->data.length();
+  st->st_blksize = 4096;
+  st->st_blocks = (st->st_size + 511) / 512;
+  st->st_nlink = 1;
+  return 0;
+}
+
+int MemStore::read(coll_t cid, const hobject_t& oid, uint64_t offset, size_t len,
+		   bufferlist& bl)
+{
+  dout(15) << "read " << cid << "/" << oid << " " << offset << "~" << len << dendl;
+  RWLock::RLocker l(lock);
+  ObjectRef o = get_object(cid, oid);
+  if (!o)
+    return -ENOENT;
+  if (offset >= o->data.length())
+    return 0;
+  if (len == 0 || offset + len > o->data.length())
+    len = o->data.length() - offset;
+  // share the buffers; writes never modify them in place
+  bufferlist got;
+  got.substr_of(o->data, offset, len);
+  bl.claim_append(got);
+  return len;
+}
+
+int MemStore::fiemap(coll_t cid, const hobject_t& oid, uint64_t offset, size_t len,
+		     bufferlist& bl)
+{
+  RWLock::RLocker l(lock);
+  ObjectRef o = get_object(cid, oid);
+  if (!o)
+    return -ENOENT;
+  map<uint64_t, uint64_t> m;
+  if (offset < o->data.length()) {
+    if (offset + len > o->data.length())
+      len = o->data.length() - offset;
+    m[offset] = len;
+  }
+  ::encode(m, bl);
+  return 0;
+}
+
+int MemStore::getattr(coll_t cid, const hobject_t& oid, const char *name,
+		      void *value, size_t size)
+{
+  RWLock::RLocker l(lock);
+  ObjectRef o = get_object(cid, oid);
+  if (!o)
+    return -ENOENT;
+  map<string,bufferptr>::iterator p = o->xattr.find(name);
+  if (p == o->xattr.end())
+    return -ENODATA;
+  size_t len = MIN(size, p->second.length());
+  memcpy(value, p->second.c_str(), len);
+  return len;
+}
+
+int MemStore::getattr(coll_t cid, const hobject_t& oid, const char *name,
+		      bufferptr& value)
+{
+  RWLock::RLocker l(lock);
+  ObjectRef o = get_object(cid, oid);
+  if (!o)
+    return -ENOENT;
+  map<string,bufferptr>::iterator p = o->xattr.find(name);
+  if (p == o->xattr.end())
+    return -ENODATA;
+  value = p->second;
+  return value.length();
+}
+
+int MemStore::getattrs(coll_t cid, const hobject_t& oid, map<string,bufferptr>& aset,
+		       bool user_only)
+{
+  RWLock::RLocker l(lock);
+  ObjectRef o = get_object(cid, oid);
+  if (!o)
+    return -ENOENT;
+  for (map<string,bufferptr>::iterator p = o->xattr.begin();
+       p != o->xattr.end();
+       ++p) {
+    if (!user_only)
+      aset[p->first] = p->second;
+    else if (p->first.length() > 1 && p->first[0] == '_')
+      aset[p->first.substr(1)] = p->second;  // same convention as FileStore
+  }
+  return 0;
+}
+
+
+// -------------------------
+// collections
+
+int MemStore::list_collections(vector<coll_t>& ls)
+{
+  RWLock::RLocker l(lock);
+  for (map<coll_t, CollectionRef>::iterator p = coll_map.begin();
+       p != coll_map.end();
+       ++p)
+    ls.push_back(p->first);
+  return 0;
+}
+
+bool MemStore::collection_exists(coll_t c)
+{
+  RWLock::RLocker l(lock);
+  return coll_map.count(c);
+}
+
+int MemStore::collection_getattr(coll_t cid, const char *name, void *value, size_t size)
+{
+  RWLock::RLocker l(lock);
+  CollectionRef c = get_collection(cid);
+  if (!c)
+    return -ENOENT;
+  map<string,bufferptr>::iterator p = c->xattr.find(name);
+  if (p == c->xattr.end())
+    return -ENODATA;
+  size_t len = MIN(size, p->second.length());
+  memcpy(value, p->second.c_str(), len);
+  return len;
+}
+
+int MemStore::collection_getattr(coll_t cid, const char *name, bufferlist& bl)
+{
+  RWLock::RLocker l(lock);
+  CollectionRef c = get_collection(cid);
+  if (!c)
+    return -ENOENT;
+  map<string,bufferptr>::iterator p = c->xattr.find(name);
+  if (p == c->xattr.end())
+    return -ENODATA;
+  bl.clear();
+  bl.append(p->second);
+  return bl.length();
+}
+
+int MemStore::collection_getattrs(coll_t cid, map<string,bufferptr>& aset)
+{
+  RWLock::RLocker l(lock);
+  CollectionRef c = get_collection(cid);
+  if (!c)
+    return -ENOENT;
+  aset = c->xattr;
+  return 0;
+}
+
+bool MemStore::collection_empty(coll_t cid)
+{
+  RWLock::RLocker l(lock);
+  CollectionRef c = get_collection(cid);
+  return !c || c->objects.empty();
+}
+
+/*
+ * objects are listed in hash order.  the handle remembers the hash of
+ * the last object returned and how many objects with that hash have been
+ * returned so far, which is enough to resume after a collision.
+ */
+int MemStore::collection_list_partial(coll_t cid, snapid_t seq, vector<hobject_t>& ls,
+				      int max_count, collection_list_handle_t *handle)
+{
+  RWLock::RLocker l(lock);
+  CollectionRef c = get_collection(cid);
+  if (!c)
+    return -ENOENT;
+
+  hobject_t start;
+  start.hash = handle->hash;
+  map<hobject_t, ObjectRef, HashOrder>::iterator p = c->objects.lower_bound(start);
+  uint32_t skip = handle->index;
+  while (skip && p != c->objects.end() && p->first.hash == handle->hash) {
+    ++p;
+    --skip;
+  }
+
+  uint32_t index = handle->index;
+  for (; p != c->objects.end(); ++p) {
+    if (max_count && (int)ls.size() >= max_count)
+      break;
+    if (p->first.hash != handle->hash) {
+      handle->hash = p->first.hash;
+      index = 0;
+    }
+    index++;
+    if (p->first.snap < seq)
+      continue;
+    ls.push_back(p->first);
+  }
+  handle->index = index;
+  return 0;
+}
+
+int MemStore::collection_list(coll_t cid, vector<hobject_t>& ls)
+{
+  RWLock::RLocker l(lock);
+  CollectionRef c = get_collection(cid);
+  if (!c)
+    return -ENOENT;
+  for (map<hobject_t, ObjectRef, HashOrder>::iterator p = c->objects.begin();
+       p != c->objects.end();
+       ++p)
+    ls.push_back(p->first);
+  return 0;
+}
+
+
+// -------------------------
+// transactions
+
+unsigned MemStore::apply_transaction(Transaction& t, Context *ondisk)
+{
+  list<Transaction*> tls;
+  tls.push_back(&t);
+  return apply_transactions(tls, ondisk);
+}
+
+unsigned MemStore::apply_transactions(list<Transaction*>& tls, Context *ondisk)
+{
+  Mutex my_lock("MemStore::apply_transactions::my_lock");
+  Cond my_cond;
+  bool done = false;
+  int r = 0;
+  queue_transactions(NULL, tls, new C_SafeCond(&my_lock, &my_cond, &done, &r), ondisk);
+
+  my_lock.Lock();
+  while (!done)
+    my_cond.Wait(my_lock);
+  my_lock.Unlock();
+  return r;
+}
+
+int MemStore::queue_transaction(Sequencer *osr, Transaction *t)
+{
+  list<Transaction*> tls;
+  tls.push_back(t);
+  return queue_transactions(osr, tls, new C_DeleteTransaction(t));
+}
+
+/*
+ * the transactions are applied here and now, so there is no need to
+ * order them by sequencer; completing the callbacks through one
+ * finisher keeps them in submission order.
+ */
+int MemStore::queue_transactions(Sequencer *osr, list<Transaction*>& tls,
+				 Context *onreadable, Context *ondisk,
+				 Context *onreadable_sync)
+{
+  lock.get_write();
+  for (list<Transaction*>::iterator p = tls.begin(); p != tls.end(); ++p)
+    _do_transaction(**p);
+  lock.put_write();
+
+  if (onreadable_sync)
+    onreadable_sync->complete(0);
+  if (onreadable)
+    finisher.queue(onreadable);
+  if (ondisk)
+    finisher.queue(ondisk);
+  return 0;
+}
+
+void MemStore::sync(Context *onsync)
+{
+  // nothing is ever more durable than it is right now
+  finisher.queue(onsync);
+}
+
+void MemStore::flush()
+{
+  finisher.wait_for_empty();
+}
+
+void MemStore::sync_and_flush()
+{
+  finisher.wait_for_empty();
+}
+
+int MemStore::_do_transaction(Transaction& t)
+{
+  while (t.have_op()) {
+    int op = t.get_op();
+    int r = 0;
+
+    switch (op) {
+    case Transaction::OP_NOP:
+    case Transaction::OP_STARTSYNC:
+      break;
+
+    case Transaction::OP_TOUCH:
+      {
+	coll_t cid = t.get_cid();
+	hobject_t oid = t.get_oid();
+	r = _touch(cid, oid);
+      }
+      break;
+
+    case Transaction::OP_WRITE:
+      {
+	coll_t cid = t.get_cid();
+	hobject_t oid = t.get_oid();
+	uint64_t off = t.get_length();
+	uint64_t len = t.get_length();
+	bufferlist bl;
+	t.get_bl(bl);
+	r = _write(cid, oid, off, len, bl);
+      }
+      break;
+
+    case Transaction::OP_ZERO:
+      {
+	coll_t cid = t.get_cid();
+	hobject_t oid = t.get_oid();
+	uint64_t off = t.get_length();
+	uint64_t len = t.get_length();
+	r = _zero(cid, oid, off, len);
+      }
+      break;
+
+    case Transaction::OP_TRIMCACHE:
+      {
+	t.get_cid();
+	t.get_oid();
+	t.get_length();
+	t.get_length();
+      }
+      break;
+
+    case Transaction::OP_TRUNCATE:
+      {
+	coll_t cid = t.get_cid();
+	hobject_t oid = t.get_oid();
+	uint64_t off = t.get_length();
+	r = _truncate(cid, oid, off);
+      }
+      break;
+
+    case Transaction::OP_REMOVE:
+      {
+	coll_t cid = t.get_cid();
+	hobject_t oid = t.get_oid();
+	r = _remove(cid, oid);
+      }
+      break;
+
+    case Transaction::OP_SETATTR:
+      {
+	coll_t cid = t.get_cid();
+	hobject_t oid = t.get_oid();
+	string name = t.get_attrname();
+	bufferlist bl;
+	t.get_bl(bl);
+	map<string,bufferptr> aset;
+	aset[name] = buffer::copy(bl.c_str(), bl.length());
+	r = _setattrs(cid, oid, aset);
+      }
+      break;
+
+    case Transaction::OP_SETATTRS:
+      {
+	coll_t cid = t.get_cid();
+	hobject_t oid = t.get_oid();
+	map<string,bufferptr> aset;
+	t.get_attrset(aset);
+	r = _setattrs(cid, oid, aset);
+      }
+      break;
+
+    case Transaction::OP_RMATTR:
+      {
+	coll_t cid = t.get_cid();
+	hobject_t oid = t.get_oid();
+	string name = t.get_attrname();
+	r = _rmattr(cid, oid, name.c_str());
+      }
+      break;
+
+    case Transaction::OP_RMATTRS:
+      {
+	coll_t cid = t.get_cid();
+	hobject_t oid = t.get_oid();
+	r = _rmattrs(cid, oid);
+      }
+      break;
+
+    case Transaction::OP_CLONE:
+      {
+	coll_t cid = t.get_cid();
+	hobject_t oid = t.get_oid();
+	hobject_t noid = t.get_oid();
+	r = _clone(cid, oid, noid);
+      }
+      break;
+
+    case Transaction::OP_CLONERANGE:
+      {
+	coll_t cid = t.get_cid();
+	hobject_t oid = t.get_oid();
+	hobject_t noid = t.get_oid();
+	uint64_t off = t.get_length();
+	uint64_t len = t.get_length();
+	r = _clone_range(cid, oid, noid, off, len, off);
+      }
+      break;
+
+    case Transaction::OP_CLONERANGE2:
+      {
+	coll_t cid = t.get_cid();
+	hobject_t oid = t.get_oid();
+	hobject_t noid = t.get_oid();
+	uint64_t srcoff = t.get_length();
+	uint64_t len = t.get_length();
+	uint64_t dstoff = t.get_length();
+	r = _clone_range(cid, oid, noid, srcoff, len, dstoff);
+      }
+      break;
+
+    case Transaction::OP_MKCOLL:
+      {
+	coll_t cid = t.get_cid();
+	r = _create_collection(cid);
+      }
+      break;
+
+    case Transaction::OP_RMCOLL:
+      {
+	coll_t cid = t.get_cid();
+	r = _destroy_collection(cid);
+      }
+      break;
+
+    case Transaction::OP_COLL_ADD:
+      {
+	coll_t ncid = t.get_cid();
+	coll_t ocid = t.get_cid();
+	hobject_t oid = t.get_oid();
+	r = _collection_add(ncid, ocid, oid);
+      }
+      break;
+
+    case Transaction::OP_COLL_REMOVE:
+      {
+	coll_t cid = t.get_cid();
+	hobject_t oid = t.get_oid();
+	r = _collection_remove(cid, oid);
+      }
+      break;
+
+    case Transaction::OP_COLL_SETATTR:
+      {
+	coll_t cid = t.get_cid();
+	string name = t.get_attrname();
+	bufferlist bl;
+	t.get_bl(bl);
+	r = _collection_setattr(cid, name.c_str(), bl.c_str(), bl.length());
+      }
+      break;
+
+    case Transaction::OP_COLL_SETATTRS:
+      {
+	coll_t cid = t.get_cid();
+	map<string,bufferptr> aset;
+	t.get_attrset(aset);
+	r = _collection_setattrs(cid, aset);
+      }
+      break;
+
+    case Transaction::OP_COLL_RMATTR:
+      {
+	coll_t cid = t.get_cid();
+	string name = t.get_attrname();
+	r = _collection_rmattr(cid, name.c_str());
+      }
+      break;
+
+    case Transaction::OP_COLL_RENAME:
+      {
+	coll_t cid(t.get_cid());
+	coll_t ncid(t.get_cid());
+	r = _collection_rename(cid, ncid);
+      }
+      break;
+
+    default:
+      derr << "bad op " << op << dendl;
+      assert(0);
+    }
+
+    if (r == -ENOENT &&
+	(op == Transaction::OP_CLONERANGE ||
+	 op == Transaction::OP_CLONE ||
+	 op == Transaction::OP_CLONERANGE2)) {
+      // same as FileStore: halt before we incorrectly mark the pg clean
+      assert(0 == "ENOENT on clone suggests osd bug");
+    }
+    if (r == -ENOTEMPTY) {
+      assert(0 == "ENOTEMPTY suggests osd bug");
+    }
+    if (r < 0)
+      dout(10) << "_do_transaction op " << op << " got " << cpp_strerror(r) << dendl;
+  }
+  return 0;
+}
+
+/*
+ * build the new contents out of references to the old ones and the
+ * new data, so that bufferlists handed out by read() stay intact.
+ */
+void MemStore::_write_into(Object *o, uint64_t offset, const bufferlist& bl)
+{
+  uint64_t old_len = o->data.length();
+  uint64_t end = offset + bl.length();
+  bufferlist n;
+  if (offset > old_len) {
+    n = o->data;
+    n.append_zero(offset - old_len);
+  } else {
+    n.substr_of(o->data, 0, offset);
+  }
+  n.append(bl);
+  if (end < old_len) {
+    bufferlist tail;
+    tail.substr_of(o->data, end, old_len - end);
+    n.claim_append(tail);
+  }
+  if (n.buffers().size() > MAX_OBJECT_BUFFERS)
+    n.rebuild();
+  used_bytes += n.length();
+  used_bytes -= old_len;
+  o->data.swap(n);
+}
+
+int MemStore::_touch(coll_t cid, const hobject_t& oid)
+{
+  dout(15) << "touch " << cid << "/" << oid << dendl;
+  CollectionRef c = get_collection(cid);
+  if (!c)
+    return -ENOENT;
+  ObjectRef& o = c->objects[oid];
+  if (!o)
+    o.reset(new Object);
+  return 0;
+}
+
+int MemStore::_write(coll_t cid, const hobject_t& oid, uint64_t offset, size_t len,
+		     const bufferlist& bl)
+{
+  dout(15) << "write " << cid << "/" << oid << " " << offset << "~" << len << dendl;
+  assert(len == bl.length());
+  CollectionRef c = get_collection(cid);
+  if (!c)
+    return -ENOENT;
+  ObjectRef& o = c->objects[oid];
+  if (!o)
+    o.reset(new Object);
+  _write_into(o.get(), offset, bl);
+  return 0;
+}
+
+int MemStore::_zero(coll_t cid, const hobject_t& oid, uint64_t offset, size_t len)
+{
+  dout(15) << "zero " << cid << "/" << oid << " " << offset << "~" << len << dendl;
+  bufferptr bp(len);
+  bp.zero();
+  bufferlist bl;
+  bl.push_back(bp);
+  return _write(cid, oid, offset, len, bl);
+}
+
+int MemStore::_truncate(coll_t cid, const hobject_t& oid, uint64_t size)
+{
+  dout(15) << "truncate " << cid << "/" << oid << " size " << size << dendl;
+  ObjectRef o = get_object(cid, oid);
+  if (!o)
+    return -ENOENT;
+  uint64_t old_len = o->data.length();
+  if (size < old_len) {
+    bufferlist n;
+    n.substr_of(o->data, 0, size);
+    o->data.swap(n);
+  } else if (size > old_len) {
+    o->data.append_zero(size - old_len);
+  }
+  used_bytes += size;
+  used_bytes -= old_len;
+  return 0;
+}
+
+int MemStore::_remove(coll_t cid, const hobject_t& oid)
+{
+  dout(15) << "remove " << cid << "/" << oid << dendl;
+  CollectionRef c = get_collection(cid);
+  if (!c)
+    return -ENOENT;
+  map<hobject_t, ObjectRef, HashOrder>::iterator p = c->objects.find(oid);
+  if (p == c->objects.end())
+    return -ENOENT;
+  if (p->second.unique())
+    used_bytes -= p->second->data.length();
+  c->objects.erase(p);
+  return 0;
+}
+
+int MemStore::_setattrs(coll_t cid, const hobject_t& oid, map<string,bufferptr>& aset)
+{
+  dout(15) << "setattrs " << cid << "/" << oid << dendl;
+  ObjectRef o = get_object(cid, oid);
+  if (!o)
+    return -ENOENT;
+  for (map<string,bufferptr>::iterator p = aset.begin(); p != aset.end(); ++p)
+    o->xattr[p->first] = p->second;
+  return 0;
+}
+
+int MemStore::_rmattr(coll_t cid, const hobject_t& oid, const char *name)
+{
+  dout(15) << "rmattr " << cid << "/" << oid << " '" << name << "'" << dendl;
+  ObjectRef o = get_object(cid, oid);
+  if (!o)
+    return -ENOENT;
+  if (!o->xattr.erase(name))
+    return -ENODATA;
+  return 0;
+}
+
+int MemStore::_rmattrs(coll_t cid, const hobject_t& oid)
+{
+  dout(15) << "rmattrs " << cid << "/" << oid << dendl;
+  ObjectRef o = get_object(cid, oid);
+  if (!o)
+    return -ENOENT;
+  o->xattr.clear();
+  return 0;
+}
+
+int MemStore::_clone(coll_t cid, const hobject_t& oldoid, const hobject_t& newoid)
+{
+  dout(15) << "clone " << cid << "/" << oldoid << " -> " << cid << "/" << newoid << dendl;
+  CollectionRef c = get_collection(cid);
+  if (!c)
+    return -ENOENT;
+  ObjectRef oo = c->get_object(oldoid);
+  if (!oo)
+    return -ENOENT;
+  ObjectRef& no = c->objects[newoid];
+  if (no && no.unique())
+    used_bytes -= no->data.length();
+  no.reset(new Object(*oo));  // shares the data buffers, copy on write
+  used_bytes += no->data.length();
+  return 0;
+}
+
+int MemStore::_clone_range(coll_t cid, const hobject_t& oldoid, const hobject_t& newoid,
+			   uint64_t srcoff, uint64_t len, uint64_t dstoff)
+{
+  dout(15) << "clone_range " << cid << "/" << oldoid << " -> " << cid << "/" << newoid
+	   << " " << srcoff << "~" << len << " to " << dstoff << dendl;
+  CollectionRef c = get_collection(cid);
+  if (!c)
+    return -ENOENT;
+  ObjectRef oo = c->get_object(oldoid);
+  if (!oo)
+    return -ENOENT;
+  ObjectRef& no = c->objects[newoid];
+  if (!no)
+    no.reset(new Object);
+  if (srcoff >= oo->data.length())
+    return 0;
+  if (srcoff + len > oo->data.length())
+    len = oo->data.length() - srcoff;
+  bufferlist bl;
+  bl.substr_of(oo->data, srcoff, len);
+  _write_into(no.get(), dstoff, bl);
+  return 0;
+}
+
+int MemStore::_create_collection(coll_t cid)
+{
+  dout(15) << "create_collection " << cid << dendl;
+  CollectionRef& c = coll_map[cid];
+  if (c)
+    return -EEXIST;
+  c.reset(new Collection);
+  return 0;
+}
+
+int MemStore::_destroy_collection(coll_t cid)
+{
+  dout(15) << "destroy_collection " << cid << dendl;
+  map<coll_t, CollectionRef>::iterator p = coll_map.find(cid);
+  if (p == coll_map.end())
+    return -ENOENT;
+  if (!p->second->objects.empty())
+    return -ENOTEMPTY;
+  coll_map.erase(p);
+  return 0;
+}
+
+int MemStore::_collection_add(coll_t cid, coll_t ocid, const hobject_t& oid)
+{
+  dout(15) << "collection_add " << cid << "/" << oid << " from " << ocid << dendl;
+  CollectionRef c = get_collection(cid);
+  if (!c)
+    return -ENOENT;
+  ObjectRef o = get_object(ocid, oid);
+  if (!o)
+    return -ENOENT;
+  ObjectRef& n = c->objects[oid];
+  if (n)
+    return -EEXIST;
+  n = o;  // a hard link, as far as anyone can tell
+  return 0;
+}
+
+int MemStore::_collection_remove(coll_t cid, const hobject_t& oid)
+{
+  return _remove(cid, oid);
+}
+
+int MemStore::_collection_setattr(coll_t cid, const char *name,
+				  const void *value, size_t size)
+{
+  dout(15) << "collection_setattr " << cid << " '" << name << "' len " << size << dendl;
+  CollectionRef c = get_collection(cid);
+  if (!c)
+    return -ENOENT;
+  c->xattr[name] = buffer::copy((const char *)value, size);
+  return 0;
+}
+
+int MemStore::_collection_setattrs(coll_t cid, map<string,bufferptr>& aset)
+{
+  dout(15) << "collection_setattrs " << cid << dendl;
+  CollectionRef c = get_collection(cid);
+  if (!c)
+    return -ENOENT;
+  for (map<string,bufferptr>::iterator p = aset.begin(); p != aset.end(); ++p)
+    c->xattr[p->first] = p->second;
+  return 0;
+}
+
+int MemStore::_collection_rmattr(coll_t cid, const char *name)
+{
+  dout(15) << "collection_rmattr " << cid << " '" << name << "'" << dendl;
+  CollectionRef c = get_collection(cid);
+  if (!c)
+    return -ENOENT;
+  if (!c->xattr.erase(name))
+    return -ENODATA;
+  return 0;
+}
+
+int MemStore::_collection_rename(const coll_t& cid, const coll_t& ncid)
+{
+  dout(15) << "collection_rename " << cid << " -> " << ncid << dendl;
+  map<coll_t, CollectionRef>::iterator p = coll_map.find(cid);
+  if (p == coll_map.end())
+    return -ENOENT;
+  if (coll_map.count(ncid))
+    return -EEXIST;
+  coll_map[ncid] = p->second;
+  coll_map.erase(p);
+  return 0;
+}
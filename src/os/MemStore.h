@@ -0,0 +1,174 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2012 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MEMSTORE_H
+#define CEPH_MEMSTORE_H
+
+#include <map>
+#include <string>
+#include <tr1/memory>
+
+#include "ObjectStore.h"
+#include "common/Finisher.h"
+#include "common/RWLock.h"
+
+/**
+ * MemStore keeps every collection, object and xattr in memory.  It is
+ * meant for measuring and testing the layers above the ObjectStore (the
+ * OSD, PGs, the messenger) without a disk in the way.
+ *
+ * Transactions are applied synchronously by the caller, under one store
+ * wide lock, so they are readable as soon as queue_transactions()
+ * returns; onreadable and ondisk are then completed, in order, from a
+ * finisher thread.  Nothing is durable until umount(), which writes the
+ * whole store to a single file under the data directory; mount() reads
+ * it back.  Objects linked into more than one collection share their
+ * contents while mounted, but come back as independent copies.
+ */
+class MemStore : public ObjectStore {
+public:
+  struct Object {
+    bufferlist data;
+    map<string,bufferptr> xattr;
+
+    void encode(bufferlist& bl) const {
+      __u8 struct_v = 1;
+      ::encode(struct_v, bl);
+      ::encode(data, bl);
+      ::encode(xattr, bl);
+    }
+    void decode(bufferlist::iterator& p) {
+      __u8 struct_v;
+      ::decode(struct_v, p);
+      ::decode(data, p);
+      ::decode(xattr, p);
+    }
+  };
+  typedef std::tr1::shared_ptr<Object> ObjectRef;
+
+  /// objects sorted the way collection_list_partial walks them
+  struct HashOrder {
+    bool operator()(const hobject_t& l, const hobject_t& r) const {
+      if (l.hash != r.hash)
+	return l.hash < r.hash;
+      if (l.oid.name != r.oid.name)
+	return l.oid.name < r.oid.name;
+      if (l.snap != r.snap)
+	return l.snap < r.snap;
+      return l.get_key() < r.get_key();
+    }
+  };
+
+  struct Collection {
+    map<hobject_t, ObjectRef, HashOrder> objects;
+    map<string,bufferptr> xattr;
+
+    ObjectRef get_object(const hobject_t& oid) {
+      map<hobject_t, ObjectRef, HashOrder>::iterator p = objects.find(oid);
+      if (p == objects.end())
+	return ObjectRef();
+      return p->second;
+    }
+    void encode(bufferlist& bl) const;
+    void decode(bufferlist::iterator& p);
+  };
+  typedef std::tr1::shared_ptr<Collection> CollectionRef;
+
+private:
+  string path;
+  RWLock lock;                       ///< protects everything below
+  map<coll_t, CollectionRef> coll_map;
+  uint64_t used_bytes;               ///< object data held, for statfs
+  Finisher finisher;
+
+  CollectionRef get_collection(coll_t cid);
+  ObjectRef get_object(coll_t cid, const hobject_t& oid);
+
+  int _save();
+  int _load();
+
+  int _do_transaction(Transaction& t);
+
+  int _touch(coll_t cid, const hobject_t& oid);
+  int _write(coll_t cid, const hobject_t& oid, uint64_t offset, size_t len,
+	     const bufferlist& bl);
+  int _zero(coll_t cid, const hobject_t& oid, uint64_t offset, size_t len);
+  int _truncate(coll_t cid, const hobject_t& oid, uint64_t size);
+  int _remove(coll_t cid, const hobject_t& oid);
+  int _setattrs(coll_t cid, const hobject_t& oid, map<string,bufferptr>& aset);
+  int _rmattr(coll_t cid, const hobject_t& oid, const char *name);
+  int _rmattrs(coll_t cid, const hobject_t& oid);
+  int _clone(coll_t cid, const hobject_t& oldoid, const hobject_t& newoid);
+  int _clone_range(coll_t cid, const hobject_t& oldoid, const hobject_t& newoid,
+		   uint64_t srcoff, uint64_t len, uint64_t dstoff);
+  int _create_collection(coll_t c);
+  int _destroy_collection(coll_t c);
+  int _collection_add(coll_t c, coll_t ocid, const hobject_t& oid);
+  int _collection_remove(coll_t c, const hobject_t& oid);
+  int _collection_setattr(coll_t c, const char *name, const void *value, size_t size);
+  int _collection_setattrs(coll_t c, map<string,bufferptr>& aset);
+  int _collection_rmattr(coll_t c, const char *name);
+  int _collection_rename(const coll_t& cid, const coll_t& ncid);
+
+  void _write_into(Object *o, uint64_t offset, const bufferlist& bl);
+
+public:
+  MemStore(const string& path);
+  ~MemStore();
+
+  int update_version_stamp() { return 0; }
+  bool test_mount_in_use() { return false; }
+  int mount();
+  int umount();
+  int get_max_object_name_length() { return 4096; }
+  int mkfs();
+  int mkjournal() { return 0; }
+
+  int statfs(struct statfs *buf);
+
+  bool exists(coll_t cid, const hobject_t& oid);
+  int stat(coll_t cid, const hobject_t& oid, struct stat *st);
+  int read(coll_t cid, const hobject_t& oid, uint64_t offset, size_t len, bufferlist& bl);
+  int fiemap(coll_t cid, const hobject_t& oid, uint64_t offset, size_t len, bufferlist& bl);
+  void trim_from_cache(coll_t cid, const hobject_t& oid, uint64_t offset, size_t len) {}
+  int is_cached(coll_t cid, const hobject_t& oid, uint64_t offset, size_t len) { return -1; }
+  int getattr(coll_t cid, const hobject_t& oid, const char *name, void *value, size_t size);
+  int getattr(coll_t cid, const hobject_t& oid, const char *name, bufferptr& value);
+  int getattrs(coll_t cid, const hobject_t& oid, map<string,bufferptr>& aset, bool user_only = false);
+
+  int list_collections(vector<coll_t>& ls);
+  bool collection_exists(coll_t c);
+  int collection_getattr(coll_t cid, const char *name, void *value, size_t size);
+  int collection_getattr(coll_t cid, const char *name, bufferlist& bl);
+  int collection_getattrs(coll_t cid, map<string,bufferptr>& aset);
+  bool collection_empty(coll_t c);
+  int collection_list_partial(coll_t c, snapid_t seq, vector<hobject_t>& o, int count,
+			      collection_list_handle_t *handle);
+  int collection_list(coll_t c, vector<hobject_t>& o);
+
+  unsigned apply_transaction(Transaction& t, Context *ondisk=0);
+  unsigned apply_transactions(list<Transaction*>& tls, Context *ondisk=0);
+  int queue_transaction(Sequencer *osr, Transaction *t);
+  int queue_transactions(Sequencer *osr, list<Transaction*>& tls, Context *onreadable,
+			 Context *ondisk=0, Context *onreadable_sync=0);
+
+  void sync(Context *onsync);
+  void sync() {}
+  void flush();
+  void sync_and_flush();
+};
+WRITE_CLASS_ENCODER(MemStore::Object)
+WRITE_CLASS_ENCODER(MemStore::Collection)
+
+#endif
@@ -61,6 +61,14 @@ enum {
   l_os_oq_bytes,
   l_os_bytes,
   l_os_committing,
+  l_os_j_lat,
+  l_os_apply_lat,
+  l_os_commit_lat,
+  l_os_wb_dirty,
+  l_os_wb_sync_bw,
+  l_os_wb_apply_bw,
+  l_os_wb_delay,
+  l_os_commit_dirty,
   l_os_last,
 };
 
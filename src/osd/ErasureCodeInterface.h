@@ -0,0 +1,90 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2012 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_ERASURE_CODE_INTERFACE_H
+#define CEPH_ERASURE_CODE_INTERFACE_H
+
+/*
+ * An erasure code splits an object into K data chunks and computes M
+ * coding chunks from them, such that the object can be rebuilt from
+ * any K of the K+M chunks.  Chunk i is stored on the i-th osd of the
+ * acting set; chunks 0..K-1 are the data chunks, so a read that finds
+ * all of them in place needs no decoding at all.
+ *
+ * Implementations live in plugins (see ErasureCodePlugin.h), so that
+ * a codec tuned for a particular cpu can be dropped in without
+ * touching the osd.
+ *
+ * Only the codec layer exists so far: no pool type or PG backend
+ * stores objects this way yet.
+ */
+
+#include <map>
+#include <set>
+#include <tr1/memory>
+#include "include/types.h"
+
+class ErasureCodeInterface {
+public:
+  virtual ~ErasureCodeInterface() {}
+
+  virtual unsigned get_data_chunk_count() const = 0;    ///< K
+  virtual unsigned get_coding_chunk_count() const = 0;  ///< M
+  unsigned get_chunk_count() const {
+    return get_data_chunk_count() + get_coding_chunk_count();
+  }
+
+  /// size of each chunk of an object of object_size bytes (padding included)
+  virtual unsigned get_chunk_size(unsigned object_size) const = 0;
+
+  /**
+   * compute the chunks of an object
+   *
+   * The object is zero padded to K * get_chunk_size(in.length()).
+   *
+   * @param want_to_encode chunks to return, in [0, K+M)
+   * @param in the object
+   * @param encoded [out] chunk index -> chunk, for each chunk wanted
+   * @return 0 or a negative error
+   */
+  virtual int encode(const set<int>& want_to_encode,
+		     const bufferlist& in,
+		     map<int, bufferlist> *encoded) = 0;
+
+  /**
+   * rebuild chunks from the ones that survive
+   *
+   * @param want_to_read chunks to return
+   * @param chunks chunk index -> chunk, all of the same size
+   * @param decoded [out] chunk index -> chunk, for each chunk wanted
+   * @return 0, or -EIO if fewer than K chunks were given
+   */
+  virtual int decode(const set<int>& want_to_read,
+		     const map<int, bufferlist>& chunks,
+		     map<int, bufferlist> *decoded) = 0;
+
+  /**
+   * which of the available chunks to fetch to be able to return
+   * want_to_read
+   *
+   * @return 0, or -EIO if want_to_read can not be rebuilt
+   */
+  virtual int minimum_to_decode(const set<int>& want_to_read,
+				const set<int>& available,
+				set<int> *minimum) = 0;
+};
+
+typedef std::tr1::shared_ptr<ErasureCodeInterface> ErasureCodeInterfaceRef;
+
+#endif
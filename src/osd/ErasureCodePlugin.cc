@@ -0,0 +1,128 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2012 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include <dlfcn.h>
+
+#include "ErasureCodePlugin.h"
+#include "common/debug.h"
+
+#define DOUT_SUBSYS osd
+#undef dout_prefix
+#define dout_prefix *_dout << "ErasureCodePluginRegistry "
+
+ErasureCodePluginRegistry ErasureCodePluginRegistry::singleton;
+
+ErasureCodePluginRegistry::ErasureCodePluginRegistry()
+  : lock("ErasureCodePluginRegistry::lock"),
+    loading(false)
+{
+}
+
+/*
+ * Plugins are never dlclose()d.  We run from a static destructor, and
+ * codecs built by a plugin may still be referenced (by other statics,
+ * or threads that have not exited yet); unmapping their code under
+ * them would crash at exit.  The libraries go away with the process.
+ */
+ErasureCodePluginRegistry::~ErasureCodePluginRegistry()
+{
+  for (map<string, ErasureCodePlugin*>::iterator p = plugins.begin();
+       p != plugins.end();
+       ++p)
+    delete p->second;
+}
+
+int ErasureCodePluginRegistry::add(const string& name,
+				   ErasureCodePlugin *plugin)
+{
+  assert(lock.is_locked());
+  if (!loading) {
+    dout(0) << "erasure code plugin " << name
+	    << " added outside of __erasure_code_init" << dendl;
+    return -EINVAL;
+  }
+  if (plugins.count(name))
+    return -EEXIST;
+  plugins[name] = plugin;
+  return 0;
+}
+
+ErasureCodePlugin *ErasureCodePluginRegistry::get(const string& name)
+{
+  assert(lock.is_locked());
+  map<string, ErasureCodePlugin*>::iterator p = plugins.find(name);
+  if (p == plugins.end())
+    return NULL;
+  return p->second;
+}
+
+int ErasureCodePluginRegistry::factory(const string& name,
+				       const string& directory,
+				       const map<string,string>& parameters,
+				       ErasureCodeInterfaceRef *erasure_code)
+{
+  Mutex::Locker l(lock);
+  ErasureCodePlugin *plugin = get(name);
+  if (!plugin) {
+    int r = _load(name, directory, &plugin);
+    if (r < 0)
+      return r;
+  }
+  return plugin->factory(parameters, erasure_code);
+}
+
+int ErasureCodePluginRegistry::_load(const string& name,
+				     const string& directory,
+				     ErasureCodePlugin **plugin)
+{
+  string fname = directory + "/libec_" + name + ".so";
+  dout(10) << "_load " << name << " from " << fname << dendl;
+
+  void *library = dlopen(fname.c_str(), RTLD_NOW);
+  if (!library) {
+    dout(0) << "_load could not open " << fname
+	    << " (dlopen failed): " << dlerror() << dendl;
+    return -EIO;
+  }
+
+  int (*erasure_code_init)(const char *) =
+    (int (*)(const char *))dlsym(library, "__erasure_code_init");
+  if (!erasure_code_init) {
+    dout(0) << "_load " << fname << " has no __erasure_code_init" << dendl;
+    dlclose(library);
+    return -EIO;
+  }
+
+  loading = true;
+  int r = erasure_code_init(name.c_str());
+  loading = false;
+  if (r < 0) {
+    dout(0) << "_load " << fname << " __erasure_code_init returned "
+	    << r << dendl;
+    dlclose(library);
+    return r;
+  }
+
+  *plugin = get(name);
+  if (!*plugin) {
+    dout(0) << "_load " << fname << " did not register itself as "
+	    << name << dendl;
+    dlclose(library);
+    return -EIO;
+  }
+  (*plugin)->library = library;
+  dout(10) << "_load " << name << " success" << dendl;
+  return 0;
+}
@@ -0,0 +1,77 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2012 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_ERASURE_CODE_PLUGIN_H
+#define CEPH_ERASURE_CODE_PLUGIN_H
+
+#include "include/types.h"
+#include "common/Mutex.h"
+#include "ErasureCodeInterface.h"
+
+/*
+ * Erasure code plugins are shared objects named libec_<name>.so in
+ * osd_erasure_code_dir.  Loading one calls its
+ *
+ *   extern "C" int __erasure_code_init(const char *name);
+ *
+ * which must add() a plugin under that name to the registry; the
+ * plugin's factory() then builds codecs from string parameters (the
+ * Reed-Solomon plugin takes erasure-code-k and erasure-code-m).
+ */
+
+class ErasureCodePlugin {
+public:
+  void *library;
+
+  ErasureCodePlugin() : library(0) {}
+  virtual ~ErasureCodePlugin() {}
+
+  virtual int factory(const map<string,string>& parameters,
+		      ErasureCodeInterfaceRef *erasure_code) = 0;
+};
+
+class ErasureCodePluginRegistry {
+  Mutex lock;
+  bool loading;
+  map<string, ErasureCodePlugin*> plugins;
+
+  static ErasureCodePluginRegistry singleton;
+
+  int _load(const string& name, const string& directory,
+	    ErasureCodePlugin **plugin);
+
+public:
+  ErasureCodePluginRegistry();
+  ~ErasureCodePluginRegistry();
+
+  static ErasureCodePluginRegistry& instance() {
+    return singleton;
+  }
+
+  /// called from a plugin's __erasure_code_init
+  int add(const string& name, ErasureCodePlugin *plugin);
+  ErasureCodePlugin *get(const string& name);
+
+  /**
+   * build a codec, loading plugin name from directory if need be
+   *
+   * @return 0, -EIO if the plugin can not be loaded, or the error
+   * from the plugin's factory
+   */
+  int factory(const string& name, const string& directory,
+	      const map<string,string>& parameters,
+	      ErasureCodeInterfaceRef *erasure_code);
+};
+
+#endif
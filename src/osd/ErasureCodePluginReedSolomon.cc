@@ -0,0 +1,40 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2012 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "ErasureCodePlugin.h"
+#include "ErasureCodeReedSolomon.h"
+
+class ErasureCodePluginReedSolomon : public ErasureCodePlugin {
+public:
+  virtual int factory(const map<string,string>& parameters,
+		      ErasureCodeInterfaceRef *erasure_code) {
+    ErasureCodeReedSolomon *rs = new ErasureCodeReedSolomon;
+    int r = rs->init(parameters);
+    if (r < 0) {
+      delete rs;
+      return r;
+    }
+    erasure_code->reset(rs);
+    return 0;
+  }
+};
+
+extern "C" int __erasure_code_init(const char *name)
+{
+  ErasureCodePlugin *plugin = new ErasureCodePluginReedSolomon;
+  int r = ErasureCodePluginRegistry::instance().add(name, plugin);
+  if (r < 0)
+    delete plugin;
+  return r;
+}
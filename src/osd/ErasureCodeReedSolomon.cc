@@ -0,0 +1,354 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2012 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#include "ErasureCodeReedSolomon.h"
+
+const unsigned ErasureCodeReedSolomon::DEFAULT_K;
+const unsigned ErasureCodeReedSolomon::DEFAULT_M;
+
+// ---------------------------------------------------------------------------
+// GF(2^8) with the polynomial x^8 + x^4 + x^3 + x^2 + 1
+
+namespace {
+
+struct GF256 {
+  uint8_t exp[512];
+  uint8_t log[256];
+  // c * x == mul_lo[c][x & 15] ^ mul_hi[c][x >> 4]
+  uint8_t mul_lo[256][16];
+  uint8_t mul_hi[256][16];
+
+  GF256() {
+    unsigned x = 1;
+    for (unsigned i = 0; i < 255; i++) {
+      exp[i] = x;
+      log[x] = i;
+      x <<= 1;
+      if (x & 0x100)
+	x ^= 0x11d;
+    }
+    for (unsigned i = 255; i < 512; i++)
+      exp[i] = exp[i - 255];
+    log[0] = 0;  // never used
+
+    for (unsigned c = 0; c < 256; c++) {
+      for (unsigned n = 0; n < 16; n++) {
+	mul_lo[c][n] = mul(c, n);
+	mul_hi[c][n] = mul(c, n << 4);
+      }
+    }
+  }
+
+  uint8_t mul(uint8_t a, uint8_t b) const {
+    if (!a || !b)
+      return 0;
+    return exp[log[a] + log[b]];
+  }
+  uint8_t inv(uint8_t a) const {
+    return exp[255 - log[a]];
+  }
+};
+
+const GF256 gf;
+
+/// invert the n x n matrix a in place; -EIO if it is singular
+int invert(vector<uint8_t>& a, unsigned n)
+{
+  vector<uint8_t> b(n * n, 0);
+  for (unsigned i = 0; i < n; i++)
+    b[i * n + i] = 1;
+
+  for (unsigned col = 0; col < n; col++) {
+    unsigned pivot = col;
+    while (pivot < n && !a[pivot * n + col])
+      pivot++;
+    if (pivot == n)
+      return -EIO;
+    if (pivot != col) {
+      for (unsigned j = 0; j < n; j++) {
+	std::swap(a[pivot * n + j], a[col * n + j]);
+	std::swap(b[pivot * n + j], b[col * n + j]);
+      }
+    }
+    uint8_t f = gf.inv(a[col * n + col]);
+    for (unsigned j = 0; j < n; j++) {
+      a[col * n + j] = gf.mul(a[col * n + j], f);
+      b[col * n + j] = gf.mul(b[col * n + j], f);
+    }
+    for (unsigned row = 0; row < n; row++) {
+      uint8_t g = a[row * n + col];
+      if (row == col || !g)
+	continue;
+      for (unsigned j = 0; j < n; j++) {
+	a[row * n + j] ^= gf.mul(g, a[col * n + j]);
+	b[row * n + j] ^= gf.mul(g, b[col * n + j]);
+      }
+    }
+  }
+  a.swap(b);
+  return 0;
+}
+
+int parse_count(const map<string,string>& parameters, const char *name,
+		unsigned def, unsigned *v)
+{
+  map<string,string>::const_iterator p = parameters.find(name);
+  if (p == parameters.end()) {
+    *v = def;
+    return 0;
+  }
+  char *end;
+  long l = strtol(p->second.c_str(), &end, 10);
+  if (p->second.empty() || *end || l < 1)
+    return -EINVAL;
+  *v = l;
+  return 0;
+}
+
+}
+
+// ---------------------------------------------------------------------------
+
+void ErasureCodeReedSolomon::region_multiply_add(uint8_t c, const uint8_t *in,
+						 uint8_t *out, unsigned len)
+{
+  unsigned i = 0;
+  if (c == 0)
+    return;
+  if (c == 1) {
+    for (; i < len; i++)
+      out[i] ^= in[i];
+    return;
+  }
+#if defined(__SSSE3__)
+  __m128i lo = _mm_loadu_si128((const __m128i *)gf.mul_lo[c]);
+  __m128i hi = _mm_loadu_si128((const __m128i *)gf.mul_hi[c]);
+  __m128i mask = _mm_set1_epi8(0x0f);
+  for (; i + 16 <= len; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+    __m128i l = _mm_and_si128(x, mask);
+    __m128i h = _mm_and_si128(_mm_srli_epi64(x, 4), mask);
+    __m128i p = _mm_xor_si128(_mm_shuffle_epi8(lo, l), _mm_shuffle_epi8(hi, h));
+    __m128i o = _mm_loadu_si128((const __m128i *)(out + i));
+    _mm_storeu_si128((__m128i *)(out + i), _mm_xor_si128(o, p));
+  }
+#endif
+  const uint8_t *lo_t = gf.mul_lo[c];
+  const uint8_t *hi_t = gf.mul_hi[c];
+  for (; i < len; i++)
+    out[i] ^= lo_t[in[i] & 15] ^ hi_t[in[i] >> 4];
+}
+
+int ErasureCodeReedSolomon::init(const map<string,string>& parameters)
+{
+  int r = parse_count(parameters, "erasure-code-k", DEFAULT_K, &k);
+  if (r < 0)
+    return r;
+  r = parse_count(parameters, "erasure-code-m", DEFAULT_M, &m);
+  if (r < 0)
+    return r;
+  if (k + m > 256)
+    return -EINVAL;
+
+  // vandermonde: row i is (1, i, i^2, ...), distinct for every i < 256
+  unsigned n = k + m;
+  vector<uint8_t> v(n * k);
+  for (unsigned i = 0; i < n; i++) {
+    uint8_t x = 1;
+    for (unsigned j = 0; j < k; j++) {
+      v[i * k + j] = x;
+      x = gf.mul(x, i);
+    }
+  }
+
+  // multiply by the inverse of the top k x k block so it becomes the
+  // identity; any k rows stay independent
+  vector<uint8_t> top(v.begin(), v.begin() + k * k);
+  r = invert(top, k);
+  if (r < 0)
+    return r;
+  matrix.assign(n * k, 0);
+  for (unsigned i = 0; i < n; i++)
+    for (unsigned j = 0; j < k; j++) {
+      uint8_t s = 0;
+      for (unsigned l = 0; l < k; l++)
+	s ^= gf.mul(v[i * k + l], top[l * k + j]);
+      matrix[i * k + j] = s;
+    }
+  return 0;
+}
+
+unsigned ErasureCodeReedSolomon::get_chunk_size(unsigned object_size) const
+{
+  unsigned chunk = (object_size + k - 1) / k;
+  return (chunk + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+void ErasureCodeReedSolomon::compute_coding(const vector<const uint8_t*>& data,
+					    int chunk, uint8_t *out,
+					    unsigned len) const
+{
+  memset(out, 0, len);
+  const uint8_t *row = &matrix[chunk * k];
+  for (unsigned j = 0; j < k; j++)
+    region_multiply_add(row[j], data[j], out, len);
+}
+
+int ErasureCodeReedSolomon::encode(const set<int>& want_to_encode,
+				   const bufferlist& in,
+				   map<int, bufferlist> *encoded)
+{
+  unsigned chunk_size = get_chunk_size(in.length());
+
+  // one padded copy of the object; the data chunks point into it
+  bufferptr buf = buffer::create_page_aligned(k * chunk_size);
+  in.copy(0, in.length(), buf.c_str());
+  memset(buf.c_str() + in.length(), 0, k * chunk_size - in.length());
+
+  vector<const uint8_t*> data(k);
+  for (unsigned j = 0; j < k; j++)
+    data[j] = (const uint8_t *)buf.c_str() + j * chunk_size;
+
+  for (set<int>::const_iterator p = want_to_encode.begin();
+       p != want_to_encode.end();
+       ++p) {
+    if (*p < 0 || *p >= (int)(k + m))
+      return -EINVAL;
+    if (*p < (int)k) {
+      (*encoded)[*p].push_back(bufferptr(buf, *p * chunk_size, chunk_size));
+    } else {
+      bufferptr coding = buffer::create_page_aligned(chunk_size);
+      compute_coding(data, *p, (uint8_t *)coding.c_str(), chunk_size);
+      (*encoded)[*p].push_back(coding);
+    }
+  }
+  return 0;
+}
+
+int ErasureCodeReedSolomon::decode(const set<int>& want_to_read,
+				   const map<int, bufferlist>& chunks,
+				   map<int, bufferlist> *decoded)
+{
+  if (chunks.empty())
+    return -EIO;
+  unsigned chunk_size = chunks.begin()->second.length();
+  for (map<int, bufferlist>::const_iterator p = chunks.begin();
+       p != chunks.end();
+       ++p)
+    if (p->second.length() != chunk_size)
+      return -EINVAL;
+
+  // everything wanted is here
+  bool missing = false;
+  for (set<int>::const_iterator p = want_to_read.begin();
+       p != want_to_read.end();
+       ++p) {
+    if (*p < 0 || *p >= (int)(k + m))
+      return -EINVAL;
+    if (!chunks.count(*p))
+      missing = true;
+  }
+  if (!missing) {
+    for (set<int>::const_iterator p = want_to_read.begin();
+	 p != want_to_read.end();
+	 ++p)
+      (*decoded)[*p] = chunks.find(*p)->second;
+    return 0;
+  }
+  if (chunks.size() < k)
+    return -EIO;
+
+  // the first k chunks we have (data chunks first, since the map is
+  // sorted), as contiguous buffers
+  vector<int> src;
+  vector<bufferlist> src_bl;
+  for (map<int, bufferlist>::const_iterator p = chunks.begin();
+       src.size() < k;
+       ++p) {
+    src.push_back(p->first);
+    src_bl.push_back(p->second);
+  }
+  vector<const uint8_t*> src_data(k);
+  for (unsigned i = 0; i < k; i++)
+    src_data[i] = (const uint8_t *)src_bl[i].c_str();
+
+  // rebuild any data chunk we do not have
+  vector<const uint8_t*> data(k);
+  vector<bufferptr> rebuilt(k);
+  vector<uint8_t> dec;
+  for (unsigned j = 0; j < k; j++) {
+    // data chunks sort before coding chunks, so any we have is in src
+    vector<int>::iterator have = find(src.begin(), src.end(), (int)j);
+    if (have != src.end()) {
+      data[j] = src_data[have - src.begin()];
+      continue;
+    }
+    if (dec.empty()) {
+      dec.resize(k * k);
+      for (unsigned i = 0; i < k; i++)
+	memcpy(&dec[i * k], &matrix[src[i] * k], k);
+      int r = invert(dec, k);
+      if (r < 0)
+	return r;
+    }
+    rebuilt[j] = buffer::create_page_aligned(chunk_size);
+    uint8_t *out = (uint8_t *)rebuilt[j].c_str();
+    memset(out, 0, chunk_size);
+    for (unsigned i = 0; i < k; i++)
+      region_multiply_add(dec[j * k + i], src_data[i], out, chunk_size);
+    data[j] = out;
+  }
+
+  for (set<int>::const_iterator p = want_to_read.begin();
+       p != want_to_read.end();
+       ++p) {
+    map<int, bufferlist>::const_iterator c = chunks.find(*p);
+    if (c != chunks.end()) {
+      (*decoded)[*p] = c->second;
+    } else if (*p < (int)k) {
+      (*decoded)[*p].push_back(rebuilt[*p]);
+    } else {
+      bufferptr coding = buffer::create_page_aligned(chunk_size);
+      compute_coding(data, *p, (uint8_t *)coding.c_str(), chunk_size);
+      (*decoded)[*p].push_back(coding);
+    }
+  }
+  return 0;
+}
+
+int ErasureCodeReedSolomon::minimum_to_decode(const set<int>& want_to_read,
+					      const set<int>& available,
+					      set<int> *minimum)
+{
+  if (includes(available.begin(), available.end(),
+	       want_to_read.begin(), want_to_read.end())) {
+    *minimum = want_to_read;
+    return 0;
+  }
+  if (available.size() < k)
+    return -EIO;
+  set<int>::const_iterator p = available.begin();
+  for (unsigned i = 0; i < k; i++, ++p)
+    minimum->insert(*p);
+  return 0;
+}
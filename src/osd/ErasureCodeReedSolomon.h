@@ -0,0 +1,67 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2012 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_ERASURE_CODE_REED_SOLOMON_H
+#define CEPH_ERASURE_CODE_REED_SOLOMON_H
+
+#include <vector>
+#include "ErasureCodeInterface.h"
+
+/**
+ * Systematic Reed-Solomon over GF(2^8).
+ *
+ * The (K+M) x K encoding matrix is a Vandermonde matrix reduced so its
+ * top K rows are the identity; any K of its rows are then invertible,
+ * so any K chunks rebuild the object.  All the work is "multiply a
+ * region by a constant and xor it into another", done with two 16
+ * entry nibble tables per constant, which is a pshufb each when built
+ * with SSSE3 and a pair of table lookups otherwise.
+ */
+class ErasureCodeReedSolomon : public ErasureCodeInterface {
+  unsigned k, m;
+  vector<uint8_t> matrix;   ///< (k+m) x k, row major
+
+  void compute_coding(const vector<const uint8_t*>& data, int chunk,
+		      uint8_t *out, unsigned len) const;
+
+public:
+  static const unsigned DEFAULT_K = 4;
+  static const unsigned DEFAULT_M = 2;
+  static const unsigned ALIGNMENT = 16;   ///< chunk sizes are a multiple of this
+
+  ErasureCodeReedSolomon() : k(0), m(0) {}
+
+  /// parse erasure-code-k and erasure-code-m; -EINVAL if out of range
+  int init(const map<string,string>& parameters);
+
+  unsigned get_data_chunk_count() const { return k; }
+  unsigned get_coding_chunk_count() const { return m; }
+  unsigned get_chunk_size(unsigned object_size) const;
+
+  int encode(const set<int>& want_to_encode,
+	     const bufferlist& in,
+	     map<int, bufferlist> *encoded);
+  int decode(const set<int>& want_to_read,
+	     const map<int, bufferlist>& chunks,
+	     map<int, bufferlist> *decoded);
+  int minimum_to_decode(const set<int>& want_to_read,
+			const set<int>& available,
+			set<int> *minimum);
+
+  /// out[i] ^= c * in[i] over GF(2^8), for i in [0, len)
+  static void region_multiply_add(uint8_t c, const uint8_t *in, uint8_t *out,
+				  unsigned len);
+};
+
+#endif
@@ -23,6 +23,7 @@
 
 #include "common/ceph_argparse.h"
 #include "os/FileStore.h"
+#include "os/MemStore.h"
 
 #include "ReplicatedPG.h"
 
@@ -30,9 +31,11 @@
 
 
 #include "msg/Messenger.h"
+#include "msg/SimpleMessenger.h"
 #include "msg/Message.h"
 
 #include "mon/MonClient.h"
+#include "osdc/Objecter.h"
 
 #include "messages/MLog.h"
 
@@ -41,6 +44,7 @@
 #include "messages/MOSDPing.h"
 #include "messages/MOSDFailure.h"
 #include "messages/MOSDOp.h"
+#include "messages/MOSDOpBatch.h"
 #include "messages/MOSDOpReply.h"
 #include "messages/MOSDSubOp.h"
 #include "messages/MOSDSubOpReply.h"
@@ -132,6 +136,9 @@ ObjectStore *OSD::create_object_store(const std::string &dev, const std::string
   if (::stat(dev.c_str(), &st) != 0)
     return 0;
 
+  if (g_conf->osd_objectstore == "memstore")
+    return new MemStore(dev);
+
   if (g_conf->filestore)
     return new FileStore(dev, jdev);
 
@@ -509,7 +516,7 @@ int OSD::peek_meta(const std::string &dev, std::string& magic,
 // cons/des
 
 OSD::OSD(int id, Messenger *internal_messenger, Messenger *external_messenger,
-	 Messenger *hbinm, Messenger *hboutm, MonClient *mc,
+	 Messenger *hbinm, Messenger *hboutm, Messenger *osdcm, MonClient *mc,
 	 const std::string &dev, const std::string &jdev) :
   Dispatcher(external_messenger->cct),
   osd_lock("OSD::osd_lock"),
@@ -525,24 +532,34 @@ OSD::OSD(int id, Messenger *internal_messenger, Messenger *external_messenger,
   whoami(id),
   dev_path(dev), journal_path(jdev),
   dispatch_running(false),
+  op_tracker(external_messenger->cct),
   osd_compat(get_osd_compat_set()),
   state(STATE_BOOTING), boot_epoch(0), up_epoch(0), bind_epoch(0),
   op_tp(external_messenger->cct, "OSD::op_tp", g_conf->osd_op_threads),
   recovery_tp(external_messenger->cct, "OSD::recovery_tp", g_conf->osd_recovery_threads),
   disk_tp(external_messenger->cct, "OSD::disk_tp", g_conf->osd_disk_threads),
+  map_tp(external_messenger->cct, "OSD::map_tp", g_conf->osd_map_threads),
   heartbeat_lock("OSD::heartbeat_lock"),
   heartbeat_stop(false), heartbeat_epoch(0),
   hbin_messenger(hbinm),
   hbout_messenger(hboutm),
+  objecter_messenger(osdcm),
   heartbeat_thread(this),
   heartbeat_dispatcher(this),
   stat_lock("OSD::stat_lock"),
   finished_lock("OSD::finished_lock"),
   op_wq(this, g_conf->osd_op_thread_timeout, &op_tp),
+  objecter_lock("OSD::objecter_lock"),
+  objecter_timer(external_messenger->cct, objecter_lock),
+  objecter(new Objecter(external_messenger->cct, osdcm, mc,
+			&objecter_osdmap, objecter_lock, objecter_timer)),
+  objecter_finisher(external_messenger->cct),
   osdmap(NULL),
   map_lock("OSD::map_lock"),
   peer_map_epoch_lock("OSD::peer_map_epoch_lock"),
   map_cache_lock("OSD::map_cache_lock"),
+  load_pg_wq(this, g_conf->osd_map_thread_timeout, &map_tp),
+  map_pg_wq(this, g_conf->osd_map_thread_timeout, &map_tp),
   up_thru_wanted(0), up_thru_pending(0),
   pg_stat_queue_lock("OSD::pg_stat_queue_lock"),
   osd_stat_updated(false),
@@ -554,6 +571,7 @@ OSD::OSD(int id, Messenger *internal_messenger, Messenger *external_messenger,
   remove_list_lock("OSD::remove_list_lock"),
   replay_queue_lock("OSD::replay_queue_lock"),
   snap_trim_wq(this, g_conf->osd_snap_trim_thread_timeout, &disk_tp),
+  agent_wq(this, g_conf->osd_agent_thread_timeout, &recovery_tp),
   sched_scrub_lock("OSD::sched_scrub_lock"),
   scrubs_pending(0),
   scrubs_active(0),
@@ -576,11 +594,14 @@ OSD::OSD(int id, Messenger *internal_messenger, Messenger *external_messenger,
 
 OSD::~OSD()
 {
+  delete objecter;
   delete authorize_handler_registry;
   delete map_in_progress_cond;
   delete class_handler;
-  g_ceph_context->GetPerfCountersCollection()->logger_remove(logger);
-  delete logger;
+  if (logger) {
+    g_ceph_context->GetPerfCountersCollection()->logger_remove(logger);
+    delete logger;
+  }
   delete store;
 }
 
@@ -635,11 +656,13 @@ int OSD::init()
 	  << (journal_path.empty() ? "(no journal)" : journal_path) << dendl;
   assert(store);  // call pre_init() first!
 
+  utime_t start = ceph_clock_now(g_ceph_context);
   int r = store->mount();
   if (r < 0) {
     derr << "OSD:init: unable to mount object store" << dendl;
     return r;
   }
+  utime_t mounted = ceph_clock_now(g_ceph_context);
 
   dout(2) << "boot" << dendl;
 
@@ -678,7 +701,14 @@ int OSD::init()
   }
 
   // load up pgs (as they previously existed)
+  utime_t loading = ceph_clock_now(g_ceph_context);
+  if (g_conf->osd_map_threads > 0)
+    map_tp.start();
   load_pgs();
+  utime_t loaded = ceph_clock_now(g_ceph_context);
+  dout(10) << "init took " << (loaded - start) << ": mount " << (mounted - start)
+	  << ", superblock and osdmap " << (loading - mounted)
+	  << ", load_pgs " << (loaded - loading) << dendl;
 
   dout(2) << "superblock: i am osd." << superblock.whoami << dendl;
   assert_warn(whoami == superblock.whoami);
@@ -689,6 +719,10 @@ int OSD::init()
   }
 
   create_logger();
+
+  AdminSocketConfigObs *asok = g_ceph_context->get_admin_socket();
+  asok->register_hook(CEPH_ADMIN_SOCK_REQ_OPS_IN_FLIGHT, &op_tracker);
+  asok->register_hook(CEPH_ADMIN_SOCK_REQ_HISTORIC_OPS, &op_tracker);
     
   // i'm ready!
   client_messenger->add_dispatcher_head(this);
@@ -697,6 +731,7 @@ int OSD::init()
 
   hbin_messenger->add_dispatcher_head(&heartbeat_dispatcher);
   hbout_messenger->add_dispatcher_head(&heartbeat_dispatcher);
+  objecter_messenger->add_dispatcher_head(this);
 
   monc->set_want_keys(CEPH_ENTITY_TYPE_MON | CEPH_ENTITY_TYPE_OSD);
   monc->init();
@@ -711,6 +746,15 @@ int OSD::init()
 
   osd_lock.Lock();
 
+  // a new incarnation each start, so base pgs never take our ops for
+  // resends of ones from before a restart
+  objecter->set_client_incarnation(ceph_clock_now(g_ceph_context).sec());
+  objecter_finisher.start();
+  objecter_lock.Lock();
+  objecter_timer.init();
+  objecter->init();
+  objecter_lock.Unlock();
+
   op_tp.start();
   recovery_tp.start();
   disk_tp.start();
@@ -750,33 +794,33 @@ void OSD::create_logger()
   osd_plb.add_u64_counter(l_osd_op,       "op");           // client ops
   osd_plb.add_u64_counter(l_osd_op_inb,   "op_inb");       // client op in bytes (writes)
   osd_plb.add_u64_counter(l_osd_op_outb,  "op_outb");      // client op out bytes (reads)
-  osd_plb.add_fl_avg(l_osd_op_lat,   "op_lat");       // client op latency
+  osd_plb.add_time_avg(l_osd_op_lat,   "op_lat");       // client op latency
 
   osd_plb.add_u64_counter(l_osd_op_r,      "op_r");        // client reads
   osd_plb.add_u64_counter(l_osd_op_r_outb, "op_r_outb");   // client read out bytes
-  osd_plb.add_fl_avg(l_osd_op_r_lat,  "op_r_lat");    // client read latency
+  osd_plb.add_time_avg(l_osd_op_r_lat,  "op_r_lat");    // client read latency
   osd_plb.add_u64_counter(l_osd_op_w,      "op_w");        // client writes
   osd_plb.add_u64_counter(l_osd_op_w_inb,  "op_w_inb");    // client write in bytes
-  osd_plb.add_fl_avg(l_osd_op_w_rlat, "op_w_rlat");   // client write readable/applied latency
-  osd_plb.add_fl_avg(l_osd_op_w_lat,  "op_w_lat");    // client write latency
+  osd_plb.add_time_avg(l_osd_op_w_rlat, "op_w_rlat");   // client write readable/applied latency
+  osd_plb.add_time_avg(l_osd_op_w_lat,  "op_w_lat");    // client write latency
   osd_plb.add_u64_counter(l_osd_op_rw,     "op_rw");       // client rmw
   osd_plb.add_u64_counter(l_osd_op_rw_inb, "op_rw_inb");   // client rmw in bytes
   osd_plb.add_u64_counter(l_osd_op_rw_outb,"op_rw_outb");  // client rmw out bytes
-  osd_plb.add_fl_avg(l_osd_op_rw_rlat,"op_rw_rlat");  // client rmw readable/applied latency
-  osd_plb.add_fl_avg(l_osd_op_rw_lat, "op_rw_lat");   // client rmw latency
+  osd_plb.add_time_avg(l_osd_op_rw_rlat,"op_rw_rlat");  // client rmw readable/applied latency
+  osd_plb.add_time_avg(l_osd_op_rw_lat, "op_rw_lat");   // client rmw latency
 
   osd_plb.add_u64_counter(l_osd_sop,       "sop");         // subops
   osd_plb.add_u64_counter(l_osd_sop_inb,   "sop_inb");     // subop in bytes
-  osd_plb.add_fl_avg(l_osd_sop_lat,   "sop_lat");     // subop latency
+  osd_plb.add_time_avg(l_osd_sop_lat,   "sop_lat");     // subop latency
 
   osd_plb.add_u64_counter(l_osd_sop_w,     "sop_w");          // replicated (client) writes
   osd_plb.add_u64_counter(l_osd_sop_w_inb, "sop_w_inb");      // replicated write in bytes
-  osd_plb.add_fl_avg(l_osd_sop_w_lat, "sop_w_lat");      // replicated write latency
+  osd_plb.add_time_avg(l_osd_sop_w_lat, "sop_w_lat");      // replicated write latency
   osd_plb.add_u64_counter(l_osd_sop_pull,     "sop_pull");       // pull request
-  osd_plb.add_fl_avg(l_osd_sop_pull_lat, "sop_pull_lat");
+  osd_plb.add_time_avg(l_osd_sop_pull_lat, "sop_pull_lat");
   osd_plb.add_u64_counter(l_osd_sop_push,     "sop_push");       // push (write)
   osd_plb.add_u64_counter(l_osd_sop_push_inb, "sop_push_inb");
-  osd_plb.add_fl_avg(l_osd_sop_push_lat, "sop_push_lat");
+  osd_plb.add_time_avg(l_osd_sop_push_lat, "sop_push_lat");
 
   osd_plb.add_u64_counter(l_osd_pull,      "pull");       // pull requests sent
   osd_plb.add_u64_counter(l_osd_push,      "push");       // push messages
@@ -813,12 +857,22 @@ int OSD::shutdown()
 
   state = STATE_STOPPING;
 
+  AdminSocketConfigObs *asok = g_ceph_context->get_admin_socket();
+  asok->unregister_hook(CEPH_ADMIN_SOCK_REQ_OPS_IN_FLIGHT);
+  asok->unregister_hook(CEPH_ADMIN_SOCK_REQ_HISTORIC_OPS);
+
   timer.shutdown();
 
   watch_lock.Lock();
   watch_timer.shutdown();
   watch_lock.Unlock();
 
+  objecter_lock.Lock();
+  objecter->shutdown();
+  objecter_timer.shutdown();
+  objecter_lock.Unlock();
+  objecter_finisher.stop();
+
   heartbeat_lock.Lock();
   heartbeat_stop = true;
   heartbeat_cond.Signal();
@@ -833,6 +887,8 @@ int OSD::shutdown()
   dout(10) << "recovery tp stopped" << dendl;
   op_tp.stop();
   dout(10) << "op tp stopped" << dendl;
+  map_tp.stop();
+  dout(10) << "map tp stopped" << dendl;
 
   // pause _new_ disk work first (to avoid racing with thread pool),
   disk_tp.pause_new();
@@ -909,6 +965,7 @@ int OSD::shutdown()
   cluster_messenger->shutdown();
   hbin_messenger->shutdown();
   hbout_messenger->shutdown();
+  objecter_messenger->shutdown();
 
   monc->shutdown();
 
@@ -1156,12 +1213,15 @@ void OSD::load_pgs()
   dout(10) << "load_pgs" << dendl;
   assert(pg_map.empty());
 
+  utime_t start = ceph_clock_now(g_ceph_context);
   vector<coll_t> ls;
   int r = store->list_collections(ls);
   if (r < 0) {
     derr << "failed to list pgs: " << cpp_strerror(-r) << dendl;
   }
 
+  // open every pg first, then read their state in parallel
+  vector<PG*> pgs;
   for (vector<coll_t>::iterator it = ls.begin();
        it != ls.end();
        it++) {
@@ -1184,14 +1244,37 @@ void OSD::load_pgs()
     }
 
     PG *pg = _open_lock_pg(pgid);
+    pg->unlock();
+    pgs.push_back(pg);
+  }
+  utime_t opened = ceph_clock_now(g_ceph_context);
+
+  // read pg state, log
+  if (g_conf->osd_map_threads > 0) {
+    for (vector<PG*>::iterator p = pgs.begin(); p != pgs.end(); ++p)
+      load_pg_wq.queue(*p);
+    load_pg_wq.drain();
+  } else {
+    for (vector<PG*>::iterator p = pgs.begin(); p != pgs.end(); ++p) {
+      (*p)->lock();
+      (*p)->read_state(store);
+      (*p)->unlock();
+    }
+  }
+  utime_t read = ceph_clock_now(g_ceph_context);
+
+  vector< vector<int> > up, acting;
+  map_pgs(pgs, up, acting);
 
-    // read pg state, log
-    pg->read_state(store);
+  for (unsigned i = 0; i < pgs.size(); i++) {
+    PG *pg = pgs[i];
+    pg->lock();
 
     reg_last_pg_scrub(pg->info.pgid, pg->info.history.last_scrub_stamp);
 
     // generate state for current mapping
-    osdmap->pg_to_up_acting_osds(pgid, pg->up, pg->acting);
+    pg->up.swap(up[i]);
+    pg->acting.swap(acting[i]);
     int role = osdmap->calc_pg_role(whoami, pg->acting);
     pg->set_role(role);
 
@@ -1201,7 +1284,58 @@ void OSD::load_pgs()
     dout(10) << "load_pgs loaded " << *pg << " " << pg->log << dendl;
     pg->unlock();
   }
-  dout(10) << "load_pgs done" << dendl;
+  utime_t done = ceph_clock_now(g_ceph_context);
+  dout(10) << "load_pgs " << pgs.size() << " pgs: open " << (opened - start)
+	  << ", read_state " << (read - opened) << " (" << g_conf->osd_map_threads
+	  << " threads), init " << (done - read) << dendl;
+}
+
+void OSD::map_pg_batch(PGMapBatch *b)
+{
+  for (unsigned i = b->start; i < b->end; i++)
+    b->map->pg_to_up_acting_osds((*b->pgs)[i]->info.pgid, (*b->up)[i], (*b->acting)[i]);
+}
+
+/*
+ * compute up and acting under the current osdmap for each of pgs.
+ * every batch maps against osdmap itself (crush mapping does not
+ * modify the map in userspace); only split the work when there are
+ * enough pgs to cover the cost of queueing it.
+ */
+#define MIN_PGS_PER_MAP_BATCH 64
+
+void OSD::map_pgs(const vector<PG*>& pgs,
+		  vector< vector<int> >& up, vector< vector<int> >& acting)
+{
+  assert(osd_lock.is_locked());
+  up.resize(pgs.size());
+  acting.resize(pgs.size());
+
+  unsigned nbatch = 1;
+  if (g_conf->osd_map_threads > 0)
+    nbatch = MIN((unsigned)g_conf->osd_map_threads + 1,
+		 pgs.size() / MIN_PGS_PER_MAP_BATCH);
+  if (nbatch < 1)
+    nbatch = 1;
+
+  // batch 0 runs here, the others on map_tp
+  vector<PGMapBatch> batches(nbatch);
+  unsigned per = pgs.size() / nbatch;
+  for (unsigned i = 0; i < nbatch; i++) {
+    PGMapBatch& b = batches[i];
+    b.pgs = &pgs;
+    b.up = &up;
+    b.acting = &acting;
+    b.start = i * per;
+    b.end = (i == nbatch - 1) ? pgs.size() : b.start + per;
+    b.map = osdmap;
+    if (i > 0)
+      map_pg_wq.queue(&b);
+  }
+  map_pg_batch(&batches[0]);
+  if (nbatch > 1)
+    map_pg_wq.drain();
+  dout(15) << "map_pgs mapped " << pgs.size() << " pgs in " << nbatch << " batches" << dendl;
 }
  
 
@@ -1393,16 +1527,24 @@ void OSD::project_pg_history(pg_t pgid, PG::Info::History& h, epoch_t from,
 
 // -------------------------------------
 
-void OSD::update_osd_stat()
+void OSD::update_osd_statfs()
 {
-  // fill in osd stats too
+  // this can block behind a busy disk, so it must not run under
+  // heartbeat_lock
   struct statfs stbuf;
-  store->statfs(&stbuf);
+  if (store->statfs(&stbuf) < 0)
+    return;
 
+  Mutex::Locker lock(stat_lock);
   osd_stat.kb = stbuf.f_blocks * stbuf.f_bsize / 1024;
   osd_stat.kb_used = (stbuf.f_blocks - stbuf.f_bfree) * stbuf.f_bsize / 1024;
   osd_stat.kb_avail = stbuf.f_bavail * stbuf.f_bsize / 1024;
+}
 
+void OSD::update_osd_stat()
+{
+  assert(heartbeat_lock.is_locked());
+  assert(stat_lock.is_locked());
   osd_stat.hb_in.clear();
   for (map<int,epoch_t>::iterator p = heartbeat_from.begin(); p != heartbeat_from.end(); p++)
     osd_stat.hb_in.push_back(p->first);
@@ -1659,6 +1801,15 @@ void OSD::heartbeat_entry()
   while (!heartbeat_stop) {
     heartbeat();
 
+    // refresh disk usage after the pings are out, and without holding
+    // heartbeat_lock, so a slow statfs delays neither our pings nor
+    // handle_osd_ping() replying to our peers'.
+    heartbeat_lock.Unlock();
+    update_osd_statfs();
+    heartbeat_lock.Lock();
+    if (heartbeat_stop)
+      break;
+
     double wait = .5 + ((float)(rand() % 10)/10.0) * (float)g_conf->osd_heartbeat_interval;
     utime_t w;
     w.set_from_double(wait);
@@ -1799,6 +1950,10 @@ void OSD::tick()
 
   check_replay_queue();
 
+  check_ops_in_flight();
+
+  agent_tick();
+
   // mon report?
   utime_t now = ceph_clock_now(g_ceph_context);
   if (now - last_pg_stats_sent > g_conf->osd_mon_report_interval_max) {
@@ -1840,6 +1995,60 @@ void OSD::tick()
   }
 }
 
+/*
+ * hand the cache tier's objecter our newest map, whole; it only needs
+ * one once a pool has a cache tier.
+ */
+void OSD::update_objecter_map()
+{
+  bool tiers = false;
+  for (map<int64_t,pg_pool_t>::const_iterator p = osdmap->get_pools().begin();
+       p != osdmap->get_pools().end();
+       ++p)
+    if (p->second.is_tier()) {
+      tiers = true;
+      break;
+    }
+  if (!tiers)
+    return;
+
+  MOSDMap *m = new MOSDMap(monc->get_fsid());
+  epoch_t e = osdmap->get_epoch();
+  osdmap->encode(m->maps[e]);
+  m->oldest_map = e;
+  m->newest_map = e;
+  Mutex::Locker l(objecter_lock);
+  objecter->handle_osd_map(m);
+}
+
+/*
+ * let the cache tier agent of each cache pg we lead flush or evict a
+ * few objects.  The work happens in agent_wq, under the pg lock only.
+ */
+void OSD::agent_tick()
+{
+  for (hash_map<pg_t, PG*>::iterator p = pg_map.begin();
+       p != pg_map.end();
+       ++p) {
+    if (!osdmap->have_pg_pool(p->first.pool()) ||
+	!osdmap->get_pg_pool(p->first.pool())->is_tier())
+      continue;
+    agent_wq.queue(p->second);
+  }
+}
+
+/*
+ * complain (once per op) about requests stuck in the osd, and let the
+ * op tracker retire ops that were dropped along the way.
+ */
+void OSD::check_ops_in_flight()
+{
+  vector<string> warnings;
+  op_tracker.check_ops_in_flight(warnings);
+  for (vector<string>::iterator p = warnings.begin(); p != warnings.end(); ++p)
+    clog.warn() << *p << "\n";
+}
+
 // =========================================
 
 void OSD::do_mon_report()
@@ -1976,6 +2185,10 @@ void OSD::disconnect_session_watches(Session *session)
 bool OSD::ms_handle_reset(Connection *con)
 {
   dout(0) << "OSD::ms_handle_reset()" << dendl;
+  if (con->get_peer_type() == CEPH_ENTITY_TYPE_OSD) {
+    Mutex::Locker l(objecter_lock);
+    objecter->ms_handle_reset(con);
+  }
   OSD::Session *session = (OSD::Session *)con->get_priv();
   if (!session)
     return false;
@@ -2057,7 +2270,8 @@ void OSD::send_boot()
     hbout_messenger->set_ip(hb_addr);
     dout(10) << " assuming hb_addr ip matches cluster_addr" << dendl;
   }
-  MOSDBoot *mboot = new MOSDBoot(superblock, hb_addr, cluster_addr);
+  MOSDBoot *mboot = new MOSDBoot(superblock, hb_addr, cluster_addr,
+				 MSGR_FEATURES_SUPPORTED);
   dout(10) << " client_addr " << client_messenger->get_myaddr()
 	   << ", cluster_addr " << cluster_addr
 	   << ", hb addr " << hb_addr
@@ -2148,6 +2362,27 @@ void OSD::send_pg_stats(const utime_t &now)
    
   pg_stat_queue_lock.Lock();
 
+  // pgs only queue themselves when their stats change.  every so often,
+  // send everything anyway, in case the monitor lost track of something.
+  if (now - last_pg_stats_full > g_conf->osd_mon_report_full_interval) {
+    last_pg_stats_full = now;
+    int queued = 0;
+    for (hash_map<pg_t, PG*>::iterator p = pg_map.begin(); p != pg_map.end(); ++p) {
+      PG *pg = p->second;
+      if (!pg->is_primary() || pg->stat_queue_item.is_on_list())
+	continue;
+      pg->pg_stats_lock.Lock();
+      if (pg->pg_stats_valid) {
+	pg->get();
+	pg_stat_queue.push_back(&pg->stat_queue_item);
+	queued++;
+      }
+      pg->pg_stats_lock.Unlock();
+    }
+    osd_stat_updated = true;
+    dout(10) << "send_pg_stats - full refresh, queued " << queued << " more pgs" << dendl;
+  }
+
   if (osd_stat_updated || !pg_stat_queue.empty()) {
     last_pg_stats_sent = now;
     osd_stat_updated = false;
@@ -2172,15 +2407,13 @@ void OSD::send_pg_stats(const utime_t &now)
       pg->pg_stats_lock.Lock();
       if (pg->pg_stats_valid) {
 	m->pg_stat[pg->info.pgid] = pg->pg_stats_stable;
-	dout(25) << " sending " << pg->info.pgid << " " << pg->pg_stats_stable.reported << dendl;
-  JSONFormatter jf(false);
-  jf.open_object_section("stats");
-  pg->pg_stats_stable.dump(&jf);
-  jf.close_section();
-  stringstream ss;
-  jf.flush(ss);
-  dout(20) << " sending " << pg->info.pgid << " " << ss.str() << dendl;
-
+	dout(20) << " sending " << pg->info.pgid << " " << pg->pg_stats_stable.reported << " ";
+	JSONFormatter jf(false);
+	jf.open_object_section("stats");
+	pg->pg_stats_stable.dump(&jf);
+	jf.close_section();
+	jf.flush(*_dout);
+	*_dout << dendl;
       } else {
 	dout(25) << " NOT sending " << pg->info.pgid << " " << pg->pg_stats_stable.reported << ", not valid" << dendl;
       }
@@ -2555,8 +2788,58 @@ bool OSD::heartbeat_dispatch(Message *m)
 
 bool OSD::ms_dispatch(Message *m)
 {
+  if (m->get_type() == CEPH_MSG_OSD_OPREPLY) {
+    // a reply to one of the cache tier's ops; no need for osd_lock
+    Mutex::Locker l(objecter_lock);
+    objecter->handle_osd_op_reply((MOSDOpReply*)m);
+    return true;
+  }
+
   // lock!
   osd_lock.Lock();
+  _ms_dispatch(m);
+  osd_lock.Unlock();
+  return true;
+}
+
+bool OSD::ms_can_fast_dispatch(Message *m)
+{
+  if (!g_conf->osd_fast_dispatch)
+    return false;
+  switch (m->get_type()) {
+  case CEPH_MSG_OSD_OP:
+  case MSG_OSD_OP_BATCH:
+  case MSG_OSD_SUBOP:
+  case MSG_OSD_SUBOPREPLY:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/*
+ * client and replica ops arrive here straight from their connection's
+ * reader thread (with osd_fast_dispatch).  they still take osd_lock and
+ * wait for dispatch_running to find and queue on their pg, so reader
+ * threads contend on osd_lock; finding the pg without it needs pg_map
+ * and the osdmap protected separately, which they are not yet.  hence
+ * off by default.
+ */
+void OSD::ms_fast_dispatch(Message *m)
+{
+  osd_lock.Lock();
+  if (is_stopping()) {
+    dout(10) << "ms_fast_dispatch stopping, dropping " << *m << dendl;
+    m->put();
+  } else {
+    _ms_dispatch(m);
+  }
+  osd_lock.Unlock();
+}
+
+void OSD::_ms_dispatch(Message *m)
+{
+  assert(osd_lock.is_locked());
   while (dispatch_running) {
     dout(10) << "ms_dispatch waiting for other dispatch thread to complete" << dendl;
     dispatch_cond.Wait(osd_lock);
@@ -2568,12 +2851,9 @@ bool OSD::ms_dispatch(Message *m)
   do_waiters();
 
   dispatch_running = false;
-  
-  // no need to signal here, since tick() doesn't wait.
-  //dispatch_cond.Signal();
 
-  osd_lock.Unlock();
-  return true;
+  // reader threads delivering ops may be waiting their turn
+  dispatch_cond.Signal();
 }
 
 bool OSD::ms_get_authorizer(int dest_type, AuthAuthorizer **authorizer, bool force_new)
@@ -2767,6 +3047,9 @@ void OSD::_dispatch(Message *m)
       case CEPH_MSG_OSD_OP:
         handle_op((MOSDOp*)m);
         break;
+      case MSG_OSD_OP_BATCH:
+	handle_op_batch((MOSDOpBatch*)m);
+	break;
         
         // for replication etc.
       case MSG_OSD_SUBOP:
@@ -3188,6 +3471,8 @@ void OSD::handle_osd_map(MOSDMap *m)
   map_lock.get_write();
 
   // advance through the new maps
+  utime_t advance_start = ceph_clock_now(g_ceph_context);
+  int advanced_maps = 0;
   for (epoch_t cur = start; cur <= superblock.newest_map; cur++) {
     dout(10) << " advance to epoch " << cur << " (<= newest " << superblock.newest_map << ")" << dendl;
 
@@ -3207,8 +3492,11 @@ void OSD::handle_osd_map(MOSDMap *m)
 
     superblock.current_epoch = cur;
     advance_map(t);
+    advanced_maps++;
     had_map_since = ceph_clock_now(g_ceph_context);
   }
+  utime_t advanced = ceph_clock_now(g_ceph_context);
+  bool was_booting = is_booting();
 
   C_Contexts *fin = new C_Contexts(g_ceph_context);
   if (osdmap->is_up(whoami) &&
@@ -3223,6 +3511,9 @@ void OSD::handle_osd_map(MOSDMap *m)
     // yay!
     activate_map(t, fin->contexts);
   }
+  if (was_booting)
+    dout(10) << "handle_osd_map booting: advanced " << advanced_maps << " maps to e" << osdmap->get_epoch() << " in " << (advanced - advance_start)
+	    << ", activate_map " << (ceph_clock_now(g_ceph_context) - advanced) << dendl;
 
   bool do_shutdown = false;
   bool do_restart = false;
@@ -3273,6 +3564,8 @@ void OSD::handle_osd_map(MOSDMap *m)
     }
   }
 
+  update_objecter_map();
+
   // process waiters
   take_waiters(waiting_for_osdmap);
 
@@ -3443,19 +3736,27 @@ void OSD::advance_map(ObjectStore::Transaction& t)
     lastmap = get_map(osdmap->get_epoch() - 1);
 
   // scan existing pg's
+  utime_t start = ceph_clock_now(g_ceph_context);
+  vector<PG*> pgs;
+  pgs.reserve(pg_map.size());
   for (hash_map<pg_t,PG*>::iterator it = pg_map.begin();
        it != pg_map.end();
-       it++) {
-    PG *pg = it->second;
-
-    vector<int> newup, newacting;
-    osdmap->pg_to_up_acting_osds(pg->info.pgid, newup, newacting);
-
+       it++)
+    pgs.push_back(it->second);
+  vector< vector<int> > newup, newacting;
+  map_pgs(pgs, newup, newacting);
+  utime_t mapped = ceph_clock_now(g_ceph_context);
+
+  for (unsigned i = 0; i < pgs.size(); i++) {
+    PG *pg = pgs[i];
     pg->lock();
     dout(10) << "Scanning pg " << *pg << dendl;
-    pg->handle_advance_map(osdmap, lastmap, newup, newacting, 0);
+    pg->handle_advance_map(osdmap, lastmap, newup[i], newacting[i], 0);
     pg->unlock();
   }
+  dout(15) << "advance_map e" << osdmap->get_epoch() << " " << pgs.size() << " pgs: map "
+	   << (mapped - start) << ", advance " << (ceph_clock_now(g_ceph_context) - mapped)
+	   << dendl;
 }
 
 void OSD::activate_map(ObjectStore::Transaction& t, list<Context*>& tfin)
@@ -5000,6 +5301,7 @@ void OSD::reply_op_error(MOSDOp *op, int err, eversion_t v)
   if (op->get_source().is_osd())
     msgr = cluster_messenger;
   msgr->send_message(reply, op->get_connection());
+  op_tracker.unregister_op(op);
   op->put();
 }
 
@@ -5028,6 +5330,8 @@ void OSD::handle_op(MOSDOp *op)
     return;
   }
 
+  op_tracker.register_op(op);
+
   // require same or newer map
   if (!require_same_or_newer_map(op, op->get_map_epoch()))
     return;
@@ -5060,6 +5364,18 @@ void OSD::handle_op(MOSDOp *op)
   // calc actual pgid
   pg_t pgid = op->get_pg();
   int64_t pool = pgid.pool();
+
+  // a client that doesn't know about the overlay would bypass the cache
+  if ((op->get_flags() & CEPH_OSD_FLAG_IGNORE_OVERLAY) == 0 &&
+      osdmap->have_pg_pool(pool) &&
+      (osdmap->get_pg_pool(pool)->has_read_tier() ||
+       osdmap->get_pg_pool(pool)->has_write_tier()) &&
+      !op->get_connection()->has_feature(CEPH_FEATURE_OSD_CACHEPOOL)) {
+    dout(4) << "handle_op " << op->get_source_inst() << " lacks the cache pool "
+	    << "feature; pool " << pool << " has an overlay" << dendl;
+    reply_op_error(op, -EOPNOTSUPP);
+    return;
+  }
   if ((op->get_flags() & CEPH_OSD_FLAG_PGOP) == 0 &&
       osdmap->have_pg_pool(pool))
     pgid = osdmap->raw_pg_to_pg(pgid);
@@ -5079,6 +5395,26 @@ void OSD::handle_op(MOSDOp *op)
   pg->put();
 }
 
+/*
+ * unpack a batch of client ops and handle each one in order, exactly
+ * as if they had arrived as separate messages.  the batch only saves
+ * messenger round trips; each op still builds its own transaction,
+ * journal entry and repop.
+ */
+void OSD::handle_op_batch(MOSDOpBatch *m)
+{
+  dout(10) << "handle_op_batch " << *m << dendl;
+  while (!m->ops.empty()) {
+    MOSDOp *op = m->ops.front();
+    m->ops.pop_front();
+    op->set_connection(m->get_connection()->get());
+    op->get_header().src = m->get_header().src;
+    op->set_recv_stamp(m->get_recv_stamp());
+    handle_op(op);
+  }
+  m->put();
+}
+
 void OSD::_handle_op(PG *pg, MOSDOp *op)
 {
   dout(10) << *pg << " _handle_op " << op << " " << *op << dendl;
@@ -5178,6 +5514,12 @@ void OSD::_handle_op(PG *pg, MOSDOp *op)
     hobject_t head(op->get_oid(), op->get_object_locator().key,
 		   CEPH_NOSNAP, op->get_pg().ps());
     if (pg->is_missing_object(head)) {
+      if (!pg->is_primary()) {
+	// a balanced read; only the primary recovers, so send it there
+	dout(10) << *pg << " replica missing " << head << ", bouncing " << *op << dendl;
+	reply_op_error(op, -EAGAIN);
+	return;
+      }
       pg->wait_for_missing_object(head, op);
       return;
     }
@@ -5210,6 +5552,8 @@ void OSD::handle_sub_op(MOSDSubOp *op)
   if (!require_osd_peer(op))
     return;
 
+  op_tracker.register_op(op);
+
   // must be a rep op.
   assert(op->get_source().is_osd());
   
@@ -5312,6 +5656,7 @@ void OSD::enqueue_op(PG *pg, Message *op)
   dout(15) << *pg << " enqueue_op " << op << " " << *op << dendl;
   assert(pg->is_locked());
   // add to pg's op_queue
+  op_tracker.mark_event(op, "queued_for_pg");
   pg->op_queue.push_back(op);
   pending_ops++;
   logger->set(l_osd_opq, pending_ops);
@@ -5386,6 +5731,8 @@ void OSD::dequeue_op(PG *pg)
   }
   osd_lock.Unlock();
 
+  op_tracker.mark_event(op, "reached_pg");
+
   if (!op->get_connection()->is_connected()) {
     dout(10) << "dequeue_op sender " << op->get_connection()->get_peer_addr()
 	     << " not connected, dropping " << *op << dendl;
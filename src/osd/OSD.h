@@ -27,8 +27,10 @@
 
 #include "os/ObjectStore.h"
 #include "OSDCaps.h"
+#include "OpTracker.h"
 
 #include "common/DecayCounter.h"
+#include "common/Finisher.h"
 #include "osd/ClassHandler.h"
 
 #include "include/CompatSet.h"
@@ -115,6 +117,7 @@ class Notification;
 class ReplicatedPG;
 
 class AuthAuthorizeHandlerRegistry;
+class Objecter;
 
 extern const coll_t meta_coll;
 
@@ -155,9 +158,11 @@ protected:
 
   void create_logger();
   void tick();
+  void check_ops_in_flight();
   void _dispatch(Message *m);
 
 public:
+  OpTracker op_tracker;   // per-op stage timings, see OpTracker.h
   ClassHandler  *class_handler;
   int get_nodeid() { return whoami; }
   
@@ -221,6 +226,7 @@ private:
   ThreadPool op_tp;
   ThreadPool recovery_tp;
   ThreadPool disk_tp;
+  ThreadPool map_tp;     // pg loading at boot, pg remapping on new maps
 
   // -- sessions --
 public:
@@ -254,6 +260,7 @@ private:
   map<int, Connection*> heartbeat_to_con, heartbeat_from_con;
   utime_t last_mon_heartbeat;
   Messenger *hbin_messenger, *hbout_messenger;
+  Messenger *objecter_messenger;   // cache tier agent's ops to other pools
   
   void _add_heartbeat_source(int p, map<int, epoch_t>& old_from, map<int, utime_t>& old_from_stamp,
 			     map<int,Connection*>& old_con);
@@ -280,6 +287,13 @@ public:
     bool ms_dispatch(Message *m) {
       return osd->heartbeat_dispatch(m);
     };
+    // pings only need heartbeat_lock; answer them from the reader thread
+    bool ms_can_fast_dispatch(Message *m) {
+      return m->get_type() == MSG_OSD_PING;
+    }
+    void ms_fast_dispatch(Message *m) {
+      osd->heartbeat_dispatch(m);
+    }
     bool ms_handle_reset(Connection *con) { return false; }
     void ms_handle_remote_reset(Connection *con) {}
   public:
@@ -297,6 +311,7 @@ private:
   osd_stat_t osd_stat;
 
   void update_osd_stat();
+  void update_osd_statfs();
   
   // -- waiters --
   list<class Message*> finished;
@@ -371,6 +386,21 @@ private:
   friend class PG;
   friend class ReplicatedPG;
 
+  // -- cache tier --
+  /*
+   * Cache tier pgs reach their base pools through an Objecter of our
+   * own.  It has its own lock, timer and copy of the map, and its
+   * callbacks run in objecter_finisher, where they may take pg locks.
+   */
+  Mutex objecter_lock;
+  SafeTimer objecter_timer;
+  OSDMap objecter_osdmap;
+  Objecter *objecter;
+  Finisher objecter_finisher;
+
+  void update_objecter_map();
+  void agent_tick();
+
 
  protected:
 
@@ -451,6 +481,89 @@ protected:
 		       C_Contexts **pfin);
   
   void load_pgs();
+
+  /*
+   * Reading pg state at boot, and recomputing every pg's mapping for a
+   * new osdmap, are spread over map_tp.  The caller holds osd_lock and
+   * waits for the queue to drain, so the workers may look at (but not
+   * change) osd state, including the current osdmap.
+   */
+  list<PG*> pg_load_queue;
+
+  struct LoadPGWQ : public ThreadPool::WorkQueue<PG> {
+    OSD *osd;
+    LoadPGWQ(OSD *o, time_t ti, ThreadPool *tp)
+      : ThreadPool::WorkQueue<PG>("OSD::LoadPGWQ", ti, ti*10, tp), osd(o) {}
+
+    bool _empty() {
+      return osd->pg_load_queue.empty();
+    }
+    bool _enqueue(PG *pg) {
+      osd->pg_load_queue.push_back(pg);
+      return true;
+    }
+    void _dequeue(PG *pg) {
+      assert(0); // Not applicable for this wq
+    }
+    PG *_dequeue() {
+      if (osd->pg_load_queue.empty())
+	return NULL;
+      PG *pg = osd->pg_load_queue.front();
+      osd->pg_load_queue.pop_front();
+      return pg;
+    }
+    void _process(PG *pg) {
+      pg->lock();
+      pg->read_state(osd->store);
+      pg->unlock();
+    }
+    void _clear() {
+      osd->pg_load_queue.clear();
+    }
+  } load_pg_wq;
+
+  struct PGMapBatch {
+    OSDMap *map;
+    const vector<PG*> *pgs;
+    vector< vector<int> > *up, *acting;
+    unsigned start, end;     // our slice of pgs, up and acting
+  };
+  list<PGMapBatch*> pg_map_queue;
+
+  struct MapPGWQ : public ThreadPool::WorkQueue<PGMapBatch> {
+    OSD *osd;
+    MapPGWQ(OSD *o, time_t ti, ThreadPool *tp)
+      : ThreadPool::WorkQueue<PGMapBatch>("OSD::MapPGWQ", ti, ti*10, tp), osd(o) {}
+
+    bool _empty() {
+      return osd->pg_map_queue.empty();
+    }
+    bool _enqueue(PGMapBatch *b) {
+      osd->pg_map_queue.push_back(b);
+      return true;
+    }
+    void _dequeue(PGMapBatch *b) {
+      assert(0); // Not applicable for this wq
+    }
+    PGMapBatch *_dequeue() {
+      if (osd->pg_map_queue.empty())
+	return NULL;
+      PGMapBatch *b = osd->pg_map_queue.front();
+      osd->pg_map_queue.pop_front();
+      return b;
+    }
+    void _process(PGMapBatch *b) {
+      osd->map_pg_batch(b);
+    }
+    void _clear() {
+      osd->pg_map_queue.clear();
+    }
+  } map_pg_wq;
+
+  void map_pg_batch(PGMapBatch *b);
+  void map_pgs(const vector<PG*>& pgs,
+	       vector< vector<int> >& up, vector< vector<int> >& acting);
+
   void calc_priors_during(pg_t pgid, epoch_t start, epoch_t end, set<int>& pset);
   void project_pg_history(pg_t pgid, PG::Info::History& h, epoch_t from,
 			  vector<int>& lastup, vector<int>& lastacting);
@@ -491,6 +604,7 @@ protected:
   // == monitor interaction ==
   utime_t last_mon_report;
   utime_t last_pg_stats_sent;
+  utime_t last_pg_stats_full;   // last time we sent stats for every pg
 
   void do_mon_report();
 
@@ -766,6 +880,50 @@ protected:
     }
   } snap_trim_wq;
 
+  // -- cache tier agent --
+  xlist<PG*> agent_queue;
+
+  struct AgentWQ : public ThreadPool::WorkQueue<PG> {
+    OSD *osd;
+    AgentWQ(OSD *o, time_t ti, ThreadPool *tp)
+      : ThreadPool::WorkQueue<PG>("OSD::AgentWQ", ti, ti*10, tp), osd(o) {}
+
+    bool _empty() {
+      return osd->agent_queue.empty();
+    }
+    bool _enqueue(PG *pg) {
+      if (pg->agent_item.is_on_list())
+	return false;
+      pg->get();
+      osd->agent_queue.push_back(&pg->agent_item);
+      return true;
+    }
+    void _dequeue(PG *pg) {
+      if (pg->agent_item.remove_myself())
+	pg->put();
+    }
+    PG *_dequeue() {
+      if (osd->agent_queue.empty())
+	return NULL;
+      PG *pg = osd->agent_queue.front();
+      osd->agent_queue.pop_front();
+      return pg;
+    }
+    void _process(PG *pg) {
+      pg->lock();
+      pg->agent_work();
+      pg->unlock();
+      pg->put();
+    }
+    void _clear() {
+      while (!osd->agent_queue.empty()) {
+	PG *pg = osd->agent_queue.front();
+	osd->agent_queue.pop_front();
+	pg->put();
+      }
+    }
+  } agent_wq;
+
   // -- scrub scheduling --
   Mutex sched_scrub_lock;
   int scrubs_pending;
@@ -970,6 +1128,9 @@ protected:
 
  private:
   bool ms_dispatch(Message *m);
+  bool ms_can_fast_dispatch(Message *m);
+  void ms_fast_dispatch(Message *m);
+  void _ms_dispatch(Message *m);
   bool ms_get_authorizer(int dest_type, AuthAuthorizer **authorizer, bool force_new);
   bool ms_verify_authorizer(Connection *con, int peer_type,
 			    int protocol, bufferlist& authorizer, bufferlist& authorizer_reply,
@@ -982,7 +1143,7 @@ protected:
   /* internal and external can point to the same messenger, they will still
    * be cleaned up properly*/
   OSD(int id, Messenger *internal, Messenger *external, Messenger *hbmin, Messenger *hbmout,
-      MonClient *mc, const std::string &dev, const std::string &jdev);
+      Messenger *osdc, MonClient *mc, const std::string &dev, const std::string &jdev);
   ~OSD();
 
   // static bits
@@ -1027,6 +1188,7 @@ public:
   void handle_scrub(class MOSDScrub *m);
   void handle_osd_ping(class MOSDPing *m);
   void handle_op(class MOSDOp *m);
+  void handle_op_batch(class MOSDOpBatch *m);
   void handle_sub_op(class MOSDSubOp *m);
   void handle_sub_op_reply(class MOSDSubOpReply *m);
 
@@ -67,6 +67,7 @@ void OSDMap::dump(Formatter *f) const
       f->dump_stream("public_addr") << get_addr(i);
       f->dump_stream("cluster_addr") << get_cluster_addr(i);
       f->dump_stream("heartbeat_addr") << get_hb_addr(i);
+      f->dump_unsigned("features", get_osd_features(i));
       f->close_section();
     }
   f->close_section();
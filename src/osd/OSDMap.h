@@ -149,6 +149,7 @@ public:
     set<int64_t> old_pools;
     map<int32_t,entity_addr_t> new_up_client;
     map<int32_t,entity_addr_t> new_up_internal;
+    map<int32_t,uint64_t> new_up_features;      // of osds in new_up_client
     map<int32_t,uint8_t> new_state;             // XORed onto previous state.
     map<int32_t,uint32_t> new_weight;
     map<pg_t,vector<int32_t> > new_pg_temp;     // [] to remove
@@ -247,6 +248,8 @@ public:
       ::encode(old_blacklist, bl);
       ::encode(new_up_internal, bl);
       ::encode(cluster_snapshot, bl);
+      encode_pool_tier_info(new_pools, bl);
+      ::encode(new_up_features, bl);
     }
     void decode(bufferlist::iterator &p) {
       __u32 n, t;
@@ -328,6 +331,10 @@ public:
         ::decode(new_up_internal, p);
       if (ev >= 7)
 	::decode(cluster_snapshot, p);
+      if (ev >= 8)
+	decode_pool_tier_info(new_pools, p);
+      if (ev >= 9)
+	::decode(new_up_features, p);
     }
 
     Incremental(epoch_t e=0) :
@@ -359,6 +366,7 @@ private:
   vector<entity_addr_t> osd_hb_addr;
   vector<__u32>   osd_weight;   // 16.16 fixed point, 0x10000 = "in", 0 = "out"
   vector<osd_info_t> osd_info;
+  vector<uint64_t> osd_features;  // CEPH_FEATURE_* each osd last booted with
   map<pg_t,vector<int> > pg_temp;  // temp pg mapping (e.g. while we rebuild)
 
   map<int64_t,pg_pool_t> pools;
@@ -438,6 +446,7 @@ private:
       osd_weight[o] = CEPH_OSD_OUT;
     }
     osd_info.resize(m);
+    osd_features.resize(m);
     osd_addr.resize(m);
     osd_cluster_addr.resize(m);
     osd_hb_addr.resize(m);
@@ -476,6 +485,29 @@ private:
     return n;
   }
 
+  /// features every existing osd has; one that hasn't booted since
+  /// they were recorded counts as having none
+  uint64_t get_common_osd_features() const {
+    uint64_t f = ~(uint64_t)0;
+    for (int i=0; i<max_osd; i++)
+      if (exists(i))
+	f &= osd_features[i];
+    return f;
+  }
+  /// true if any pool sends client io through a cache tier
+  bool have_cache_overlay() const {
+    for (map<int64_t,pg_pool_t>::const_iterator p = pools.begin();
+	 p != pools.end();
+	 ++p)
+      if (p->second.has_read_tier() || p->second.has_write_tier())
+	return true;
+    return false;
+  }
+  uint64_t get_osd_features(int o) const {
+    assert(o < max_osd);
+    return osd_features[o];
+  }
+
   int get_flags() const { return flags; }
   int test_flag(int f) const { return flags & f; }
   void set_flag(int f) { flags |= f; }
@@ -690,6 +722,10 @@ private:
       else
 	osd_hb_addr[i->first] = inc.new_hb_up[i->first];
       osd_info[i->first].up_from = epoch;
+      if (inc.new_up_features.count(i->first))
+	osd_features[i->first] = inc.new_up_features[i->first];
+      else
+	osd_features[i->first] = 0;
     }
     for (map<int32_t,entity_addr_t>::iterator i = inc.new_up_internal.begin();
          i != inc.new_up_internal.end();
@@ -747,6 +783,32 @@ private:
   }
 
   // serialize, unserialize
+
+  /// the pg_pool_t tiering fields of any pool that has them, by pool id
+  static void encode_pool_tier_info(const map<int64_t,pg_pool_t>& pools,
+				    bufferlist& bl) {
+    map<int64_t,bufferlist> info;
+    for (map<int64_t,pg_pool_t>::const_iterator p = pools.begin();
+	 p != pools.end();
+	 ++p)
+      if (p->second.has_tier_info())
+	p->second.encode_tier_info(info[p->first]);
+    ::encode(info, bl);
+  }
+  static void decode_pool_tier_info(map<int64_t,pg_pool_t>& pools,
+				    bufferlist::iterator& bl) {
+    map<int64_t,bufferlist> info;
+    ::decode(info, bl);
+    for (map<int64_t,bufferlist>::iterator p = info.begin();
+	 p != info.end();
+	 ++p) {
+      if (!pools.count(p->first))
+	continue;
+      bufferlist::iterator q = p->second.begin();
+      pools[p->first].decode_tier_info(q);
+    }
+  }
+
   void encode_client_old(bufferlist& bl) {
     __u16 v = 5;
     ::encode(v, bl);
@@ -842,6 +904,8 @@ private:
     ::encode(osd_cluster_addr, bl);
     ::encode(cluster_snapshot_epoch, bl);
     ::encode(cluster_snapshot, bl);
+    encode_pool_tier_info(pools, bl);
+    ::encode(osd_features, bl);
   }
   
   void decode(bufferlist& bl) {
@@ -932,6 +996,12 @@ private:
       ::decode(cluster_snapshot_epoch, p);
       ::decode(cluster_snapshot, p);
     }      
+    if (ev >= 8)
+      decode_pool_tier_info(pools, p);
+    if (ev >= 9)
+      ::decode(osd_features, p);
+    else
+      osd_features.assign(max_osd, 0);
 
     // index pool names
     name_pool.clear();
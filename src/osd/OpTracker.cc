@@ -0,0 +1,271 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "OpTracker.h"
+
+#include "common/Clock.h"
+#include "common/config.h"
+#include "common/debug.h"
+#include "msg/Message.h"
+
+#include <sstream>
+
+#define DOUT_SUBSYS osd
+#undef dout_prefix
+#define dout_prefix *_dout << "optracker "
+
+OpTracker::OpTracker(CephContext *cct_)
+  : cct(cct_),
+    lock("OpTracker::lock"),
+    enabled(cct->_conf->osd_op_tracking)
+{
+}
+
+OpTracker::~OpTracker()
+{
+  Mutex::Locker l(lock);
+  for (std::map<Message*, TrackedOp*>::iterator p = ops_in_flight.begin();
+       p != ops_in_flight.end();
+       ++p)
+    p->first->put();
+  ops_in_flight.clear();
+}
+
+void OpTracker::register_op(Message *m)
+{
+  if (!enabled)
+    return;
+  utime_t now = ceph_clock_now(cct);
+  Mutex::Locker l(lock);
+  TrackedOp *op = (TrackedOp*)m->get_tracked();
+  if (op) {
+    simple_spin_lock(&op->lock);
+    if (!op->done)
+      op->events.push_back(Event(now, "redispatched"));
+    simple_spin_unlock(&op->lock);
+    return;
+  }
+  op = new TrackedOp;
+  op->req = m;
+  op->received = m->get_recv_stamp();
+  if (op->received == utime_t())
+    op->received = now;
+  op->events.reserve(12);
+  op->events.push_back(Event(now, "dispatched"));
+  m->set_tracked(op);   // the message owns op from here on
+  m->get();
+  ops_in_flight[m] = op;
+}
+
+void OpTracker::mark_event(Message *m, const char *what)
+{
+  if (!enabled)
+    return;
+  TrackedOp *op = (TrackedOp*)m->get_tracked();
+  if (!op)
+    return;
+  utime_t now = ceph_clock_now(cct);
+  simple_spin_lock(&op->lock);
+  if (!op->done)
+    op->events.push_back(Event(now, what));
+  simple_spin_unlock(&op->lock);
+}
+
+void OpTracker::unregister_op(Message *m)
+{
+  if (!enabled)
+    return;
+  utime_t now = ceph_clock_now(cct);
+  Mutex::Locker l(lock);
+  std::map<Message*, TrackedOp*>::iterator p = ops_in_flight.find(m);
+  if (p == ops_in_flight.end())
+    return;
+  _retire(p, now, "done");
+}
+
+/*
+ * Move a finished op into the history if it is slow enough to be worth
+ * keeping.  Only then do we pay for formatting its description.
+ */
+void OpTracker::_retire(std::map<Message*, TrackedOp*>::iterator p, utime_t now,
+			const char *what)
+{
+  assert(lock.is_locked());
+  TrackedOp *op = p->second;
+  std::vector<Event> events;
+  simple_spin_lock(&op->lock);
+  op->events.push_back(Event(now, what));
+  op->events.swap(events);
+  op->done = true;
+  simple_spin_unlock(&op->lock);
+  double duration = (now - op->received);
+
+  _trim_history(now);
+  unsigned max = cct->_conf->osd_op_history_size;
+  if (max > 0 &&
+      (history.size() < max || duration > history.begin()->first)) {
+    std::ostringstream ss;
+    op->req->print(ss);
+    HistoricOp& h = history.insert(std::make_pair(duration, HistoricOp()))->second;
+    h.received = op->received;
+    h.duration = duration;
+    h.desc = ss.str();
+    h.events.swap(events);
+    while (history.size() > max)
+      history.erase(history.begin());
+  }
+
+  op->req->put();
+  ops_in_flight.erase(p);
+}
+
+void OpTracker::_trim_history(utime_t now)
+{
+  utime_t cutoff = now;
+  cutoff -= cct->_conf->osd_op_history_duration;
+  std::multimap<double, HistoricOp>::iterator p = history.begin();
+  while (p != history.end()) {
+    if (p->second.received < cutoff)
+      history.erase(p++);
+    else
+      ++p;
+  }
+}
+
+void OpTracker::check_ops_in_flight(std::vector<std::string>& warnings)
+{
+  if (!enabled)
+    return;
+  utime_t now = ceph_clock_now(cct);
+  utime_t too_old = now;
+  too_old -= cct->_conf->osd_op_complaint_time;
+
+  Mutex::Locker l(lock);
+  std::map<Message*, TrackedOp*>::iterator p = ops_in_flight.begin();
+  while (p != ops_in_flight.end()) {
+    TrackedOp *op = p->second;
+    if (op->req->nref.read() == 1) {
+      // ours is the last ref: the op was dropped (stale map, closed
+      // connection, ...) somewhere we don't hear about.
+      ldout(cct, 20) << "retiring dropped op " << *op->req << dendl;
+      _retire(p++, now, "dropped");
+      continue;
+    }
+    if (!op->warned && op->received < too_old) {
+      simple_spin_lock(&op->lock);
+      const char *current = op->events.empty() ? "dispatched" : op->events.back().what;
+      simple_spin_unlock(&op->lock);
+      std::ostringstream ss;
+      ss << "slow request " << (now - op->received) << " seconds old, received at "
+	 << op->received << ": " << *op->req << " currently " << current;
+      warnings.push_back(ss.str());
+      op->warned = true;
+    }
+    ++p;
+  }
+}
+
+static void dump_quoted(std::ostream& out, const std::string& s)
+{
+  out << '"';
+  for (std::string::const_iterator p = s.begin(); p != s.end(); ++p) {
+    if (*p == '"' || *p == '\\')
+      out << '\\';
+    out << *p;
+  }
+  out << '"';
+}
+
+void OpTracker::dump_events(std::ostream& out, utime_t received,
+			    const std::vector<Event>& events)
+{
+  out << "\"events\":[";
+  utime_t last = received;
+  for (std::vector<Event>::const_iterator p = events.begin();
+       p != events.end();
+       ++p) {
+    if (p != events.begin())
+      out << ",";
+    out << "{\"event\":\"" << p->what << "\","
+	<< "\"at\":" << (double)(p->stamp - received) << ","
+	<< "\"delta\":" << (double)(p->stamp - last) << "}";
+    last = p->stamp;
+  }
+  out << "]";
+}
+
+void OpTracker::dump_ops_in_flight(std::ostream& out)
+{
+  utime_t now = ceph_clock_now(cct);
+  Mutex::Locker l(lock);
+  out << "{\"num_ops\":" << ops_in_flight.size() << ",\"ops\":[";
+  for (std::map<Message*, TrackedOp*>::iterator p = ops_in_flight.begin();
+       p != ops_in_flight.end();
+       ++p) {
+    TrackedOp *op = p->second;
+    if (p != ops_in_flight.begin())
+      out << ",";
+    std::ostringstream ss;
+    p->first->print(ss);
+    out << "{\"description\":";
+    dump_quoted(out, ss.str());
+    out << ",\"received_at\":\"" << op->received << "\""
+	<< ",\"age\":" << (double)(now - op->received) << ",";
+    simple_spin_lock(&op->lock);
+    std::vector<Event> events(op->events);
+    simple_spin_unlock(&op->lock);
+    dump_events(out, op->received, events);
+    out << "}";
+  }
+  out << "]}";
+}
+
+void OpTracker::dump_historic_ops(std::ostream& out)
+{
+  utime_t now = ceph_clock_now(cct);
+  Mutex::Locker l(lock);
+  _trim_history(now);
+  out << "{\"num_ops\":" << history.size() << ",\"ops\":[";
+  // slowest first
+  for (std::multimap<double, HistoricOp>::reverse_iterator p = history.rbegin();
+       p != history.rend();
+       ++p) {
+    if (p != history.rbegin())
+      out << ",";
+    out << "{\"description\":";
+    dump_quoted(out, p->second.desc);
+    out << ",\"received_at\":\"" << p->second.received << "\""
+	<< ",\"duration\":" << p->second.duration << ",";
+    dump_events(out, p->second.received, p->second.events);
+    out << "}";
+  }
+  out << "]}";
+}
+
+bool OpTracker::call(uint32_t request, std::string& out)
+{
+  std::ostringstream ss;
+  switch (request) {
+  case CEPH_ADMIN_SOCK_REQ_OPS_IN_FLIGHT:
+    dump_ops_in_flight(ss);
+    break;
+  case CEPH_ADMIN_SOCK_REQ_HISTORIC_OPS:
+    dump_historic_ops(ss);
+    break;
+  default:
+    return false;
+  }
+  out = ss.str();
+  return true;
+}
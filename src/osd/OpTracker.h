@@ -0,0 +1,108 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2011 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OSD_OPTRACKER_H
+#define CEPH_OSD_OPTRACKER_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/Mutex.h"
+#include "common/admin_socket.h"
+#include "common/simple_spin.h"
+#include "include/utime.h"
+#include "msg/Message.h"
+
+class CephContext;
+
+/*
+ * OpTracker follows client ops and replica subops through the OSD and
+ * stamps them as they pass each stage of the write path (dispatch, op
+ * queue, pg lock, journal submit/commit, filestore apply, replica acks).
+ *
+ * In-flight ops hold a reference to their message so they can be
+ * described on demand.  When an op finishes, its timeline is kept only
+ * if it is among the slowest osd_op_history_size ops of the last
+ * osd_op_history_duration seconds, so the common case costs a map
+ * insert/erase and a few clock reads.  Both lists can be dumped through
+ * the admin socket.
+ *
+ * The timeline hangs off the message itself, so marking an event only
+ * takes that op's spinlock; the tracker lock is only taken to register,
+ * retire and dump ops.  Lock order is tracker lock, then op lock.
+ */
+class OpTracker : public AdminSocketHook {
+  struct Event {
+    utime_t stamp;
+    const char *what;   // always a string literal
+    Event(utime_t s, const char *w) : stamp(s), what(w) {}
+  };
+
+  struct TrackedOp : public RefCountedObject {
+    simple_spinlock_t lock;   // protects events and done
+    Message *req;       // we hold a ref while the op is in flight
+    utime_t received;
+    std::vector<Event> events;
+    bool warned;        // only touched under the tracker lock
+    bool done;          // retired; later events are ignored
+    TrackedOp() : lock(SIMPLE_SPINLOCK_INITIALIZER), req(NULL),
+		  warned(false), done(false) {}
+  };
+
+  struct HistoricOp {
+    utime_t received;
+    double duration;
+    std::string desc;
+    std::vector<Event> events;
+  };
+
+  CephContext *cct;
+  Mutex lock;
+  bool enabled;
+  std::map<Message*, TrackedOp*> ops_in_flight;
+  std::multimap<double, HistoricOp> history;   // by duration, slowest last
+
+  void _retire(std::map<Message*, TrackedOp*>::iterator p, utime_t now,
+	       const char *what);
+  void _trim_history(utime_t now);
+  static void dump_events(std::ostream& out, utime_t received,
+			  const std::vector<Event>& events);
+
+public:
+  OpTracker(CephContext *cct_);
+  ~OpTracker();
+
+  /// start tracking m (no-op if already tracked, e.g. when it is redispatched;
+  /// an op is only tracked once, so a retired op is not picked up again)
+  void register_op(Message *m);
+  /// note that m just reached stage what
+  void mark_event(Message *m, const char *what);
+  /// m is finished; drop it from the in-flight list
+  void unregister_op(Message *m);
+
+  /**
+   * Retire ops that everyone else has dropped without telling us, and
+   * append a warning for each op in flight longer than
+   * osd_op_complaint_time that we have not complained about yet.
+   */
+  void check_ops_in_flight(std::vector<std::string>& warnings);
+
+  void dump_ops_in_flight(std::ostream& out);
+  void dump_historic_ops(std::ostream& out);
+
+  bool call(uint32_t request, std::string& out);
+};
+
+#endif
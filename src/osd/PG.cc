@@ -917,6 +917,7 @@ void PG::generate_past_intervals()
       return;
     }
     past_intervals.clear();
+    dirty_big_info = true;
   }
 
   epoch_t first_epoch = 0;
@@ -944,6 +945,7 @@ void PG::generate_past_intervals()
     }
 
     Interval &i = past_intervals[first_epoch];
+    dirty_big_info = true;
     i.first = first_epoch;
     i.last = last_epoch;
     i.up.swap(tup);
@@ -978,6 +980,7 @@ void PG::trim_past_intervals()
       return;
     dout(10) << __func__ << ": trimming " << pif->second << dendl;
     past_intervals.erase(pif++);
+    dirty_big_info = true;
   }
 }
 
@@ -1256,6 +1259,7 @@ void PG::clear_primary_state()
   scrub_reserved_peers.clear();
   osd->recovery_wq.dequeue(this);
   osd->snap_trim_wq.dequeue(this);
+  osd->agent_wq.dequeue(this);
 }
 
 bool PG::choose_acting(int newest_update_osd) const
@@ -1941,50 +1945,93 @@ void PG::purge_strays()
 
 
 
+/*
+ * two stats are the same if they would tell the monitor the same thing;
+ * reported is the version we are deciding whether to bump, so it does
+ * not count.
+ */
+static bool pg_stats_equal(const pg_stat_t& a, const pg_stat_t& b)
+{
+  // cheapest and most volatile fields first; this runs on every op
+  return a.version == b.version &&
+    a.state == b.state &&
+    a.stats.sum == b.stats.sum &&
+    a.log_size == b.log_size &&
+    a.ondisk_log_size == b.ondisk_log_size &&
+    a.log_start == b.log_start &&
+    a.ondisk_log_start == b.ondisk_log_start &&
+    a.created == b.created &&
+    a.last_epoch_clean == b.last_epoch_clean &&
+    a.parent == b.parent &&
+    a.parent_split_bits == b.parent_split_bits &&
+    a.last_scrub == b.last_scrub &&
+    a.last_scrub_stamp == b.last_scrub_stamp &&
+    a.up == b.up &&
+    a.acting == b.acting &&
+    a.stats.cat_sum == b.stats.cat_sum;
+}
+
+/*
+ * publish our stats for the monitor.  info.stats.reported is the pg's
+ * stats version: it is only bumped, and the pg only queued for the next
+ * MPGStats, when something the monitor sees has actually changed.  the
+ * osd resends everything every osd_mon_report_full_interval regardless.
+ */
 void PG::update_stats()
 {
+  bool changed = false;
   pg_stats_lock.Lock();
   if (is_primary()) {
     // update our stat summary
-    info.stats.reported.inc(info.history.same_primary_since);
     info.stats.version = info.last_update;
     info.stats.created = info.history.epoch_created;
     info.stats.last_scrub = info.history.last_scrub;
     info.stats.last_scrub_stamp = info.history.last_scrub_stamp;
     info.stats.last_epoch_clean = info.history.last_epoch_clean;
-    pg_stats_valid = true;
-    pg_stats_stable = info.stats;
-    pg_stats_stable.state = state;
-    pg_stats_stable.up = up;
-    pg_stats_stable.acting = acting;
 
-    pg_stats_stable.log_size = ondisklog.length();
-    pg_stats_stable.ondisk_log_size = ondisklog.length();
-    pg_stats_stable.log_start = log.tail;
-    pg_stats_stable.ondisk_log_start = log.tail;
+    pg_stat_t pre_publish = info.stats;
+    pre_publish.state = state;
+    pre_publish.up = up;
+    pre_publish.acting = acting;
+
+    pre_publish.log_size = ondisklog.length();
+    pre_publish.ondisk_log_size = ondisklog.length();
+    pre_publish.log_start = log.tail;
+    pre_publish.ondisk_log_start = log.tail;
 
-    pg_stats_stable.stats.calc_copies_degraded(osd->osdmap->get_pg_size(info.pgid), acting.size());
+    pre_publish.stats.calc_copies_degraded(osd->osdmap->get_pg_size(info.pgid), acting.size());
 
     if (!is_clean() && is_active()) {
-      pg_stats_stable.stats.sum.num_objects_missing_on_primary = missing.num_missing();
+      pre_publish.stats.sum.num_objects_missing_on_primary = missing.num_missing();
       int degraded = missing.num_missing();
       for (unsigned i=1; i<acting.size(); i++) {
 	assert(peer_missing.count(acting[i]));
 	degraded += peer_missing[acting[i]].num_missing();
       }
-      pg_stats_stable.stats.sum.num_objects_degraded += degraded;
+      pre_publish.stats.sum.num_objects_degraded += degraded;
 
-      pg_stats_stable.stats.sum.num_objects_unfound = get_num_unfound();
+      pre_publish.stats.sum.num_objects_unfound = get_num_unfound();
     }
 
-    dout(15) << "update_stats " << pg_stats_stable.reported << dendl;
+    if (!pg_stats_valid ||
+	info.stats.reported.epoch < info.history.same_primary_since ||
+	!pg_stats_equal(pre_publish, pg_stats_stable)) {
+      info.stats.reported.inc(info.history.same_primary_since);
+      pre_publish.reported = info.stats.reported;
+      pg_stats_valid = true;
+      pg_stats_stable = pre_publish;
+      changed = true;
+      dout(15) << "update_stats " << pg_stats_stable.reported << dendl;
+    } else {
+      dout(20) << "update_stats " << pg_stats_stable.reported << " unchanged" << dendl;
+    }
   } else {
     pg_stats_valid = false;
     dout(15) << "update_stats -- not primary" << dendl;
   }
   pg_stats_lock.Unlock();
 
-  if (is_primary())
+  if (changed)
     osd->pg_stat_queue_enqueue(this);
 }
 
@@ -2009,13 +2056,16 @@ void PG::write_info(ObjectStore::Transaction& t)
   dout(20) << "write_info info " << infobl.length() << dendl;
   t.collection_setattr(coll, "info", infobl);
  
-  // potentially big stuff
-  bufferlist bigbl;
-  ::encode(past_intervals, bigbl);
-  ::encode(snap_collections, bigbl);
-  dout(20) << "write_info bigbl " << bigbl.length() << dendl;
-  t.truncate(coll_t::META_COLL, biginfo_oid, 0);
-  t.write(coll_t::META_COLL, biginfo_oid, 0, bigbl.length(), bigbl);
+  // potentially big stuff; only rewrite it if it changed
+  if (dirty_big_info) {
+    bufferlist bigbl;
+    ::encode(past_intervals, bigbl);
+    ::encode(snap_collections, bigbl);
+    dout(20) << "write_info bigbl " << bigbl.length() << dendl;
+    t.truncate(coll_t::META_COLL, biginfo_oid, 0);
+    t.write(coll_t::META_COLL, biginfo_oid, 0, bigbl.length(), bigbl);
+    dirty_big_info = false;
+  }
 
   dirty_info = false;
 }
@@ -2426,6 +2476,7 @@ void PG::read_state(ObjectStore *store)
   p = bl.begin();
   ::decode(struct_v, p);
   ::decode(info, p);
+  dirty_big_info = (struct_v < 3);  // rewrite old formats on next write_info
   if (struct_v < 2) {
     ::decode(past_intervals, p);
   
@@ -2540,6 +2591,7 @@ coll_t PG::make_snap_collection(ObjectStore::Transaction& t, snapid_t s)
   coll_t c(info.pgid, s);
   if (!snap_collections.contains(s)) {
     snap_collections.insert(s);
+    dirty_big_info = true;
     dout(10) << "create_snap_collection " << c << ", set now " << snap_collections << dendl;
     bufferlist bl;
     ::encode(snap_collections, bl);
@@ -2560,9 +2612,11 @@ void PG::update_snap_collections(vector<Log::Entry> &log_entries)
       ::decode(snaps, p);
       if (!snap_collections.contains(*snaps.begin())) {
 	snap_collections.insert(*snaps.begin());
+	dirty_big_info = true;
       }
       if (snaps.size() > 1 && !snap_collections.contains(*(snaps.end() - 1))) {
 	snap_collections.insert(*(snaps.end() - 1));
+	dirty_big_info = true;
       }
     }
   }
@@ -3551,6 +3605,7 @@ void PG::on_removal()
   osd->scrub_finalize_wq.dequeue(this);
   osd->snap_trim_wq.dequeue(this);
   osd->remove_wq.dequeue(this);
+  osd->agent_wq.dequeue(this);
   osd->pg_stat_queue_dequeue(this);
 
   remove_watchers_and_notifies();
@@ -3589,6 +3644,7 @@ void PG::start_peering_interval(const OSDMap *lastmap,
   } else if (acting != oldacting || up != oldup) {
     // remember past interval
     PG::Interval& i = past_intervals[info.history.same_interval_since];
+    dirty_big_info = true;
     i.first = info.history.same_interval_since;
     i.last = osdmap->get_epoch() - 1;
     i.acting = oldacting;
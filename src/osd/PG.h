@@ -767,6 +767,7 @@ public:
   list<Message*> op_queue;  // op queue
 
   bool dirty_info, dirty_log;
+  bool dirty_big_info;   // past_intervals or snap_collections changed since last write_info
 
 public:
   struct Interval {
@@ -812,7 +813,7 @@ public:
 
   /* You should not use these items without taking their respective queue locks
    * (if they have one) */
-  xlist<PG*>::item recovery_item, backlog_item, scrub_item, scrub_finalize_item, snap_trim_item, remove_item, stat_queue_item;
+  xlist<PG*>::item recovery_item, backlog_item, scrub_item, scrub_finalize_item, snap_trim_item, remove_item, stat_queue_item, agent_item;
   int recovery_ops_active;
 #ifdef DEBUG_RECOVERY_OIDS
   set<hobject_t> recovering_oids;
@@ -1514,9 +1515,9 @@ public:
   PG(OSD *o, PGPool *_pool, pg_t p, const hobject_t& loid, const hobject_t& ioid) : 
     osd(o), pool(_pool),
     _lock("PG::_lock"),
-    ref(0), deleting(false), dirty_info(false), dirty_log(false),
+    ref(0), deleting(false), dirty_info(false), dirty_log(false), dirty_big_info(true),
     info(p), coll(p), log_oid(loid), biginfo_oid(ioid),
-    recovery_item(this), backlog_item(this), scrub_item(this), scrub_finalize_item(this), snap_trim_item(this), remove_item(this), stat_queue_item(this),
+    recovery_item(this), backlog_item(this), scrub_item(this), scrub_finalize_item(this), snap_trim_item(this), remove_item(this), stat_queue_item(this), agent_item(this),
     recovery_ops_active(0),
     generate_backlog_epoch(0),
     role(0),
@@ -1656,6 +1657,7 @@ public:
   virtual void do_sub_op(MOSDSubOp *op) = 0;
   virtual void do_sub_op_reply(MOSDSubOpReply *op) = 0;
   virtual bool snap_trimmer() = 0;
+  virtual void agent_work() = 0;
 
   virtual bool same_for_read_since(epoch_t e) = 0;
   virtual bool same_for_modify_since(epoch_t e) = 0;
@@ -32,6 +32,8 @@
 #include "messages/MOSDPing.h"
 #include "messages/MWatchNotify.h"
 
+#include "osdc/Objecter.h"
+
 #include "Watch.h"
 
 #include "mds/inode_backtrace.h" // Ugh
@@ -400,12 +402,18 @@ void ReplicatedPG::do_op(MOSDOp *op)
     return do_pg_op(op);
 
   dout(10) << "do_op " << *op << (op->may_write() ? " may_write" : "") << dendl;
+  osd->op_tracker.mark_event(op, "started");
   if (finalizing_scrub && op->may_write()) {
     dout(20) << __func__ << ": waiting for scrub" << dendl;
     waiting_for_active.push_back(op);
     return;
   }
 
+  if (pool->info.is_cache() &&
+      !(op->get_flags() & CEPH_OSD_FLAG_IGNORE_OVERLAY) &&
+      maybe_handle_cache(op))
+    return;
+
   entity_inst_t client = op->get_source_inst();
 
   ObjectContext *obc;
@@ -418,10 +426,10 @@ void ReplicatedPG::do_op(MOSDOp *op)
 			      &obc, can_create, &snapid);
   if (r) {
     if (r == -EAGAIN) {
-      // If we're not the primary of this OSD, and we have
-      // CEPH_OSD_FLAG_LOCALIZE_READS set, we just return -EAGAIN. Otherwise,
-      // we have to wait for the object.
-      if (is_primary() || (!(op->get_rmw_flags() & CEPH_OSD_FLAG_LOCALIZE_READS))) {
+      // a replica serving a balanced or localized read can't recover the
+      // object itself; return -EAGAIN so the client retries at the
+      // primary.  Otherwise, we have to wait for the object.
+      if (is_primary()) {
 	// missing the specific snap we need; requeue and wait.
 	assert(!can_create); // only happens on a read
 	hobject_t soid(op->get_oid(), op->get_object_locator().key,
@@ -469,6 +477,7 @@ void ReplicatedPG::do_op(MOSDOp *op)
     assert(0);
   if (!ok) {
     dout(10) << "do_op waiting on mode " << mode << dendl;
+    osd->op_tracker.mark_event(op, "waiting_for_mode");
     mode.waiting.push_back(op);
     return;
   }
@@ -630,6 +639,14 @@ void ReplicatedPG::do_op(MOSDOp *op)
     return;
   }
 
+  if (result >= 0 && !ctx->op_t.empty() && ctx->new_obs.exists &&
+      pool->info.is_tier()) {
+    // the base pool's copy is stale until the agent flushes this one
+    bufferlist bl;
+    ::encode((__u8)1, bl);
+    ctx->op_t.setattr(coll, soid, CACHE_DIRTY_ATTR, bl);
+  }
+
   // prepare the reply
   ctx->reply = new MOSDOpReply(op, 0, osd->osdmap->get_epoch(), 0); 
   ctx->reply->set_data(ctx->outdata);
@@ -647,6 +664,7 @@ void ReplicatedPG::do_op(MOSDOp *op)
     ctx->reply = NULL;
     reply->add_flags(CEPH_OSD_FLAG_ACK | CEPH_OSD_FLAG_ONDISK);
     osd->client_messenger->send_message(reply, op->get_connection());
+    osd->op_tracker.unregister_op(op);
     op->put();
     delete ctx;
     put_object_context(obc);
@@ -699,23 +717,23 @@ void ReplicatedPG::log_op_stats(OpContext *ctx)
 
   osd->logger->inc(l_osd_op_outb, outb);
   osd->logger->inc(l_osd_op_inb, inb);
-  osd->logger->fset(l_osd_op_lat, latency);
+  osd->logger->tinc(l_osd_op_lat, latency);
 
   if (op->may_read() && op->may_write()) {
     osd->logger->inc(l_osd_op_rw);
     osd->logger->inc(l_osd_op_rw_inb, inb);
     osd->logger->inc(l_osd_op_rw_outb, outb);
-    osd->logger->fset(l_osd_op_rw_rlat, rlatency);
-    osd->logger->fset(l_osd_op_rw_lat, latency);
+    osd->logger->tinc(l_osd_op_rw_rlat, rlatency);
+    osd->logger->tinc(l_osd_op_rw_lat, latency);
   } else if (op->may_read()) {
     osd->logger->inc(l_osd_op_r);
     osd->logger->inc(l_osd_op_r_outb, outb);
-    osd->logger->fset(l_osd_op_r_lat, latency);
+    osd->logger->tinc(l_osd_op_r_lat, latency);
   } else if (op->may_write()) {
     osd->logger->inc(l_osd_op_w);
     osd->logger->inc(l_osd_op_w_inb, inb);
-    osd->logger->fset(l_osd_op_w_rlat, rlatency);
-    osd->logger->fset(l_osd_op_w_lat, latency);
+    osd->logger->tinc(l_osd_op_w_rlat, rlatency);
+    osd->logger->tinc(l_osd_op_w_lat, latency);
   } else
     assert(0);
 
@@ -737,11 +755,11 @@ void ReplicatedPG::log_subop_stats(MOSDSubOp *op, int tag_inb, int tag_lat)
   osd->logger->inc(l_osd_sop);
 
   osd->logger->inc(l_osd_sop_inb, inb);
-  osd->logger->fset(l_osd_sop_lat, latency);
+  osd->logger->tinc(l_osd_sop_lat, latency);
 
   if (tag_inb)
     osd->logger->inc(tag_inb, inb);
-  osd->logger->fset(tag_lat, latency);
+  osd->logger->tinc(tag_lat, latency);
 
   dout(15) << "log_subop_stats " << *op << " inb " << inb << " latency " << latency << dendl;
 }
@@ -1841,6 +1859,49 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops,
       }
       break;
 
+    case CEPH_OSD_OP_TMAPGETVALS:
+      {
+	set<string> keys;
+	::decode(keys, bp);
+
+	bufferlist ibl;
+	vector<OSDOp> nops(1);
+	OSDOp& newop = nops[0];
+	newop.op.op = CEPH_OSD_OP_READ;
+	newop.op.extent.offset = 0;
+	newop.op.extent.length = 0;
+	do_osd_ops(ctx, nops, ibl);
+	dout(10) << "tmapgetvals read " << ibl.length() << ", want " << keys.size() << " keys" << dendl;
+	if (ibl.length() == 0)
+	  break;
+
+	// return the header and any matching keys, tmap-encoded
+	bufferlist::iterator ip = ibl.begin();
+	bufferlist header;
+	__u32 nkeys;
+	::decode(header, ip);
+	::decode(nkeys, ip);
+
+	bufferlist keydata;
+	__u32 nfound = 0;
+	while (nkeys-- && nfound < keys.size()) {
+	  string key;
+	  bufferlist val;
+	  ::decode(key, ip);
+	  ::decode(val, ip);
+	  if (keys.count(key)) {
+	    ::encode(key, keydata);
+	    ::encode(val, keydata);
+	    nfound++;
+	  }
+	}
+	dout(20) << "tmapgetvals found " << nfound << " keys" << dendl;
+	::encode(header, odata);
+	::encode(nfound, odata);
+	odata.claim_append(keydata);
+      }
+      break;
+
     case CEPH_OSD_OP_TMAPPUT:
       {
 	//_dout_lock.Lock();
@@ -2609,6 +2670,8 @@ public:
     pg->get();    // we're copying the pointer
   }
   void finish(int r) {
+    if (repop->ctx->op)
+      pg->osd->op_tracker.mark_event(repop->ctx->op, "filestore_applied");
     pg->op_applied(repop);
     pg->put();
   }
@@ -2625,6 +2688,8 @@ public:
     pg->get();    // we're copying the pointer
   }
   void finish(int r) {
+    if (repop->ctx->op)
+      pg->osd->op_tracker.mark_event(repop->ctx->op, "journal_committed");
     pg->op_commit(repop);
     pg->put();
   }
@@ -2649,6 +2714,8 @@ void ReplicatedPG::apply_repop(RepGather *repop)
   Context *onapplied = new C_OSD_OpApplied(this, repop);
   Context *onapplied_sync = new C_OSD_OndiskWriteUnlock(repop->obc,
 							repop->ctx->clone_obc);
+  if (repop->ctx->op)
+    osd->op_tracker.mark_event(repop->ctx->op, "journal_submit");
   int r = osd->store->queue_transactions(&osr, repop->tls, onapplied, oncommit, onapplied_sync);
   if (r) {
     derr << "apply_repop  queue_transactions returned " << r << " on " << *repop << dendl;
@@ -2660,6 +2727,8 @@ void ReplicatedPG::op_applied(RepGather *repop)
 {
   lock();
   dout(10) << "op_applied " << *repop << dendl;
+  if (repop->ctx->op)
+    osd->op_tracker.mark_event(repop->ctx->op, "op_applied");
 
   // discard my reference to the buffer
   if (repop->ctx->op)
@@ -2717,6 +2786,8 @@ void ReplicatedPG::op_commit(RepGather *repop)
     dout(10) << "op_commit " << *repop << " -- already marked ondisk" << dendl;
   } else {
     dout(10) << "op_commit " << *repop << dendl;
+    if (repop->ctx->op)
+      osd->op_tracker.mark_event(repop->ctx->op, "op_commit");
     repop->waitfor_disk.erase(osd->get_nodeid());
     //repop->waitfor_nvram.erase(osd->get_nodeid());
 
@@ -2773,10 +2844,10 @@ void ReplicatedPG::eval_repop(RepGather *repop)
 	  reply = new MOSDOpReply(op, 0, osd->osdmap->get_epoch(), 0);
 	reply->add_flags(CEPH_OSD_FLAG_ACK | CEPH_OSD_FLAG_ONDISK);
 	dout(10) << " sending commit on " << *repop << " " << reply << dendl;
-	assert(entity_name_t::TYPE_OSD != op->get_connection()->peer_type);
 	osd->client_messenger->send_message(reply, op->get_connection());
 	repop->sent_disk = true;
       }
+      osd->op_tracker.unregister_op(op);
     }
 
     // applied?
@@ -2790,9 +2861,9 @@ void ReplicatedPG::eval_repop(RepGather *repop)
 	  reply = new MOSDOpReply(op, 0, osd->osdmap->get_epoch(), 0);
 	reply->add_flags(CEPH_OSD_FLAG_ACK);
 	dout(10) << " sending ack on " << *repop << " " << reply << dendl;
-        assert(entity_name_t::TYPE_OSD != op->get_connection()->peer_type);
 	osd->client_messenger->send_message(reply, op->get_connection());
 	repop->sent_ack = true;
+	osd->op_tracker.mark_event(op, "ack_sent");
       }
 
       // note the write is now readable (for rlatency calc).  note
@@ -2870,6 +2941,8 @@ void ReplicatedPG::issue_repop(RepGather *repop, utime_t now,
     
     wr->pg_trim_to = pg_trim_to;
     osd->cluster_messenger->send_message(wr, osd->osdmap->get_cluster_inst(peer));
+    if (op)
+      osd->op_tracker.mark_event(op, "sub_op_sent");
 
     // keep peer_info up to date
     Info &in = peer_info[peer];
@@ -2939,6 +3012,10 @@ void ReplicatedPG::repop_ack(RepGather *repop, int result, int ack_type,
 	    << " from osd." << fromosd
 	    << dendl;
   
+  if (op)
+    osd->op_tracker.mark_event(op, (ack_type & CEPH_OSD_FLAG_ONDISK) ?
+			       "sub_op_commit_rec" : "sub_op_applied_rec");
+
   if (ack_type & CEPH_OSD_FLAG_ONDISK) {
     // disk
     if (repop->waitfor_disk.count(fromosd)) {
@@ -3069,6 +3146,453 @@ void ReplicatedPG::handle_watch_timeout(void *_obc,
   eval_repop(repop);
 }
 
+// ==========================================================================================
+// CACHE TIER
+
+/*
+ * Decide how a cache pg serves a client op.  Return false to let do_op
+ * go on and serve it from the cache, or true if the op was redirected
+ * to the base pool or is waiting for a promote.  In forward mode we
+ * never promote: misses go to the base while the agent drains us.
+ */
+bool ReplicatedPG::maybe_handle_cache(MOSDOp *op)
+{
+  hobject_t soid(op->get_oid(), op->get_object_locator().key,
+		 CEPH_NOSNAP, op->get_pg().ps());
+  bool hot = hit_set.contains(soid.hash);
+  hit_set.insert(soid.hash, ceph_clock_now(g_ceph_context),
+		 pool->info.hit_set_period, pool->info.hit_set_count);
+
+  if (op->get_snapid() != CEPH_NOSNAP) {
+    dout(20) << __func__ << " " << soid << " snap read, redirecting" << dendl;
+    reply_redirect(op);
+    return true;
+  }
+
+  map<hobject_t, list<Message*> >::iterator w = waiting_for_promote.find(soid);
+  if (w != waiting_for_promote.end()) {
+    dout(20) << __func__ << " " << soid << " waiting for promote" << dendl;
+    w->second.push_back(op);
+    return true;
+  }
+
+  if (is_missing_object(soid))
+    return false;   // do_op will wait for recovery
+
+  bool exists;
+  ObjectContext *obc = lookup_object_context(soid);
+  if (obc) {
+    exists = obc->obs.exists;
+    put_object_context(obc);
+  } else {
+    struct stat st;
+    exists = osd->store->stat(coll, soid, &st) == 0;
+  }
+
+  if (!is_primary()) {
+    // a balanced read at a replica; only the primary promotes
+    if (exists)
+      return false;
+    reply_redirect(op);
+    return true;
+  }
+
+  bool deletes = false;
+  for (vector<OSDOp>::iterator p = op->ops.begin(); p != op->ops.end(); ++p)
+    if (p->op.op == CEPH_OSD_OP_DELETE)
+      deletes = true;
+
+  if (exists) {
+    if (!deletes)
+      return false;
+
+    // remove the base copy first, or a later miss would promote it again
+    dout(10) << __func__ << " " << soid << " delete, removing from base pool" << dendl;
+    waiting_for_promote[soid].push_back(op);
+    object_locator_t oloc = op->get_object_locator();
+    oloc.pool = pool->info.tier_of;
+    ObjectOperation rm;
+    rm.remove();
+    rm.set_last_op_flags(CEPH_OSD_OP_FLAG_FAILOK);
+    Context *fin = new C_OnFinisher(new C_BaseDelete(this, soid, last_peering_reset),
+				    &osd->objecter_finisher);
+    Mutex::Locker l(osd->objecter_lock);
+    osd->objecter->mutate(soid.oid, oloc, rm, SnapContext(), op->get_mtime(),
+			  CEPH_OSD_FLAG_IGNORE_OVERLAY, NULL, fin);
+    return true;
+  }
+
+  // a miss.  deletes and cold reads go straight to the base pool, as
+  // does everything once we are draining.
+  if (deletes || !pool->info.is_writeback_cache() ||
+      (!op->may_write() && !hot)) {
+    dout(20) << __func__ << " " << soid << " miss, redirecting" << dendl;
+    reply_redirect(op);
+    return true;
+  }
+
+  promote_object(op, soid);
+  return true;
+}
+
+void ReplicatedPG::reply_redirect(MOSDOp *op)
+{
+  MOSDOpReply *reply = new MOSDOpReply(op, -ENOENT, osd->osdmap->get_epoch(),
+				       CEPH_OSD_FLAG_ACK | CEPH_OSD_FLAG_ONDISK);
+  reply->add_flags(CEPH_OSD_FLAG_REDIRECTED);
+  osd->client_messenger->send_message(reply, op->get_connection());
+  osd->op_tracker.unregister_op(op);
+  op->put();
+}
+
+void ReplicatedPG::promote_object(MOSDOp *op, const hobject_t& soid)
+{
+  dout(10) << __func__ << " " << soid << dendl;
+  waiting_for_promote[soid].push_back(op);
+
+  object_locator_t oloc = op->get_object_locator();
+  oloc.pool = pool->info.tier_of;
+  C_PromoteRead *c = new C_PromoteRead(this, soid, last_peering_reset);
+  C_GatherBuilder gather(g_ceph_context,
+			 new C_OnFinisher(c, &osd->objecter_finisher));
+  int flags = CEPH_OSD_FLAG_IGNORE_OVERLAY;
+
+  Mutex::Locker l(osd->objecter_lock);
+  osd->objecter->read_full(soid.oid, oloc, CEPH_NOSNAP, &c->data, flags,
+			   gather.new_sub());
+  osd->objecter->getxattrs(soid.oid, oloc, CEPH_NOSNAP, c->attrs, flags,
+			   gather.new_sub());
+  osd->objecter->stat(soid.oid, oloc, CEPH_NOSNAP, &c->size, &c->mtime, flags,
+		      gather.new_sub());
+  gather.activate();
+}
+
+void ReplicatedPG::finish_promote(C_PromoteRead *c, int r)
+{
+  const hobject_t& soid = c->soid;
+  dout(10) << __func__ << " " << soid << " r=" << r << dendl;
+  if (c->epoch != last_peering_reset) {
+    dout(10) << __func__ << " " << soid << " pg changed, dropping" << dendl;
+    return;   // on_change requeued the waiters
+  }
+
+  if (r == -ENOENT) {
+    // nothing to promote: writes create the object here, reads fail here
+    kick_promote_waiters(soid, true);
+    return;
+  }
+  if (r < 0) {
+    list<Message*> ls;
+    ls.swap(waiting_for_promote[soid]);
+    waiting_for_promote.erase(soid);
+    for (list<Message*>::iterator p = ls.begin(); p != ls.end(); ++p)
+      osd->reply_op_error((MOSDOp*)*p, r);
+    return;
+  }
+
+  object_locator_t oloc(info.pgid.pool());
+  oloc.key = soid.get_key();
+  ObjectContext *obc = get_object_context(soid, oloc, true);
+
+  ObjectOperation op;
+  op.create(false);
+  op.write_full(c->data);
+  for (map<string,bufferlist>::iterator p = c->attrs.begin(); p != c->attrs.end(); ++p)
+    op.setxattr(p->first.c_str(), p->second);
+  internal_op(obc, op.ops, c->mtime);
+
+  kick_promote_waiters(soid, false);
+}
+
+void ReplicatedPG::finish_base_delete(const hobject_t& soid, epoch_t epoch, int r)
+{
+  dout(10) << __func__ << " " << soid << " r=" << r << dendl;
+  if (epoch != last_peering_reset)
+    return;
+  if (r < 0) {
+    list<Message*> ls;
+    ls.swap(waiting_for_promote[soid]);
+    waiting_for_promote.erase(soid);
+    for (list<Message*>::iterator p = ls.begin(); p != ls.end(); ++p)
+      osd->reply_op_error((MOSDOp*)*p, r);
+    return;
+  }
+  // the object is gone from the base pool; only our copy matters now
+  kick_promote_waiters(soid, true);
+}
+
+void ReplicatedPG::kick_promote_waiters(const hobject_t& soid, bool ignore_overlay)
+{
+  map<hobject_t, list<Message*> >::iterator p = waiting_for_promote.find(soid);
+  if (p == waiting_for_promote.end())
+    return;
+  list<Message*> ls;
+  ls.swap(p->second);
+  waiting_for_promote.erase(p);
+  if (ignore_overlay)
+    for (list<Message*>::iterator i = ls.begin(); i != ls.end(); ++i)
+      ((MOSDOp*)*i)->add_flags(CEPH_OSD_FLAG_IGNORE_OVERLAY);
+  osd->requeue_ops(this, ls);
+}
+
+/*
+ * Apply ops to an object on behalf of the pg itself, with nobody to
+ * reply to.  Consumes the obc ref.
+ */
+void ReplicatedPG::internal_op(ObjectContext *obc, vector<OSDOp>& ops, utime_t mtime)
+{
+  tid_t rep_tid = osd->get_tid();
+  osd_reqid_t reqid(osd->cluster_messenger->get_myname(), 0, rep_tid);
+  OpContext *ctx = new OpContext(NULL, reqid, ops, &obc->obs, obc->ssc, this);
+  ctx->obc = obc;
+  ctx->mtime = mtime;
+  ctx->snapc = pool->snapc;
+  ctx->at_version = log.head;
+  ctx->at_version.epoch = osd->osdmap->get_epoch();
+  ctx->at_version.version++;
+
+  eversion_t old_last_update = log.head;
+  bool old_exists = obc->obs.exists;
+  uint64_t old_size = obc->obs.oi.size;
+  eversion_t old_version = obc->obs.oi.version;
+
+  int r = prepare_transaction(ctx);
+  if (r < 0 || ctx->op_t.empty()) {
+    dout(0) << __func__ << " " << obc->obs.oi.soid << " " << ops
+	    << " got " << r << dendl;
+    delete ctx;
+    put_object_context(obc);
+    return;
+  }
+
+  /* As in handle_watch_timeout, mode.try_write always returns true for
+   * now; if that changes we will need to delay. */
+  entity_inst_t nobody;
+  bool ok = mode.try_write(nobody);
+  assert(ok);
+
+  calc_trim_to();
+  append_log(ctx->log, pg_trim_to, ctx->local_t);
+
+  RepGather *repop = new_repop(ctx, obc, rep_tid);  // claims our obc ref
+  issue_repop(repop, mtime, old_last_update, old_exists, old_size, old_version);
+  eval_repop(repop);
+  repop->put();
+}
+
+bool ReplicatedPG::is_cache_dirty(const hobject_t& soid)
+{
+  bufferlist bl;
+  return osd->store->getattr(coll, soid, CACHE_DIRTY_ATTR, bl) >= 0;
+}
+
+/*
+ * The base pool has the object's current contents; bump the version
+ * and drop the dirty mark.  Consumes the obc ref.
+ */
+void ReplicatedPG::clear_cache_dirty(ObjectContext *obc)
+{
+  const hobject_t& soid = obc->obs.oi.soid;
+  dout(10) << __func__ << " " << soid << dendl;
+
+  vector<OSDOp> ops;
+  tid_t rep_tid = osd->get_tid();
+  osd_reqid_t reqid(osd->cluster_messenger->get_myname(), 0, rep_tid);
+  OpContext *ctx = new OpContext(NULL, reqid, ops, &obc->obs, obc->ssc, this);
+  ctx->mtime = ceph_clock_now(g_ceph_context);
+  ctx->at_version.epoch = osd->osdmap->get_epoch();
+  ctx->at_version.version = log.head.version + 1;
+
+  entity_inst_t nobody;
+  bool ok = mode.try_write(nobody);
+  assert(ok);
+  RepGather *repop = new_repop(ctx, obc, rep_tid);
+
+  ctx->log.push_back(Log::Entry(Log::Entry::MODIFY, soid, ctx->at_version,
+				obc->obs.oi.version, osd_reqid_t(), ctx->mtime));
+
+  eversion_t old_last_update = log.head;
+  bool old_exists = obc->obs.exists;
+  uint64_t old_size = obc->obs.oi.size;
+  eversion_t old_version = obc->obs.oi.version;
+
+  obc->obs.oi.prior_version = old_version;
+  obc->obs.oi.version = ctx->at_version;
+  bufferlist bl;
+  ::encode(obc->obs.oi, bl);
+  ctx->op_t.setattr(coll, soid, OI_ATTR, bl);
+  ctx->op_t.rmattr(coll, soid, CACHE_DIRTY_ATTR);
+
+  append_log(ctx->log, eversion_t(), ctx->local_t);
+
+  issue_repop(repop, ctx->mtime, old_last_update, old_exists,
+	      old_size, old_version);
+  eval_repop(repop);
+  repop->put();
+}
+
+/*
+ * Write a dirty object back to the base pool whole: data, then user
+ * xattrs.  Consumes the obc ref.
+ */
+void ReplicatedPG::agent_flush(ObjectContext *obc)
+{
+  const hobject_t& soid = obc->obs.oi.soid;
+  dout(10) << __func__ << " " << soid << " " << obc->obs.oi.version << dendl;
+
+  bufferlist data;
+  map<string,bufferptr> attrs;
+  int r = osd->store->read(coll, soid, 0, 0, data);
+  if (r >= 0)
+    r = osd->store->getattrs(coll, soid, attrs, true);
+  if (r < 0) {
+    dout(0) << __func__ << " " << soid << " can't read object: " << r << dendl;
+    put_object_context(obc);
+    return;
+  }
+
+  ObjectOperation op;
+  op.remove();
+  op.set_last_op_flags(CEPH_OSD_OP_FLAG_FAILOK);
+  op.create(false);
+  op.write_full(data);
+  for (map<string,bufferptr>::iterator p = attrs.begin(); p != attrs.end(); ++p) {
+    bufferlist bl;
+    bl.append(p->second);
+    op.setxattr(p->first.c_str(), bl);
+  }
+
+  // the mon keeps snapshots off tiered pools, so there is no
+  // SnapContext to carry back to the base
+  object_locator_t oloc = obc->obs.oi.oloc;
+  oloc.pool = pool->info.tier_of;
+  agent_ops.insert(soid);
+  Context *fin = new C_OnFinisher(new C_AgentFlush(this, soid, obc->obs.oi.version,
+						   last_peering_reset),
+				  &osd->objecter_finisher);
+  {
+    Mutex::Locker l(osd->objecter_lock);
+    osd->objecter->mutate(soid.oid, oloc, op, SnapContext(), obc->obs.oi.mtime,
+			  CEPH_OSD_FLAG_IGNORE_OVERLAY, NULL, fin);
+  }
+  put_object_context(obc);
+}
+
+void ReplicatedPG::finish_flush(const hobject_t& soid, eversion_t v, epoch_t epoch, int r)
+{
+  dout(10) << __func__ << " " << soid << " " << v << " r=" << r << dendl;
+  if (epoch != last_peering_reset)
+    return;   // on_change forgot the flush
+  agent_ops.erase(soid);
+  if (r < 0) {
+    osd->clog.warn() << info.pgid << " failed to flush " << soid
+		     << " to pool " << pool->info.tier_of << ": " << r << "\n";
+    return;
+  }
+
+  object_locator_t oloc(info.pgid.pool());
+  oloc.key = soid.get_key();
+  ObjectContext *obc = get_object_context(soid, oloc, true);
+  if (!obc->obs.exists || obc->obs.oi.version != v) {
+    // written (or deleted) since we read it; stays dirty for next time
+    dout(10) << __func__ << " " << soid << " changed since flush, still dirty" << dendl;
+    put_object_context(obc);
+    return;
+  }
+  clear_cache_dirty(obc);
+}
+
+/*
+ * Drop a clean object from the cache.  Consumes the obc ref.
+ */
+void ReplicatedPG::agent_evict(ObjectContext *obc)
+{
+  dout(10) << __func__ << " " << obc->obs.oi.soid << dendl;
+  ObjectOperation op;
+  op.remove();
+  internal_op(obc, op.ops, ceph_clock_now(g_ceph_context));
+}
+
+/*
+ * Scan the next chunk of the pg for objects to flush or evict.  Dirty
+ * objects are flushed once they are old enough; clean, cold ones are
+ * evicted while the pg holds more than its share of the pool's
+ * target_max_objects.  In any other cache mode we drain: everything
+ * is flushed and evicted, so the overlay can then be removed.
+ */
+void ReplicatedPG::agent_work()
+{
+  if (!is_primary() || !is_active())
+    return;
+
+  const pg_pool_t& pi = pool->info;
+  unsigned max_ops = MAX(1, g_conf->osd_agent_max_ops);
+  if (agent_ops.size() >= max_ops)
+    return;
+
+  uint64_t num_objects = info.stats.stats.sum.num_objects;
+  bool full = pi.is_cache_full(num_objects);
+
+  int chunk = MAX(1, g_conf->osd_agent_scan_chunk);
+  vector<hobject_t> ls;
+  int r = osd->store->collection_list_partial(coll, 0, ls, chunk, &agent_handle);
+  if (r < 0) {
+    dout(0) << __func__ << " collection_list_partial got " << r << dendl;
+    agent_handle = collection_list_handle_t();
+    return;
+  }
+  if ((int)ls.size() < chunk)
+    agent_handle = collection_list_handle_t();  // wrap around next time
+  dout(20) << __func__ << " scanning " << ls.size() << " objects, "
+	   << num_objects << "/" << pi.target_max_objects << " objects in pool"
+	   << (pi.is_writeback_cache() ? "" : ", draining") << dendl;
+
+  utime_t now = ceph_clock_now(g_ceph_context);
+  for (vector<hobject_t>::iterator p = ls.begin();
+       p != ls.end() && agent_ops.size() < max_ops;
+       ++p) {
+    const hobject_t& soid = *p;
+    if (soid.snap != CEPH_NOSNAP ||
+	agent_ops.count(soid) ||
+	waiting_for_promote.count(soid) ||
+	object_contexts.count(soid) ||   // busy
+	is_missing_object(soid) ||
+	is_degraded_object(soid))
+      continue;
+
+    object_locator_t oloc(info.pgid.pool());
+    oloc.key = soid.get_key();
+    ObjectContext *obc = get_object_context(soid, oloc, true);
+    if (!obc->obs.exists || !obc->obs.oi.watchers.empty()) {
+      put_object_context(obc);
+      continue;
+    }
+
+    double age = now - obc->obs.oi.mtime;
+    switch (pi.get_cache_agent_op(is_cache_dirty(soid), hit_set.contains(soid.hash),
+				  age, full)) {
+    case pg_pool_t::CACHE_AGENT_FLUSH:
+      agent_flush(obc);
+      break;
+    case pg_pool_t::CACHE_AGENT_EVICT:
+      agent_evict(obc);
+      if (num_objects)
+	num_objects--;
+      full = pi.is_cache_full(num_objects);
+      break;
+    default:
+      put_object_context(obc);
+    }
+  }
+}
+
+void ReplicatedPG::cache_on_change()
+{
+  take_object_waiters(waiting_for_promote);
+  agent_ops.clear();
+  agent_handle = collection_list_handle_t();
+}
+
 ReplicatedPG::ObjectContext *ReplicatedPG::get_object_context(const hobject_t& soid,
 							      const object_locator_t& oloc,
 							      bool can_create)
@@ -3336,6 +3860,7 @@ void ReplicatedPG::sub_op_modify(MOSDSubOp *op)
 	   << (op->logbl.length() ? " (transaction)" : " (parallel exec")
 	   << " " << op->logbl.length()
 	   << dendl;  
+  osd->op_tracker.mark_event(op, "started");
 
   // sanity checks
   assert(op->map_epoch >= info.history.same_interval_since);
@@ -3414,6 +3939,7 @@ void ReplicatedPG::sub_op_modify(MOSDSubOp *op)
   
   Context *oncommit = new C_OSD_RepModifyCommit(rm);
   Context *onapply = new C_OSD_RepModifyApply(rm);
+  osd->op_tracker.mark_event(op, "journal_submit");
   int r = osd->store->queue_transactions(&osr, rm->tls, onapply, oncommit);
   if (r) {
     dout(0) << "error applying transaction: r = " << r << dendl;
@@ -3426,6 +3952,7 @@ void ReplicatedPG::sub_op_modify_applied(RepModify *rm)
 {
   lock();
   dout(10) << "sub_op_modify_applied on " << rm << " op " << *rm->op << dendl;
+  osd->op_tracker.mark_event(rm->op, "op_applied");
 
   if (!rm->committed) {
     // send ack to acker only if we haven't sent a commit already
@@ -3447,6 +3974,7 @@ void ReplicatedPG::sub_op_modify_applied(RepModify *rm)
 
   unlock();
   if (done) {
+    osd->op_tracker.unregister_op(rm->op);
     delete rm->ctx;
     rm->op->put();
     delete rm;
@@ -3462,6 +3990,7 @@ void ReplicatedPG::sub_op_modify_commit(RepModify *rm)
   dout(10) << "sub_op_modify_commit on op " << *rm->op
            << ", sending commit to osd." << rm->ackerosd
            << dendl;
+  osd->op_tracker.mark_event(rm->op, "op_commit");
 
   log_subop_stats(rm->op, l_osd_sop_w_inb, l_osd_sop_w_lat);
 
@@ -3478,6 +4007,7 @@ void ReplicatedPG::sub_op_modify_commit(RepModify *rm)
 
   unlock();
   if (done) {
+    osd->op_tracker.unregister_op(rm->op);
     delete rm->ctx;
     rm->op->put();
     delete rm;
@@ -4513,6 +5043,7 @@ void ReplicatedPG::on_change()
   // take object waiters
   take_object_waiters(waiting_for_missing_object);
   take_object_waiters(waiting_for_degraded_object);
+  cache_on_change();
 
   // clear pushing/pulling maps
   pushing.clear();
@@ -5208,6 +5739,7 @@ boost::statechart::result ReplicatedPG::RepColTrim::react(const SnapTrim&)
   int r = pg->osd->store->queue_transaction(NULL, t, new ObjectStore::C_DeleteTransaction(t));
   assert(r == 0);
   pg->snap_collections.erase(snap_to_trim);
+  pg->dirty_big_info = true;
   return discard_event();
 }
 
@@ -5315,6 +5847,7 @@ boost::statechart::result ReplicatedPG::WaitingOnReplicas::react(const SnapTrim&
   ObjectStore::Transaction *t = new ObjectStore::Transaction;
   dout(10) << "removing snap " << sn << " collection " << c << dendl;
   pg->snap_collections.erase(sn);
+  pg->dirty_big_info = true;
   pg->write_info(*t);
   t->remove_collection(c);
   int tr = pg->osd->store->queue_transaction(&pg->osr, t);
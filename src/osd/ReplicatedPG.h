@@ -540,6 +540,82 @@ protected:
   }
 
 
+  // -- cache tier --
+  hit_set_history_t hit_set;   // objects clients touched lately
+
+  // ops held while their object is promoted, or deleted from the base pool
+  map<hobject_t, list<Message*> > waiting_for_promote;
+
+  // objects the agent is flushing or evicting
+  set<hobject_t> agent_ops;
+  collection_list_handle_t agent_handle;
+
+  struct C_PromoteRead : public Context {
+    ReplicatedPG *pg;
+    hobject_t soid;
+    epoch_t epoch;
+    bufferlist data;
+    map<string,bufferlist> attrs;
+    uint64_t size;
+    utime_t mtime;
+    C_PromoteRead(ReplicatedPG *p, const hobject_t& o, epoch_t e)
+      : pg(p), soid(o), epoch(e), size(0) {
+      pg->get();
+    }
+    void finish(int r) {
+      pg->lock();
+      pg->finish_promote(this, r);
+      pg->unlock();
+      pg->put();
+    }
+  };
+  struct C_BaseDelete : public Context {
+    ReplicatedPG *pg;
+    hobject_t soid;
+    epoch_t epoch;
+    C_BaseDelete(ReplicatedPG *p, const hobject_t& o, epoch_t e)
+      : pg(p), soid(o), epoch(e) {
+      pg->get();
+    }
+    void finish(int r) {
+      pg->lock();
+      pg->finish_base_delete(soid, epoch, r);
+      pg->unlock();
+      pg->put();
+    }
+  };
+  struct C_AgentFlush : public Context {
+    ReplicatedPG *pg;
+    hobject_t soid;
+    eversion_t version;
+    epoch_t epoch;
+    C_AgentFlush(ReplicatedPG *p, const hobject_t& o, eversion_t v, epoch_t e)
+      : pg(p), soid(o), version(v), epoch(e) {
+      pg->get();
+    }
+    void finish(int r) {
+      pg->lock();
+      pg->finish_flush(soid, version, epoch, r);
+      pg->unlock();
+      pg->put();
+    }
+  };
+
+  bool maybe_handle_cache(MOSDOp *op);
+  void reply_redirect(MOSDOp *op);
+  void promote_object(MOSDOp *op, const hobject_t& soid);
+  void finish_promote(C_PromoteRead *c, int r);
+  void finish_base_delete(const hobject_t& soid, epoch_t epoch, int r);
+  void kick_promote_waiters(const hobject_t& soid, bool ignore_overlay);
+  void internal_op(ObjectContext *obc, vector<OSDOp>& ops, utime_t mtime);
+  bool is_cache_dirty(const hobject_t& soid);
+  void clear_cache_dirty(ObjectContext *obc);
+  void agent_flush(ObjectContext *obc);
+  void finish_flush(const hobject_t& soid, eversion_t v, epoch_t epoch, int r);
+  void agent_evict(ObjectContext *obc);
+  void cache_on_change();
+
+
   
   // pull
   struct pull_info_t {
@@ -811,6 +887,8 @@ public:
   void on_change();
   void on_activate();
   void on_shutdown();
+
+  void agent_work();
 };
 
 
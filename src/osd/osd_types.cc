@@ -256,6 +256,19 @@ void pg_pool_t::dump(Formatter *f) const
   }
   f->close_section();
   f->dump_stream("removed_snaps") << removed_snaps;
+  f->open_array_section("tiers");
+  for (set<uint64_t>::const_iterator p = tiers.begin(); p != tiers.end(); ++p)
+    f->dump_unsigned("pool_id", *p);
+  f->close_section();
+  f->dump_int("tier_of", tier_of);
+  f->dump_int("read_tier", read_tier);
+  f->dump_int("write_tier", write_tier);
+  f->dump_string("cache_mode", get_cache_mode_name(cache_mode));
+  f->dump_unsigned("hit_set_period", hit_set_period);
+  f->dump_unsigned("hit_set_count", hit_set_count);
+  f->dump_unsigned("target_max_objects", target_max_objects);
+  f->dump_unsigned("cache_min_flush_age", cache_min_flush_age);
+  f->dump_unsigned("cache_min_evict_age", cache_min_evict_age);
 }
 
 
@@ -419,6 +432,62 @@ void pg_pool_t::decode(bufferlist::iterator& bl)
   calc_pg_masks();
 }
 
+void pg_pool_t::encode_tier_info(bufferlist& bl) const
+{
+  __u8 struct_v = 1;
+  ::encode(struct_v, bl);
+  ::encode(tiers, bl);
+  ::encode(tier_of, bl);
+  ::encode(read_tier, bl);
+  ::encode(write_tier, bl);
+  ::encode(cache_mode, bl);
+  ::encode(hit_set_period, bl);
+  ::encode(hit_set_count, bl);
+  ::encode(target_max_objects, bl);
+  ::encode(cache_min_flush_age, bl);
+  ::encode(cache_min_evict_age, bl);
+}
+
+void pg_pool_t::decode_tier_info(bufferlist::iterator& bl)
+{
+  __u8 struct_v;
+  ::decode(struct_v, bl);
+  if (struct_v > 1)
+    throw buffer::error();
+  ::decode(tiers, bl);
+  ::decode(tier_of, bl);
+  ::decode(read_tier, bl);
+  ::decode(write_tier, bl);
+  ::decode(cache_mode, bl);
+  ::decode(hit_set_period, bl);
+  ::decode(hit_set_count, bl);
+  ::decode(target_max_objects, bl);
+  ::decode(cache_min_flush_age, bl);
+  ::decode(cache_min_evict_age, bl);
+}
+
+bool pg_pool_t::is_cache_full(uint64_t num_objects) const
+{
+  if (!is_writeback_cache())
+    return true;  // draining
+  if (!target_max_objects)
+    return false;
+  return num_objects > target_max_objects / MAX(1u, get_pg_num());
+}
+
+int pg_pool_t::get_cache_agent_op(bool dirty, bool hot, double age, bool full) const
+{
+  bool drain = !is_writeback_cache();
+  if (dirty) {
+    if (drain || age >= (double)cache_min_flush_age)
+      return CACHE_AGENT_FLUSH;
+    return CACHE_AGENT_SKIP;
+  }
+  if (full && (drain || (!hot && age >= (double)cache_min_evict_age)))
+    return CACHE_AGENT_EVICT;
+  return CACHE_AGENT_SKIP;
+}
+
 ostream& operator<<(ostream& out, const pg_pool_t& p)
 {
   out << "pg_pool(";
@@ -434,12 +503,51 @@ ostream& operator<<(ostream& out, const pg_pool_t& p)
       << " lpg_num " << p.get_lpg_num()
       << " lpgp_num " << p.get_lpgp_num()
       << " last_change " << p.get_last_change()
-      << " owner " << p.v.auid
-      << ")";
+      << " owner " << p.v.auid;
+  if (p.has_tiers())
+    out << " tiers " << p.tiers;
+  if (p.is_tier())
+    out << " tier_of " << p.tier_of
+	<< " cache_mode " << pg_pool_t::get_cache_mode_name(p.cache_mode);
+  if (p.has_read_tier())
+    out << " read_tier " << p.read_tier;
+  if (p.has_write_tier())
+    out << " write_tier " << p.write_tier;
+  out << ")";
   return out;
 }
 
 
+// -- hit_set_history_t --
+
+void hit_set_history_t::insert(uint32_t hash, utime_t now,
+			       unsigned period, unsigned count)
+{
+  if (current_start == utime_t())
+    current_start = now;
+  if (period && (double)(now - current_start) > (double)period) {
+    history.push_front(hash_set<uint32_t>());
+    history.front().swap(current);
+    while (history.size() + 1 > MAX(1u, count))
+      history.pop_back();
+    current_start = now;
+  }
+  current.insert(hash);
+}
+
+bool hit_set_history_t::contains(uint32_t hash) const
+{
+  if (current.count(hash))
+    return true;
+  for (list<hash_set<uint32_t> >::const_iterator p = history.begin();
+       p != history.end();
+       ++p)
+    if (p->count(hash))
+      return true;
+  return false;
+}
+
+
 
 // -- OSDSuperblock --
 
@@ -16,6 +16,7 @@
 #define CEPH_OSD_TYPES_H
 
 #include <sstream>
+#include <errno.h>
 #include <stdio.h>
 #include <stdexcept>
 
@@ -551,8 +552,53 @@ struct pg_pool_t {
    */
   interval_set<snapid_t> removed_snaps;
 
+  /*
+   * Cache tiering.  A cache pool names its base pool in @tier_of; the
+   * base lists its cache pools in @tiers, and sends client io to one
+   * of them when @read_tier/@write_tier are set (the overlay).  None of
+   * this is in ceph_pg_pool: it lives in the extended part of the
+   * OSDMap encoding, where older and kernel clients never look.
+   */
+  enum {
+    CACHEMODE_NONE = 0,       ///< no caching; ops are served as usual
+    CACHEMODE_WRITEBACK = 1,  ///< promote on miss, flush dirty objects later
+    CACHEMODE_FORWARD = 2,    ///< serve hits, send misses to the base; drain
+  };
+  static const char *get_cache_mode_name(int m) {
+    switch (m) {
+    case CACHEMODE_NONE: return "none";
+    case CACHEMODE_WRITEBACK: return "writeback";
+    case CACHEMODE_FORWARD: return "forward";
+    default: return "???";
+    }
+  }
+  static int get_cache_mode_from_str(const string& s) {
+    if (s == "none")
+      return CACHEMODE_NONE;
+    if (s == "writeback")
+      return CACHEMODE_WRITEBACK;
+    if (s == "forward")
+      return CACHEMODE_FORWARD;
+    return -EINVAL;
+  }
+
+  set<uint64_t> tiers;      ///< pools that are tiers of us
+  int64_t tier_of;          ///< pool we are a tier of, or -1
+  int64_t read_tier;        ///< pool client reads are sent to, or -1
+  int64_t write_tier;       ///< pool client writes are sent to, or -1
+  uint8_t cache_mode;       ///< CACHEMODE_*, when we are a tier
+
+  uint32_t hit_set_period;       ///< seconds covered by each hit set
+  uint32_t hit_set_count;        ///< past hit sets to remember
+  uint64_t target_max_objects;   ///< evict clean objects above this many
+  uint32_t cache_min_flush_age;  ///< seconds an object stays dirty, at least
+  uint32_t cache_min_evict_age;  ///< seconds an object stays cached, at least
+
   pg_pool_t() :
-    pg_num_mask(0), pgp_num_mask(0), lpg_num_mask(0), lpgp_num_mask(0) {
+    pg_num_mask(0), pgp_num_mask(0), lpg_num_mask(0), lpgp_num_mask(0),
+    tier_of(-1), read_tier(-1), write_tier(-1), cache_mode(CACHEMODE_NONE),
+    hit_set_period(0), hit_set_count(0), target_max_objects(0),
+    cache_min_flush_age(0), cache_min_evict_age(0) {
     memset(&v, 0, sizeof(v));
   }
 
@@ -576,6 +622,44 @@ struct pg_pool_t {
   bool is_rep()   const { return get_type() == CEPH_PG_TYPE_REP; }
   bool is_raid4() const { return get_type() == CEPH_PG_TYPE_RAID4; }
 
+  bool is_tier() const { return tier_of >= 0; }
+  bool has_tiers() const { return !tiers.empty(); }
+  bool has_read_tier() const { return read_tier >= 0; }
+  bool has_write_tier() const { return write_tier >= 0; }
+  /// true if client ops sent through the overlay are handled by the cache
+  bool is_cache() const {
+    return is_tier() && cache_mode != CACHEMODE_NONE;
+  }
+  bool is_writeback_cache() const {
+    return is_tier() && cache_mode == CACHEMODE_WRITEBACK;
+  }
+  /// true if any tiering field is set, and so needs encoding
+  bool has_tier_info() const {
+    return is_tier() || has_tiers() || has_read_tier() || has_write_tier();
+  }
+  void clear_tier() {
+    tier_of = -1;
+    cache_mode = CACHEMODE_NONE;
+    hit_set_period = hit_set_count = 0;
+    target_max_objects = 0;
+    cache_min_flush_age = cache_min_evict_age = 0;
+  }
+
+  /*
+   * The cache agent's verdict on one object of a pg: dirty objects are
+   * flushed once old enough; clean ones are evicted while the pg is
+   * full, if cold and old enough.  Outside writeback mode we drain,
+   * and everything goes.
+   */
+  enum {
+    CACHE_AGENT_SKIP = 0,
+    CACHE_AGENT_FLUSH = 1,
+    CACHE_AGENT_EVICT = 2,
+  };
+  /// true if a pg holding num_objects is over its share of target_max_objects
+  bool is_cache_full(uint64_t num_objects) const;
+  int get_cache_agent_op(bool dirty, bool hot, double age, bool full) const;
+
   unsigned get_pg_num() const { return v.pg_num; }
   unsigned get_pgp_num() const { return v.pgp_num; }
   unsigned get_lpg_num() const { return v.lpg_num; }
@@ -600,6 +684,8 @@ struct pg_pool_t {
    */
   bool is_pool_snaps_mode() const;
   bool is_removed_snap(snapid_t s) const;
+  /// true once a snap of either kind has been taken
+  bool has_snaps() const { return get_snap_seq() > 0; }
 
   /*
    * build set of known-removed sets from either pool snaps or
@@ -628,11 +714,30 @@ struct pg_pool_t {
 
   void encode(bufferlist& bl) const;
   void decode(bufferlist::iterator& bl);
+
+  /// the tiering fields, kept apart from encode() (see above)
+  void encode_tier_info(bufferlist& bl) const;
+  void decode_tier_info(bufferlist::iterator& bl);
 };
 WRITE_CLASS_ENCODER(pg_pool_t)
 
 ostream& operator<<(ostream& out, const pg_pool_t& p);
 
+/*
+ * hit_set_history_t - hashes of the objects a cache pg has touched in
+ * the current hit set period, and in the pool's last few.  Kept in
+ * memory only, so a new primary starts out cold.
+ */
+struct hit_set_history_t {
+  hash_set<uint32_t> current;
+  utime_t current_start;
+  list<hash_set<uint32_t> > history;
+
+  // start a new set once period seconds have passed; keep count sets in all
+  void insert(uint32_t hash, utime_t now, unsigned period, unsigned count);
+  bool contains(uint32_t hash) const;
+};
+
 
 /*
  * object_stat_sum_t - a summation of object stats
@@ -739,6 +844,21 @@ struct object_stat_sum_t {
 };
 WRITE_CLASS_ENCODER(object_stat_sum_t)
 
+inline bool operator==(const object_stat_sum_t& l, const object_stat_sum_t& r) {
+  return l.num_bytes == r.num_bytes &&
+    l.num_kb == r.num_kb &&
+    l.num_objects == r.num_objects &&
+    l.num_object_clones == r.num_object_clones &&
+    l.num_object_copies == r.num_object_copies &&
+    l.num_objects_missing_on_primary == r.num_objects_missing_on_primary &&
+    l.num_objects_degraded == r.num_objects_degraded &&
+    l.num_objects_unfound == r.num_objects_unfound &&
+    l.num_rd == r.num_rd &&
+    l.num_rd_kb == r.num_rd_kb &&
+    l.num_wr == r.num_wr &&
+    l.num_wr_kb == r.num_wr_kb;
+}
+
 struct object_stat_collection_t {
   object_stat_sum_t sum;
   map<string,object_stat_sum_t> cat_sum;
@@ -797,6 +917,11 @@ struct object_stat_collection_t {
 };
 WRITE_CLASS_ENCODER(object_stat_collection_t)
 
+inline bool operator==(const object_stat_collection_t& l,
+		       const object_stat_collection_t& r) {
+  return l.sum == r.sum && l.cat_sum == r.cat_sum;
+}
+
 /** pg_stat
  * aggregate stats for a single PG.
  */
@@ -1147,6 +1272,7 @@ ostream& operator<<(ostream& out, const SnapSet& cs);
 
 #define OI_ATTR "_"
 #define SS_ATTR "snapset"
+#define CACHE_DIRTY_ATTR "cache_dirty"  // cache tier object not yet flushed to base
 
 struct watch_info_t {
   uint64_t cookie;
@@ -56,9 +56,28 @@ void Journaler::set_layout(ceph_file_layout *l)
   last_written.layout = layout;
   last_committed.layout = layout;
 
+  _update_fetch_len();
+}
+
+/*
+ * read further ahead than journaler_prefetch_periods, e.g. while an mds
+ * is replaying the whole journal.  0 reverts to the configured value.
+ * takes effect on the next prefetch.
+ */
+void Journaler::set_prefetch_periods(uint64_t periods)
+{
+  ldout(cct, 10) << "set_prefetch_periods " << periods << dendl;
+  prefetch_periods = periods;
+  _update_fetch_len();
+}
+
+void Journaler::_update_fetch_len()
+{
   // prefetch intelligently.
   // (watch out, this is big if you use big objects or weird striping)
-  uint64_t periods = cct->_conf->journaler_prefetch_periods;
+  uint64_t periods = prefetch_periods;
+  if (!periods)
+    periods = cct->_conf->journaler_prefetch_periods;
   if (periods < 2)
     periods = 2;  // we need at least 2 periods to make progress.
   fetch_len = layout.fl_stripe_count * layout.fl_object_size * periods;
@@ -193,6 +193,9 @@ private:
   uint64_t fetch_len;     // how much to read at a time
   uint64_t temp_fetch_len;
   uint64_t prefetch_from; // how far from end do we read next chunk
+  uint64_t prefetch_periods;  // override journaler_prefetch_periods, if non-zero
+
+  void _update_fetch_len();
 
   // for wait_for_readable()
   Context    *on_readable;
@@ -238,7 +241,7 @@ public:
     prezeroing_pos(0), prezero_pos(0), write_pos(0), flush_pos(0), safe_pos(0),
     waiting_for_zero(false),
     read_pos(0), requested_pos(0), received_pos(0),
-    fetch_len(0), temp_fetch_len(0), prefetch_from(0),
+    fetch_len(0), temp_fetch_len(0), prefetch_from(0), prefetch_periods(0),
     on_readable(0),
     expire_pos(0), trimming_pos(0), trimmed_pos(0) 
   {
@@ -284,6 +287,7 @@ public:
   void write_head(Context *onsave=0);
 
   void set_layout(ceph_file_layout *l);
+  void set_prefetch_periods(uint64_t periods);
 
   void set_readonly();
   void set_writeable();
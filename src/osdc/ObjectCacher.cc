@@ -21,6 +21,8 @@ ObjectCacher(CephContext *cct_, Objecter *o, Mutex& l, flush_set_callback_t flus
 	     void *flush_callback_arg) : 
     cct(cct_), objecter(o), filer(o), lock(l),
     flush_set_callback(flush_callback), flush_set_callback_arg(flush_callback_arg),
+    objects_lock("ObjectCacher::objects_lock"),
+    lru_lock("ObjectCacher::lru_lock"),
     flusher_stop(false), flusher_thread(this),
     stat_waiter(0),
     stat_clean(0), stat_dirty(0), stat_rx(0), stat_tx(0), stat_missing(0) {
@@ -31,7 +33,7 @@ ObjectCacher::BufferHead *ObjectCacher::Object::split(BufferHead *left, loff_t o
   ldout(oc->cct, 20) << "split " << *left << " at " << off << dendl;
   
   // split off right
-  ObjectCacher::BufferHead *right = new BufferHead(this);
+  ObjectCacher::BufferHead *right = oc->new_bh(this);
   right->last_write_tid = left->last_write_tid;
   right->set_state(left->get_state());
   right->snapc = left->snapc;
@@ -104,7 +106,7 @@ void ObjectCacher::Object::merge_left(BufferHead *left, BufferHead *right)
                                          p->second );
   
   // hose right
-  delete right;
+  oc->free_bh(right);
 
   ldout(oc->cct, 10) << "merge_left result " << *left << dendl;
 }
@@ -134,6 +136,29 @@ void ObjectCacher::Object::try_merge_bh(BufferHead *bh)
     merge_left(bh, p->second);
 }
 
+/*
+ * merge runs of adjacent clean bh's overlapping [start, end), so that
+ * a region written back or read in piecemeal doesn't stay fragmented.
+ */
+void ObjectCacher::Object::merge_clean(loff_t start, loff_t end)
+{
+  map<loff_t,BufferHead*>::iterator p = data.lower_bound(start);
+  if (p != data.begin())
+    p--;
+  while (p != data.end() && p->first < end) {
+    map<loff_t,BufferHead*>::iterator n = p;
+    n++;
+    if (n == data.end())
+      break;
+    if (p->second->is_clean() && n->second->is_clean() &&
+	p->second->end() == n->second->start()) {
+      merge_left(p->second, n->second);   // drops n, p stays valid
+      continue;
+    }
+    p = n;
+  }
+}
+
 /*
  * count bytes we have cached in given range
  */
@@ -169,6 +194,38 @@ bool ObjectCacher::Object::is_cached(loff_t cur, loff_t left)
   return true;
 }
 
+/*
+ * map an extent onto readable (clean, dirty or tx) bh's, without
+ * creating anything.  false if any part of it isn't readable.
+ */
+bool ObjectCacher::Object::map_hits(ObjectExtent &ex, map<loff_t, BufferHead*>& hits)
+{
+  loff_t cur = ex.offset;
+  loff_t left = ex.length;
+  map<loff_t, BufferHead*>::iterator p = data.lower_bound(cur);
+
+  if (p != data.begin() && 
+      (p == data.end() || p->first > cur)) {
+    p--;     // might overlap!
+    if (p->first + p->second->length() <= cur) 
+      p++;   // doesn't overlap.
+  }
+
+  while (left > 0) {
+    if (p == data.end() || p->first > cur)
+      return false;  // gap
+    BufferHead *e = p->second;
+    if (!e->is_clean() && !e->is_dirty() && !e->is_tx())
+      return false;
+    hits[cur] = e;
+    loff_t lenfromcur = MIN(e->end() - cur, left);
+    cur += lenfromcur;
+    left -= lenfromcur;
+    p++;
+  }
+  return true;
+}
+
 /*
  * map a range of bytes into buffer_heads.
  * - create missing buffer_heads as necessary.
@@ -204,7 +261,7 @@ int ObjectCacher::Object::map_read(OSDRead *rd,
       // at end?
       if (p == data.end()) {
         // rest is a miss.
-        BufferHead *n = new BufferHead(this);
+        BufferHead *n = oc->new_bh(this);
         n->set_start(cur);
         n->set_length(left);
         oc->bh_add(this, n);
@@ -242,7 +299,7 @@ int ObjectCacher::Object::map_read(OSDRead *rd,
       } else if (p->first > cur) {
         // gap.. miss
         loff_t next = p->first;
-        BufferHead *n = new BufferHead(this);
+        BufferHead *n = oc->new_bh(this);
         n->set_start( cur );
         n->set_length( MIN(next - cur, left) );
         oc->bh_add(this,n);
@@ -305,7 +362,7 @@ ObjectCacher::BufferHead *ObjectCacher::Object::map_write(OSDWrite *wr)
       // at end ?
       if (p == data.end()) {
         if (final == NULL) {
-          final = new BufferHead(this);
+          final = oc->new_bh(this);
           final->set_start( cur );
           final->set_length( max );
           oc->bh_add(this, final);
@@ -374,7 +431,7 @@ ObjectCacher::BufferHead *ObjectCacher::Object::map_write(OSDWrite *wr)
           final->set_length(final->length() + glen);
 	  oc->bh_stat_add(final);
         } else {
-          final = new BufferHead(this);
+          final = oc->new_bh(this);
           final->set_start( cur );
           final->set_length( glen );
           oc->bh_add(this, final);
@@ -397,6 +454,7 @@ ObjectCacher::BufferHead *ObjectCacher::Object::map_write(OSDWrite *wr)
 void ObjectCacher::Object::truncate(loff_t s)
 {
   ldout(oc->cct, 10) << "truncate " << *this << " to " << s << dendl;
+  Mutex::Locker l(lock);
 
   while (!data.empty()) {
     BufferHead *bh = data.rbegin()->second;
@@ -412,7 +470,7 @@ void ObjectCacher::Object::truncate(loff_t s)
     // remove bh entirely
     assert(bh->start() >= s);
     oc->bh_remove(this, bh);
-    delete bh;
+    oc->free_bh(bh);
   }
 }
 
@@ -425,13 +483,34 @@ void ObjectCacher::Object::truncate(loff_t s)
 
 /* private */
 
+ObjectCacher::BufferHead *ObjectCacher::new_bh(Object *ob)
+{
+  if (bh_pool.empty())
+    return new BufferHead(ob);
+  void *p = bh_pool.back();
+  bh_pool.pop_back();
+  return new (p) BufferHead(ob);
+}
+
+void ObjectCacher::free_bh(BufferHead *bh)
+{
+  if (bh_pool.size() >= (unsigned)cct->_conf->client_oc_bh_pool) {
+    delete bh;
+    return;
+  }
+  bh->~BufferHead();
+  bh_pool.push_back(bh);
+}
+
 void ObjectCacher::close_object(Object *ob) 
 {
   ldout(cct, 10) << "close_object " << *ob << dendl;
   assert(ob->can_close());
   
-  // ok!
+  // ok!  readx_shared holds objects_lock (read) while it uses ob.
+  objects_lock.get_write();
   objects[ob->oloc.pool].erase(ob->get_soid());
+  objects_lock.put_write();
   delete ob;
 }
 
@@ -475,10 +554,12 @@ void ObjectCacher::bh_read_finish(int64_t poolid, sobject_t oid, loff_t start, u
     bl.push_back(bp);
   }
   
+  list<Context*> ls;
   if (objects[poolid].count(oid) == 0) {
     ldout(cct, 7) << "bh_read_finish no object cache" << dendl;
   } else {
     Object *ob = objects[poolid][oid];
+    ob->lock.Lock();
     
     // apply to bh's!
     loff_t opos = start;
@@ -517,19 +598,20 @@ void ObjectCacher::bh_read_finish(int64_t poolid, sobject_t oid, loff_t start, u
       p++;
 
       // finishers?
-      // called with lock held.
-      list<Context*> ls;
       for (map<loff_t, list<Context*> >::iterator p = bh->waitfor_read.begin();
            p != bh->waitfor_read.end();
            p++)
         ls.splice(ls.end(), p->second);
       bh->waitfor_read.clear();
-      finish_contexts(cct, ls);
-
-      // clean up?
-      ob->try_merge_bh(bh);
     }
+
+    // clean up.  (only now; merging invalidates the iterator above.)
+    ob->merge_clean(start, start+length);
+    ob->lock.Unlock();
   }
+
+  // called with lock held, but not ob->lock: waiters may retry the read.
+  finish_contexts(cct, ls);
   //lock.Unlock();
 }
 
@@ -552,6 +634,7 @@ void ObjectCacher::bh_write(BufferHead *bh)
 				    NULL, oncommit);
 
   // set bh last_write_tid
+  Mutex::Locker l(bh->ob->lock);
   oncommit->tid = tid;
   bh->ob->last_write_tid = tid;
   bh->last_write_tid = tid;
@@ -634,6 +717,7 @@ void ObjectCacher::bh_write_commit(int64_t poolid, sobject_t oid, loff_t start,
     ldout(cct, 7) << "bh_write_commit no object cache" << dendl;
   } else {
     Object *ob = objects[poolid][oid];
+    ob->lock.Lock();
     
     // apply to bh's!
     for (map<loff_t, BufferHead*>::iterator p = ob->data.lower_bound(start);
@@ -667,6 +751,10 @@ void ObjectCacher::bh_write_commit(int64_t poolid, sobject_t oid, loff_t start,
       mark_clean(bh);
       ldout(cct, 10) << "bh_write_commit clean " << *bh << dendl;
     }
+
+    // stitch the now-clean range back together with its clean neighbors
+    ob->merge_clean(start, start+length);
+    ob->lock.Unlock();
     
     // update last_commit.
     assert(ob->last_commit_tid < tid);
@@ -708,7 +796,7 @@ void ObjectCacher::flush(loff_t amount)
    */
   loff_t did = 0;
   while (amount == 0 || did < amount) {
-    BufferHead *bh = (BufferHead*) lru_dirty.lru_get_next_expire();
+    BufferHead *bh = bh_next_expire(lru_dirty);
     if (!bh) break;
     if (bh->last_write > cutoff) break;
 
@@ -728,15 +816,17 @@ void ObjectCacher::trim(loff_t max)
            << dendl;
 
   while (get_stat_clean() > max) {
-    BufferHead *bh = (BufferHead*) lru_rest.lru_expire();
+    BufferHead *bh = bh_next_expire(lru_rest);
     if (!bh) break;
     
     ldout(cct, 10) << "trim trimming " << *bh << dendl;
     assert(bh->is_clean());
     
     Object *ob = bh->ob;
+    ob->lock.Lock();
     bh_remove(ob, bh);
-    delete bh;
+    ob->lock.Unlock();
+    free_bh(bh);
     
     if (ob->can_close()) {
       ldout(cct, 10) << "trim trimming " << *ob << dendl;
@@ -790,6 +880,7 @@ int ObjectCacher::readx(OSDRead *rd, ObjectSet *oset, Context *onfinish)
     // get Object cache
     sobject_t soid(ex_it->oid, rd->snap);
     Object *o = get_object(soid, oset, ex_it->oloc);
+    Mutex::Locker ol(o->lock);
     
     // map extent into bufferheads
     map<loff_t, BufferHead*> hits, missing, rx;
@@ -832,50 +923,7 @@ int ObjectCacher::readx(OSDRead *rd, ObjectSet *oset, Context *onfinish)
         hit_ls.push_back(bh_it->second);
       }
 
-      // create reverse map of buffer offset -> object for the eventual result.
-      // this is over a single ObjectExtent, so we know that
-      //  - the bh's are contiguous
-      //  - the buffer frags need not be (and almost certainly aren't)
-      loff_t opos = ex_it->offset;
-      map<loff_t, BufferHead*>::iterator bh_it = hits.begin();
-      assert(bh_it->second->start() <= opos);
-      uint64_t bhoff = opos - bh_it->second->start();
-      map<__u32,__u32>::iterator f_it = ex_it->buffer_extents.begin();
-      uint64_t foff = 0;
-      while (1) {
-        BufferHead *bh = bh_it->second;
-        assert(opos == (loff_t)(bh->start() + bhoff));
-
-        ldout(cct, 10) << "readx rmap opos " << opos
-                 << ": " << *bh << " +" << bhoff
-                 << " frag " << f_it->first << "~" << f_it->second << " +" << foff
-                 << dendl;
-
-        uint64_t len = MIN(f_it->second - foff,
-                         bh->length() - bhoff);
-	bufferlist bit;  // put substr here first, since substr_of clobbers, and
-	                 // we may get multiple bh's at this stripe_map position
-	bit.substr_of(bh->bl,
-		      opos - bh->start(),
-		      len);
-        stripe_map[f_it->first].claim_append(bit);
-
-        opos += len;
-        bhoff += len;
-        foff += len;
-        if (opos == bh->end()) {
-          bh_it++;
-          bhoff = 0;
-        }
-        if (foff == f_it->second) {
-          f_it++;
-          foff = 0;
-        }
-        if (bh_it == hits.end()) break;
-        if (f_it == ex_it->buffer_extents.end()) break;
-      }
-      assert(f_it == ex_it->buffer_extents.end());
-      assert(opos == ex_it->offset + (loff_t)ex_it->length);
+      stripe_hits(*ex_it, hits, stripe_map);
     }
   }
   
@@ -892,28 +940,155 @@ int ObjectCacher::readx(OSDRead *rd, ObjectSet *oset, Context *onfinish)
   ldout(cct, 10) << "readx has all buffers" << dendl;
   
   // ok, assemble into result buffer.
+  uint64_t pos = assemble_stripes(stripe_map, rd->bl);
+
+  // done with read.
+  delete rd;
+
+  trim();
+  
+  return pos;
+}
+
+/*
+ * readx for the case where everything is already in cache, for callers
+ * that do NOT hold our lock.  this is not lock-free: we take
+ * objects_lock (read), each object's lock in turn, and lru_lock, but
+ * never the cacher's lock, so hits on different objects proceed in
+ * parallel.  returns -EAGAIN (and leaves rd alone) on any miss.
+ */
+int ObjectCacher::readx_shared(OSDRead *rd)
+{
+  map<uint64_t, bufferlist> stripe_map;  // final buffer offset -> substring
+  RWLock::RLocker l(objects_lock);
+
+  vector<Object*> obs;
+  obs.reserve(rd->extents.size());
+  for (vector<ObjectExtent>::iterator ex_it = rd->extents.begin();
+       ex_it != rd->extents.end();
+       ex_it++) {
+    sobject_t soid(ex_it->oid, rd->snap);
+    Object *o = get_object_maybe(soid, ex_it->oloc);
+    if (!o)
+      return -EAGAIN;
+    obs.push_back(o);
+  }
+
+  // hold every object at once, so a writex spanning several of them is
+  // seen either entirely or not at all
+  set<Object*> locked(obs.begin(), obs.end());
+  lock_objects(locked);
+  int r = 0;
+  vector<Object*>::iterator ob_it = obs.begin();
+  for (vector<ObjectExtent>::iterator ex_it = rd->extents.begin();
+       ex_it != rd->extents.end();
+       ex_it++, ob_it++) {
+    map<loff_t, BufferHead*> hits;
+    if (!(*ob_it)->map_hits(*ex_it, hits)) {
+      ldout(cct, 20) << "readx_shared miss on " << *ex_it << dendl;
+      r = -EAGAIN;
+      break;
+    }
+    stripe_hits(*ex_it, hits, stripe_map);
+    for (map<loff_t, BufferHead*>::iterator bh_it = hits.begin();
+	 bh_it != hits.end();
+	 bh_it++)
+      touch_bh(bh_it->second);
+  }
+  unlock_objects(locked);
+  if (r < 0)
+    return r;
+
+  ldout(cct, 10) << "readx_shared has all buffers" << dendl;
+  return assemble_stripes(stripe_map, rd->bl);
+}
+
+/*
+ * take the locks of several objects in a fixed (address) order, so
+ * that readers and writers spanning the same objects can't deadlock.
+ */
+void ObjectCacher::lock_objects(set<Object*>& obs)
+{
+  for (set<Object*>::iterator p = obs.begin(); p != obs.end(); ++p)
+    (*p)->lock.Lock();
+}
+
+void ObjectCacher::unlock_objects(set<Object*>& obs)
+{
+  for (set<Object*>::reverse_iterator p = obs.rbegin(); p != obs.rend(); ++p)
+    (*p)->lock.Unlock();
+}
+
+/*
+ * create reverse map of buffer offset -> object for the eventual result.
+ * this is over a single ObjectExtent, so we know that
+ *  - the bh's are contiguous
+ *  - the buffer frags need not be (and almost certainly aren't)
+ */
+void ObjectCacher::stripe_hits(ObjectExtent &ex, map<loff_t, BufferHead*>& hits,
+			       map<uint64_t, bufferlist>& stripe_map)
+{
+  loff_t opos = ex.offset;
+  map<loff_t, BufferHead*>::iterator bh_it = hits.begin();
+  assert(bh_it->second->start() <= opos);
+  uint64_t bhoff = opos - bh_it->second->start();
+  map<__u32,__u32>::iterator f_it = ex.buffer_extents.begin();
+  uint64_t foff = 0;
+  while (1) {
+    BufferHead *bh = bh_it->second;
+    assert(opos == (loff_t)(bh->start() + bhoff));
+
+    ldout(cct, 10) << "readx rmap opos " << opos
+             << ": " << *bh << " +" << bhoff
+             << " frag " << f_it->first << "~" << f_it->second << " +" << foff
+             << dendl;
+
+    uint64_t len = MIN(f_it->second - foff,
+                     bh->length() - bhoff);
+    bufferlist bit;  // put substr here first, since substr_of clobbers, and
+                     // we may get multiple bh's at this stripe_map position
+    bit.substr_of(bh->bl,
+		  opos - bh->start(),
+		  len);
+    stripe_map[f_it->first].claim_append(bit);
+
+    opos += len;
+    bhoff += len;
+    foff += len;
+    if (opos == bh->end()) {
+      bh_it++;
+      bhoff = 0;
+    }
+    if (foff == f_it->second) {
+      f_it++;
+      foff = 0;
+    }
+    if (bh_it == hits.end()) break;
+    if (f_it == ex.buffer_extents.end()) break;
+  }
+  assert(f_it == ex.buffer_extents.end());
+  assert(opos == ex.offset + (loff_t)ex.length);
+}
+
+uint64_t ObjectCacher::assemble_stripes(map<uint64_t, bufferlist>& stripe_map,
+					bufferlist *bl)
+{
   uint64_t pos = 0;
-  if (rd->bl) {
-    rd->bl->clear();
+  if (bl) {
+    bl->clear();
     for (map<uint64_t,bufferlist>::iterator i = stripe_map.begin();
 	 i != stripe_map.end();
 	 i++) {
       assert(pos == i->first);
       ldout(cct, 10) << "readx  adding buffer len " << i->second.length() << " at " << pos << dendl;
       pos += i->second.length();
-      rd->bl->claim_append(i->second);
-      assert(rd->bl->length() == pos);
+      bl->claim_append(i->second);
+      assert(bl->length() == pos);
     }
-    ldout(cct, 10) << "readx  result is " << rd->bl->length() << dendl;
+    ldout(cct, 10) << "readx  result is " << bl->length() << dendl;
   } else {
     ldout(cct, 10) << "readx  no bufferlist ptr (readahead?), done." << dendl;
   }
-
-  // done with read.
-  delete rd;
-
-  trim();
-  
   return pos;
 }
 
@@ -921,13 +1096,24 @@ int ObjectCacher::readx(OSDRead *rd, ObjectSet *oset, Context *onfinish)
 int ObjectCacher::writex(OSDWrite *wr, ObjectSet *oset)
 {
   utime_t now = ceph_clock_now(cct);
-  
+
+  // get object caches, and lock them all for readx_shared's sake
+  vector<Object*> obs;
+  obs.reserve(wr->extents.size());
   for (vector<ObjectExtent>::iterator ex_it = wr->extents.begin();
        ex_it != wr->extents.end();
        ex_it++) {
-    // get object cache
     sobject_t soid(ex_it->oid, CEPH_NOSNAP);
-    Object *o = get_object(soid, oset, ex_it->oloc);
+    obs.push_back(get_object(soid, oset, ex_it->oloc));
+  }
+  set<Object*> locked(obs.begin(), obs.end());
+  lock_objects(locked);
+
+  vector<Object*>::iterator ob_it = obs.begin();
+  for (vector<ObjectExtent>::iterator ex_it = wr->extents.begin();
+       ex_it != wr->extents.end();
+       ex_it++, ob_it++) {
+    Object *o = *ob_it;
 
     // map it all into a single bufferhead.
     BufferHead *bh = o->map_write(wr);
@@ -968,6 +1154,7 @@ int ObjectCacher::writex(OSDWrite *wr, ObjectSet *oset)
 
     o->try_merge_bh(bh);
   }
+  unlock_objects(locked);
 
   delete wr;
 
@@ -1036,7 +1223,7 @@ void ObjectCacher::flusher_entry()
         utime_t cutoff = ceph_clock_now(cct);
         cutoff.sec_ref()--;
         BufferHead *bh = 0;
-        while ((bh = (BufferHead*)lru_dirty.lru_get_next_expire()) != 0 &&
+        while ((bh = bh_next_expire(lru_dirty)) != 0 &&
                bh->last_write < cutoff) {
           ldout(cct, 10) << "flusher flushing aged dirty bh " << *bh << dendl;
           bh_write(bh);
@@ -1518,9 +1705,10 @@ void ObjectCacher::purge_set(ObjectSet *oset)
   ldout(cct, 10) << "purge_set " << oset << dendl;
 
   for (xlist<Object*>::iterator i = oset->objects.begin();
-       !i.end(); ++i) {
+       !i.end(); ) {
     Object *ob = *i;
-	purge(ob);
+    ++i;   // purge may close ob, taking it off the list
+    purge(ob);
   }
 }
 
@@ -1540,12 +1728,14 @@ loff_t ObjectCacher::release(Object *ob)
       o_unclean += bh->length();
   }
 
+  ob->lock.Lock();
   for (list<BufferHead*>::iterator p = clean.begin();
        p != clean.end();
        p++) {
     bh_remove(ob, *p);
-    delete *p;
+    free_bh(*p);
   }
+  ob->lock.Unlock();
 
   if (ob->can_close()) {
     ldout(cct, 10) << "trim trimming " << *ob << dendl;
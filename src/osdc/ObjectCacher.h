@@ -9,6 +9,7 @@
 #include "include/xlist.h"
 
 #include "common/Cond.h"
+#include "common/RWLock.h"
 #include "common/Thread.h"
 
 #include "Objecter.h"
@@ -167,6 +168,10 @@ class ObjectCacher {
     int wrlock_ref;  // how many ppl want or are using a WRITE lock
     int rdlock_ref;  // how many ppl want or are using a READ lock
 
+    // protects data and our bh's against readx_shared.  anything that
+    // modifies them holds both the cacher's lock and this one.
+    Mutex lock;
+
   public:
     Object(const Object& other);
     const Object& operator=(const Object& other);
@@ -176,7 +181,8 @@ class ObjectCacher {
       oid(o), oset(os), set_item(this), oloc(l),
       last_write_tid(0), last_commit_tid(0),
       dirty_or_tx(0),
-      lock_state(LOCK_NONE), wrlock_ref(0), rdlock_ref(0) {
+      lock_state(LOCK_NONE), wrlock_ref(0), rdlock_ref(0),
+      lock("ObjectCacher::Object::lock", true, false) {
       // add to set
       os->objects.push_back(&set_item);
     }
@@ -235,8 +241,10 @@ class ObjectCacher {
     BufferHead *split(BufferHead *bh, loff_t off);
     void merge_left(BufferHead *left, BufferHead *right);
     void try_merge_bh(BufferHead *bh);
+    void merge_clean(loff_t start, loff_t end);
 
     bool is_cached(loff_t off, loff_t len);
+    bool map_hits(ObjectExtent &ex, map<loff_t, BufferHead*>& hits);
     int map_read(OSDRead *rd,
                  map<loff_t, BufferHead*>& hits,
                  map<loff_t, BufferHead*>& missing,
@@ -278,9 +286,16 @@ class ObjectCacher {
   void *flush_set_callback_arg;
 
   vector<hash_map<sobject_t, Object*> > objects; // indexed by pool_id
+  RWLock objects_lock;  // guards objects against readx_shared
 
   set<BufferHead*>    dirty_bh;
   LRU   lru_dirty, lru_rest;
+  Mutex lru_lock;       // guards the lrus, which readx_shared touches
+
+  // recycled BufferHead memory
+  vector<void*> bh_pool;
+  BufferHead *new_bh(Object *ob);
+  void free_bh(BufferHead *bh);
 
   Cond flusher_cond;
   bool flusher_stop;
@@ -307,19 +322,22 @@ class ObjectCacher {
 
   Object *get_object(sobject_t oid, ObjectSet *oset, object_locator_t &l) {
     // have it?
-    if ((uint32_t)l.pool < objects.size()) {
-      if (objects[l.pool].count(oid))
-        return objects[l.pool][oid];
-    } else {
-      objects.resize(l.pool+1);
-    }
+    if ((uint32_t)l.pool < objects.size() &&
+        objects[l.pool].count(oid))
+      return objects[l.pool][oid];
 
     // create it.
     Object *o = new Object(this, oid, oset, l);
+    objects_lock.get_write();
+    if ((uint32_t)l.pool >= objects.size())
+      objects.resize(l.pool+1);
     objects[l.pool][oid] = o;
+    objects_lock.put_write();
     return o;
   }
   void close_object(Object *ob);
+  void lock_objects(set<Object*>& obs);
+  void unlock_objects(set<Object*>& obs);
 
   // bh stats
   Cond  stat_cond;
@@ -386,6 +404,7 @@ class ObjectCacher {
   loff_t get_stat_clean() { return stat_clean; }
 
   void touch_bh(BufferHead *bh) {
+    Mutex::Locker l(lru_lock);
     if (bh->is_dirty())
       lru_dirty.lru_touch(bh);
     else
@@ -394,6 +413,8 @@ class ObjectCacher {
 
   // bh states
   void bh_set_state(BufferHead *bh, int s) {
+    Mutex::Locker l(lru_lock);
+
     // move between lru lists?
     if (s == BufferHead::STATE_DIRTY && bh->get_state() != BufferHead::STATE_DIRTY) {
       lru_rest.lru_remove(bh);
@@ -422,11 +443,12 @@ class ObjectCacher {
   void mark_tx(BufferHead *bh) { bh_set_state(bh, BufferHead::STATE_TX); };
   void mark_dirty(BufferHead *bh) { 
     bh_set_state(bh, BufferHead::STATE_DIRTY); 
-    lru_dirty.lru_touch(bh);
+    touch_bh(bh);
     //bh->set_dirty_stamp(ceph_clock_now(g_ceph_context));
   };
 
   void bh_add(Object *ob, BufferHead *bh) {
+    Mutex::Locker l(lru_lock);
     ob->add_bh(bh);
     if (bh->is_dirty()) {
       lru_dirty.lru_insert_top(bh);
@@ -437,6 +459,7 @@ class ObjectCacher {
     bh_stat_add(bh);
   }
   void bh_remove(Object *ob, BufferHead *bh) {
+    Mutex::Locker l(lru_lock);
     ob->remove_bh(bh);
     if (bh->is_dirty()) {
       lru_dirty.lru_remove(bh);
@@ -447,6 +470,12 @@ class ObjectCacher {
     bh_stat_sub(bh);
   }
 
+  // oldest unpinned bh on the given lru (left in place)
+  BufferHead *bh_next_expire(LRU& lru) {
+    Mutex::Locker l(lru_lock);
+    return (BufferHead*)lru.lru_get_next_expire();
+  }
+
   // io
   void bh_read(BufferHead *bh);
   void bh_write(BufferHead *bh);
@@ -456,6 +485,10 @@ class ObjectCacher {
 
   bool flush(Object *o);
   loff_t release(Object *o);
+
+  void stripe_hits(ObjectExtent &ex, map<loff_t, BufferHead*>& hits,
+		   map<uint64_t, bufferlist>& stripe_map);
+  uint64_t assemble_stripes(map<uint64_t, bufferlist>& stripe_map, bufferlist *bl);
   void purge(Object *o);
 
   void rdlock(Object *o);
@@ -527,6 +560,8 @@ class ObjectCacher {
     assert(lru_rest.lru_get_size() == 0);
     assert(lru_dirty.lru_get_size() == 0);
     assert(dirty_bh.empty());
+    for (vector<void*>::iterator p = bh_pool.begin(); p != bh_pool.end(); ++p)
+      ::operator delete(*p);
   }
 
   void start() {
@@ -563,6 +598,7 @@ class ObjectCacher {
   // non-blocking.  async.
   int readx(OSDRead *rd, ObjectSet *oset, Context *onfinish);
   int writex(OSDWrite *wr, ObjectSet *oset);
+  int readx_shared(OSDRead *rd);
   bool is_cached(ObjectSet *oset, vector<ObjectExtent>& extents, snapid_t snapid);
 
   // write blocking
@@ -612,6 +648,20 @@ class ObjectCacher {
     return readx(rd, oset, onfinish);
   }
 
+  /*
+   * may be called WITHOUT the caller's lock.  returns bytes read if the
+   * whole range is readable from cache, or -EAGAIN, in which case the
+   * caller should retake its lock and use file_read.  a range spanning
+   * several objects sees each file_write either entirely or not at all.
+   */
+  int file_read_shared(ObjectSet *oset, ceph_file_layout *layout, snapid_t snapid,
+		       loff_t offset, uint64_t len,
+		       bufferlist *bl) {
+    OSDRead rd(snapid, bl, 0);
+    filer.file_to_extents(oset->ino, layout, offset, len, rd.extents);
+    return readx_shared(&rd);
+  }
+
   int file_write(ObjectSet *oset, ceph_file_layout *layout, const SnapContext& snapc,
                  loff_t offset, uint64_t len, 
                  bufferlist& bl, utime_t mtime, int flags) {
@@ -23,6 +23,7 @@
 
 #include "messages/MPing.h"
 #include "messages/MOSDOp.h"
+#include "messages/MOSDOpBatch.h"
 #include "messages/MOSDOpReply.h"
 #include "messages/MOSDMap.h"
 
@@ -210,6 +211,9 @@ void Objecter::handle_osd_map(MOSDMap *m)
             << "] > " << osdmap->get_epoch()
             << dendl;
 
+    // send anything we are still coalescing before targets get recalculated
+    flush_all_batches();
+
     if (osdmap->get_epoch()) {
       // we want incrementals
       for (epoch_t e = osdmap->get_epoch() + 1;
@@ -467,6 +471,7 @@ void Objecter::reopen_session(OSDSession *s)
 {
   entity_inst_t inst = osdmap->get_inst(s->osd);
   ldout(cct, 10) << "reopen_session osd." << s->osd << " session, addr now " << inst << dendl;
+  discard_batch(s);
   if (s->con) {
     messenger->mark_down(s->con);
     s->con->put();
@@ -478,6 +483,7 @@ void Objecter::reopen_session(OSDSession *s)
 void Objecter::close_session(OSDSession *s)
 {
   ldout(cct, 10) << "close_session for osd." << s->osd << dendl;
+  discard_batch(s);
   if (s->con) {
     messenger->mark_down(s->con);
     s->con->put();
@@ -690,8 +696,9 @@ int Objecter::recalc_op_target(Op *op)
 {
   vector<int> acting;
   pg_t pgid = op->pgid;
+  op->target_oloc = get_target_oloc(op->oloc, op->flags);
   if (op->oid.name.length()) {
-    int ret = osdmap->object_locator_to_pg(op->oid, op->oloc, pgid);
+    int ret = osdmap->object_locator_to_pg(op->oid, op->target_oloc, pgid);
     if (ret == -ENOENT)
       return RECALC_OP_TARGET_POOL_DNE;
   }
@@ -706,27 +713,13 @@ int Objecter::recalc_op_target(Op *op)
     OSDSession *s = NULL;
     op->used_replica = false;
     if (acting.size()) {
-      int osd;
+      unsigned p = 0;
       bool read = (op->flags & CEPH_OSD_FLAG_READ) && (op->flags & CEPH_OSD_FLAG_WRITE) == 0;
-      if (read && (op->flags & CEPH_OSD_FLAG_BALANCE_READS)) {
-	int p = rand() % acting.size();
-	if (p)
-	  op->used_replica = true;
-	osd = acting[p];
-	ldout(cct, 10) << " chose random osd." << osd << " of " << acting << dendl;
-      } else if (read && (op->flags & CEPH_OSD_FLAG_LOCALIZE_READS)) {
-	// look for a local replica
-	unsigned i;
-	for (i = acting.size()-1; i > 0; i++)
-	  if (osdmap->get_addr(i).is_same_host(messenger->get_myaddr())) {
-	    op->used_replica = true;
-	    ldout(cct, 10) << " chose local osd." << acting[i] << " of " << acting << dendl;
-	    break;
-	  }
-	osd = acting[i];
-      } else
-	osd = acting[0];
-      s = get_session(osd);
+      if (read && (op->flags & (CEPH_OSD_FLAG_BALANCE_READS|CEPH_OSD_FLAG_LOCALIZE_READS)))
+	p = choose_read_target(op, acting);
+      if (p)
+	op->used_replica = true;
+      s = get_session(acting[p]);
     }
 
     if (op->session != s) {
@@ -744,11 +737,111 @@ int Objecter::recalc_op_target(Op *op)
   return RECALC_OP_TARGET_NO_ACTION;
 }
 
+/*
+ * a base pool with an overlay has its io sent to its cache tier.  pg
+ * ops (object listing) and ops that ask to ignore the overlay go to
+ * the pool they name.
+ */
+object_locator_t Objecter::get_target_oloc(const object_locator_t& oloc, int flags)
+{
+  object_locator_t target = oloc;
+  if (flags & (CEPH_OSD_FLAG_IGNORE_OVERLAY | CEPH_OSD_FLAG_PGOP))
+    return target;
+  const pg_pool_t *pi = osdmap->get_pg_pool(oloc.pool);
+  if (!pi)
+    return target;
+  if ((flags & CEPH_OSD_FLAG_WRITE) && pi->has_write_tier())
+    target.pool = pi->write_tier;
+  else if ((flags & CEPH_OSD_FLAG_READ) && pi->has_read_tier())
+    target.pool = pi->read_tier;
+  return target;
+}
+
+int Objecter::get_read_policy_flags(int policy)
+{
+  switch (policy) {
+  case READ_FROM_PRIMARY:
+    return 0;
+  case READ_FROM_RANDOM:
+    return CEPH_OSD_FLAG_BALANCE_READS;
+  case READ_FROM_LOCAL:
+    return CEPH_OSD_FLAG_LOCALIZE_READS;
+  case READ_FROM_LEAST_OUTSTANDING:
+    return CEPH_OSD_FLAG_BALANCE_READS | READ_BALANCE_OUTSTANDING;
+  case READ_FROM_LOWEST_LATENCY:
+    return CEPH_OSD_FLAG_BALANCE_READS | READ_BALANCE_LATENCY;
+  }
+  return -EINVAL;
+}
+
+/*
+ * pick the acting osd to read from; returns an index into acting,
+ * where 0 is the primary.  ties go to the lower index, so the primary
+ * wins when there is nothing to choose between.
+ */
+unsigned Objecter::choose_read_target(Op *op, vector<int>& acting)
+{
+  unsigned p = 0;
+  if (op->flags & CEPH_OSD_FLAG_LOCALIZE_READS) {
+    const entity_addr_t& me = messenger->get_myaddr();
+    for (p = 0; p < acting.size(); p++)
+      if (osdmap->get_addr(acting[p]).is_same_host(me))
+	break;
+    if (p == acting.size())
+      p = 0;
+    ldout(cct, 10) << " chose " << (p ? "local " : "") << "osd." << acting[p]
+		   << " of " << acting << dendl;
+    return p;
+  }
+
+  switch (op->flags & READ_BALANCE_MASK) {
+  case READ_BALANCE_OUTSTANDING:
+    {
+      int best = -1;
+      for (unsigned i = 0; i < acting.size(); i++) {
+	map<int,OSDSession*>::iterator q = osd_sessions.find(acting[i]);
+	int n = q == osd_sessions.end() ? 0 : q->second->ops.size();
+	if (best < 0 || n < best) {
+	  best = n;
+	  p = i;
+	}
+      }
+      ldout(cct, 10) << " chose osd." << acting[p] << " of " << acting
+		     << " with " << best << " ops outstanding" << dendl;
+    }
+    break;
+
+  case READ_BALANCE_LATENCY:
+    {
+      // an osd we have no latency for yet looks free, so it gets tried
+      double best = -1;
+      for (unsigned i = 0; i < acting.size(); i++) {
+	map<int,OSDSession*>::iterator q = osd_sessions.find(acting[i]);
+	double lat = q == osd_sessions.end() ? 0 : q->second->read_latency;
+	if (best < 0 || lat < best) {
+	  best = lat;
+	  p = i;
+	}
+      }
+      ldout(cct, 10) << " chose osd." << acting[p] << " of " << acting
+		     << " with read latency " << best << dendl;
+    }
+    break;
+
+  default:
+    p = rand() % acting.size();
+    ldout(cct, 10) << " chose random osd." << acting[p] << " of " << acting << dendl;
+  }
+  return p;
+}
+
 bool Objecter::recalc_linger_op_target(LingerOp *linger_op)
 {
   vector<int> acting;
   pg_t pgid;
-  int ret = osdmap->object_locator_to_pg(linger_op->oid, linger_op->oloc, pgid);
+  object_locator_t oloc = get_target_oloc(linger_op->oloc,
+					  linger_op->flags | CEPH_OSD_FLAG_READ);
+  int ret = osdmap->object_locator_to_pg(linger_op->oid, oloc, pgid);
   if (ret == -ENOENT) {
     return RECALC_OP_TARGET_POOL_DNE;
   }
@@ -776,7 +869,7 @@ void Objecter::send_op(Op *op)
 {
   ldout(cct, 15) << "send_op " << op->tid << " to osd." << op->session->osd << dendl;
 
-  int flags = op->flags;
+  int flags = op->flags & ~READ_BALANCE_MASK;
   if (op->oncommit)
     flags |= CEPH_OSD_FLAG_ONDISK;
   if (op->onack)
@@ -798,10 +891,9 @@ void Objecter::send_op(Op *op)
 
   op->paused = false;
   op->incarnation = op->session->incarnation;
-  op->stamp = ceph_clock_now(cct);
 
   MOSDOp *m = new MOSDOp(client_inc, op->tid, 
-			 op->oid, op->oloc, op->pgid, osdmap->get_epoch(),
+			 op->oid, op->target_oloc, op->pgid, osdmap->get_epoch(),
 			 flags);
 
   m->set_snapid(op->snapid);
@@ -818,9 +910,103 @@ void Objecter::send_op(Op *op)
   if (op->priority)
     m->set_priority(op->priority);
 
+  if (op_is_batchable(op)) {
+    batch_op(op->session, m);
+    return;
+  }
+
+  // preserve ordering with anything we are still holding back
+  flush_batch(op->session);
+  op->stamp = ceph_clock_now(cct);
   messenger->send_message(m, op->session->con);
 }
 
+bool Objecter::op_is_batchable(Op *op)
+{
+  if (cct->_conf->objecter_batch_window <= 0)
+    return false;
+  if (!op->session->con->has_feature(CEPH_FEATURE_OSD_OPBATCH))
+    return false;
+  uint64_t len = 0;
+  for (vector<OSDOp>::iterator i = op->ops.begin(); i != op->ops.end(); ++i)
+    len += i->data.length();
+  return len <= (uint64_t)cct->_conf->objecter_batch_max_op_bytes;
+}
+
+void Objecter::batch_op(OSDSession *s, MOSDOp *m)
+{
+  list<MOSDOp*>& ls = s->batch_pending[m->get_pg()];
+  ls.push_back(m);
+  ldout(cct, 20) << "batch_op " << m->get_tid() << " to osd." << s->osd
+		 << " " << m->get_pg() << ", " << ls.size() << " pending" << dendl;
+
+  if ((int)ls.size() >= cct->_conf->objecter_batch_max_ops) {
+    flush_batch(s);
+    return;
+  }
+  if (!s->batch_flush_event) {
+    s->batch_flush_event = new C_FlushBatch(this, s);
+    timer.add_event_after(cct->_conf->objecter_batch_window, s->batch_flush_event);
+  }
+}
+
+void Objecter::flush_batch(OSDSession *s)
+{
+  if (s->batch_flush_event) {
+    timer.cancel_event(s->batch_flush_event);
+    s->batch_flush_event = NULL;
+  }
+  // latency and laggy checks count from when the op hits the wire,
+  // not from when it was queued behind the batch window
+  utime_t now = ceph_clock_now(cct);
+  for (map<pg_t, list<MOSDOp*> >::iterator p = s->batch_pending.begin();
+       p != s->batch_pending.end();
+       ++p) {
+    list<MOSDOp*>& ls = p->second;
+    for (list<MOSDOp*>::iterator q = ls.begin(); q != ls.end(); ++q) {
+      hash_map<tid_t,Op*>::iterator o = ops.find((*q)->get_tid());
+      if (o != ops.end())
+	o->second->stamp = now;
+    }
+    if (ls.size() == 1) {
+      messenger->send_message(ls.front(), s->con);
+    } else {
+      ldout(cct, 15) << "flush_batch " << ls.size() << " ops for " << p->first
+		     << " to osd." << s->osd << dendl;
+      MOSDOpBatch *b = new MOSDOpBatch(p->first);
+      b->ops.swap(ls);
+      messenger->send_message(b, s->con);
+    }
+  }
+  s->batch_pending.clear();
+}
+
+void Objecter::flush_all_batches()
+{
+  for (map<int,OSDSession*>::iterator p = osd_sessions.begin();
+       p != osd_sessions.end();
+       ++p)
+    flush_batch(p->second);
+}
+
+/*
+ * drop coalesced messages without sending them.  the ops are still on
+ * the session and will be resent (or retargeted) by the caller.
+ */
+void Objecter::discard_batch(OSDSession *s)
+{
+  if (s->batch_flush_event) {
+    timer.cancel_event(s->batch_flush_event);
+    s->batch_flush_event = NULL;
+  }
+  for (map<pg_t, list<MOSDOp*> >::iterator p = s->batch_pending.begin();
+       p != s->batch_pending.end();
+       ++p)
+    for (list<MOSDOp*>::iterator q = p->second.begin(); q != p->second.end(); ++q)
+      (*q)->put();
+  s->batch_pending.clear();
+}
+
 int Objecter::calc_op_budget(Op *op)
 {
   int op_budget = 0;
@@ -885,12 +1071,47 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
 
   int rc = m->get_result();
 
+  if ((op->flags & CEPH_OSD_FLAG_READ) && !(op->flags & CEPH_OSD_FLAG_WRITE)) {
+    double lat = ceph_clock_now(cct) - op->stamp;
+    double alpha = cct->_conf->objecter_read_latency_alpha;
+    OSDSession *s = op->session;
+    if (s->read_latency == 0)
+      s->read_latency = lat;
+    else
+      s->read_latency = alpha * lat + (1.0 - alpha) * s->read_latency;
+  }
+
+  if (m->get_flags() & CEPH_OSD_FLAG_REDIRECTED) {
+    // the cache tier does not have it and does not want it; go to the
+    // base pool directly
+    ldout(cct, 7) << " redirected by cache pool " << op->target_oloc.pool
+		  << ", resending to base pool " << op->oloc.pool << dendl;
+    op->flags |= CEPH_OSD_FLAG_IGNORE_OVERLAY;
+    rc = -EAGAIN;
+  }
+
   if (rc == -EAGAIN) {
     ldout(cct, 7) << " got -EAGAIN, resubmitting" << dendl;
     if (op->onack)
       num_unacked--;
     if (op->oncommit)
       num_uncommitted--;
+
+    if (op->used_replica) {
+      // the replica could not serve it; go to the primary this time
+      ldout(cct, 7) << " osd." << op->session->osd << " is a replica for "
+		    << op->pgid << ", retrying at the primary" << dendl;
+      op->flags &= ~(CEPH_OSD_FLAG_BALANCE_READS | CEPH_OSD_FLAG_LOCALIZE_READS |
+		     READ_BALANCE_MASK);
+    }
+
+    // op_submit gives it a new tid and budget and retargets it; drop
+    // the old ones
+    put_op_budget(op);
+    ops.erase(tid);
+    op->session_item.remove_myself();
+    op->session = NULL;
+    op->acting.clear();
     op_submit(op);
     m->put();
     return;
@@ -252,6 +252,12 @@ struct ObjectOperation {
   void tmap_get() {
     add_op(CEPH_OSD_OP_TMAPGET);
   }
+  /// fetch the header and only the named keys (result is tmap-encoded)
+  void tmap_get_vals(const set<string>& keys) {
+    bufferlist bl;
+    ::encode(keys, bl);
+    add_data(CEPH_OSD_OP_TMAPGETVALS, 0, bl.length(), bl);
+  }
 
   // object classes
   void call(const char *cname, const char *method, bufferlist &indata) {
@@ -346,6 +352,28 @@ public:
 
   class OSDSession;
 
+  /*
+   * replica read selection.  reads with BALANCE_READS set go to the
+   * acting osd picked by the policy in the READ_BALANCE bits of the op
+   * flags (uniformly random if none); LOCALIZE_READS prefers an acting
+   * osd on this host.  the READ_BALANCE bits are ours, and are masked
+   * off before the op goes on the wire.
+   */
+  enum {
+    READ_FROM_PRIMARY = 0,
+    READ_FROM_RANDOM = 1,
+    READ_FROM_LOCAL = 2,
+    READ_FROM_LEAST_OUTSTANDING = 3,  // fewest of our ops in flight
+    READ_FROM_LOWEST_LATENCY = 4,     // lowest smoothed read latency
+  };
+  static const int READ_BALANCE_SHIFT = 24;
+  static const int READ_BALANCE_MASK = 0xf << READ_BALANCE_SHIFT;
+  static const int READ_BALANCE_OUTSTANDING = 1 << READ_BALANCE_SHIFT;
+  static const int READ_BALANCE_LATENCY = 2 << READ_BALANCE_SHIFT;
+
+  /// op flags for a READ_FROM_* policy, or -EINVAL
+  static int get_read_policy_flags(int policy);
+
   struct Op {
     OSDSession *session;
     xlist<Op*>::item session_item;
@@ -353,6 +381,7 @@ public:
     
     object_t oid;
     object_locator_t oloc;
+    object_locator_t target_oloc;  ///< oloc after any pool overlay; what we send
 
     pg_t pgid;
     vector<int> acting;
@@ -590,7 +619,14 @@ public:
     int incarnation;
     Connection *con;
 
-    OSDSession(int o) : osd(o), incarnation(0), con(NULL) {}
+    double read_latency;   // ewma of read latency (seconds), 0 until measured
+
+    // small ops waiting to be coalesced into an MOSDOpBatch, per pg
+    map<pg_t, list<MOSDOp*> > batch_pending;
+    Context *batch_flush_event;
+
+    OSDSession(int o) : osd(o), incarnation(0), con(NULL),
+			read_latency(0), batch_flush_event(NULL) {}
   };
   map<int,OSDSession*> osd_sessions;
 
@@ -612,6 +648,24 @@ public:
   map<epoch_t,list< pair<Context*, int> > > waiting_for_map;
 
   void send_op(Op *op);
+
+  // op batching
+  class C_FlushBatch : public Context {
+    Objecter *ob;
+    OSDSession *s;
+  public:
+    C_FlushBatch(Objecter *o, OSDSession *se) : ob(o), s(se) {}
+    void finish(int r) {
+      s->batch_flush_event = NULL;
+      ob->flush_batch(s);
+    }
+  };
+  bool op_is_batchable(Op *op);
+  void batch_op(OSDSession *s, MOSDOp *m);
+  void flush_batch(OSDSession *s);
+  void flush_all_batches();
+  void discard_batch(OSDSession *s);
+
   bool is_pg_changed(vector<int>& a, vector<int>& b, bool any_change=false);
   enum recalc_op_target_result {
     RECALC_OP_TARGET_NO_ACTION = 0,
@@ -619,6 +673,8 @@ public:
     RECALC_OP_TARGET_POOL_DNE,
   };
   int recalc_op_target(Op *op);
+  unsigned choose_read_target(Op *op, vector<int>& acting);
+  object_locator_t get_target_oloc(const object_locator_t& oloc, int flags);
   bool recalc_linger_op_target(LingerOp *op);
 
   void send_linger(LingerOp *info);
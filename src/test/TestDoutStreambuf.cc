@@ -85,6 +85,9 @@ int main(int argc, const char **argv)
   oss.flush();
   oss.flush();
 
+  // what a crash would dump
+  dos->emergency_dump_recent();
+
   syslog(LOG_USER | LOG_NOTICE, "TestDoutStreambuf: ending test\n");
 
   return 0;
@@ -18,6 +18,7 @@
 #include "common/ceph_context.h"
 #include "test/unit.h"
 
+#include <errno.h>
 #include <stdint.h>
 #include <string.h>
 #include <string>
@@ -72,3 +73,30 @@ TEST(AdminSocket, SendNoOp) {
   ASSERT_EQ(CEPH_ADMIN_SOCK_VERSION, version);
   ASSERT_EQ(true, asoct.shutdown());
 }
+
+class MyTestHook : public AdminSocketHook {
+public:
+  bool call(uint32_t request, std::string &out) {
+    out = "hook response";
+    return true;
+  }
+};
+
+TEST(AdminSocket, RegisterHook) {
+  std::auto_ptr<AdminSocketConfigObs>
+      asokc(new AdminSocketConfigObs(g_ceph_context));
+  AdminSocketTest asoct(asokc.get());
+  ASSERT_EQ(true, asoct.shutdown());
+  ASSERT_EQ(true, asoct.init(get_rand_socket_path()));
+  MyTestHook hook;
+  ASSERT_EQ(0, asokc->register_hook(CEPH_ADMIN_SOCK_REQ_OPS_IN_FLIGHT, &hook));
+  ASSERT_EQ(-EEXIST, asokc->register_hook(CEPH_ADMIN_SOCK_REQ_OPS_IN_FLIGHT, &hook));
+  AdminSocketClient client(get_rand_socket_path());
+  std::string msg;
+  ASSERT_EQ("", client.get_json(&msg, CEPH_ADMIN_SOCK_REQ_OPS_IN_FLIGHT));
+  ASSERT_EQ("hook response", msg);
+  asokc->unregister_hook(CEPH_ADMIN_SOCK_REQ_OPS_IN_FLIGHT);
+  ASSERT_EQ(0, asokc->register_hook(CEPH_ADMIN_SOCK_REQ_OPS_IN_FLIGHT, &hook));
+  asokc->unregister_hook(CEPH_ADMIN_SOCK_REQ_OPS_IN_FLIGHT);
+  ASSERT_EQ(true, asoct.shutdown());
+}
@@ -0,0 +1,86 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "mds/mdstypes.h"
+#include "messages/MClientCaps.h"
+#include "messages/MClientCapsBatch.h"
+#include "include/ceph_fs.h"
+#include "test/unit.h"
+
+static MClientCaps *make_caps(int op, inodeno_t ino, long seq)
+{
+  MClientCaps *m = new MClientCaps(op, ino, 1, ino.val + 100, seq,
+				   CEPH_CAP_PIN | CEPH_CAP_FILE_SHARED,
+				   CEPH_CAP_FILE_RD, 0, 0);
+  m->head.size = seq * 4096;
+  return m;
+}
+
+TEST(MClientCapsBatch, RoundTrip) {
+  Connection *con = new Connection;
+  con->set_features(CEPH_FEATURE_FLOCK | CEPH_FEATURE_CAPS_BATCH);
+
+  MClientCapsBatch *batch = new MClientCapsBatch;
+  batch->set_connection(con->get());
+  batch->caps.push_back(make_caps(CEPH_CAP_OP_GRANT, 0x1000, 1));
+  batch->caps.push_back(make_caps(CEPH_CAP_OP_REVOKE, 0x1001, 2));
+  batch->caps.push_back(make_caps(CEPH_CAP_OP_FLUSH_ACK, 0x1002, 3));
+
+  bufferlist bl;
+  encode_message(g_ceph_context, batch, bl);
+  batch->put();
+
+  bufferlist::iterator p = bl.begin();
+  Message *m = decode_message(g_ceph_context, p);
+  ASSERT_TRUE(m != NULL);
+  ASSERT_EQ(CEPH_MSG_CLIENT_CAPS_BATCH, m->get_type());
+  MClientCapsBatch *out = (MClientCapsBatch*)m;
+  ASSERT_EQ(3u, out->caps.size());
+
+  int ops[] = { CEPH_CAP_OP_GRANT, CEPH_CAP_OP_REVOKE, CEPH_CAP_OP_FLUSH_ACK };
+  int i = 0;
+  for (list<MClientCaps*>::iterator q = out->caps.begin();
+       q != out->caps.end(); ++q, ++i) {
+    ASSERT_EQ(ops[i], (*q)->get_op());
+    ASSERT_EQ(inodeno_t(0x1000 + i), (*q)->get_ino());
+    ASSERT_EQ((unsigned)(i + 1), (*q)->get_seq());
+    ASSERT_EQ((uint64_t)(i + 1) * 4096, (*q)->get_size());
+  }
+  out->put();
+  con->put();
+}
+
+TEST(MClientCapsBatch, RejectBadEntry) {
+  Connection *con = new Connection;
+  con->set_features(CEPH_FEATURE_FLOCK | CEPH_FEATURE_CAPS_BATCH);
+
+  // a good cap message followed by one we can't decode
+  MClientCaps *good = make_caps(CEPH_CAP_OP_GRANT, 0x2000, 1);
+  good->set_connection(con->get());
+  MClientCaps *bad = make_caps(CEPH_CAP_OP_REVOKE, 0x2001, 2);
+  bad->set_connection(con->get());
+  bad->set_type(0xffff);
+
+  bufferlist payload;
+  __u32 n = 2;
+  ::encode(n, payload);
+  encode_message(g_ceph_context, good, payload);
+  encode_message(g_ceph_context, bad, payload);
+  good->put();
+  bad->put();
+
+  MClientCapsBatch *batch = new MClientCapsBatch;
+  batch->set_payload(payload);
+  ASSERT_THROW(batch->decode_payload(g_ceph_context), buffer::error);
+  batch->put();
+  con->put();
+}
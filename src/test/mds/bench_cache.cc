@@ -0,0 +1,118 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2012 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Build a large synthetic set of cached inodes and dentries (no MDS, no
+ * cluster) and report how much memory each one costs.
+ */
+
+#include "common/ceph_argparse.h"
+#include "common/config.h"
+#include "common/Clock.h"
+#include "common/MemoryModel.h"
+#include "global/global_init.h"
+#include "global/global_context.h"
+#include "mds/CInode.h"
+#include "mds/CDentry.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::string;
+
+static void usage(void)
+{
+  cerr << "--num           number of inodes (and primary dentries) to create" << std::endl;
+  cerr << "--per-dir       files per directory (default 1000)" << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+  global_init(args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  string val;
+  long num = 1000000;
+  long per_dir = 1000;
+  for (std::vector<const char*>::iterator i = args.begin(); i != args.end(); ) {
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_witharg(args, i, &val, "--num", "-n", (char*)NULL)) {
+      num = atol(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--per-dir", (char*)NULL)) {
+      per_dir = atol(val.c_str());
+    } else {
+      cerr << "unknown command line option: " << *i << std::endl;
+      usage();
+      return 2;
+    }
+  }
+  if (num <= 0 || per_dir <= 0) {
+    usage();
+    return 2;
+  }
+
+  MemoryModel mm(g_ceph_context);
+  MemoryModel::snap before, after;
+  mm.sample(&before);
+  utime_t start = ceph_clock_now(g_ceph_context);
+
+  vector<CInode*> inodes;
+  vector<CDentry*> dentries;
+  inodes.reserve(num);
+  dentries.reserve(num);
+  for (long i = 0; i < num; i++) {
+    CInode *in = new CInode(NULL);
+    in->inode.ino = 0x10000000000ull + i;
+    in->inode.mode = (i % per_dir) ? (S_IFREG | 0644) : (S_IFDIR | 0755);
+    in->inode.nlink = 1;
+    in->inode.size = i;
+    in->inode.version = 1;
+
+    std::ostringstream ss;
+    ss << "file_" << (i % per_dir) << "_" << i;
+    CDentry *dn = new CDentry(ss.str(), ceph_str_hash_linux(ss.str().c_str(), ss.str().length()),
+			      2, CEPH_NOSNAP);
+    dn->get_linkage()->inode = in;
+    in->set_primary_parent(dn);
+
+    inodes.push_back(in);
+    dentries.push_back(dn);
+  }
+
+  utime_t elapsed = ceph_clock_now(g_ceph_context) - start;
+  mm.sample(&after);
+
+  // heap is in KB; mallinfo's counters overflow on big caches
+  uint64_t bytes = ((uint64_t)(after.get_heap() - before.get_heap())) << 10;
+  cout << num << " inodes in " << elapsed << " s" << std::endl;
+  cout << "sizeof(CInode) " << sizeof(CInode)
+       << ", sizeof(CDentry) " << sizeof(CDentry) << std::endl;
+  cout << "heap grew " << (bytes >> 10) << " KB, "
+       << (bytes / num) << " bytes per cached inode+dentry" << std::endl;
+
+  for (long i = 0; i < num; i++) {
+    inodes[i]->remove_primary_parent(dentries[i]);
+    delete dentries[i];
+    delete inodes[i];
+  }
+  return 0;
+}
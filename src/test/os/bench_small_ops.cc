@@ -0,0 +1,196 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2012 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Time small FileStore ops (read, getattr, stat, write) against a hot
+ * set of objects, once with the fd cache disabled and once with it
+ * enabled, and print the average latency of each.
+ */
+
+#include "common/ceph_argparse.h"
+#include "common/config.h"
+#include "common/Clock.h"
+#include "global/global_init.h"
+#include "global/global_context.h"
+#include "os/FileStore.h"
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::string;
+
+static void usage(void)
+{
+  cerr << "usage: bench_filestore_small_ops [options] <dir> <journal>" << std::endl;
+  cerr << "--objects       number of hot objects (default 64)" << std::endl;
+  cerr << "--ops           ops of each type per pass (default 10000)" << std::endl;
+  cerr << "--size          bytes per read/write (default 4096)" << std::endl;
+  cerr << "--name-len      object name length; > 255 exercises long file names (default 32)" << std::endl;
+  cerr << "--cache-size    filestore_fd_cache_size for the cached pass (default 128)" << std::endl;
+}
+
+struct Result {
+  double read, getattr, stat, write;
+};
+
+static int run(const string& dir, const string& journal, int cache_size,
+	       int num_objects, int num_ops, int size, int name_len,
+	       Result *res)
+{
+  std::ostringstream ss;
+  ss << cache_size;
+  g_ceph_context->_conf->set_val("filestore_fd_cache_size", ss.str().c_str());
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  ::mkdir(dir.c_str(), 0777);
+  FileStore store(dir, journal);
+  int r = store.mkfs();
+  if (r < 0) {
+    cerr << "mkfs failed: " << r << std::endl;
+    return r;
+  }
+  r = store.mount();
+  if (r < 0) {
+    cerr << "mount failed: " << r << std::endl;
+    return r;
+  }
+
+  coll_t cid("bench");
+  vector<hobject_t> objects;
+  bufferlist data, attr;
+  data.append(string(size, 'x'));
+  attr.append(string(64, 'a'));
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    for (int i = 0; i < num_objects; i++) {
+      std::ostringstream name;
+      name << "object_" << i << "_";
+      string n = name.str();
+      if ((int)n.length() < name_len)
+	n.append(name_len - n.length(), 'o');
+      hobject_t hoid(sobject_t(n, CEPH_NOSNAP));
+      objects.push_back(hoid);
+      t.write(cid, hoid, 0, data.length(), data);
+      t.setattr(cid, hoid, "attr", attr);
+    }
+    r = store.apply_transaction(t);
+    if (r < 0) {
+      cerr << "populate failed: " << r << std::endl;
+      store.umount();
+      return r;
+    }
+  }
+
+  utime_t start = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < num_ops; i++) {
+    bufferlist bl;
+    store.read(cid, objects[i % num_objects], 0, size, bl);
+  }
+  res->read = (double)(ceph_clock_now(g_ceph_context) - start) / num_ops;
+
+  start = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < num_ops; i++) {
+    bufferptr bp;
+    store.getattr(cid, objects[i % num_objects], "attr", bp);
+  }
+  res->getattr = (double)(ceph_clock_now(g_ceph_context) - start) / num_ops;
+
+  start = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < num_ops; i++) {
+    struct stat st;
+    store.stat(cid, objects[i % num_objects], &st);
+  }
+  res->stat = (double)(ceph_clock_now(g_ceph_context) - start) / num_ops;
+
+  start = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < num_ops; i++) {
+    ObjectStore::Transaction t;
+    t.write(cid, objects[i % num_objects], 0, data.length(), data);
+    store.apply_transaction(t);
+  }
+  res->write = (double)(ceph_clock_now(g_ceph_context) - start) / num_ops;
+
+  {
+    ObjectStore::Transaction t;
+    for (vector<hobject_t>::iterator p = objects.begin(); p != objects.end(); ++p)
+      t.remove(cid, *p);
+    t.remove_collection(cid);
+    store.apply_transaction(t);
+  }
+  store.umount();
+  return 0;
+}
+
+int main(int argc, const char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+  global_init(args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+  g_ceph_context->_conf->set_val("osd_journal_size", "400");
+
+  string val;
+  int num_objects = 64;
+  int num_ops = 10000;
+  int size = 4096;
+  int name_len = 32;
+  int cache_size = 128;
+  for (std::vector<const char*>::iterator i = args.begin(); i != args.end(); ) {
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_witharg(args, i, &val, "--objects", (char*)NULL)) {
+      num_objects = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--ops", (char*)NULL)) {
+      num_ops = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--size", (char*)NULL)) {
+      size = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--name-len", (char*)NULL)) {
+      name_len = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--cache-size", (char*)NULL)) {
+      cache_size = atoi(val.c_str());
+    } else {
+      ++i;
+    }
+  }
+  if (args.size() != 2 || num_objects <= 0 || num_ops <= 0 || size <= 0 ||
+      cache_size <= 0) {
+    usage();
+    return 2;
+  }
+
+  Result uncached, cached;
+  int r = run(args[0], args[1], 0, num_objects, num_ops, size, name_len, &uncached);
+  if (r < 0)
+    return 1;
+  r = run(args[0], args[1], cache_size, num_objects, num_ops, size, name_len, &cached);
+  if (r < 0)
+    return 1;
+
+  cout << num_objects << " objects, " << num_ops << " ops of each type, "
+       << size << " bytes, name length " << name_len << std::endl;
+  cout << "op\tno cache (us)\tcache " << cache_size << " (us)" << std::endl;
+  cout << "read\t" << uncached.read * 1000000 << "\t" << cached.read * 1000000 << std::endl;
+  cout << "getattr\t" << uncached.getattr * 1000000 << "\t" << cached.getattr * 1000000 << std::endl;
+  cout << "stat\t" << uncached.stat * 1000000 << "\t" << cached.stat * 1000000 << std::endl;
+  cout << "write\t" << uncached.write * 1000000 << "\t" << cached.write * 1000000 << std::endl;
+  return 0;
+}
@@ -0,0 +1,222 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2012 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Push a sustained stream of writes through a journaled FileStore, once
+ * with the writeback throttle off and once with it on, and compare
+ * throughput and the spread of per-op commit latency.  Without the
+ * throttle, bursts of dirty data show up as multi-second stalls in the
+ * tail whenever a sync has to flush them.
+ */
+
+#include "common/ceph_argparse.h"
+#include "common/config.h"
+#include "common/Clock.h"
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "global/global_init.h"
+#include "global/global_context.h"
+#include "include/Context.h"
+#include "os/FileStore.h"
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::string;
+
+static void usage(void)
+{
+  cerr << "usage: bench_filestore_writeback [options] <dir> <journal>" << std::endl;
+  cerr << "--seconds       length of each pass (default 60)" << std::endl;
+  cerr << "--size          bytes per write (default 65536)" << std::endl;
+  cerr << "--objects       objects written round robin (default 1024)" << std::endl;
+  cerr << "--object-size   object size; writes cycle through it (default 4194304)" << std::endl;
+  cerr << "--inflight      writes kept in flight (default 16)" << std::endl;
+}
+
+struct Stream {
+  Mutex lock;
+  Cond cond;
+  int inflight;
+  vector<double> lat;
+  Stream() : lock("bench_writeback::Stream::lock"), inflight(0) {}
+};
+
+struct C_Committed : public Context {
+  Stream *s;
+  utime_t start;
+  C_Committed(Stream *s_, utime_t st) : s(s_), start(st) {}
+  void finish(int r) {
+    utime_t lat = ceph_clock_now(g_ceph_context) - start;
+    Mutex::Locker l(s->lock);
+    s->lat.push_back((double)lat);
+    s->inflight--;
+    s->cond.Signal();
+  }
+};
+
+struct Result {
+  double mb_per_sec;
+  double avg, p50, p99, p999, max;
+};
+
+static double pct(const vector<double>& v, double p)
+{
+  if (v.empty())
+    return 0;
+  return v[(size_t)((v.size() - 1) * p)];
+}
+
+static int run(const string& dir, const string& journal, bool throttle,
+	       int seconds, int size, int num_objects, int object_size, int max_inflight,
+	       Result *res)
+{
+  g_ceph_context->_conf->set_val("filestore_wbthrottle", throttle ? "true" : "false");
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  ::mkdir(dir.c_str(), 0777);
+  FileStore store(dir, journal);
+  int r = store.mkfs();
+  if (r < 0) {
+    cerr << "mkfs failed: " << r << std::endl;
+    return r;
+  }
+  r = store.mount();
+  if (r < 0) {
+    cerr << "mount failed: " << r << std::endl;
+    return r;
+  }
+
+  coll_t cid("bench");
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    store.apply_transaction(t);
+  }
+
+  bufferlist data;
+  data.append(string(size, 'x'));
+  int per_object = MAX(object_size / size, 1);
+
+  ObjectStore *os = &store;
+  ObjectStore::Sequencer osr;
+  Stream s;
+  uint64_t bytes = 0;
+  utime_t start = ceph_clock_now(g_ceph_context);
+  utime_t end = start;
+  end += seconds;
+  for (uint64_t i = 0; ceph_clock_now(g_ceph_context) < end; i++) {
+    {
+      Mutex::Locker l(s.lock);
+      while (s.inflight >= max_inflight)
+	s.cond.Wait(s.lock);
+      s.inflight++;
+    }
+    std::ostringstream name;
+    name << "object_" << (i % num_objects);
+    hobject_t hoid(sobject_t(name.str(), CEPH_NOSNAP));
+    uint64_t off = (uint64_t)((i / num_objects) % per_object) * size;
+
+    ObjectStore::Transaction *t = new ObjectStore::Transaction;
+    t->write(cid, hoid, off, data.length(), data);
+    os->queue_transaction(&osr, t, new ObjectStore::C_DeleteTransaction(t),
+			  new C_Committed(&s, ceph_clock_now(g_ceph_context)));
+    bytes += size;
+  }
+  {
+    Mutex::Locker l(s.lock);
+    while (s.inflight > 0)
+      s.cond.Wait(s.lock);
+  }
+  double elapsed = (double)(ceph_clock_now(g_ceph_context) - start);
+  store.umount();
+
+  std::sort(s.lat.begin(), s.lat.end());
+  double sum = 0;
+  for (vector<double>::iterator p = s.lat.begin(); p != s.lat.end(); ++p)
+    sum += *p;
+  res->mb_per_sec = (double)bytes / elapsed / (1 << 20);
+  res->avg = s.lat.empty() ? 0 : sum / s.lat.size();
+  res->p50 = pct(s.lat, .5);
+  res->p99 = pct(s.lat, .99);
+  res->p999 = pct(s.lat, .999);
+  res->max = s.lat.empty() ? 0 : s.lat.back();
+  return 0;
+}
+
+static void print(const char *what, const Result& r)
+{
+  cout << what << "\t" << r.mb_per_sec << "\t" << r.avg * 1000 << "\t"
+       << r.p50 * 1000 << "\t" << r.p99 * 1000 << "\t" << r.p999 * 1000 << "\t"
+       << r.max * 1000 << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+  global_init(args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+  g_ceph_context->_conf->set_val("osd_journal_size", "400");
+
+  string val;
+  int seconds = 60;
+  int size = 65536;
+  int num_objects = 1024;
+  int object_size = 4 << 20;
+  int inflight = 16;
+  for (std::vector<const char*>::iterator i = args.begin(); i != args.end(); ) {
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_witharg(args, i, &val, "--seconds", (char*)NULL)) {
+      seconds = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--size", (char*)NULL)) {
+      size = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--objects", (char*)NULL)) {
+      num_objects = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--object-size", (char*)NULL)) {
+      object_size = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--inflight", (char*)NULL)) {
+      inflight = atoi(val.c_str());
+    } else {
+      ++i;
+    }
+  }
+  if (args.size() != 2 || seconds <= 0 || size <= 0 || num_objects <= 0 ||
+      object_size <= 0 || inflight <= 0) {
+    usage();
+    return 2;
+  }
+
+  Result off, on;
+  if (run(args[0], args[1], false, seconds, size, num_objects, object_size, inflight, &off) < 0)
+    return 1;
+  if (run(args[0], args[1], true, seconds, size, num_objects, object_size, inflight, &on) < 0)
+    return 1;
+
+  cout << seconds << "s per pass, " << size << " byte writes, " << inflight
+       << " in flight, " << num_objects << " objects" << std::endl;
+  cout << "throttle\tMB/s\tavg ms\tp50 ms\tp99 ms\tp99.9 ms\tmax ms" << std::endl;
+  print("off", off);
+  print("on", on);
+  return 0;
+}
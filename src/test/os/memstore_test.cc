@@ -0,0 +1,298 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2012 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <sstream>
+#include <set>
+#include "os/MemStore.h"
+#include "include/Context.h"
+#include "common/ceph_argparse.h"
+#include "global/global_init.h"
+#include "common/Mutex.h"
+#include "common/Cond.h"
+#include <boost/scoped_ptr.hpp>
+#include <gtest/gtest.h>
+
+class MemStoreTest : public ::testing::Test {
+public:
+  boost::scoped_ptr<ObjectStore> store;
+  coll_t cid;
+
+  MemStoreTest() : store(0), cid("memstore_test") {}
+  virtual void SetUp() {
+    ::mkdir("memstore_test_temp_dir", 0777);
+    store.reset(new MemStore(string("memstore_test_temp_dir")));
+    ASSERT_EQ(0, store->mkfs());
+    ASSERT_EQ(0, store->mount());
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    ASSERT_EQ(0u, store->apply_transaction(t));
+  }
+
+  virtual void TearDown() {
+    store->umount();
+  }
+
+  string read_all(const hobject_t& oid) {
+    bufferlist bl;
+    store->read(cid, oid, 0, 0, bl);
+    return string(bl.c_str(), bl.length());
+  }
+};
+
+TEST_F(MemStoreTest, WriteReadTruncate) {
+  hobject_t a(sobject_t("a", CEPH_NOSNAP));
+  bufferlist bl;
+  bl.append("0123456789");
+  {
+    ObjectStore::Transaction t;
+    t.write(cid, a, 0, bl.length(), bl);
+    store->apply_transaction(t);
+  }
+  ASSERT_TRUE(store->exists(cid, a));
+  ASSERT_EQ("0123456789", read_all(a));
+
+  // keep a reference to the old contents across an overwrite
+  bufferlist before;
+  ASSERT_EQ(10, store->read(cid, a, 0, 10, before));
+  {
+    bufferlist x;
+    x.append("xx");
+    ObjectStore::Transaction t;
+    t.write(cid, a, 4, x.length(), x);
+    t.write(cid, a, 12, x.length(), x);
+    store->apply_transaction(t);
+  }
+  ASSERT_EQ(string("0123xx6789\0\0xx", 14), read_all(a));
+  ASSERT_EQ("0123456789", string(before.c_str(), before.length()));
+
+  {
+    ObjectStore::Transaction t;
+    t.zero(cid, a, 1, 2);
+    t.truncate(cid, a, 6);
+    store->apply_transaction(t);
+  }
+  ASSERT_EQ(string("0\0\0" "3xx", 6), read_all(a));
+
+  struct stat st;
+  ASSERT_EQ(0, store->stat(cid, a, &st));
+  ASSERT_EQ(6, st.st_size);
+
+  bufferlist part;
+  ASSERT_EQ(2, store->read(cid, a, 4, 10, part));
+  ASSERT_EQ(0, store->read(cid, a, 100, 10, part));
+  hobject_t missing(sobject_t("missing", CEPH_NOSNAP));
+  ASSERT_EQ(-ENOENT, store->read(cid, missing, 0, 0, part));
+
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, a);
+    store->apply_transaction(t);
+  }
+  ASSERT_FALSE(store->exists(cid, a));
+}
+
+TEST_F(MemStoreTest, Attrs) {
+  hobject_t a(sobject_t("a", CEPH_NOSNAP));
+  {
+    bufferlist v;
+    v.append("value");
+    ObjectStore::Transaction t;
+    t.touch(cid, a);
+    t.setattr(cid, a, "_user", v);
+    t.setattr(cid, a, "internal", v);
+    t.collection_setattr(cid, "cattr", v);
+    store->apply_transaction(t);
+  }
+  bufferptr bp;
+  ASSERT_EQ(5, store->getattr(cid, a, "_user", bp));
+  ASSERT_EQ(-ENODATA, store->getattr(cid, a, "nope", bp));
+
+  map<string,bufferptr> aset;
+  ASSERT_EQ(0, store->getattrs(cid, a, aset, true));
+  ASSERT_EQ(1u, aset.size());
+  ASSERT_EQ(1u, aset.count("user"));
+  aset.clear();
+  ASSERT_EQ(0, store->getattrs(cid, a, aset));
+  ASSERT_EQ(2u, aset.size());
+
+  bufferlist cbl;
+  ASSERT_EQ(5, store->collection_getattr(cid, "cattr", cbl));
+  {
+    ObjectStore::Transaction t;
+    t.rmattr(cid, a, "_user");
+    store->apply_transaction(t);
+  }
+  ASSERT_EQ(-ENODATA, store->getattr(cid, a, "_user", bp));
+  {
+    ObjectStore::Transaction t;
+    t.rmattrs(cid, a);
+    store->apply_transaction(t);
+  }
+  aset.clear();
+  ASSERT_EQ(0, store->getattrs(cid, a, aset));
+  ASSERT_TRUE(aset.empty());
+}
+
+TEST_F(MemStoreTest, Clone) {
+  hobject_t a(sobject_t("a", CEPH_NOSNAP));
+  hobject_t b(sobject_t("a", 1));
+  hobject_t c(sobject_t("c", CEPH_NOSNAP));
+  bufferlist bl;
+  bl.append("abcdef");
+  {
+    ObjectStore::Transaction t;
+    t.write(cid, a, 0, bl.length(), bl);
+    t.clone(cid, a, b);
+    t.clone_range(cid, a, c, 2, 3, 1);
+    store->apply_transaction(t);
+  }
+  {
+    bufferlist x;
+    x.append("X");
+    ObjectStore::Transaction t;
+    t.write(cid, a, 0, x.length(), x);
+    store->apply_transaction(t);
+  }
+  ASSERT_EQ("Xbcdef", read_all(a));
+  ASSERT_EQ("abcdef", read_all(b));
+  ASSERT_EQ(string("\0cde", 4), read_all(c));
+}
+
+TEST_F(MemStoreTest, CollectionAddRename) {
+  coll_t other("other");
+  coll_t renamed("renamed");
+  hobject_t a(sobject_t("a", CEPH_NOSNAP));
+  {
+    bufferlist bl;
+    bl.append("abc");
+    ObjectStore::Transaction t;
+    t.create_collection(other);
+    t.write(cid, a, 0, bl.length(), bl);
+    t.collection_add(other, cid, a);
+    t.collection_remove(cid, a);
+    store->apply_transaction(t);
+  }
+  ASSERT_FALSE(store->exists(cid, a));
+  ASSERT_TRUE(store->collection_empty(cid));
+  ASSERT_FALSE(store->collection_empty(other));
+  {
+    ObjectStore::Transaction t;
+    t.collection_rename(other, renamed);
+    store->apply_transaction(t);
+  }
+  ASSERT_FALSE(store->collection_exists(other));
+  ASSERT_TRUE(store->collection_exists(renamed));
+  bufferlist bl;
+  ASSERT_EQ(3, store->read(renamed, a, 0, 0, bl));
+
+  vector<coll_t> ls;
+  store->list_collections(ls);
+  ASSERT_EQ(2u, ls.size());
+}
+
+TEST_F(MemStoreTest, ListPartial) {
+  set<string> created;
+  {
+    ObjectStore::Transaction t;
+    for (int i = 0; i < 100; i++) {
+      std::ostringstream name;
+      name << "object_" << i;
+      // a handful of hashes so the handle has to resume inside a run
+      hobject_t oid(object_t(name.str()), "", CEPH_NOSNAP, i % 7);
+      t.touch(cid, oid);
+      created.insert(name.str());
+    }
+    store->apply_transaction(t);
+  }
+
+  set<string> listed;
+  collection_list_handle_t handle;
+  while (true) {
+    vector<hobject_t> ls;
+    ASSERT_EQ(0, store->collection_list_partial(cid, 0, ls, 8, &handle));
+    for (vector<hobject_t>::iterator p = ls.begin(); p != ls.end(); ++p) {
+      ASSERT_TRUE(listed.insert(p->oid.name).second);
+    }
+    if (ls.size() < 8)
+      break;
+  }
+  ASSERT_EQ(created, listed);
+
+  vector<hobject_t> all;
+  ASSERT_EQ(0, store->collection_list(cid, all));
+  ASSERT_EQ(100u, all.size());
+}
+
+TEST_F(MemStoreTest, Callbacks) {
+  hobject_t a(sobject_t("a", CEPH_NOSNAP));
+  Mutex lock("MemStoreTest::Callbacks::lock");
+  Cond cond;
+  bool readable = false, committed = false;
+  ObjectStore::Transaction *t = new ObjectStore::Transaction;
+  t->touch(cid, a);
+  ObjectStore::Sequencer osr;
+  list<ObjectStore::Transaction*> tls;
+  tls.push_back(t);
+  store->queue_transactions(&osr, tls,
+			    new C_SafeCond(&lock, &cond, &readable),
+			    new C_SafeCond(&lock, &cond, &committed));
+  // applied synchronously
+  ASSERT_TRUE(store->exists(cid, a));
+  lock.Lock();
+  while (!readable || !committed)
+    cond.Wait(lock);
+  lock.Unlock();
+  delete t;
+}
+
+TEST_F(MemStoreTest, Persist) {
+  hobject_t a(sobject_t("a", CEPH_NOSNAP));
+  {
+    bufferlist bl, v;
+    bl.append("persist me");
+    v.append("v");
+    ObjectStore::Transaction t;
+    t.write(cid, a, 0, bl.length(), bl);
+    t.setattr(cid, a, "_attr", v);
+    store->apply_transaction(t);
+  }
+  struct statfs before;
+  ASSERT_EQ(0, store->statfs(&before));
+
+  ASSERT_EQ(0, store->umount());
+  ASSERT_EQ(0, store->mount());
+
+  ASSERT_TRUE(store->collection_exists(cid));
+  ASSERT_EQ("persist me", read_all(a));
+  bufferptr bp;
+  ASSERT_EQ(1, store->getattr(cid, a, "_attr", bp));
+  struct statfs after;
+  ASSERT_EQ(0, store->statfs(&after));
+  ASSERT_EQ(before.f_bfree, after.f_bfree);
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
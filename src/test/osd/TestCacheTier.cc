@@ -0,0 +1,124 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "osd/osd_types.h"
+#include "include/ceph_fs.h"
+#include "test/unit.h"
+
+static pg_pool_t make_cache(int mode)
+{
+  pg_pool_t p;
+  p.v.type = CEPH_PG_TYPE_REP;
+  p.v.pg_num = 4;
+  p.tier_of = 1;
+  p.cache_mode = mode;
+  p.hit_set_period = 60;
+  p.hit_set_count = 3;
+  p.target_max_objects = 400;   // 100 per pg
+  p.cache_min_flush_age = 600;
+  p.cache_min_evict_age = 1800;
+  return p;
+}
+
+TEST(HitSet, SecondTouchIsHot) {
+  // maybe_handle_cache promotes a read miss only once it is hot
+  hit_set_history_t h;
+  utime_t now(1000, 0);
+  ASSERT_FALSE(h.contains(17));
+  h.insert(17, now, 60, 3);
+  ASSERT_TRUE(h.contains(17));
+  ASSERT_FALSE(h.contains(18));
+}
+
+TEST(HitSet, Expire) {
+  hit_set_history_t h;
+  h.insert(1, utime_t(1000, 0), 60, 3);
+  h.insert(2, utime_t(1061, 0), 60, 3);   // 1 moves to history
+  ASSERT_EQ(1u, h.history.size());
+  ASSERT_TRUE(h.contains(1));
+  ASSERT_TRUE(h.contains(2));
+
+  h.insert(3, utime_t(1122, 0), 60, 3);
+  ASSERT_EQ(2u, h.history.size());
+  ASSERT_TRUE(h.contains(1));
+
+  // three sets in all: the oldest goes
+  h.insert(4, utime_t(1183, 0), 60, 3);
+  ASSERT_EQ(2u, h.history.size());
+  ASSERT_FALSE(h.contains(1));
+  ASSERT_TRUE(h.contains(2));
+  ASSERT_TRUE(h.contains(3));
+  ASSERT_TRUE(h.contains(4));
+}
+
+TEST(HitSet, NoPeriod) {
+  // with no period we never rotate, and nothing goes cold
+  hit_set_history_t h;
+  h.insert(1, utime_t(1000, 0), 0, 3);
+  h.insert(2, utime_t(100000, 0), 0, 3);
+  ASSERT_TRUE(h.history.empty());
+  ASSERT_TRUE(h.contains(1));
+}
+
+TEST(HitSet, CountOne) {
+  hit_set_history_t h;
+  h.insert(1, utime_t(1000, 0), 60, 1);
+  h.insert(2, utime_t(1061, 0), 60, 1);
+  ASSERT_TRUE(h.history.empty());
+  ASSERT_FALSE(h.contains(1));
+  ASSERT_TRUE(h.contains(2));
+}
+
+TEST(CacheAgent, Full) {
+  pg_pool_t p = make_cache(pg_pool_t::CACHEMODE_WRITEBACK);
+  ASSERT_FALSE(p.is_cache_full(0));
+  ASSERT_FALSE(p.is_cache_full(100));
+  ASSERT_TRUE(p.is_cache_full(101));
+
+  // no target: never full
+  p.target_max_objects = 0;
+  ASSERT_FALSE(p.is_cache_full(1000000));
+
+  // draining: always full
+  p = make_cache(pg_pool_t::CACHEMODE_FORWARD);
+  ASSERT_TRUE(p.is_cache_full(0));
+  p = make_cache(pg_pool_t::CACHEMODE_NONE);
+  ASSERT_TRUE(p.is_cache_full(0));
+}
+
+TEST(CacheAgent, Flush) {
+  pg_pool_t p = make_cache(pg_pool_t::CACHEMODE_WRITEBACK);
+  ASSERT_EQ(pg_pool_t::CACHE_AGENT_SKIP, p.get_cache_agent_op(true, false, 599, false));
+  ASSERT_EQ(pg_pool_t::CACHE_AGENT_FLUSH, p.get_cache_agent_op(true, false, 600, false));
+  ASSERT_EQ(pg_pool_t::CACHE_AGENT_FLUSH, p.get_cache_agent_op(true, true, 600, true));
+
+  // dirty objects are flushed before they can be evicted
+  ASSERT_EQ(pg_pool_t::CACHE_AGENT_SKIP, p.get_cache_agent_op(true, false, 599, true));
+}
+
+TEST(CacheAgent, Evict) {
+  pg_pool_t p = make_cache(pg_pool_t::CACHEMODE_WRITEBACK);
+  ASSERT_EQ(pg_pool_t::CACHE_AGENT_EVICT, p.get_cache_agent_op(false, false, 1800, true));
+
+  // not when there is room, nor when hot or young
+  ASSERT_EQ(pg_pool_t::CACHE_AGENT_SKIP, p.get_cache_agent_op(false, false, 1800, false));
+  ASSERT_EQ(pg_pool_t::CACHE_AGENT_SKIP, p.get_cache_agent_op(false, true, 1800, true));
+  ASSERT_EQ(pg_pool_t::CACHE_AGENT_SKIP, p.get_cache_agent_op(false, false, 1799, true));
+}
+
+TEST(CacheAgent, Drain) {
+  // forward mode flushes and evicts everything, so the overlay can go
+  pg_pool_t p = make_cache(pg_pool_t::CACHEMODE_FORWARD);
+  bool full = p.is_cache_full(1);
+  ASSERT_EQ(pg_pool_t::CACHE_AGENT_FLUSH, p.get_cache_agent_op(true, true, 0, full));
+  ASSERT_EQ(pg_pool_t::CACHE_AGENT_EVICT, p.get_cache_agent_op(false, true, 0, full));
+}
@@ -0,0 +1,182 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2012 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "osd/ErasureCodePlugin.h"
+#include "osd/ErasureCodeReedSolomon.h"
+#include "common/ceph_argparse.h"
+#include "global/global_init.h"
+#include "global/global_context.h"
+#include <gtest/gtest.h>
+
+static map<string,string> km(const char *k, const char *m)
+{
+  map<string,string> parameters;
+  parameters["erasure-code-k"] = k;
+  parameters["erasure-code-m"] = m;
+  return parameters;
+}
+
+static bufferlist random_object(unsigned len)
+{
+  bufferptr bp(len);
+  for (unsigned i = 0; i < len; i++)
+    bp[i] = rand();
+  bufferlist bl;
+  bl.push_back(bp);
+  return bl;
+}
+
+static bool same(bufferlist a, bufferlist b)
+{
+  return a.length() == b.length() &&
+    memcmp(a.c_str(), b.c_str(), a.length()) == 0;
+}
+
+TEST(ErasureCodeReedSolomon, Init) {
+  ErasureCodeReedSolomon rs;
+  ASSERT_EQ(0, rs.init(map<string,string>()));
+  ASSERT_EQ(ErasureCodeReedSolomon::DEFAULT_K, rs.get_data_chunk_count());
+  ASSERT_EQ(ErasureCodeReedSolomon::DEFAULT_M, rs.get_coding_chunk_count());
+  ASSERT_EQ(0, rs.init(km("10", "4")));
+  ASSERT_EQ(14u, rs.get_chunk_count());
+  ASSERT_EQ(-EINVAL, rs.init(km("0", "2")));
+  ASSERT_EQ(-EINVAL, rs.init(km("2", "x")));
+  ASSERT_EQ(-EINVAL, rs.init(km("200", "100")));
+}
+
+TEST(ErasureCodeReedSolomon, ChunkSize) {
+  ErasureCodeReedSolomon rs;
+  ASSERT_EQ(0, rs.init(km("4", "2")));
+  ASSERT_EQ(16u, rs.get_chunk_size(1));
+  ASSERT_EQ(16u, rs.get_chunk_size(64));
+  ASSERT_EQ(32u, rs.get_chunk_size(65));
+  ASSERT_EQ(1024u, rs.get_chunk_size(4096));
+}
+
+TEST(ErasureCodeReedSolomon, EncodeDecode) {
+  ErasureCodeReedSolomon rs;
+  ASSERT_EQ(0, rs.init(km("4", "2")));
+  bufferlist in = random_object(4000);
+
+  set<int> all;
+  for (int i = 0; i < 6; i++)
+    all.insert(i);
+  map<int, bufferlist> encoded;
+  ASSERT_EQ(0, rs.encode(all, in, &encoded));
+  ASSERT_EQ(6u, encoded.size());
+
+  // the data chunks are the object, zero padded
+  bufferlist data;
+  for (int i = 0; i < 4; i++) {
+    ASSERT_EQ(rs.get_chunk_size(in.length()), encoded[i].length());
+    data.append(encoded[i]);
+  }
+  bufferlist head;
+  head.substr_of(data, 0, in.length());
+  ASSERT_TRUE(same(in, head));
+
+  // any two chunks may go missing
+  for (int a = 0; a < 6; a++) {
+    for (int b = a + 1; b < 6; b++) {
+      map<int, bufferlist> chunks = encoded;
+      chunks.erase(a);
+      chunks.erase(b);
+      map<int, bufferlist> decoded;
+      ASSERT_EQ(0, rs.decode(all, chunks, &decoded));
+      for (int i = 0; i < 6; i++)
+	ASSERT_TRUE(same(encoded[i], decoded[i]));
+    }
+  }
+
+  // but not three
+  map<int, bufferlist> chunks = encoded;
+  chunks.erase(0);
+  chunks.erase(1);
+  chunks.erase(5);
+  map<int, bufferlist> decoded;
+  ASSERT_EQ(-EIO, rs.decode(all, chunks, &decoded));
+}
+
+TEST(ErasureCodeReedSolomon, MinimumToDecode) {
+  ErasureCodeReedSolomon rs;
+  ASSERT_EQ(0, rs.init(km("3", "2")));
+  set<int> want, available, minimum;
+  want.insert(1);
+  for (int i = 0; i < 5; i++)
+    available.insert(i);
+  ASSERT_EQ(0, rs.minimum_to_decode(want, available, &minimum));
+  ASSERT_EQ(want, minimum);
+
+  available.erase(1);
+  minimum.clear();
+  ASSERT_EQ(0, rs.minimum_to_decode(want, available, &minimum));
+  ASSERT_EQ(3u, minimum.size());
+  ASSERT_EQ(0u, minimum.count(1));
+
+  available.erase(0);
+  available.erase(2);
+  minimum.clear();
+  ASSERT_EQ(-EIO, rs.minimum_to_decode(want, available, &minimum));
+}
+
+TEST(ErasureCodeReedSolomon, RegionMultiplyAdd) {
+  // unaligned lengths take the scalar tail either way
+  for (unsigned len = 1; len < 100; len += 7) {
+    vector<uint8_t> in(len), out(len, 0);
+    for (unsigned i = 0; i < len; i++)
+      in[i] = rand();
+    ErasureCodeReedSolomon::region_multiply_add(1, &in[0], &out[0], len);
+    ASSERT_EQ(0, memcmp(&in[0], &out[0], len));
+    // x + x == 0 in GF(2^8), whatever the constant
+    ErasureCodeReedSolomon::region_multiply_add(0x53, &in[0], &out[0], len);
+    ErasureCodeReedSolomon::region_multiply_add(0x53, &in[0], &out[0], len);
+    ASSERT_EQ(0, memcmp(&in[0], &out[0], len));
+  }
+}
+
+TEST(ErasureCodePluginRegistry, Factory) {
+  ErasureCodePluginRegistry& registry = ErasureCodePluginRegistry::instance();
+  ErasureCodeInterfaceRef erasure_code;
+  ASSERT_EQ(-EIO, registry.factory("does_not_exist", ".libs",
+				   map<string,string>(), &erasure_code));
+  ASSERT_FALSE(erasure_code);
+  ASSERT_EQ(0, registry.factory("rs", ".libs", km("3", "2"), &erasure_code));
+  ASSERT_TRUE(erasure_code);
+  ASSERT_EQ(5u, erasure_code->get_chunk_count());
+  ASSERT_EQ(-EINVAL, registry.factory("rs", ".libs", km("0", "2"), &erasure_code));
+}
+
+// destroyed at exit, possibly after the registry: the plugin's code
+// must still be mapped when this codec's destructor runs.
+static ErasureCodeInterfaceRef exit_codec;
+
+TEST(ErasureCodePluginRegistry, CodecOutlivesRegistry) {
+  ErasureCodePluginRegistry& registry = ErasureCodePluginRegistry::instance();
+  ASSERT_EQ(0, registry.factory("rs", ".libs", km("2", "1"), &exit_codec));
+  ASSERT_TRUE(exit_codec);
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,175 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "osd/OSDMap.h"
+#include "include/ceph_fs.h"
+#include "test/unit.h"
+
+static void make_cache_tier(pg_pool_t& base, int64_t base_id,
+			    pg_pool_t& cache, int64_t cache_id)
+{
+  base.tiers.insert(cache_id);
+  base.read_tier = base.write_tier = cache_id;
+  cache.tier_of = base_id;
+  cache.cache_mode = pg_pool_t::CACHEMODE_FORWARD;
+  cache.hit_set_period = 1200;
+  cache.hit_set_count = 4;
+  cache.target_max_objects = 1000;
+  cache.cache_min_flush_age = 600;
+  cache.cache_min_evict_age = 1800;
+}
+
+static void check_cache_tier(const pg_pool_t& base, int64_t base_id,
+			     const pg_pool_t& cache, int64_t cache_id)
+{
+  ASSERT_EQ(1u, base.tiers.size());
+  ASSERT_EQ(1u, base.tiers.count(cache_id));
+  ASSERT_EQ(cache_id, base.read_tier);
+  ASSERT_EQ(cache_id, base.write_tier);
+  ASSERT_FALSE(base.is_tier());
+  ASSERT_EQ(base_id, cache.tier_of);
+  ASSERT_EQ(pg_pool_t::CACHEMODE_FORWARD, cache.cache_mode);
+  ASSERT_TRUE(cache.is_cache());
+  ASSERT_FALSE(cache.is_writeback_cache());
+  ASSERT_EQ(1200u, cache.hit_set_period);
+  ASSERT_EQ(4u, cache.hit_set_count);
+  ASSERT_EQ(1000u, cache.target_max_objects);
+  ASSERT_EQ(600u, cache.cache_min_flush_age);
+  ASSERT_EQ(1800u, cache.cache_min_evict_age);
+}
+
+TEST(pg_pool_t, TierInfoRoundTrip) {
+  pg_pool_t base, cache;
+  make_cache_tier(base, 1, cache, 2);
+
+  bufferlist bl;
+  base.encode_tier_info(bl);
+  cache.encode_tier_info(bl);
+
+  pg_pool_t dbase, dcache;
+  bufferlist::iterator p = bl.begin();
+  dbase.decode_tier_info(p);
+  dcache.decode_tier_info(p);
+  ASSERT_TRUE(p.end());
+  check_cache_tier(dbase, 1, dcache, 2);
+}
+
+TEST(pg_pool_t, TierInfoNotInBaseEncoding) {
+  // older and kernel clients only see encode(); tiering lives elsewhere
+  pg_pool_t base, cache;
+  make_cache_tier(base, 1, cache, 2);
+
+  bufferlist bl;
+  ::encode(cache, bl);
+  pg_pool_t d;
+  bufferlist::iterator p = bl.begin();
+  ::decode(d, p);
+  ASSERT_FALSE(d.is_tier());
+  ASSERT_FALSE(d.has_tier_info());
+  ASSERT_EQ(pg_pool_t::CACHEMODE_NONE, d.cache_mode);
+}
+
+TEST(pg_pool_t, CacheModeNames) {
+  int modes[] = { pg_pool_t::CACHEMODE_NONE, pg_pool_t::CACHEMODE_WRITEBACK,
+		  pg_pool_t::CACHEMODE_FORWARD };
+  for (unsigned i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+    ASSERT_EQ(modes[i],
+	      pg_pool_t::get_cache_mode_from_str(pg_pool_t::get_cache_mode_name(modes[i])));
+  ASSERT_EQ(-EINVAL, pg_pool_t::get_cache_mode_from_str("writethrough"));
+}
+
+class OSDMapTest : public ::testing::Test {
+protected:
+  OSDMap osdmap;
+
+  virtual void SetUp() {
+    ceph_fsid_t fsid;
+    memset(&fsid, 0, sizeof(fsid));
+    osdmap.build_simple(g_ceph_context, 1, fsid, 3, 0, 4, 4, 0);
+  }
+
+  // bring osds 0 and 1 up, only 1 with the cache pool feature, and
+  // make pool 2 a cache tier of pool 1
+  void make_incremental(OSDMap::Incremental& inc) {
+    inc.fsid = osdmap.get_fsid();
+    inc.epoch = osdmap.get_epoch() + 1;
+    entity_addr_t a;
+    a.parse("127.0.0.1:6800");
+    inc.new_up_client[0] = a;
+    inc.new_up_features[0] = CEPH_FEATURE_PGID64;
+    a.parse("127.0.0.1:6801");
+    inc.new_up_client[1] = a;
+    inc.new_up_features[1] = CEPH_FEATURE_PGID64 | CEPH_FEATURE_OSD_CACHEPOOL;
+    inc.new_pools[1] = *osdmap.get_pg_pool(1);
+    inc.new_pools[2] = *osdmap.get_pg_pool(2);
+    make_cache_tier(inc.new_pools[1], 1, inc.new_pools[2], 2);
+  }
+
+  void check(OSDMap& m) {
+    check_cache_tier(*m.get_pg_pool(1), 1, *m.get_pg_pool(2), 2);
+    ASSERT_FALSE(m.get_pg_pool(0)->has_tier_info());
+    ASSERT_TRUE(m.have_cache_overlay());
+    ASSERT_EQ((uint64_t)CEPH_FEATURE_PGID64, m.get_osd_features(0));
+    ASSERT_EQ((uint64_t)(CEPH_FEATURE_PGID64 | CEPH_FEATURE_OSD_CACHEPOOL),
+	      m.get_osd_features(1));
+    ASSERT_EQ(0u, m.get_osd_features(2));
+    // osd.2 never came up, so it doesn't exist and doesn't count
+    ASSERT_EQ((uint64_t)CEPH_FEATURE_PGID64, m.get_common_osd_features());
+  }
+};
+
+TEST_F(OSDMapTest, IncrementalRoundTrip) {
+  ASSERT_FALSE(osdmap.have_cache_overlay());
+
+  OSDMap::Incremental inc;
+  make_incremental(inc);
+  bufferlist bl;
+  inc.encode(bl);
+
+  OSDMap::Incremental dinc(bl);
+  ASSERT_EQ(inc.new_up_features, dinc.new_up_features);
+  check_cache_tier(dinc.new_pools[1], 1, dinc.new_pools[2], 2);
+
+  osdmap.apply_incremental(dinc);
+  check(osdmap);
+}
+
+TEST_F(OSDMapTest, FullRoundTrip) {
+  OSDMap::Incremental inc;
+  make_incremental(inc);
+  osdmap.apply_incremental(inc);
+
+  bufferlist bl;
+  osdmap.encode(bl);
+  OSDMap m;
+  m.decode(bl);
+  check(m);
+}
+
+TEST_F(OSDMapTest, RebootWithoutFeatures) {
+  OSDMap::Incremental inc;
+  make_incremental(inc);
+  osdmap.apply_incremental(inc);
+
+  // an old osd.1 comes back up without telling us its features
+  OSDMap::Incremental down(osdmap.get_epoch() + 1);
+  down.new_state[1] = CEPH_OSD_UP;
+  osdmap.apply_incremental(down);
+
+  OSDMap::Incremental up(osdmap.get_epoch() + 1);
+  entity_addr_t a;
+  a.parse("127.0.0.1:6802");
+  up.new_up_client[1] = a;
+  osdmap.apply_incremental(up);
+  ASSERT_EQ(0u, osdmap.get_osd_features(1));
+  ASSERT_EQ(0u, osdmap.get_common_osd_features());
+}
@@ -0,0 +1,148 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2012 New Dream Network
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Encode an object with an erasure code plugin over and over, then
+ * decode it with some chunks erased, and print the throughput of each
+ * in MB/s of object data.
+ */
+
+#include "common/ceph_argparse.h"
+#include "common/config.h"
+#include "common/Clock.h"
+#include "global/global_init.h"
+#include "global/global_context.h"
+#include "osd/ErasureCodePlugin.h"
+
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::string;
+
+static void usage(void)
+{
+  cerr << "usage: bench_erasure_code [options]" << std::endl;
+  cerr << "--plugin        erasure code plugin (default rs)" << std::endl;
+  cerr << "--plugin-dir    where to find it (default osd_erasure_code_dir)" << std::endl;
+  cerr << "--k             data chunks (default 4)" << std::endl;
+  cerr << "--m             coding chunks (default 2)" << std::endl;
+  cerr << "--size          object size in bytes (default 1048576)" << std::endl;
+  cerr << "--iterations    encodes and decodes to time (default 100)" << std::endl;
+  cerr << "--erasures      chunks lost before each decode (default m)" << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+  global_init(args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  string plugin = "rs";
+  string dir = g_conf->osd_erasure_code_dir;
+  string k = "4", m = "2";
+  int size = 1 << 20, iterations = 100, erasures = -1;
+  std::string val;
+  for (std::vector<const char*>::iterator i = args.begin(); i != args.end(); ) {
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_witharg(args, i, &val, "--plugin", (char*)NULL)) {
+      plugin = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--plugin-dir", (char*)NULL)) {
+      dir = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--k", (char*)NULL)) {
+      k = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--m", (char*)NULL)) {
+      m = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--size", (char*)NULL)) {
+      size = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--iterations", (char*)NULL)) {
+      iterations = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--erasures", (char*)NULL)) {
+      erasures = atoi(val.c_str());
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  map<string,string> parameters;
+  parameters["erasure-code-k"] = k;
+  parameters["erasure-code-m"] = m;
+  ErasureCodeInterfaceRef ec;
+  int r = ErasureCodePluginRegistry::instance().factory(plugin, dir, parameters, &ec);
+  if (r < 0) {
+    cerr << "could not create erasure code " << plugin << " from " << dir
+	 << ": " << r << std::endl;
+    return 1;
+  }
+  int n = ec->get_chunk_count();
+  if (erasures < 0)
+    erasures = ec->get_coding_chunk_count();
+  if (erasures > (int)ec->get_coding_chunk_count()) {
+    cerr << "can not recover from more than " << ec->get_coding_chunk_count()
+	 << " erasures" << std::endl;
+    return 1;
+  }
+
+  bufferptr bp(size);
+  for (int i = 0; i < size; i++)
+    bp[i] = rand();
+  bufferlist in;
+  in.push_back(bp);
+
+  set<int> all;
+  for (int i = 0; i < n; i++)
+    all.insert(i);
+
+  map<int, bufferlist> encoded;
+  utime_t start = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < iterations; i++) {
+    encoded.clear();
+    ec->encode(all, in, &encoded);
+  }
+  utime_t encode_time = ceph_clock_now(g_ceph_context) - start;
+
+  // lose the first data chunks, the expensive case
+  map<int, bufferlist> chunks = encoded;
+  set<int> lost;
+  for (int i = 0; i < erasures; i++) {
+    chunks.erase(i);
+    lost.insert(i);
+  }
+  start = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < iterations; i++) {
+    map<int, bufferlist> decoded;
+    r = ec->decode(lost, chunks, &decoded);
+    if (r < 0) {
+      cerr << "decode failed: " << r << std::endl;
+      return 1;
+    }
+  }
+  utime_t decode_time = ceph_clock_now(g_ceph_context) - start;
+
+  double mb = (double)size * iterations / (1024 * 1024);
+  cout << plugin << " k=" << k << " m=" << m << " size=" << size
+       << " iterations=" << iterations << std::endl;
+  cout << "encode: " << encode_time << " s, "
+       << mb / (double)encode_time << " MB/s" << std::endl;
+  cout << "decode (" << erasures << " erasures): " << decode_time << " s, "
+       << mb / (double)decode_time << " MB/s" << std::endl;
+  return 0;
+}
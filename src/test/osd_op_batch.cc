@@ -0,0 +1,118 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "messages/MOSDOp.h"
+#include "messages/MOSDOpBatch.h"
+#include "include/ceph_fs.h"
+#include "test/unit.h"
+
+#define OPBATCH_FEATURES (CEPH_FEATURE_OBJECTLOCATOR | CEPH_FEATURE_PGID64 | \
+			  CEPH_FEATURE_OSD_OPBATCH)
+
+static MOSDOp *make_op(long tid, const char *name, const char *data)
+{
+  object_t oid(name);
+  object_locator_t oloc(3);
+  MOSDOp *m = new MOSDOp(1, tid, oid, oloc, pg_t(7, 3, -1), 10,
+			 CEPH_OSD_FLAG_WRITE | CEPH_OSD_FLAG_ONDISK);
+  bufferlist bl;
+  bl.append(data);
+  m->write(0, bl.length(), bl);
+  return m;
+}
+
+TEST(MOSDOpBatch, RoundTrip) {
+  Connection *con = new Connection;
+  con->set_features(OPBATCH_FEATURES);
+
+  MOSDOpBatch *batch = new MOSDOpBatch(pg_t(7, 3, -1));
+  batch->set_connection(con->get());
+  batch->ops.push_back(make_op(1, "foo", "aaaa"));
+  batch->ops.push_back(make_op(2, "bar", "bbbbbbbb"));
+  batch->ops.push_back(make_op(3, "baz", "c"));
+
+  bufferlist bl;
+  encode_message(g_ceph_context, batch, bl);
+  batch->put();
+
+  bufferlist::iterator p = bl.begin();
+  Message *m = decode_message(g_ceph_context, p);
+  ASSERT_TRUE(m != NULL);
+  ASSERT_EQ(MSG_OSD_OP_BATCH, m->get_type());
+  MOSDOpBatch *out = (MOSDOpBatch*)m;
+  ASSERT_EQ(pg_t(7, 3, -1), out->pgid);
+  ASSERT_EQ(3u, out->ops.size());
+
+  const char *names[] = { "foo", "bar", "baz" };
+  const char *datas[] = { "aaaa", "bbbbbbbb", "c" };
+  int i = 0;
+  for (list<MOSDOp*>::iterator q = out->ops.begin();
+       q != out->ops.end(); ++q, ++i) {
+    ASSERT_EQ((tid_t)(i + 1), (*q)->get_tid());
+    ASSERT_EQ(object_t(names[i]), (*q)->get_oid());
+    ASSERT_EQ(1u, (*q)->ops.size());
+    ASSERT_EQ(CEPH_OSD_OP_WRITE, (*q)->ops[0].op.op);
+    ASSERT_EQ(strlen(datas[i]), (*q)->get_data().length());
+    ASSERT_EQ(0, memcmp(datas[i], (*q)->get_data().c_str(), strlen(datas[i])));
+  }
+  out->put();
+  con->put();
+}
+
+TEST(MOSDOpBatch, RejectBadEntry) {
+  Connection *con = new Connection;
+  con->set_features(OPBATCH_FEATURES);
+
+  // a good op followed by one we can't decode
+  MOSDOp *good = make_op(1, "foo", "aaaa");
+  good->set_connection(con->get());
+  MOSDOp *bad = make_op(2, "bar", "bbbb");
+  bad->set_connection(con->get());
+  bad->set_type(0xffff);
+
+  bufferlist payload;
+  ::encode(pg_t(7, 3, -1), payload);
+  __u32 n = 2;
+  ::encode(n, payload);
+  encode_message(g_ceph_context, good, payload);
+  encode_message(g_ceph_context, bad, payload);
+  good->put();
+  bad->put();
+
+  MOSDOpBatch *batch = new MOSDOpBatch;
+  batch->set_payload(payload);
+  ASSERT_THROW(batch->decode_payload(g_ceph_context), buffer::error);
+  batch->put();
+  con->put();
+}
+
+TEST(MOSDOpBatch, RejectForeignMessage) {
+  Connection *con = new Connection;
+  con->set_features(OPBATCH_FEATURES);
+
+  // a well-formed message that isn't an op
+  MOSDOpBatch *inner = new MOSDOpBatch(pg_t(7, 3, -1));
+  inner->set_connection(con->get());
+
+  bufferlist payload;
+  ::encode(pg_t(7, 3, -1), payload);
+  __u32 n = 1;
+  ::encode(n, payload);
+  encode_message(g_ceph_context, inner, payload);
+  inner->put();
+
+  MOSDOpBatch *batch = new MOSDOpBatch;
+  batch->set_payload(payload);
+  ASSERT_THROW(batch->decode_payload(g_ceph_context), buffer::error);
+  batch->put();
+  con->put();
+}
@@ -0,0 +1,132 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "osdc/ObjectCacher.h"
+#include "osdc/Objecter.h"
+#include "common/Mutex.h"
+#include "common/Thread.h"
+#include "common/Timer.h"
+#include "include/atomic.h"
+#include "test/unit.h"
+
+/*
+ * The cacher is never started and nothing is ever flushed, so it never
+ * talks to the (uninitialized) Objecter: writes stay dirty in the cache
+ * and readx_shared is served entirely from them.
+ */
+
+#define OBJECT_SIZE 4096
+#define NUM_OBJECTS 4
+#define FILE_SIZE (OBJECT_SIZE * NUM_OBJECTS)
+
+class ObjectCacherTest : public ::testing::Test {
+protected:
+  Mutex lock;
+  SafeTimer timer;
+  Objecter objecter;
+  ObjectCacher oc;
+  ObjectCacher::ObjectSet oset;
+  ceph_file_layout layout;
+
+  ObjectCacherTest()
+    : lock("ObjectCacherTest::lock"),
+      timer(g_ceph_context, lock),
+      objecter(g_ceph_context, NULL, NULL, NULL, lock, timer),
+      oc(g_ceph_context, &objecter, lock, NULL, NULL),
+      oset(NULL, 0, 0x1000)
+  {
+    memset(&layout, 0, sizeof(layout));
+    layout.fl_stripe_unit = OBJECT_SIZE;
+    layout.fl_stripe_count = 1;
+    layout.fl_object_size = OBJECT_SIZE;
+    layout.fl_pg_pool = 0;
+  }
+
+  virtual void TearDown() {
+    lock.Lock();
+    oc.purge_set(&oset);
+    lock.Unlock();
+  }
+
+public:
+  // fill the whole file with byte v, as one write spanning every object
+  void write_all(char v) {
+    bufferptr bp(FILE_SIZE);
+    memset(bp.c_str(), v, FILE_SIZE);
+    bufferlist bl;
+    bl.push_back(bp);
+    SnapContext snapc;
+    lock.Lock();
+    oc.file_write(&oset, &layout, snapc, 0, FILE_SIZE, bl, utime_t(), 0);
+    lock.Unlock();
+  }
+
+  int read_all(bufferlist& bl) {
+    return oc.file_read_shared(&oset, &layout, CEPH_NOSNAP, 0, FILE_SIZE, &bl);
+  }
+};
+
+TEST_F(ObjectCacherTest, ReadSharedMiss) {
+  bufferlist bl;
+  ASSERT_EQ(-EAGAIN, read_all(bl));
+}
+
+TEST_F(ObjectCacherTest, ReadSharedHit) {
+  write_all('a');
+  bufferlist bl;
+  ASSERT_EQ(FILE_SIZE, read_all(bl));
+  ASSERT_EQ((unsigned)FILE_SIZE, bl.length());
+  for (unsigned i = 0; i < bl.length(); i++)
+    ASSERT_EQ('a', bl[i]);
+}
+
+struct SharedReader : public Thread {
+  ObjectCacherTest *t;
+  atomic_t *stop;
+  int reads, torn;
+  SharedReader(ObjectCacherTest *t_, atomic_t *s)
+    : t(t_), stop(s), reads(0), torn(0) {}
+  void *entry() {
+    while (!stop->read()) {
+      bufferlist bl;
+      if (t->read_all(bl) != FILE_SIZE)
+	continue;
+      reads++;
+      char v = bl[0];
+      for (unsigned i = 1; i < bl.length(); i++) {
+	if (bl[i] != v) {
+	  torn++;
+	  break;
+	}
+      }
+    }
+    return 0;
+  }
+};
+
+TEST_F(ObjectCacherTest, ReadSharedSeesWholeWrites) {
+  write_all('a');
+
+  atomic_t stop(0);
+  SharedReader r1(this, &stop), r2(this, &stop);
+  r1.create();
+  r2.create();
+  for (int i = 0; i < 20000; i++)
+    write_all('a' + (i % 26));
+  stop.set(1);
+  r1.join();
+  r2.join();
+
+  ASSERT_LT(0, r1.reads + r2.reads);
+  ASSERT_EQ(0, r1.torn);
+  ASSERT_EQ(0, r2.torn);
+}
@@ -137,6 +137,7 @@ TEST(PerfCounters, MultiplePerfCounters) {
 	    "{'avgcount':0,'sum':0}},'test_perfcounter_2':{'foo':0,'bar':0}}"), msg);
 
   coll->logger_remove(fake_pf2);
+  delete fake_pf2;
   ASSERT_EQ("", client.get_message(&msg));
   ASSERT_EQ(sd("{'test_perfcounter_1':{'element1':6,'element2':0,"
 	    "'element3':{'avgcount':0,'sum':0}}}"), msg);
@@ -147,3 +148,47 @@ TEST(PerfCounters, MultiplePerfCounters) {
   ASSERT_EQ("", client.get_message(&msg));
   ASSERT_EQ("{}", msg);
 }
+
+enum {
+  TEST_PERFCOUNTERS3_ELEMENT_FIRST = 600,
+  TEST_PERFCOUNTERS3_ELEMENT_LAT,
+  TEST_PERFCOUNTERS3_ELEMENT_LAST,
+};
+
+static PerfCounters* setup_test_perfcounter3(CephContext *cct)
+{
+  PerfCountersBuilder bld(cct, "test_perfcounter_3",
+	  TEST_PERFCOUNTERS3_ELEMENT_FIRST, TEST_PERFCOUNTERS3_ELEMENT_LAST);
+  bld.add_time_avg(TEST_PERFCOUNTERS3_ELEMENT_LAT, "lat");
+  return bld.create_perf_counters();
+}
+
+TEST(PerfCounters, TimePerfCounters) {
+  PerfCountersCollection *coll = g_ceph_context->GetPerfCountersCollection();
+  coll->logger_clear();
+  PerfCounters* fake_pf = setup_test_perfcounter3(g_ceph_context);
+  coll->logger_add(fake_pf);
+  g_ceph_context->_conf->set_val_or_die("admin_socket", get_rand_socket_path());
+  g_ceph_context->_conf->apply_changes(NULL);
+  AdminSocketClient client(get_rand_socket_path());
+  std::string msg;
+
+  ASSERT_EQ("", client.get_message(&msg));
+  ASSERT_EQ(sd("{'test_perfcounter_3':{'lat':{'avgcount':0,'sum':0.000000000,"
+	    "'p50':0,'p99':0,'p999':0}}}"), msg);
+
+  // three 100us samples all land in the [64us, 128us) bucket
+  for (int i = 0; i < 3; i++)
+    fake_pf->tinc(TEST_PERFCOUNTERS3_ELEMENT_LAT, utime_t(0, 100000));
+  ASSERT_EQ(utime_t(0, 300000), fake_pf->tget(TEST_PERFCOUNTERS3_ELEMENT_LAT));
+  ASSERT_EQ("", client.get_message(&msg));
+  ASSERT_EQ(sd("{'test_perfcounter_3':{'lat':{'avgcount':3,'sum':0.000300000,"
+	    "'p50':9.6e-05,'p99':0.00012736,'p999':0.000127936}}}"), msg);
+
+  // u64 and float accessors ignore time counters
+  fake_pf->inc(TEST_PERFCOUNTERS3_ELEMENT_LAT);
+  fake_pf->finc(TEST_PERFCOUNTERS3_ELEMENT_LAT, 1.0);
+  ASSERT_EQ(0u, fake_pf->get(TEST_PERFCOUNTERS3_ELEMENT_LAT));
+  ASSERT_EQ(utime_t(0, 300000), fake_pf->tget(TEST_PERFCOUNTERS3_ELEMENT_LAT));
+  coll->logger_clear();
+}
@@ -455,3 +455,57 @@ TEST(LibRadosIo, XattrListPP) {
   ioctx.close();
   ASSERT_EQ(0, destroy_one_pool_pp(pool_name, cluster));
 }
+
+TEST(LibRadosIo, ReadPolicyRoundTrip) {
+  char buf[128];
+  char buf2[128];
+  rados_t cluster;
+  rados_ioctx_t ioctx;
+  std::string pool_name = get_temp_pool_name();
+  ASSERT_EQ("", create_one_pool(pool_name, &cluster));
+  rados_ioctx_create(cluster, pool_name.c_str(), &ioctx);
+  memset(buf, 0xcc, sizeof(buf));
+  ASSERT_EQ((int)sizeof(buf), rados_write(ioctx, "foo", buf, sizeof(buf), 0));
+  ASSERT_EQ(-EINVAL, rados_ioctx_set_read_policy(ioctx, 42));
+  int policies[] = { LIBRADOS_READ_RANDOM, LIBRADOS_READ_LOCAL,
+		     LIBRADOS_READ_LEAST_OUTSTANDING, LIBRADOS_READ_LATENCY,
+		     LIBRADOS_READ_PRIMARY };
+  for (unsigned i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+    ASSERT_EQ(0, rados_ioctx_set_read_policy(ioctx, policies[i]));
+    for (int j = 0; j < 10; j++) {
+      memset(buf2, 0, sizeof(buf2));
+      ASSERT_EQ((int)sizeof(buf2), rados_read(ioctx, "foo", buf2, sizeof(buf2), 0));
+      ASSERT_EQ(0, memcmp(buf, buf2, sizeof(buf)));
+    }
+  }
+  rados_ioctx_destroy(ioctx);
+  ASSERT_EQ(0, destroy_one_pool(pool_name, &cluster));
+}
+
+TEST(LibRadosIo, ReadPolicyRoundTripPP) {
+  char buf[128];
+  Rados cluster;
+  std::string pool_name = get_temp_pool_name();
+  ASSERT_EQ("", create_one_pool_pp(pool_name, cluster));
+  IoCtx ioctx;
+  cluster.ioctx_create(pool_name.c_str(), ioctx);
+  memset(buf, 0xcc, sizeof(buf));
+  bufferlist bl;
+  bl.append(buf, sizeof(buf));
+  ASSERT_EQ((int)sizeof(buf), ioctx.write("foo", bl, sizeof(buf), 0));
+  ASSERT_EQ(0, ioctx.set_read_policy(LIBRADOS_READ_LEAST_OUTSTANDING));
+  // a missing object is still missing when read from a replica
+  bufferlist cl;
+  ASSERT_EQ(-ENOENT, ioctx.read("nonexistent", cl, sizeof(buf), 0));
+  for (int j = 0; j < 10; j++) {
+    bufferlist cl;
+    ASSERT_EQ((int)sizeof(buf), ioctx.read("foo", cl, sizeof(buf), 0));
+    ASSERT_EQ(0, memcmp(buf, cl.c_str(), sizeof(buf)));
+    uint64_t size;
+    time_t mtime;
+    ASSERT_EQ(0, ioctx.stat("foo", &size, &mtime));
+    ASSERT_EQ(sizeof(buf), size);
+  }
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, cluster));
+}
@@ -22,6 +22,7 @@
 #include "global/global_init.h"
 #include "common/Mutex.h"
 #include "common/Cond.h"
+#include "common/perf_counters.h"
 #include <boost/scoped_ptr.hpp>
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_int.hpp>
@@ -32,6 +33,17 @@
 using __gnu_cxx::hash_map;
 typedef boost::mt11213b gen_type;
 
+static uint64_t get_commit_dirty()
+{
+  vector<char> buf;
+  g_ceph_context->GetPerfCountersCollection()->write_json_to_buf(buf, false);
+  const char *key = "\"commit_dirty\":";
+  const char *p = strstr(&buf[0], key);
+  if (!p)
+    return 0;
+  return strtoull(p + strlen(key), NULL, 10);
+}
+
 class StoreTest : public ::testing::Test {
 public:
   boost::scoped_ptr<ObjectStore> store;
@@ -139,6 +151,261 @@ TEST_F(StoreTest, SimpleObjectLongnameTest) {
   }
 }
 
+TEST_F(StoreTest, CoalescedWriteTest) {
+  int r;
+  coll_t cid = coll_t("coll");
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  hobject_t hoid(sobject_t("Object 1", CEPH_NOSNAP));
+  {
+    // adjacent, overlapping and disjoint writes plus repeated setattrs
+    // on one object, which the apply path merges
+    ObjectStore::Transaction t;
+    bufferlist a, b, c, d, v1, v2;
+    a.append("abcd");
+    b.append("efgh");
+    c.append("XXXX");
+    d.append("zz");
+    v1.append("one");
+    v2.append("two");
+    t.write(cid, hoid, 0, a.length(), a);
+    t.setattr(cid, hoid, "attr", v1);
+    t.write(cid, hoid, 4, b.length(), b);
+    t.write(cid, hoid, 2, c.length(), c);
+    t.setattr(cid, hoid, "attr", v2);
+    t.write(cid, hoid, 10, d.length(), d);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  {
+    bufferlist bl;
+    r = store->read(cid, hoid, 0, 12, bl);
+    ASSERT_EQ(r, 12);
+    ASSERT_EQ(0, memcmp(bl.c_str(), "abXXXXgh\0\0zz", 12));
+    bufferptr bp;
+    r = store->getattr(cid, hoid, "attr", bp);
+    ASSERT_EQ(r, 3);
+    ASSERT_EQ(0, memcmp(bp.c_str(), "two", 3));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+}
+
+TEST_F(StoreTest, CoalescedEmptyWriteTest) {
+  int r;
+  coll_t cid = coll_t("coll");
+  hobject_t hoid(sobject_t("Object 1", CEPH_NOSNAP));
+  hobject_t hoid2(sobject_t("Object 2", CEPH_NOSNAP));
+  {
+    // an empty write must still create the object, with or without attrs
+    ObjectStore::Transaction t;
+    bufferlist empty, v;
+    v.append("val");
+    t.create_collection(cid);
+    t.write(cid, hoid, 0, 0, empty);
+    t.setattr(cid, hoid, "attr", v);
+    t.write(cid, hoid2, 0, 0, empty);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+    struct stat st;
+    ASSERT_EQ(0, store->stat(cid, hoid, &st));
+    ASSERT_EQ(0, st.st_size);
+    ASSERT_EQ(0, store->stat(cid, hoid2, &st));
+    bufferptr bp;
+    ASSERT_EQ(3, store->getattr(cid, hoid, "attr", bp));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove(cid, hoid2);
+    t.remove_collection(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+}
+
+TEST_F(StoreTest, FDCacheTest) {
+  int r;
+  coll_t cid = coll_t("coll");
+  coll_t cid2 = coll_t("coll2");
+  coll_t cid3 = coll_t("coll3");
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    t.create_collection(cid2);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  hobject_t hoid(sobject_t("Object 1", CEPH_NOSNAP));
+  bufferlist a, b;
+  a.append("aaaa");
+  b.append("bbbb");
+  {
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, 0, a.length(), a);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  {
+    // read twice so the second one is served from the cache
+    bufferlist bl;
+    ASSERT_EQ(4, store->read(cid, hoid, 0, 4, bl));
+    bl.clear();
+    ASSERT_EQ(4, store->read(cid, hoid, 0, 4, bl));
+    ASSERT_EQ(0, memcmp(bl.c_str(), "aaaa", 4));
+  }
+  {
+    // a recreated object must not reuse the old file's fd
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.write(cid, hoid, 0, b.length(), b);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+    bufferlist bl;
+    ASSERT_EQ(4, store->read(cid, hoid, 0, 4, bl));
+    ASSERT_EQ(0, memcmp(bl.c_str(), "bbbb", 4));
+  }
+  {
+    // move it to another collection
+    ObjectStore::Transaction t;
+    t.collection_add(cid2, cid, hoid);
+    t.collection_remove(cid, hoid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+    struct stat st;
+    ASSERT_EQ(-ENOENT, store->stat(cid, hoid, &st));
+    bufferlist bl;
+    ASSERT_EQ(4, store->read(cid2, hoid, 0, 4, bl));
+    ASSERT_EQ(0, memcmp(bl.c_str(), "bbbb", 4));
+  }
+  {
+    // and rename that collection out from under the cached entry
+    ObjectStore::Transaction t;
+    t.collection_rename(cid2, cid3);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+    struct stat st;
+    ASSERT_EQ(-ENOENT, store->stat(cid2, hoid, &st));
+    bufferlist bl;
+    ASSERT_EQ(4, store->read(cid3, hoid, 0, 4, bl));
+    ASSERT_EQ(0, memcmp(bl.c_str(), "bbbb", 4));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid3, hoid);
+    t.remove_collection(cid3);
+    t.remove_collection(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+}
+
+TEST_F(StoreTest, DirtyObjectSyncTest) {
+  // commit by fdatasync'ing tracked objects, as when syncfs(2) is missing
+  store->umount();
+  g_ceph_context->_conf->set_val("filestore_syncfs", "false");
+  g_ceph_context->_conf->apply_changes(NULL);
+  {
+    FileStore fs(string("store_test_temp_dir"), string("store_test_temp_journal"));
+    ASSERT_EQ(0, fs.mount());
+    coll_t cid = coll_t("coll");
+    hobject_t hoid(sobject_t("Object 1", CEPH_NOSNAP));
+    hobject_t hoid2(sobject_t("Object 2", CEPH_NOSNAP));
+    bufferlist bl;
+    bl.append("abcd");
+    {
+      ObjectStore::Transaction t;
+      t.create_collection(cid);
+      t.write(cid, hoid, 0, bl.length(), bl);
+      t.clone(cid, hoid, hoid2);
+      ASSERT_EQ(0u, fs.apply_transaction(t));
+    }
+    fs.sync_and_flush();
+    {
+      ObjectStore::Transaction t;
+      t.remove(cid, hoid);
+      t.write(cid, hoid, 0, bl.length(), bl);
+      ASSERT_EQ(0u, fs.apply_transaction(t));
+    }
+    fs.sync_and_flush();
+    bufferlist in;
+    ASSERT_EQ(4, fs.read(cid, hoid2, 0, 4, in));
+    ASSERT_EQ(0, memcmp(in.c_str(), "abcd", 4));
+    {
+      ObjectStore::Transaction t;
+      t.remove(cid, hoid);
+      t.remove(cid, hoid2);
+      t.remove_collection(cid);
+      ASSERT_EQ(0u, fs.apply_transaction(t));
+    }
+    fs.umount();
+  }
+  g_ceph_context->_conf->set_val("filestore_syncfs", "true");
+  g_ceph_context->_conf->apply_changes(NULL);
+  ASSERT_EQ(0, store->mount());
+}
+
+TEST_F(StoreTest, DirtyObjectMovedSyncTest) {
+  // recovery writes into a temp collection, then moves the object into
+  // place; its data must still be synced by the next commit
+  store->umount();
+  g_ceph_context->_conf->set_val("filestore_syncfs", "false");
+  g_ceph_context->_conf->apply_changes(NULL);
+  {
+    FileStore fs(string("store_test_temp_dir"), string("store_test_temp_journal"));
+    ASSERT_EQ(0, fs.mount());
+    fs.start_logger(0, utime_t());
+    coll_t cid = coll_t("coll");
+    coll_t temp = coll_t("coll_TEMP");
+    hobject_t hoid(sobject_t("Object 1", CEPH_NOSNAP));
+    bufferlist bl;
+    bl.append("abcd");
+    {
+      ObjectStore::Transaction t;
+      t.create_collection(cid);
+      t.create_collection(temp);
+      ASSERT_EQ(0u, fs.apply_transaction(t));
+    }
+    fs.sync_and_flush();
+    fs.sync();
+    uint64_t before = get_commit_dirty();
+    {
+      ObjectStore::Transaction t;
+      t.write(temp, hoid, 0, bl.length(), bl);
+      t.collection_add(cid, temp, hoid);
+      t.collection_remove(temp, hoid);
+      ASSERT_EQ(0u, fs.apply_transaction(t));
+    }
+    fs.sync_and_flush();
+    fs.sync();
+    ASSERT_EQ(before + 1, get_commit_dirty());
+    bufferlist in;
+    ASSERT_EQ(4, fs.read(cid, hoid, 0, 4, in));
+    ASSERT_EQ(0, memcmp(in.c_str(), "abcd", 4));
+    {
+      ObjectStore::Transaction t;
+      t.remove(cid, hoid);
+      t.remove_collection(cid);
+      t.remove_collection(temp);
+      ASSERT_EQ(0u, fs.apply_transaction(t));
+    }
+    fs.stop_logger();
+    fs.umount();
+  }
+  g_ceph_context->_conf->set_val("filestore_syncfs", "true");
+  g_ceph_context->_conf->apply_changes(NULL);
+  ASSERT_EQ(0, store->mount());
+}
+
 TEST_F(StoreTest, ManyObjectTest) {
   int NUM_OBJS = 2000;
   int r = 0;